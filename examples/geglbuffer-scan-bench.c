@@ -0,0 +1,95 @@
+#include "config.h"
+#include <stdlib.h>
+#include <glib.h>
+#include <gegl.h>
+#include "gegl-buffer-iterator.h"
+#include "gegl-tile.h"
+
+/* Measures how fast gegl_buffer_iterator scans a buffer made of many small
+ * tiles, where the per tile overhead dominates. Run it under
+ * "perf stat -e cache-misses" to compare the cache behaviour of changes to
+ * the tile header.
+ */
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GeglRectangle  rect      = { 0, 0, 4096, 4096 };
+  gint           tile_size = 16;
+  gint           scans     = 10;
+  gint           n_tiles;
+  GeglBuffer    *buffer;
+  GTimer        *timer;
+  gdouble        sum = 0.0;
+  gint           i;
+
+  gegl_init (&argc, &argv);
+
+  if (argc > 1)
+    tile_size = atoi (argv[1]);
+  if (argc > 2)
+    scans = atoi (argv[2]);
+  if (tile_size <= 0 || scans <= 0)
+    {
+      g_print ("\nusage: %s [tile-size] [scans]\n\n"
+               "Scans a 4096x4096 buffer with tiles of tile-size pixels squared\n"
+               "using gegl_buffer_iterator, and reports the tile header footprint\n"
+               "and the time taken per scan.\n\n", argv[0]);
+      exit (-1);
+    }
+
+  n_tiles = (rect.width / tile_size) * (rect.height / tile_size);
+  g_object_set (gegl_config (),
+                "tile-width",  tile_size,
+                "tile-height", tile_size,
+                "cache-size",  (gint) MIN ((gint64) n_tiles * tile_size *
+                                           tile_size * 4 * 2, G_MAXINT),
+                NULL);
+
+  buffer = gegl_buffer_new (&rect, babl_format ("R'G'B'A u8"));
+
+  /* the first pass populates the buffer, the timed passes read it back */
+  {
+    GeglBufferIterator *gi = gegl_buffer_iterator_new (buffer, &rect, NULL,
+                                                       GEGL_BUFFER_WRITE);
+    while (gegl_buffer_iterator_next (gi))
+      {
+        guint32 *pixel = gi->data[0];
+        gint     j;
+
+        for (j = 0; j < gi->length; j++)
+          pixel[j] = j;
+      }
+  }
+
+  timer = g_timer_new ();
+  for (i = 0; i < scans; i++)
+    {
+      GeglBufferIterator *gi = gegl_buffer_iterator_new (buffer, &rect, NULL,
+                                                         GEGL_BUFFER_READ);
+      while (gegl_buffer_iterator_next (gi))
+        {
+          guchar *pixel = gi->data[0];
+          gint    j;
+
+          for (j = 0; j < gi->length * 4; j += 64)
+            sum += pixel[j];
+        }
+    }
+  g_timer_stop (timer);
+
+  g_print ("tiles:        %i of %ix%i pixels\n", n_tiles, tile_size, tile_size);
+  g_print ("tile header:  %i bytes, %.2fmb for all tiles\n",
+           (gint) sizeof (GeglTile),
+           n_tiles * sizeof (GeglTile) / 1024.0 / 1024.0);
+  g_print ("scan:         %.2fms, %.1f Mpixels/s (checksum %.0f)\n",
+           g_timer_elapsed (timer, NULL) * 1000.0 / scans,
+           (gdouble) rect.width * rect.height * scans /
+           g_timer_elapsed (timer, NULL) / 1000000.0,
+           sum);
+
+  g_timer_destroy (timer);
+  g_object_unref (buffer);
+  gegl_exit ();
+  return 0;
+}
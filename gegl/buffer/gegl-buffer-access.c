@@ -17,6 +17,7 @@
  */
 
 #include "config.h"
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
@@ -41,7 +42,10 @@
 #include "gegl-sampler-yafr.h"
 #include "gegl-buffer-index.h"
 #include "gegl-tile-backend.h"
+#include "gegl-tile-handler-zoom.h"
+#include "gegl-tile-handler-cache.h"
 #include "gegl-buffer-iterator.h"
+#include "gegl-buffer-resample.h"
 
 #include "gegl-region.h"
 #if HAVE_GPU
@@ -95,11 +99,12 @@ gegl_buffer_pixel_set (GeglBuffer *buffer,
 
         if (tile)
           {
-            gint    offsetx = gegl_tile_offset (tiledx, tile_width);
-            gint    offsety = gegl_tile_offset (tiledy, tile_height);
-            guchar *tp;
+            gint      offsetx = gegl_tile_offset (tiledx, tile_width);
+            gint      offsety = gegl_tile_offset (tiledy, tile_height);
+            guchar   *tp;
+            gboolean  locked;
 
-            gegl_tile_lock (tile, GEGL_TILE_LOCK_WRITE);
+            locked = gegl_buffer_linear_lock_tile (tile, GEGL_TILE_LOCK_WRITE);
             tp = gegl_tile_get_data (tile) +
                  (offsety * tile_width + offsetx) * px_size;
             if (fish)
@@ -107,7 +112,8 @@ gegl_buffer_pixel_set (GeglBuffer *buffer,
             else
               memcpy (tp, buf, bpx_size);
 
-            gegl_tile_unlock (tile);
+            if (locked)
+              gegl_tile_unlock (tile);
             g_object_unref (tile);
           }
       }
@@ -116,6 +122,34 @@ gegl_buffer_pixel_set (GeglBuffer *buffer,
 }
 #endif
 
+/* returns the hot tile of buffer if it holds the tile at index_x,index_y
+ * and no tiles were replaced in the storage since it was fetched, the hot
+ * tile is dropped otherwise and the generation a replacement is fetched at
+ * is recorded
+ */
+static inline GeglTile *
+gegl_buffer_get_hot_tile (GeglBuffer *buffer,
+                          gint        index_x,
+                          gint        index_y)
+{
+  GeglTile *tile       = buffer->hot_tile;
+  gint      generation = g_atomic_int_get (&buffer->tile_storage->hot_tile_generation);
+
+  if (tile &&
+      tile->x == index_x &&
+      tile->y == index_y &&
+      buffer->hot_tile_generation == generation)
+    return tile;
+
+  if (tile)
+    {
+      gegl_tile_unref (tile);
+      buffer->hot_tile = NULL;
+    }
+  buffer->hot_tile_generation = generation;
+  return NULL;
+}
+
 static gboolean
 gegl_buffer_in_abyss( GeglBuffer *buffer,
                       gint        x,
@@ -175,31 +209,20 @@ gegl_buffer_set_pixel (GeglBuffer *buffer,
         gint      index_y = gegl_tile_index (tiledy, tile_height);
         GeglTile *tile     = NULL;
 
-        if (buffer->hot_tile &&
-            buffer->hot_tile->x == index_x &&
-            buffer->hot_tile->y == index_y)
-          {
-            tile = buffer->hot_tile;
-          }
-        else
-          {
-            if (buffer->hot_tile)
-              {
-                g_object_unref (buffer->hot_tile);
-                buffer->hot_tile = NULL;
-              }
-            tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                              index_x, index_y,
-                                              0);
-          }
+        tile = gegl_buffer_get_hot_tile (buffer, index_x, index_y);
+        if (!tile)
+          tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
+                                            index_x, index_y,
+                                            0);
 
         if (tile)
           {
-            gint    offsetx = gegl_tile_offset (tiledx, tile_width);
-            gint    offsety = gegl_tile_offset (tiledy, tile_height);
-            guchar *tp;
+            gint      offsetx = gegl_tile_offset (tiledx, tile_width);
+            gint      offsety = gegl_tile_offset (tiledy, tile_height);
+            guchar   *tp;
+            gboolean  locked;
 
-            gegl_tile_lock (tile, GEGL_TILE_LOCK_WRITE);
+            locked = gegl_buffer_linear_lock_tile (tile, GEGL_TILE_LOCK_WRITE);
 
             tp = gegl_tile_get_data (tile) +
                  (offsety * tile_width + offsetx) * px_size;
@@ -208,7 +231,8 @@ gegl_buffer_set_pixel (GeglBuffer *buffer,
             else
               memcpy (tp, buf, bpx_size);
 
-            gegl_tile_unlock (tile);
+            if (locked)
+              gegl_tile_unlock (tile);
             buffer->hot_tile = tile;
           }
       }
@@ -236,25 +260,12 @@ gegl_buffer_gpu_set_pixel (GeglBuffer           *buffer,
       gint      index_x = gegl_tile_index (x, tile_width);
       gint      index_y = gegl_tile_index (y, tile_height);
 
-      if (buffer->hot_tile
-          && buffer->hot_tile->x == index_x
-          && buffer->hot_tile->y == index_y)
-        {
-          tile = buffer->hot_tile;
-        }
-      else
-        {
-          if (buffer->hot_tile)
-            {
-              g_object_unref (buffer->hot_tile);
-              buffer->hot_tile = NULL;
-            }
-
-          tile = gegl_tile_source_get_tile ((GeglTileSource *) buffer,
-                                            index_x,
-                                            index_y,
-                                            0);
-        }
+      tile = gegl_buffer_get_hot_tile (buffer, index_x, index_y);
+      if (!tile)
+        tile = gegl_tile_source_get_tile ((GeglTileSource *) buffer,
+                                          index_x,
+                                          index_y,
+                                          0);
 
       if (tile != NULL)
         {
@@ -317,31 +328,20 @@ gegl_buffer_get_pixel (GeglBuffer *buffer,
         gint      index_y = gegl_tile_index (tiledy, tile_height);
         GeglTile *tile     = NULL;
 
-        if (buffer->hot_tile &&
-            buffer->hot_tile->x == index_x &&
-            buffer->hot_tile->y == index_y)
-          {
-            tile = buffer->hot_tile;
-          }
-        else
-          {
-            if (buffer->hot_tile)
-              {
-                g_object_unref (buffer->hot_tile);
-                buffer->hot_tile = NULL;
-              }
-            tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                              index_x, index_y,
-                                              0);
-          }
+        tile = gegl_buffer_get_hot_tile (buffer, index_x, index_y);
+        if (!tile)
+          tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
+                                            index_x, index_y,
+                                            0);
 
         if (tile)
           {
-            gint    offsetx = gegl_tile_offset (tiledx, tile_width);
-            gint    offsety = gegl_tile_offset (tiledy, tile_height);
-            guchar *tp;
+            gint      offsetx = gegl_tile_offset (tiledx, tile_width);
+            gint      offsety = gegl_tile_offset (tiledy, tile_height);
+            guchar   *tp;
+            gboolean  locked;
 
-            gegl_tile_lock (tile, GEGL_TILE_LOCK_READ);
+            locked = gegl_buffer_linear_lock_tile (tile, GEGL_TILE_LOCK_READ);
 
             tp = gegl_tile_get_data (tile)
               + (offsety * tile_width + offsetx) * px_size;
@@ -351,7 +351,8 @@ gegl_buffer_get_pixel (GeglBuffer *buffer,
             else
               memcpy (buf, tp, px_size);
 
-            gegl_tile_unlock (tile);
+            if (locked)
+              gegl_tile_unlock (tile);
 
             /*g_object_unref (tile);*/
             buffer->hot_tile = tile;
@@ -385,25 +386,12 @@ gegl_buffer_gpu_get_pixel (GeglBuffer     *buffer,
       gint      index_x = gegl_tile_index (x, tile_width);
       gint      index_y = gegl_tile_index (y, tile_height);
 
-      if (buffer->hot_tile &&
-          buffer->hot_tile->x == index_x &&
-          buffer->hot_tile->y == index_y)
-        {
-          tile = buffer->hot_tile;
-        }
-      else
-        {
-          if (buffer->hot_tile)
-            {
-              g_object_unref (buffer->hot_tile);
-              buffer->hot_tile = NULL;
-            }
-
-          tile = gegl_tile_source_get_tile ((GeglTileSource *) buffer,
-                                            index_x,
-                                            index_y,
-                                            0);
-        }
+      tile = gegl_buffer_get_hot_tile (buffer, index_x, index_y);
+      if (!tile)
+        tile = gegl_tile_source_get_tile ((GeglTileSource *) buffer,
+                                          index_x,
+                                          index_y,
+                                          0);
 
       if (tile != NULL)
         {
@@ -428,6 +416,247 @@ gegl_buffer_gpu_get_pixel (GeglBuffer     *buffer,
 }
 #endif
 
+/* a pixel of a gegl_buffer_get_pixels / gegl_buffer_set_pixels batch
+ * resolved to the tile holding it
+ */
+typedef struct
+{
+  gint index_x;
+  gint index_y;
+  gint offset; /* byte offset of the pixel within the tile data */
+  gint pixel;  /* position of the pixel in the batch */
+} PixelRef;
+
+static gint
+pixel_ref_compare (gconstpointer a,
+                   gconstpointer b)
+{
+  const PixelRef *ra = a;
+  const PixelRef *rb = b;
+
+  if (ra->index_y != rb->index_y)
+    return ra->index_y < rb->index_y ? -1 : 1;
+  if (ra->index_x != rb->index_x)
+    return ra->index_x < rb->index_x ? -1 : 1;
+  /* pixels of the same tile keep the order of the batch, so the last of
+   * several writes to one pixel wins
+   */
+  return ra->pixel - rb->pixel;
+}
+
+/* takes over the hot tile when it is the wanted one, the tile last used
+ * by a batch is left as the hot tile so batches walking the same area
+ * do not look it up again
+ */
+static inline GeglTile *
+gegl_buffer_pixels_get_tile (GeglBuffer *buffer,
+                             gint        index_x,
+                             gint        index_y)
+{
+  GeglTile *tile = gegl_buffer_get_hot_tile (buffer, index_x, index_y);
+
+  if (tile)
+    {
+      buffer->hot_tile = NULL;
+      return tile;
+    }
+  return gegl_tile_source_get_tile ((GeglTileSource *) buffer,
+                                    index_x, index_y, 0);
+}
+
+/* Gathers or scatters a batch of scattered pixels. The pixels are sorted
+ * by tile, so every tile touched by the batch is fetched and locked once
+ * however the coordinates are spread, and the format conversion is done
+ * with a single babl call for the whole batch.
+ */
+static void
+gegl_buffer_access_pixels (GeglBuffer *buffer,
+                           gint        n_pixels,
+                           const gint *coords,
+                           const Babl *format,
+                           guchar     *data,
+                           gboolean    write)
+{
+  gint      tile_width  = buffer->tile_storage->tile_width;
+  gint      tile_height = buffer->tile_storage->tile_height;
+  gint      px_size     = babl_format_get_bytes_per_pixel (buffer->format);
+  gint      bpx_size    = babl_format_get_bytes_per_pixel (format);
+  gint      abyss_x0    = buffer->abyss.x;
+  gint      abyss_y0    = buffer->abyss.y;
+  gint      abyss_x1    = buffer->abyss.x + buffer->abyss.width;
+  gint      abyss_y1    = buffer->abyss.y + buffer->abyss.height;
+  Babl     *fish        = NULL;
+  guchar   *pixels      = data;
+  PixelRef *refs;
+  gint      n_refs      = 0;
+  gboolean  sorted      = TRUE;
+  GeglTile *tile        = NULL;
+  gboolean  locked      = FALSE;
+  guchar   *tile_data   = NULL;
+  gint      tile_x      = 0;
+  gint      tile_y      = 0;
+  gboolean  have_tile   = FALSE;
+  gint      i;
+
+  if (n_pixels <= 0)
+    return;
+
+  /* pixels holds the batch in the format of the buffer */
+  if (format != buffer->format)
+    {
+      if (write)
+        fish = babl_fish ((gpointer) format, (gpointer) buffer->format);
+      else
+        fish = babl_fish ((gpointer) buffer->format, (gpointer) format);
+      pixels = gegl_malloc (n_pixels * px_size);
+
+      if (write)
+        babl_process (fish, data, pixels, n_pixels);
+    }
+
+  refs = g_new (PixelRef, n_pixels);
+  for (i = 0; i < n_pixels; i++)
+    {
+      gint      x = coords[i * 2];
+      gint      y = coords[i * 2 + 1];
+      gint      tiledx;
+      gint      tiledy;
+      PixelRef *ref;
+
+      if (x < abyss_x0 || x >= abyss_x1 ||
+          y < abyss_y0 || y >= abyss_y1)
+        continue; /* in abyss, cleared below for reads */
+
+      tiledx = x + buffer->shift_x;
+      tiledy = y + buffer->shift_y;
+
+      ref = &refs[n_refs];
+      ref->index_x = gegl_tile_index (tiledx, tile_width);
+      ref->index_y = gegl_tile_index (tiledy, tile_height);
+      ref->offset  = (gegl_tile_offset (tiledy, tile_height) * tile_width +
+                      gegl_tile_offset (tiledx, tile_width)) * px_size;
+      ref->pixel   = i;
+
+      if (n_refs && sorted && pixel_ref_compare (ref - 1, ref) > 0)
+        sorted = FALSE;
+      n_refs++;
+    }
+
+  if (!sorted)
+    qsort (refs, n_refs, sizeof (PixelRef), pixel_ref_compare);
+
+  for (i = 0; i < n_refs; i++)
+    {
+      PixelRef *ref   = &refs[i];
+      guchar   *pixel = pixels + ref->pixel * px_size;
+
+      if (!have_tile || ref->index_x != tile_x || ref->index_y != tile_y)
+        {
+          if (tile)
+            {
+              if (locked)
+                gegl_tile_unlock (tile);
+              gegl_tile_unref (tile);
+            }
+
+          tile_x    = ref->index_x;
+          tile_y    = ref->index_y;
+          have_tile = TRUE;
+          tile      = gegl_buffer_pixels_get_tile (buffer, tile_x, tile_y);
+          if (tile)
+            {
+              locked    = gegl_buffer_linear_lock_tile (tile, write ?
+                                                        GEGL_TILE_LOCK_WRITE :
+                                                        GEGL_TILE_LOCK_READ);
+              tile_data = gegl_tile_get_data (tile);
+            }
+        }
+
+      if (!tile)
+        {
+          if (!write)
+            memset (pixel, 0x00, px_size);
+        }
+      else if (write)
+        {
+          memcpy (tile_data + ref->offset, pixel, px_size);
+        }
+      else
+        {
+          memcpy (pixel, tile_data + ref->offset, px_size);
+        }
+    }
+
+  if (tile)
+    {
+      if (locked)
+        gegl_tile_unlock (tile);
+      if (buffer->hot_tile)
+        gegl_tile_unref (buffer->hot_tile);
+      buffer->hot_tile = tile;
+    }
+
+  if (!write)
+    {
+      if (fish)
+        babl_process (fish, pixels, data, n_pixels);
+
+      if (n_refs < n_pixels)
+        for (i = 0; i < n_pixels; i++)
+          {
+            gint x = coords[i * 2];
+            gint y = coords[i * 2 + 1];
+
+            if (x < abyss_x0 || x >= abyss_x1 ||
+                y < abyss_y0 || y >= abyss_y1)
+              memset (data + i * bpx_size, 0x00, bpx_size);
+          }
+    }
+
+  if (pixels != data)
+    gegl_free (pixels);
+  g_free (refs);
+}
+
+void
+gegl_buffer_get_pixels (GeglBuffer *buffer,
+                        gint        n_pixels,
+                        const gint *coords,
+                        const Babl *format,
+                        gpointer    dest)
+{
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (n_pixels == 0 || (coords != NULL && dest != NULL));
+
+  if (format == NULL)
+    format = buffer->format;
+
+  gegl_buffer_lock (buffer);
+  gegl_buffer_access_pixels (buffer, n_pixels, coords, format, dest, FALSE);
+  gegl_buffer_unlock (buffer);
+}
+
+void
+gegl_buffer_set_pixels (GeglBuffer    *buffer,
+                        gint           n_pixels,
+                        const gint    *coords,
+                        const Babl    *format,
+                        gconstpointer  src)
+{
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+  g_return_if_fail (n_pixels == 0 || (coords != NULL && src != NULL));
+
+  if (format == NULL)
+    format = buffer->format;
+
+  gegl_buffer_lock (buffer);
+  gegl_buffer_access_pixels (buffer, n_pixels, coords, format,
+                             (guchar *) src, TRUE);
+  if (gegl_buffer_is_shared (buffer))
+    gegl_buffer_flush (buffer);
+  gegl_buffer_unlock (buffer);
+}
+
 /* flush any unwritten data (flushes the hot-cache of a single
  * tile used by gegl_buffer_set for 1x1 pixel sized rectangles
  */
@@ -438,7 +667,7 @@ gegl_buffer_flush (GeglBuffer *buffer)
 
   if (buffer->hot_tile)
     {
-      g_object_unref (buffer->hot_tile);
+      gegl_tile_unref (buffer->hot_tile);
       buffer->hot_tile = NULL;
     }
   if ((GeglBufferHeader*)(gegl_buffer_backend (buffer)->header))
@@ -454,6 +683,71 @@ gegl_buffer_flush (GeglBuffer *buffer)
 }
 
 
+/* copies rows of pixels between a tile and a linear buffer, when both
+ * sides are contiguous the whole rectangle goes through a single babl
+ * call or memcpy.
+ */
+static inline void
+gegl_buffer_copy_rows (Babl         *fish,
+                       const guchar *src,
+                       gint          src_stride,
+                       gint          src_bpp,
+                       guchar       *dst,
+                       gint          dst_stride,
+                       gint          dst_bpp,
+                       gint          pixels,
+                       gint          rows)
+{
+  if (pixels <= 0 || rows <= 0)
+    return;
+
+  if (src_stride == pixels * src_bpp &&
+      dst_stride == pixels * dst_bpp)
+    {
+      pixels *= rows;
+      rows    = 1;
+    }
+
+  while (rows--)
+    {
+      if (fish)
+        babl_process (fish, (gpointer) src, dst, pixels);
+      else
+        memcpy (dst, src, pixels * src_bpp);
+      src += src_stride;
+      dst += dst_stride;
+    }
+}
+
+static inline void
+gegl_buffer_zero_rows (guchar *dst,
+                       gint    stride,
+                       gint    bytes,
+                       gint    rows)
+{
+  if (bytes <= 0)
+    return;
+
+  if (stride == bytes)
+    {
+      memset (dst, 0x00, bytes * rows);
+      return;
+    }
+
+  while (rows-- > 0)
+    {
+      memset (dst, 0x00, bytes);
+      dst += stride;
+    }
+}
+
+/* tile pointers kept on the stack for a row of tiles, wider requests
+ * allocate the row from the heap
+ */
+#define GEGL_ITERATE_STACK_TILES 64
+
+/* the largest pixel read from uniform tiles without copying the tile */
+#define GEGL_ITERATE_MAX_PIXEL   64
 
 static void inline
 gegl_buffer_iterate (GeglBuffer          *buffer,
@@ -488,6 +782,11 @@ gegl_buffer_iterate (GeglBuffer          *buffer,
   gint  i;
   gint  factor = 1;
 
+  GeglTile  *stack_tiles[GEGL_ITERATE_STACK_TILES];
+  GeglTile **tiles = stack_tiles;
+  gint       max_tiles;
+  guchar     uniform_pixel[GEGL_ITERATE_MAX_PIXEL];
+
   /* roi specified, override buffers extent */
   if (roi)
     {
@@ -533,195 +832,167 @@ gegl_buffer_iterate (GeglBuffer          *buffer,
         }
     }
 
+  max_tiles = width / tile_width + 2;
+  if (max_tiles > GEGL_ITERATE_STACK_TILES)
+    tiles = g_new (GeglTile *, max_tiles);
+
   while (bufy < height)
     {
       gint tiledy  = buffer_y + bufy;
       gint offsety = gegl_tile_offset (tiledy, tile_height);
+      gint rows    = MIN (tile_height - offsety, height - bufy);
 
+      /* the rows of this row of tiles that are inside the abyss, the
+       * same for every tile of the row
+       */
+      gint row_start = CLAMP (buffer_abyss_y - tiledy, 0, rows);
+      gint row_end   = CLAMP (abyss_y_total - tiledy, row_start, rows);
 
+      gint n_tiles = 0;
+      gint bufx;
 
-      gint bufx    = 0;
-
-      if (!(buffer_y + bufy + (tile_height) >= buffer_abyss_y &&
-            buffer_y + bufy < abyss_y_total))
+      if (row_start == row_end)
         { /* entire row of tiles is in abyss */
           if (!write)
+            gegl_buffer_zero_rows (buf + bufy * buf_stride, buf_stride,
+                                   width * bpx_size, rows);
+          bufy += rows;
+          continue;
+        }
+
+      /* resolve every tile of the row before touching pixels, and hint
+       * the storage about the row that follows while this one is copied
+       */
+      for (bufx = 0; bufx < width; n_tiles++)
+        {
+          gint tiledx  = buffer_x + bufx;
+          gint offsetx = gegl_tile_offset (tiledx, tile_width);
+
+          if (tiledx + tile_width - offsetx > buffer_abyss_x &&
+              tiledx < abyss_x_total)
+            tiles[n_tiles] = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
+                                                        gegl_tile_index (tiledx, tile_width),
+                                                        gegl_tile_index (tiledy, tile_height),
+                                                        level);
+          else
+            tiles[n_tiles] = NULL;
+
+          bufx += tile_width - offsetx;
+        }
+
+      if (bufy + rows < height &&
+          tiledy + rows < abyss_y_total)
+        {
+          for (bufx = 0; bufx < width;)
             {
-              gint    row;
-              gint    y  = bufy;
-              guchar *bp = buf + ((bufy) * width) * bpx_size;
-
-              for (row = offsety;
-                   row < tile_height && y < height;
-                   row++, y++)
-                {
-                  memset (bp, 0x00, buf_stride);
-                  bp += buf_stride;
-                }
+              gint tiledx = buffer_x + bufx;
+
+              gegl_tile_source_prefetch ((GeglTileSource *) (buffer),
+                                         gegl_tile_index (tiledx, tile_width),
+                                         gegl_tile_index (tiledy + rows, tile_height),
+                                         level);
+              bufx += tile_width - gegl_tile_offset (tiledx, tile_width);
             }
         }
-      else
 
-        while (bufx < width)
-          {
-            gint    tiledx  = buffer_x + bufx;
-            gint    offsetx = gegl_tile_offset (tiledx, tile_width);
-            gint    pixels;
-            guchar *bp;
+      /* rows above and below the abyss are zeroed across the full width */
+      if (!write)
+        {
+          gegl_buffer_zero_rows (buf + bufy * buf_stride, buf_stride,
+                                 width * bpx_size, row_start);
+          gegl_buffer_zero_rows (buf + (bufy + row_end) * buf_stride, buf_stride,
+                                 width * bpx_size, rows - row_end);
+        }
 
-            bp = buf + bufy * buf_stride + bufx * bpx_size;
+      for (bufx = 0, n_tiles = 0; bufx < width; n_tiles++)
+        {
+          gint      tiledx  = buffer_x + bufx;
+          gint      offsetx = gegl_tile_offset (tiledx, tile_width);
+          gint      pixels  = MIN (tile_width - offsetx, width - bufx);
+          GeglTile *tile    = tiles[n_tiles];
+          guchar   *bp;
+          guchar   *tp;
+          gboolean  locked;
+
+          gint lskip = (buffer_abyss_x) - tiledx;
+          /* gap between left side of tile, and abyss */
+          gint rskip = (tiledx + pixels) - abyss_x_total;
+          /* gap between right side of tile, and abyss */
+
+          lskip = CLAMP (lskip, 0, pixels);
+          rskip = CLAMP (rskip, 0, pixels - lskip);
+
+          bp = buf + (bufy + row_start) * buf_stride + bufx * bpx_size;
+          bufx += tile_width - offsetx;
+
+          if (!tile)
+            {
+              if (!write)
+                gegl_buffer_zero_rows (bp, buf_stride, pixels * bpx_size,
+                                       row_end - row_start);
+              if (lskip + rskip < pixels)
+                g_warning ("didn't get tile, trying to continue");
+              continue;
+            }
 
-            if (width + offsetx - bufx < tile_width)
-              pixels = (width + offsetx - bufx) - offsetx;
-            else
-              pixels = tile_width - offsetx;
-
-
-            if (!(buffer_x + bufx + tile_width >= buffer_abyss_x &&
-                  buffer_x + bufx < abyss_x_total))
-              { /* entire tile is in abyss */
-                if (!write)
-                  {
-                    gint row;
-                    gint y = bufy;
-
-                    for (row = offsety;
-                         row < tile_height && y < height;
-                         row++, y++)
-                      {
-                        memset (bp, 0x00, pixels * bpx_size);
-                        bp += buf_stride;
-                      }
-                  }
-              }
-            else
-              {
-                guchar   *tile_base, *tp;
-                GeglTile *tile = gegl_tile_source_get_tile ((GeglTileSource *) (buffer),
-                                                           gegl_tile_index (tiledx, tile_width),
-                                                           gegl_tile_index (tiledy, tile_height),
-                                                           level);
-
-                gint lskip = (buffer_abyss_x) - (buffer_x + bufx);
-                /* gap between left side of tile, and abyss */
-                gint rskip = (buffer_x + bufx + pixels) - abyss_x_total;
-                /* gap between right side of tile, and abyss */
-
-                if (lskip < 0)
-                  lskip = 0;
-                if (lskip > pixels)
-                  lskip = pixels;
-                if (rskip < 0)
-                  rskip = 0;
-                if (rskip > pixels)
-                  rskip = pixels;
-
-                if (!tile)
-                  {
-                    g_warning ("didn't get tile, trying to continue");
-                    bufx += (tile_width - offsetx);
-                    continue;
-                  }
-
-                if (write)
-                  gegl_tile_lock (tile, GEGL_TILE_LOCK_WRITE);
-                else
-                  gegl_tile_lock (tile, GEGL_TILE_LOCK_READ);
-
-                tile_base = gegl_tile_get_data (tile);
-                tp        = ((guchar *) tile_base) + (offsety * tile_width + offsetx) * px_size;
-
-                if (write)
-                  {
-                    gint row;
-                    gint y = bufy;
-
-
-                    if (fish)
-                      {
-                        for (row = offsety;
-                             row < tile_height &&
-                             y < height &&
-                             buffer_y + y < abyss_y_total;
-                             row++, y++)
-                          {
-
-                            if (buffer_y + y >= buffer_abyss_y &&
-                                buffer_y + y < abyss_y_total)
-                              {
-                                babl_process (fish, bp + lskip * bpx_size, tp + lskip * px_size,
-                                 pixels - lskip - rskip);
-                              }
-
-                            tp += tile_stride;
-                            bp += buf_stride;
-                          }
-                      }
-                    else
-                      {
-                        for (row = offsety;
-                             row < tile_height && y < height;
-                             row++, y++)
-                          {
-
-                            if (buffer_y + y >= buffer_abyss_y &&
-                                buffer_y + y < abyss_y_total)
-                              {
-
-                                memcpy (tp + lskip * px_size, bp + lskip * px_size,
-                                      (pixels - lskip - rskip) * px_size);
-                              }
-
-                            tp += tile_stride;
-                            bp += buf_stride;
-                          }
-                      }
-                  }
-                else /* read */
-                  {
-                    gint row;
-                    gint y = bufy;
-
-                    for (row = offsety;
-                         row < tile_height && y < height;
-                         row++, y++)
-                      {
-                        if (buffer_y + y >= buffer_abyss_y &&
-                            buffer_y + y < abyss_y_total)
-                          {
-                            if (fish)
-                              babl_process (fish, tp, bp, pixels);
-                            else
-                              memcpy (bp, tp, pixels * px_size);
-                          }
-                        else
-                          {
-                            /* entire row in abyss */
-                            memset (bp, 0x00, pixels * bpx_size);
-                          }
-
-                          /* left hand zeroing of abyss in tile */
-                        if (lskip)
-                          {
-                            memset (bp, 0x00, bpx_size * lskip);
-                          }
-
-                        /* right side zeroing of abyss in tile */
-                        if (rskip)
-                          {
-                            memset (bp + (pixels - rskip) * bpx_size, 0x00, bpx_size * rskip);
-                          }
-                        tp += tile_stride;
-                        bp += buf_stride;
-                      }
-                  }
-                gegl_tile_unlock (tile);
-                gegl_tile_unref (tile);
-              }
-            bufx += (tile_width - offsetx);
-          }
-      bufy += (tile_height - offsety);
+          locked = gegl_buffer_linear_lock_tile (tile, write ?
+                                                 GEGL_TILE_LOCK_WRITE :
+                                                 GEGL_TILE_LOCK_READ);
+
+          tp = gegl_tile_get_data (tile) +
+               ((offsety + row_start) * tile_width + offsetx) * px_size;
+
+          if (write)
+            {
+              gegl_buffer_copy_rows (fish,
+                                     bp + lskip * bpx_size, buf_stride, bpx_size,
+                                     tp + lskip * px_size, tile_stride, px_size,
+                                     pixels - lskip - rskip,
+                                     row_end - row_start);
+            }
+          else if (gegl_tile_is_uniform (tile) &&
+                   bpx_size <= (gint) sizeof (uniform_pixel))
+            {
+              /* the single color of the tile is converted once */
+              if (fish)
+                babl_process (fish, tp, uniform_pixel, 1);
+              else
+                memcpy (uniform_pixel, tp, bpx_size);
+
+              gegl_tile_fill_rect (bp + lskip * bpx_size, buf_stride,
+                                   pixels - lskip - rskip, row_end - row_start,
+                                   uniform_pixel, bpx_size);
+            }
+          else /* read */
+            {
+              gegl_buffer_copy_rows (fish,
+                                     tp + lskip * px_size, tile_stride, px_size,
+                                     bp + lskip * bpx_size, buf_stride, bpx_size,
+                                     pixels - lskip - rskip,
+                                     row_end - row_start);
+            }
+
+          if (!write)
+            {
+              /* left and right hand zeroing of abyss in tile */
+              if (lskip)
+                gegl_buffer_zero_rows (bp, buf_stride, bpx_size * lskip,
+                                       row_end - row_start);
+              if (rskip)
+                gegl_buffer_zero_rows (bp + (pixels - rskip) * bpx_size,
+                                       buf_stride, bpx_size * rskip,
+                                       row_end - row_start);
+            }
+
+          if (locked)
+            gegl_tile_unlock (tile);
+          gegl_tile_unref (tile);
+        }
+      bufy += rows;
     }
+
+  if (tiles != stack_tiles)
+    g_free (tiles);
 }
 
 #if HAVE_GPU
@@ -1126,198 +1397,90 @@ resample_nearest (void   *dest_buf,
     }
 }
 
-static inline void
-box_filter (guint          left_weight,
-            guint          center_weight,
-            guint          right_weight,
-            guint          top_weight,
-            guint          middle_weight,
-            guint          bottom_weight,
-            guint          sum,
-            const guchar **src,   /* the 9 surrounding source pixels */
-            guchar        *dest,
-            gint           components)
-{
-  /* NOTE: this box filter presumes pre-multiplied alpha, if there
-   * is alpha.
-   */
-   guint lt, lm, lb;
-   guint ct, cm, cb;
-   guint rt, rm, rb;
-
-   lt = left_weight * top_weight;
-   lm = left_weight * middle_weight;
-   lb = left_weight * bottom_weight;
-   ct = center_weight * top_weight;
-   cm = center_weight * middle_weight;
-   cb = center_weight * bottom_weight;
-   rt = right_weight * top_weight;
-   rm = right_weight * middle_weight;
-   rb = right_weight * bottom_weight;
-
-#define docomponent(i) \
-      dest[i] = (src[0][i] * lt + src[3][i] * lm + src[6][i] * lb + \
-                 src[1][i] * ct + src[4][i] * cm + src[7][i] * cb + \
-                 src[2][i] * rt + src[5][i] * rm + src[8][i] * rb) / sum
-  switch (components)
-    {
-      case 5: docomponent(4);
-      case 4: docomponent(3);
-      case 3: docomponent(2);
-      case 2: docomponent(1);
-      case 1: docomponent(0);
-    }
-#undef docomponent
-}
-
+/* builds the tiles of the mipmap level that rect is fetched from in
+ * parallel, instead of one by one as gegl_buffer_iterate asks for them
+ */
 static void
-resample_boxfilter_u8 (void   *dest_buf,
-                       void   *source_buf,
-                       gint    dest_w,
-                       gint    dest_h,
-                       gint    source_w,
-                       gint    source_h,
-                       gdouble offset_x,
-                       gdouble offset_y,
-                       gdouble scale,
-                       gint    components,
-                       gint    rowstride)
+gegl_buffer_build_pyramid (GeglBuffer          *buffer,
+                           const GeglRectangle *rect,
+                           gint                 level)
 {
-  gint x, y;
-  gint iscale      = scale * 256;
-  gint s_rowstride = source_w * components;
-  gint d_rowstride = dest_w * components;
-
-  gint          footprint_x;
-  gint          footprint_y;
-  guint         foosum;
-
-  guint         left_weight;
-  guint         center_weight;
-  guint         right_weight;
+  GeglTileHandlerZoom *zoom;
+  gint                 tile_width  = buffer->tile_storage->tile_width;
+  gint                 tile_height = buffer->tile_storage->tile_height;
+  gint                 factor      = 1 << level;
+  gint                 x, y, width, height;
+
+  zoom = g_object_get_data (G_OBJECT (buffer->tile_storage), "zoom");
+  if (!zoom || level == 0)
+    return;
 
-  guint         top_weight;
-  guint         middle_weight;
-  guint         bottom_weight;
+  x      = (rect->x + buffer->shift_x) / factor;
+  y      = (rect->y + buffer->shift_y) / factor;
+  width  = rect->width / factor;
+  height = rect->height / factor;
+  if (width <= 0 || height <= 0)
+    return;
 
-  footprint_y = (1.0 / scale) * 256;
-  footprint_x = (1.0 / scale) * 256;
-  foosum = footprint_x * footprint_y;
+  gegl_tile_handler_zoom_build (zoom,
+                                gegl_tile_index (x, tile_width),
+                                gegl_tile_index (y, tile_height),
+                                gegl_tile_index (x + width - 1, tile_width),
+                                gegl_tile_index (y + height - 1, tile_height),
+                                level);
+}
 
-  if (rowstride != GEGL_AUTO_ROWSTRIDE)
-    d_rowstride = rowstride;
+/* resamples sample_buf, fetched from the mipmap level closest to scale,
+ * into dest_buf. scale is what is left to do after picking the level.
+ */
+static void
+gegl_buffer_resample (void       *dest_buf,
+                      void       *sample_buf,
+                      gint        dest_w,
+                      gint        dest_h,
+                      gint        sample_w,
+                      gint        sample_h,
+                      gdouble     offset_x,
+                      gdouble     offset_y,
+                      gdouble     scale,
+                      gint        level,
+                      const Babl *format,
+                      gint        rowstride)
+{
+  gboolean done = FALSE;
 
-  for (y = 0; y < dest_h; y++)
+  /* XXX: zooming in further than 2x shows the pixels, smoothing them
+   * looks blurry in the viewers using us
+   */
+  if (!(level == 0 && scale > 1.99))
     {
-      gint    sy;
-      gint    dy;
-      guchar *dst;
-      const guchar *src_base;
-      gint sx;
-      gint xdelta;
-
-      sy = ((y + offset_y) * 65536) / iscale;
-
-      if (sy >= (source_h - 1) << 8)
-        sy = (source_h - 2) << 8;/* is this the right thing to do? */
-
-      dy = sy & 255;
-
-      dst      = ((guchar *) dest_buf) + y * d_rowstride;
-      src_base = ((guchar *) source_buf) + (sy >> 8) * s_rowstride;
-
-      if (dy > footprint_y / 2)
-        top_weight = 0;
-      else
-        top_weight = footprint_y / 2 - dy;
-
-      if (0xff - dy > footprint_y / 2)
-        bottom_weight = 0;
+      if (scale <= 1.0)
+        done = gegl_buffer_resample_box (dest_buf, sample_buf,
+                                         dest_w, dest_h,
+                                         sample_w, sample_h,
+                                         offset_x, offset_y,
+                                         scale, format, rowstride);
       else
-        bottom_weight = footprint_y / 2 - (0xff - dy);
-
-      middle_weight = footprint_y - top_weight - bottom_weight;
-
-      sx = (offset_x *65536) / iscale;
-      xdelta = 65536/iscale;
-
-      /* XXX: needs quite a bit of optimization */
-      for (x = 0; x < dest_w; x++)
-        {
-          gint          dx;
-          const guchar *src[9];
-
-          /*sx = (x << 16) / iscale;*/
-          dx = sx & 255;
-
-          if (dx > footprint_x / 2)
-            left_weight = 0;
-          else
-            left_weight = footprint_x / 2 - dx;
-
-          if (0xff - dx > footprint_x / 2)
-            right_weight = 0;
-          else
-            right_weight = footprint_x / 2 - (0xff - dx);
-
-          center_weight = footprint_x - left_weight - right_weight;
-
-          src[4] = src_base + (sx >> 8) * components;
-          src[1] = src[4] - s_rowstride;
-          src[7] = src[4] + s_rowstride;
-
-          src[2] = src[1] + components;
-          src[5] = src[4] + components;
-          src[8] = src[7] + components;
-
-          src[0] = src[1] - components;
-          src[3] = src[4] - components;
-          src[6] = src[7] - components;
-
-          if ((sx >>8) - 1<0)
-            {
-              src[0]=src[1];
-              src[3]=src[4];
-              src[6]=src[7];
-            }
-          if ((sy >> 8) - 1 < 0)
-            {
-              src[0]=src[3];
-              src[1]=src[4];
-              src[2]=src[5];
-            }
-          if ((sx >>8) + 1 >= source_w)
-            {
-              src[2]=src[1];
-              src[5]=src[4];
-              src[8]=src[7];
-              break;
-            }
-          if ((sy >> 8) + 1 >= source_h)
-            {
-              src[6]=src[3];
-              src[7]=src[4];
-              src[8]=src[5];
-            }
-
-          box_filter (left_weight,
-                      center_weight,
-                      right_weight,
-                      top_weight,
-                      middle_weight,
-                      bottom_weight,
-                      foosum,
-                      src,   /* the 9 surrounding source pixels */
-                      dst,
-                      components);
-
-
-          dst += components;
-          sx += xdelta;
-        }
+        done = gegl_buffer_resample_bilinear (dest_buf, sample_buf,
+                                              dest_w, dest_h,
+                                              sample_w, sample_h,
+                                              offset_x, offset_y,
+                                              scale, format, rowstride);
     }
-}
 
+  if (!done)
+    resample_nearest (dest_buf,
+                      sample_buf,
+                      dest_w,
+                      dest_h,
+                      sample_w,
+                      sample_h,
+                      offset_x,
+                      offset_y,
+                      scale,
+                      babl_format_get_bytes_per_pixel (format),
+                      rowstride);
+}
 
 void
 gegl_buffer_get_unlocked (GeglBuffer          *buffer,
@@ -1392,35 +1555,9 @@ gegl_buffer_get_unlocked (GeglBuffer          *buffer,
       offset_y = rect->y-floor(rect->y/scale) * scale;
 
       sample_buf = g_malloc (buf_width * buf_height * bpp);
+      gegl_buffer_build_pyramid (buffer, &sample_rect, level);
       gegl_buffer_iterate (buffer, &sample_rect, sample_buf, GEGL_AUTO_ROWSTRIDE, FALSE, format, level);
-#if 1
-  /* slows testing of rendering code speed to much for now and
-   * no time to make a fast implementation
-   */
-
-      if (babl_format_get_type (format, 0) == babl_type ("u8")
-          && !(level == 0 && scale > 1.99))
-        { /* do box-filter resampling if we're 8bit (which projections are) */
-
-          /* XXX: use box-filter also for > 1.99 when testing and probably
-           * later, there are some bugs when doing so
-           */
-          resample_boxfilter_u8 (dest_buf,
-                                 sample_buf,
-                                 rect->width,
-                                 rect->height,
-                                 buf_width,
-                                 buf_height,
-                                 offset_x,
-                                 offset_y,
-                                 scale,
-                                 bpp,
-                                 rowstride);
-        }
-      else
-#endif
-        {
-          resample_nearest (dest_buf,
+      gegl_buffer_resample (dest_buf,
                             sample_buf,
                             rect->width,
                             rect->height,
@@ -1429,9 +1566,9 @@ gegl_buffer_get_unlocked (GeglBuffer          *buffer,
                             offset_x,
                             offset_y,
                             scale,
-                            bpp,
+                            level,
+                            format,
                             rowstride);
-        }
       g_free (sample_buf);
     }
 }
@@ -1547,6 +1684,7 @@ gegl_buffer_gpu_get (GeglBuffer          *buffer,
       dest_buf = g_malloc (dest->width * dest->height * bpp);
       sample_buf = g_malloc (buf_width * buf_height * bpp);
 
+      gegl_buffer_build_pyramid (buffer, &sample_rect, level);
       gegl_buffer_iterate (buffer,
                            &sample_rect,
                            sample_buf,
@@ -1554,34 +1692,8 @@ gegl_buffer_gpu_get (GeglBuffer          *buffer,
                            FALSE,
                            dest->format,
                            level);
-#if 1
-      /* slows testing of rendering code speed to much for now and
-       * no time to make a fast implementation
-       */
-      if (babl_format_get_type (dest->format, 0) == babl_type ("u8")
-          && !(level == 0 && scale > 1.99))
-        {
-          /* do box-filter resampling if we're 8bit (which projections are) */
-
-          /* XXX: use box-filter also for > 1.99 when testing and probably
-           * later, there are some bugs when doing so
-           */
-          resample_boxfilter_u8 (dest_buf,
-                                 sample_buf,
-                                 rect->width,
-                                 rect->height,
-                                 buf_width,
-                                 buf_height,
-                                 offset_x,
-                                 offset_y,
-                                 scale,
-                                 bpp,
-                                 GEGL_AUTO_ROWSTRIDE);
-        }
-      else
-#endif
-        {
-          resample_nearest (dest_buf,
+
+      gegl_buffer_resample (dest_buf,
                             sample_buf,
                             rect->width,
                             rect->height,
@@ -1590,9 +1702,9 @@ gegl_buffer_gpu_get (GeglBuffer          *buffer,
                             offset_x,
                             offset_y,
                             scale,
-                            bpp,
+                            level,
+                            dest->format,
                             GEGL_AUTO_ROWSTRIDE);
-        }
 
       gegl_gpu_texture_set (dest, NULL, dest_buf, NULL);
 
@@ -1672,13 +1784,239 @@ gegl_buffer_sample_cleanup (GeglBuffer *buffer)
 }
 
 
+/* copies src_rect of src to the equally sized rectangle at dst_rect of
+ * dst a destination chunk at a time, the pixels are fetched with
+ * gegl_buffer_get straight into the destination tiles row span by row
+ * span.
+ */
+static void
+gegl_buffer_copy_blit (GeglBuffer          *src,
+                       const GeglRectangle *src_rect,
+                       GeglBuffer          *dst,
+                       const GeglRectangle *dst_rect)
+{
+  GeglBufferIterator *i;
+  gint                offset_x = src_rect->x - dst_rect->x;
+  gint                offset_y = src_rect->y - dst_rect->y;
+
+  if (dst_rect->width <= 0 || dst_rect->height <= 0)
+    return;
+
+  i = gegl_buffer_iterator_new (dst, dst_rect, dst->format,
+                                GEGL_BUFFER_WRITE | GEGL_BUFFER_STRIDED);
+  while (gegl_buffer_iterator_next (i))
+    {
+      GeglRectangle rect = i->roi[0];
+
+      rect.x += offset_x;
+      rect.y += offset_y;
+      gegl_buffer_get (src, 1.0, &rect, dst->format, i->data[0], i->rowstride[0]);
+    }
+  gegl_buffer_iterator_free (i);
+}
+
+/* splits the parts of rect outside of inner, which has to lie within
+ * rect, into the bands above, below, left and right of inner. Bands can
+ * be empty.
+ */
+static void
+gegl_buffer_rect_bands (GeglRectangle        bands[4],
+                        const GeglRectangle *rect,
+                        const GeglRectangle *inner)
+{
+  bands[0].x      = rect->x;
+  bands[0].y      = rect->y;
+  bands[0].width  = rect->width;
+  bands[0].height = inner->y - rect->y;
+
+  bands[1].x      = rect->x;
+  bands[1].y      = inner->y + inner->height;
+  bands[1].width  = rect->width;
+  bands[1].height = rect->y + rect->height - bands[1].y;
+
+  bands[2].x      = rect->x;
+  bands[2].y      = inner->y;
+  bands[2].width  = inner->x - rect->x;
+  bands[2].height = inner->height;
+
+  bands[3].x      = inner->x + inner->width;
+  bands[3].y      = inner->y;
+  bands[3].width  = rect->x + rect->width - bands[3].x;
+  bands[3].height = inner->height;
+}
+
+/* tiles put into the cache directly are not seen by gegl_buffer_get_tile,
+ * this widens the range of tiles that gegl_buffer_void drops to the
+ * columns x0 to x1 and rows y0 to y1, both excluding the last one
+ */
+static void
+gegl_buffer_track_tiles (GeglBuffer *buffer,
+                         gint        x0,
+                         gint        y0,
+                         gint        x1,
+                         gint        y1)
+{
+  buffer->min_x = MIN (buffer->min_x, x0);
+  buffer->min_y = MIN (buffer->min_y, y0);
+  buffer->max_x = MAX (buffer->max_x, x1 - 1);
+  buffer->max_y = MAX (buffer->max_y, y1 - 1);
+}
+
+/* shares the tiles of src that the copy covers entirely with dst, the
+ * tiles are cloned and only get duplicated when either side writes to
+ * them. Returns the part of src_rect that was copied this way in shared,
+ * empty if the tile grids of the two buffers do not line up.
+ */
+static void
+gegl_buffer_copy_tiles (GeglBuffer          *src,
+                        const GeglRectangle *src_rect,
+                        GeglBuffer          *dst,
+                        const GeglRectangle *dst_rect,
+                        GeglRectangle       *shared)
+{
+  gint                  tile_width  = src->tile_storage->tile_width;
+  gint                  tile_height = src->tile_storage->tile_height;
+  gint                  offset_x    = dst_rect->x - src_rect->x;
+  gint                  offset_y    = dst_rect->y - src_rect->y;
+  gint                  tile_offset_x;
+  gint                  tile_offset_y;
+  GeglTileHandlerCache *cache;
+  GeglTileHandlerZoom  *zoom;
+  GeglRectangle         dst_abyss;
+  GeglRectangle         area;
+  GeglTile            **tiles;
+  gint                  x0, y0, x1, y1;
+  gint                  columns, rows;
+  gint                  x, y;
+
+  shared->x = src_rect->x;
+  shared->y = src_rect->y;
+  shared->width  = 0;
+  shared->height = 0;
+
+  cache = g_object_get_data (G_OBJECT (dst->tile_storage), "cache");
+
+  if (src->format != dst->format ||
+      src->tile_storage == dst->tile_storage ||
+      dst->tile_storage->tile_width  != tile_width ||
+      dst->tile_storage->tile_height != tile_height ||
+      !cache ||
+      gegl_buffer_linear_has_views (dst->tile_storage))
+    return;
+
+  /* the offset between the buffers in tile storage coordinates has to
+   * be a whole number of tiles
+   */
+  if (gegl_tile_offset (offset_x + dst->shift_x - src->shift_x, tile_width) ||
+      gegl_tile_offset (offset_y + dst->shift_y - src->shift_y, tile_height))
+    return;
+
+  /* only pixels inside both abysses can be shared, the rest is
+   * either read as zeros or dropped when written
+   */
+  dst_abyss    = dst->abyss;
+  dst_abyss.x -= offset_x;
+  dst_abyss.y -= offset_y;
+  if (!gegl_rectangle_intersect (&area, src_rect, &src->abyss) ||
+      !gegl_rectangle_intersect (&area, &area, &dst_abyss))
+    return;
+
+  /* the whole tiles inside area, in the tile coordinates of src */
+  x0 = gegl_tile_index (area.x + src->shift_x + tile_width - 1, tile_width);
+  y0 = gegl_tile_index (area.y + src->shift_y + tile_height - 1, tile_height);
+  x1 = gegl_tile_index (area.x + area.width + src->shift_x, tile_width);
+  y1 = gegl_tile_index (area.y + area.height + src->shift_y, tile_height);
+  columns = x1 - x0;
+  rows    = y1 - y0;
+  if (columns <= 0 || rows <= 0)
+    return;
+
+  /* all the tiles are fetched before any is replaced, this keeps the
+   * copy correct when the source is a sub buffer sharing the storage
+   * of the destination in other ways than the checks above catch
+   */
+  tiles = g_new (GeglTile *, columns * rows);
+  for (y = 0; y < rows; y++)
+    for (x = 0; x < columns; x++)
+      tiles[y * columns + x] = gegl_tile_source_get_tile ((GeglTileSource *) src,
+                                                          x0 + x, y0 + y, 0);
+
+  zoom = g_object_get_data (G_OBJECT (dst->tile_storage), "zoom");
+
+  tile_offset_x = (offset_x + dst->shift_x - src->shift_x) / tile_width;
+  tile_offset_y = (offset_y + dst->shift_y - src->shift_y) / tile_height;
+
+  for (y = 0; y < rows; y++)
+    for (x = 0; x < columns; x++)
+      {
+        GeglTile *src_tile = tiles[y * columns + x];
+        GeglTile *dst_tile;
+        gint      dx, dy;
+
+        if (!src_tile)
+          continue;
+
+        dx = x0 + x + tile_offset_x;
+        dy = y0 + y + tile_offset_y;
+
+        dst_tile = gegl_tile_dup (src_tile);
+        dst_tile->x = dx;
+        dst_tile->y = dy;
+        dst_tile->z = 0;
+        dst_tile->tile_storage = dst->tile_storage;
+        /* the backend of dst still holds the old contents */
+        gegl_tile_mark_as_unstored (dst_tile);
+
+        gegl_tile_handler_cache_insert (cache, dst_tile, dx, dy, 0);
+        if (zoom && dst->tile_storage->seen_zoom)
+          gegl_tile_handler_zoom_invalidate (zoom, dx, dy);
+
+        gegl_tile_unref (dst_tile);
+        gegl_tile_unref (src_tile);
+      }
+  gegl_buffer_track_tiles (dst, x0 + tile_offset_x, y0 + tile_offset_y,
+                           x1 + tile_offset_x, y1 + tile_offset_y);
+
+  /* the hot tiles of all the buffers of the storage may be replaced */
+  g_atomic_int_inc (&dst->tile_storage->hot_tile_generation);
+
+  /* the tiles src could not provide are still counted as shared, they
+   * are copied pixel by pixel instead
+   */
+  for (y = 0; y < rows; y++)
+    for (x = 0; x < columns; x++)
+      if (!tiles[y * columns + x])
+        {
+          GeglRectangle src_tile_rect;
+          GeglRectangle dst_tile_rect;
+
+          src_tile_rect.x      = (x0 + x) * tile_width - src->shift_x;
+          src_tile_rect.y      = (y0 + y) * tile_height - src->shift_y;
+          src_tile_rect.width  = tile_width;
+          src_tile_rect.height = tile_height;
+          dst_tile_rect    = src_tile_rect;
+          dst_tile_rect.x += offset_x;
+          dst_tile_rect.y += offset_y;
+          gegl_buffer_copy_blit (src, &src_tile_rect, dst, &dst_tile_rect);
+        }
+  g_free (tiles);
+
+  shared->x      = x0 * tile_width - src->shift_x;
+  shared->y      = y0 * tile_height - src->shift_y;
+  shared->width  = columns * tile_width;
+  shared->height = rows * tile_height;
+}
+
 void
 gegl_buffer_copy (GeglBuffer          *src,
                   const GeglRectangle *src_rect,
                   GeglBuffer          *dst,
                   const GeglRectangle *dst_rect)
 {
-  Babl         *fish;
+  GeglRectangle dest_rect_r;
+  GeglRectangle shared;
+  gint          offset_x;
+  gint          offset_y;
 
   g_return_if_fail (GEGL_IS_BUFFER (src));
   g_return_if_fail (GEGL_IS_BUFFER (dst));
@@ -1693,15 +2031,21 @@ gegl_buffer_copy (GeglBuffer          *src,
       dst_rect = src_rect;
     }
 
-  fish = babl_fish (src->format, dst->format);
+  dest_rect_r        = *dst_rect;
+  dest_rect_r.width  = src_rect->width;
+  dest_rect_r.height = src_rect->height;
 
+  if (dest_rect_r.width <= 0 || dest_rect_r.height <= 0)
+    return;
+
+  if (src->tile_storage == dst->tile_storage)
     {
-      GeglRectangle dest_rect_r = *dst_rect;
+      /* reading and writing the same tiles, the iterator takes care of
+       * tiles that are visited by both sides
+       */
+      Babl               *fish = babl_fish (src->format, dst->format);
       GeglBufferIterator *i;
-      gint read;
-
-      dest_rect_r.width = src_rect->width;
-      dest_rect_r.height = src_rect->height;
+      gint                read;
 
       i = gegl_buffer_iterator_new (dst, &dest_rect_r, dst->format, GEGL_BUFFER_WRITE);
       read = gegl_buffer_iterator_add (i, src, src_rect, src->format, GEGL_BUFFER_READ);
@@ -1709,7 +2053,101 @@ gegl_buffer_copy (GeglBuffer          *src,
         babl_process (fish, i->data[read], i->data[0], i->length);
 
       gegl_buffer_iterator_free (i);
+      return;
     }
+
+  gegl_buffer_copy_tiles (src, src_rect, dst, &dest_rect_r, &shared);
+
+  if (shared.width == 0 || shared.height == 0)
+    {
+      gegl_buffer_copy_blit (src, src_rect, dst, &dest_rect_r);
+      return;
+    }
+
+  /* blit the bands around the shared tiles */
+  offset_x = dest_rect_r.x - src_rect->x;
+  offset_y = dest_rect_r.y - src_rect->y;
+  {
+    GeglRectangle bands[4];
+    gint          n;
+
+    gegl_buffer_rect_bands (bands, src_rect, &shared);
+    for (n = 0; n < 4; n++)
+      {
+        GeglRectangle dst_band = bands[n];
+
+        dst_band.x += offset_x;
+        dst_band.y += offset_y;
+        gegl_buffer_copy_blit (src, &bands[n], dst, &dst_band);
+      }
+  }
+}
+
+/* replaces the whole tiles of dst inside dst_rect by tiles sharing the
+ * data of the zero tile, the area they cover is returned in cleared
+ */
+static void
+gegl_buffer_clear_tiles (GeglBuffer          *dst,
+                         const GeglRectangle *dst_rect,
+                         GeglRectangle       *cleared)
+{
+  GeglTileStorage      *storage     = dst->tile_storage;
+  gint                  tile_width  = storage->tile_width;
+  gint                  tile_height = storage->tile_height;
+  GeglTileHandlerCache *cache;
+  GeglTileHandlerZoom  *zoom;
+  GeglRectangle         area;
+  gint                  x0, y0, x1, y1;
+  gint                  x, y;
+
+  cleared->x = dst_rect->x;
+  cleared->y = dst_rect->y;
+  cleared->width  = 0;
+  cleared->height = 0;
+
+  cache = g_object_get_data (G_OBJECT (storage), "cache");
+  zoom  = g_object_get_data (G_OBJECT (storage), "zoom");
+
+  /* pixels outside the abyss are not written */
+  if (!cache ||
+      gegl_buffer_linear_has_views (storage) ||
+      !gegl_rectangle_intersect (&area, dst_rect, &dst->abyss))
+    return;
+
+  x0 = gegl_tile_index (area.x + dst->shift_x + tile_width - 1, tile_width);
+  y0 = gegl_tile_index (area.y + dst->shift_y + tile_height - 1, tile_height);
+  x1 = gegl_tile_index (area.x + area.width + dst->shift_x, tile_width);
+  y1 = gegl_tile_index (area.y + area.height + dst->shift_y, tile_height);
+  if (x1 <= x0 || y1 <= y0)
+    return;
+
+  for (y = y0; y < y1; y++)
+    for (x = x0; x < x1; x++)
+      {
+        GeglTile *tile = gegl_tile_new_uniform (tile_width, tile_height,
+                                                storage->format, NULL);
+
+        tile->x = x;
+        tile->y = y;
+        tile->z = 0;
+        tile->tile_storage = storage;
+        /* the backend still holds the old contents */
+        gegl_tile_mark_as_unstored (tile);
+
+        gegl_tile_handler_cache_insert (cache, tile, x, y, 0);
+        if (zoom && storage->seen_zoom)
+          gegl_tile_handler_zoom_invalidate (zoom, x, y);
+        gegl_tile_unref (tile);
+      }
+  gegl_buffer_track_tiles (dst, x0, y0, x1, y1);
+
+  /* the hot tiles of all the buffers of the storage may be replaced */
+  g_atomic_int_inc (&storage->hot_tile_generation);
+
+  cleared->x      = x0 * tile_width - dst->shift_x;
+  cleared->y      = y0 * tile_height - dst->shift_y;
+  cleared->width  = (x1 - x0) * tile_width;
+  cleared->height = (y1 - y0) * tile_height;
 }
 
 void
@@ -1717,6 +2155,10 @@ gegl_buffer_clear (GeglBuffer          *dst,
                    const GeglRectangle *dst_rect)
 {
   GeglBufferIterator *i;
+  GeglRectangle       cleared;
+  GeglRectangle       bands[4];
+  gint                n_bands;
+  gint                n;
   gint                pxsize;
 
   g_return_if_fail (GEGL_IS_BUFFER (dst));
@@ -1731,15 +2173,34 @@ gegl_buffer_clear (GeglBuffer          *dst,
 
   pxsize = babl_format_get_bytes_per_pixel (dst->format);
 
-  /* FIXME: this can be even further optimized by special casing it so
-   * that fully voided tiles are dropped.
+  /* whole tiles are replaced by the shared zero tile, only the bands
+   * around them are written to
    */
-  i = gegl_buffer_iterator_new (dst, dst_rect, dst->format, GEGL_BUFFER_WRITE);
-  while (gegl_buffer_iterator_next (i))
+  gegl_buffer_clear_tiles (dst, dst_rect, &cleared);
+  if (cleared.width == 0 || cleared.height == 0)
     {
-      memset (((guchar*)(i->data[0])), 0, i->length * pxsize);
+      n_bands  = 1;
+      bands[0] = *dst_rect;
+    }
+  else
+    {
+      n_bands = 4;
+      gegl_buffer_rect_bands (bands, dst_rect, &cleared);
+    }
+
+  for (n = 0; n < n_bands; n++)
+    {
+      if (bands[n].width <= 0 || bands[n].height <= 0)
+        continue;
+
+      i = gegl_buffer_iterator_new (dst, &bands[n], dst->format,
+                                    GEGL_BUFFER_WRITE);
+      while (gegl_buffer_iterator_next (i))
+        {
+          memset (((guchar*)(i->data[0])), 0, i->length * pxsize);
+        }
+      gegl_buffer_iterator_free (i);
     }
-  gegl_buffer_iterator_free (i);
 }
 
 GeglBuffer *
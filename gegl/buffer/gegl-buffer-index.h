@@ -9,12 +9,17 @@ GeglBuffer on disk representation
 
 
 /* Increase this number when the structures change.*/
-#define GEGL_FILE_SPEC_REV     0
+#define GEGL_FILE_SPEC_REV     1
 #define GEGL_MAGIC             {'G','E','G','L'}
 
 #define GEGL_FLAG_TILE         1
 #define GEGL_FLAG_FREE_TILE    0xf+2
 
+/* a tile entry extended with the codec its data is compressed with,
+ * added in revision 1 of the format.
+ */
+#define GEGL_FLAG_COMPRESSED_TILE 4
+
 /* a VOID message, indicating that the specified tile has been rewritten */
 #define GEGL_FLAG_INVALIDATED  2
 
@@ -97,15 +102,31 @@ typedef struct {
                             own state when revision differs. */
 } GeglBufferTile;
 
+/* Compressed tiles store size bytes at tile.offset, a uniform tile with
+ * a pixel no larger than GEGL_BUFFER_INLINE_PIXEL bytes doesn't use any
+ * space in the file, its pixel is kept in the entry and size is 0.
+ */
+#define GEGL_BUFFER_INLINE_PIXEL 32
+
+typedef struct {
+  GeglBufferTile tile;   /* tile.block.flags is GEGL_FLAG_COMPRESSED_TILE */
+  guint32 codec;         /* GeglTileCodec the tile is stored with          */
+  guint32 size;          /* size of the compressed data in bytes          */
+  guchar  pixel[GEGL_BUFFER_INLINE_PIXEL];
+} GeglBufferCompressedTile;
+
 /* A convenience union to allow quick and simple casting */
 typedef union {
-  guint32          length;
-  GeglBufferBlock  block;
-  GeglBufferHeader header;
-  GeglBufferTile   tile;
+  guint32                  length;
+  GeglBufferBlock          block;
+  GeglBufferHeader         header;
+  GeglBufferTile           tile;
+  GeglBufferCompressedTile compressed;
 } GeglBufferItem;
 
-/* functions to initialize data structures */
+/* functions to initialize data structures, tile entries are allocated
+ * large enough to be turned into a GeglBufferCompressedTile in place.
+ */
 GeglBufferTile * gegl_tile_entry_new (gint x,
                                       gint y,
                                       gint z);
@@ -146,7 +167,9 @@ GList          *gegl_buffer_read_index (int i,
     }
 #define GEGL_BUFFER_STRUCT_CHECK_PADDING \
   {struct_check_padding (GeglBufferBlock, 16);\
-  struct_check_padding (GeglBufferHeader, 256);}
+  struct_check_padding (GeglBufferHeader, 256);\
+  struct_check_padding (GeglBufferTile, 40);\
+  struct_check_padding (GeglBufferCompressedTile, 80);}
 #define GEGL_BUFFER_SANITY {static gboolean done=FALSE;if(!done){GEGL_BUFFER_STRUCT_CHECK_PADDING;done=TRUE;}}
 
 #endif
@@ -43,8 +43,12 @@ typedef struct GeglBufferTileIterator
   GeglBuffer      *buffer;
   GeglRectangle    roi;      /* the rectangular region we're iterating over */
   GeglTile        *tile;     /* current tile */
+  gboolean         locked;   /* tile is to be unlocked, it is not when it
+                              * is accessed under the lock of a linear view
+                              */
 
   GeglTileLockMode lock_mode;
+  gboolean         strided;  /* sub tile rectangles are accessed in place */
 
   GeglRectangle    subrect;  /* the rectangular subregion of data in the
                               * buffer represented by this scan
@@ -63,14 +67,32 @@ typedef struct GeglBufferTileIterator
 #define GEGL_BUFFER_SCAN_COMPATIBLE   128 /* should be integrated into enum */
 #define GEGL_BUFFER_FORMAT_COMPATIBLE 256 /* should be integrated into enum */
 
-#define DEBUG_DIRECT 0
+
+/* the number of tiles ahead of the current one an iteration asks the
+ * storage to start bringing in from swap
+ */
+#define GEGL_ITERATOR_READAHEAD 2
+
+/* the number of tiles along a tile row that make up one chunk of a split
+ * iteration, few enough for load balancing and enough to amortize setting
+ * up an iteration per chunk
+ */
+#define GEGL_ITERATOR_CHUNK_TILES 4
+
+/* how many of the pixels iterated were accessed in place */
+static GStaticMutex direct_mutex        = G_STATIC_MUTEX_INIT;
+static gint64       stats_direct_read   = 0;
+static gint64       stats_direct_write  = 0;
+static gint64       stats_copied_read   = 0;
+static gint64       stats_copied_write  = 0;
 
 typedef struct _GeglBufferIterator
 {
   /* current region of interest */
   gint                    length; /* length of current data in pixels */
-  gpointer                data    [GEGL_BUFFER_MAX_ITERABLES];
-  GeglRectangle           roi     [GEGL_BUFFER_MAX_ITERABLES];
+  gpointer                data     [GEGL_BUFFER_MAX_ITERABLES];
+  GeglRectangle           roi      [GEGL_BUFFER_MAX_ITERABLES];
+  gint                    rowstride[GEGL_BUFFER_MAX_ITERABLES];
 #if HAVE_GPU
   GeglGpuTexture         *gpu_data[GEGL_BUFFER_MAX_ITERABLES];
 #endif
@@ -85,6 +107,31 @@ typedef struct _GeglBufferIterator
   const Babl             *format  [GEGL_BUFFER_MAX_ITERABLES];
   guint                   flags   [GEGL_BUFFER_MAX_ITERABLES];
   _GeglBufferTileIterator i       [GEGL_BUFFER_MAX_ITERABLES];
+  gint                    share   [GEGL_BUFFER_MAX_ITERABLES]; /* or -1 */
+
+  /* pixels accessed in place and through scratch copies, added to the
+   * global statistics when the iteration is done
+   */
+  gint64                  direct_read;
+  gint64                  direct_write;
+  gint64                  copied_read;
+  gint64                  copied_write;
+
+  /* set when iterating a chunk of a split iteration, the tile locks alone
+   * keep the chunks iterated by other threads out
+   */
+  gboolean                is_chunk;
+
+  /* the tile aligned chunks of the first rect handed out by a cursor to
+   * the iterators split from this one
+   */
+  GeglRectangle          *chunks;
+  gint                    n_chunks;
+  volatile gint           next_chunk;
+
+  /* for split iterators, the iterator split from and the current chunk */
+  struct _GeglBufferIterator *parent;
+  struct _GeglBufferIterator *chunk;
 
 } _GeglBufferIterator;
 
@@ -146,6 +193,7 @@ gegl_buffer_tile_iterator_init (_GeglBufferTileIterator *i,
   i->tile   = NULL;
 
   i->lock_mode = lock_mode;
+  i->strided   = FALSE;
 
   memset (&i->subrect, 0, sizeof (GeglRectangle));
   i->sub_data = NULL;
@@ -157,6 +205,46 @@ gegl_buffer_tile_iterator_init (_GeglBufferTileIterator *i,
   i->next_col = 0;
 }
 
+/* hints the storage about the tiles that follow the current one in the
+ * scan order
+ */
+static void
+gegl_buffer_tile_iterator_prefetch (_GeglBufferTileIterator *i)
+{
+  GeglBuffer *buffer = i->buffer;
+
+  gint tile_width  = buffer->tile_storage->tile_width;
+  gint tile_height = buffer->tile_storage->tile_height;
+
+  gint buffer_x = buffer->extent.x + buffer->shift_x;
+  gint buffer_y = buffer->extent.y + buffer->shift_y;
+
+  gint col = i->next_col;
+  gint row = i->next_row;
+  gint n;
+
+  for (n = 0; n < GEGL_ITERATOR_READAHEAD; n++)
+    {
+      gint x, y;
+
+      if (col >= i->roi.width)
+        {
+          row += tile_height - gegl_tile_offset (buffer_y + row, tile_height);
+          col  = 0;
+          if (row >= i->roi.height)
+            return;
+        }
+
+      x = buffer_x + col;
+      y = buffer_y + row;
+      gegl_tile_source_prefetch ((GeglTileSource *) buffer,
+                                 gegl_tile_index (x, tile_width),
+                                 gegl_tile_index (y, tile_height),
+                                 0);
+      col += tile_width - gegl_tile_offset (x, tile_width);
+    }
+}
+
 static gboolean
 gegl_buffer_tile_iterator_next (_GeglBufferTileIterator *i)
 {
@@ -173,14 +261,13 @@ gegl_buffer_tile_iterator_next (_GeglBufferTileIterator *i)
 
 gulp:
 
-  /* unref previously held tile */
+  /* unlock and unref previously held tile, tiles are only held while
+   * they are locked for direct access
+   */
   if (i->tile != NULL)
     {
-      if ((i->lock_mode & GEGL_TILE_LOCK_WRITE)
-       && i->subrect.width == tile_width)
-        {
-          gegl_tile_unlock (i->tile);
-        }
+      if (i->locked)
+        gegl_tile_unlock (i->tile);
       gegl_tile_unref (i->tile);
       i->tile = NULL;
 
@@ -220,7 +307,7 @@ gulp:
 
       direct_access = ((i->lock_mode & GEGL_TILE_LOCK_READ
                                  || i->lock_mode & GEGL_TILE_LOCK_WRITE)
-                                && tile_width == rect.width);
+                                && (tile_width == rect.width || i->strided));
 
 #if HAVE_GPU
       gpu_direct_access = ((i->lock_mode & GEGL_TILE_LOCK_GPU_READ
@@ -240,13 +327,14 @@ gulp:
                                                gegl_tile_index (y, tile_height),
                                                0);
 
-          gegl_tile_lock (i->tile, i->lock_mode);
+          i->locked = gegl_buffer_linear_lock_tile (i->tile, i->lock_mode);
 
           if (direct_access)
             {
               gpointer data = gegl_tile_get_data (i->tile);
               gint bpp = babl_format_get_bytes_per_pixel (buffer->format);
-              i->sub_data = (guchar *) data + (bpp * rect.y * tile_width);
+              i->sub_data = (guchar *) data +
+                            bpp * (rect.y * tile_width + rect.x);
             }
 #if HAVE_GPU
           if (gpu_direct_access)
@@ -261,6 +349,8 @@ gulp:
 
       i->next_col += tile_width - offset_x;
 
+      gegl_buffer_tile_iterator_prefetch (i);
+
       return TRUE;
     }
   else
@@ -282,6 +372,78 @@ gulp:
   return FALSE;
 }
 
+static gboolean
+gegl_buffer_iterator_can_share (_GeglBufferIterator *i,
+                                gint                 no)
+{
+  return (i->flags[no] & GEGL_BUFFER_SCAN_COMPATIBLE) &&
+         !(i->flags[no] & (GEGL_BUFFER_GPU_READ | GEGL_BUFFER_GPU_WRITE));
+}
+
+/* whether later iterables are served from the tile locked for no */
+static gboolean
+gegl_buffer_iterator_lends_tile (_GeglBufferIterator *i,
+                                 gint                 no)
+{
+  gint j;
+
+  for (j = no + 1; j < i->iterable_count; j++)
+    if (i->share[j] == no)
+      return TRUE;
+  return FALSE;
+}
+
+/* whether iterable no is accessed in place in the tile locked for it */
+static gboolean
+gegl_buffer_iterator_is_direct (_GeglBufferIterator *i,
+                                gint                 no)
+{
+  gint holder     = i->share[no] >= 0 ? i->share[no] : no;
+  gint tile_width = i->i[no].buffer->tile_storage->tile_width;
+
+  return (i->flags[no] & GEGL_BUFFER_SCAN_COMPATIBLE) &&
+         (i->flags[no] & GEGL_BUFFER_FORMAT_COMPATIBLE) &&
+         (i->roi[no].width == tile_width || i->i[no].strided) &&
+         i->i[holder].tile != NULL;
+}
+
+/* copies the pixels of iterable no between its scratch buffer and the
+ * tile locked for it, converting them on the way. Used when no could not
+ * lock the tile itself without waiting for the lock of an earlier
+ * iterable visiting the same tile.
+ */
+static void
+gegl_buffer_iterator_copy_tile (_GeglBufferIterator *i,
+                                gint                 no,
+                                gboolean             to_tile)
+{
+  gint        holder    = i->share[no] >= 0 ? i->share[no] : no;
+  const Babl *format    = i->buffer[no]->format;
+  gint        tile_rowstride;
+  guchar     *tile_data = i->i[holder].sub_data;
+  guchar     *data      = i->data[no];
+  Babl       *fish;
+  gint        y;
+
+  tile_rowstride = i->i[holder].buffer->tile_storage->tile_width *
+                   babl_format_get_bytes_per_pixel (format);
+
+  if (to_tile)
+    fish = babl_fish ((gpointer) i->format[no], (gpointer) format);
+  else
+    fish = babl_fish ((gpointer) format, (gpointer) i->format[no]);
+
+  for (y = 0; y < i->roi[no].height; y++)
+    {
+      if (to_tile)
+        babl_process (fish, data + y * i->rowstride[no],
+                      tile_data + y * tile_rowstride, i->roi[no].width);
+      else
+        babl_process (fish, tile_data + y * tile_rowstride,
+                      data + y * i->rowstride[no], i->roi[no].width);
+    }
+}
+
 gint
 gegl_buffer_iterator_add (GeglBufferIterator  *iterator,
                           GeglBuffer          *buffer,
@@ -366,78 +528,216 @@ gegl_buffer_iterator_add (GeglBufferIterator  *iterator,
   if (i->format[self] == i->buffer[self]->format)
     i->flags[self] |= GEGL_BUFFER_FORMAT_COMPATIBLE;
 
+  /* converting data can't be done in place, don't lock tiles for it */
+  i->i[self].strided = (flags & GEGL_BUFFER_STRIDED) &&
+                       (i->flags[self] & GEGL_BUFFER_FORMAT_COMPATIBLE);
+
+  /* an iterable visiting the same tiles as an earlier one, like the input
+   * and output of an operation processing in place, uses the tile locked
+   * for the earlier one instead of locking it a second time, which would
+   * wait for the earlier lock forever. Whatever their formats, it reads
+   * and writes the tile in place or through a converted copy of it.
+   */
+  i->share[self] = -1;
+  if (gegl_buffer_iterator_can_share (i, self))
+    {
+      gint j;
+
+      for (j = 0; j < self; j++)
+        if (i->share[j] < 0 &&
+            gegl_buffer_iterator_can_share (i, j) &&
+            i->buffer[j]->tile_storage == i->buffer[self]->tile_storage &&
+            i->buffer[j]->shift_x + i->rect[j].x ==
+              i->buffer[self]->shift_x + i->rect[self].x &&
+            i->buffer[j]->shift_y + i->rect[j].y ==
+              i->buffer[self]->shift_y + i->rect[self].y)
+          {
+            i->share[self]        = j;
+            i->i[j].lock_mode    |= i->i[self].lock_mode;
+            i->i[self].lock_mode  = GEGL_TILE_LOCK_NONE;
+            break;
+          }
+    }
+
   return self;
 }
 
-/* XXX: keeping a small pool of such buffers around for the used formats
- * would probably improve performance (old note from pippin, kept as a
- * reminder)
+/* Scratch buffers for the iterations that can not access tiles directly.
+ * Every thread keeps free lists of power of two sized buffers, getting and
+ * releasing a buffer takes no locks and no searching. The buffers are cache
+ * line aligned for the vector loads of the conversion and processing code.
  */
 
-typedef struct BufInfo {
-  gint     size;
-  gint     used; /* if this buffer is currently allocated */
-  gpointer buf;
-} BufInfo;
+#define SCRATCH_ALIGN       64
+#define SCRATCH_MIN_SHIFT   12  /* 4kb, the smallest size class */
+#define SCRATCH_CLASSES     16  /* up to 128mb, larger buffers aren't kept */
+#define SCRATCH_HIGH_WATER  (32 * 1024 * 1024) /* bytes kept free per thread */
 
-static GArray *buf_pool = NULL;
+typedef struct
+{
+  gpointer raw;        /* what was returned by g_malloc */
+  gint     size_class; /* -1 for buffers that are not kept */
+} ScratchHeader;
 
-#if ENABLE_MT
-static GStaticMutex pool_mutex = G_STATIC_MUTEX_INIT;
-#endif
+typedef struct
+{
+  GTrashStack *free[SCRATCH_CLASSES];
+  gsize        free_bytes;
+} ScratchPool;
+
+static GPrivate     *scratch_key  = NULL;
+static GOnce         scratch_once = G_ONCE_INIT;
+
+static volatile gint scratch_gets    = 0;
+static volatile gint scratch_reuses  = 0;
+static volatile gint scratch_mallocs = 0;
+static volatile gint scratch_trims   = 0;
+static volatile gint scratch_bytes   = 0; /* allocated, in use or free */
+static volatile gint scratch_peak    = 0;
+
+static inline ScratchHeader *
+scratch_header (gpointer buf)
+{
+  return (ScratchHeader *) ((guchar *) buf - sizeof (ScratchHeader));
+}
 
-static gpointer iterator_buf_pool_get (gint size)
+static inline gsize
+scratch_class_size (gint size_class)
 {
-  gint cnt;
-#if ENABLE_MT
-  g_static_mutex_lock (&pool_mutex);
-#endif
+  return (gsize) 1 << (size_class + SCRATCH_MIN_SHIFT);
+}
+
+static void
+scratch_free (gpointer buf)
+{
+  ScratchHeader *header = scratch_header (buf);
+
+  if (header->size_class >= 0)
+    g_atomic_int_add (&scratch_bytes,
+                      -(gint) scratch_class_size (header->size_class));
+  g_free (header->raw);
+}
 
-  if (G_UNLIKELY (!buf_pool))
-    buf_pool = g_array_new (TRUE, TRUE, sizeof (BufInfo));
+static void
+scratch_pool_free (gpointer data)
+{
+  ScratchPool *pool = data;
+  gint         c;
+
+  for (c = 0; c < SCRATCH_CLASSES; c++)
+    while (pool->free[c])
+      {
+        /* the trash stack link overwrote the start of the buffer, not the
+         * header in front of it
+         */
+        scratch_free (g_trash_stack_pop (&pool->free[c]));
+      }
+  g_slice_free (ScratchPool, pool);
+}
+
+static gpointer
+scratch_init (gpointer data)
+{
+  scratch_key = g_private_new (scratch_pool_free);
+  return NULL;
+}
 
-  for (cnt = 0; cnt < buf_pool->len; cnt++)
+static inline ScratchPool *
+scratch_pool_get (void)
+{
+  ScratchPool *pool;
+
+  g_once (&scratch_once, scratch_init, NULL);
+  pool = g_private_get (scratch_key);
+  if (G_UNLIKELY (pool == NULL))
     {
-      BufInfo *info = &g_array_index (buf_pool, BufInfo, cnt);
+      pool = g_slice_new0 (ScratchPool);
+      g_private_set (scratch_key, pool);
+    }
+  return pool;
+}
 
-      if (info->size >= size && info->used == 0)
+static gpointer
+scratch_alloc (gsize size,
+               gint  size_class)
+{
+  guchar        *raw = g_malloc (size + sizeof (ScratchHeader) + SCRATCH_ALIGN);
+  guchar        *buf;
+  ScratchHeader *header;
+  gint           bytes;
+
+  buf = (guchar *) (((gsize) raw + sizeof (ScratchHeader) + SCRATCH_ALIGN - 1)
+                    & ~(gsize) (SCRATCH_ALIGN - 1));
+  header             = scratch_header (buf);
+  header->raw        = raw;
+  header->size_class = size_class;
+
+  g_atomic_int_inc (&scratch_mallocs);
+  if (size_class >= 0)
+    {
+      bytes = g_atomic_int_exchange_and_add (&scratch_bytes, size) + size;
+      while (bytes > g_atomic_int_get (&scratch_peak))
         {
-          info->used ++;
-#if ENABLE_MT
-          g_static_mutex_unlock (&pool_mutex);
-#endif
-          return info->buf;
+          gint peak = g_atomic_int_get (&scratch_peak);
+          if (bytes <= peak ||
+              g_atomic_int_compare_and_exchange (&scratch_peak, peak, bytes))
+            break;
         }
     }
-  {
-    BufInfo info = {0, 1, NULL};
-    info.size = size;
-    info.buf = gegl_malloc (size);
-    g_array_append_val (buf_pool, info);
-#if ENABLE_MT
-    g_static_mutex_unlock (&pool_mutex);
-#endif
-    return info.buf;
-  }
+  return buf;
+}
+
+static gpointer iterator_buf_pool_get (gint size)
+{
+  ScratchPool *pool;
+  gint         size_class = 0;
+
+  g_atomic_int_inc (&scratch_gets);
+
+  while (size_class < SCRATCH_CLASSES && scratch_class_size (size_class) < size)
+    size_class++;
+  if (size_class == SCRATCH_CLASSES)
+    return scratch_alloc (size, -1);
+
+  pool = scratch_pool_get ();
+  if (pool->free[size_class])
+    {
+      g_atomic_int_inc (&scratch_reuses);
+      pool->free_bytes -= scratch_class_size (size_class);
+      return g_trash_stack_pop (&pool->free[size_class]);
+    }
+  return scratch_alloc (scratch_class_size (size_class), size_class);
 }
 
 static void
 iterator_buf_pool_release (gpointer buf)
 {
-  gint i;
-#if ENABLE_MT
-  g_static_mutex_lock (&pool_mutex);
-#endif
-  for (i=0; i<buf_pool->len; i++)
-    {
-      BufInfo *info = &g_array_index (buf_pool, BufInfo, i);
+  ScratchHeader *header = scratch_header (buf);
+  ScratchPool   *pool;
+  gint           c;
 
-      if (info->buf == buf)
-        info->used--;
+  if (header->size_class < 0)
+    {
+      scratch_free (buf);
+      return;
     }
-#if ENABLE_MT
-  g_static_mutex_unlock (&pool_mutex);
-#endif
+
+  /* the buffer joins the pool of the releasing thread, which is the
+   * acquiring thread for all iterations but the odd handover
+   */
+  pool = scratch_pool_get ();
+  g_trash_stack_push (&pool->free[header->size_class], buf);
+  pool->free_bytes += scratch_class_size (header->size_class);
+
+  /* trim from the largest classes down to the high water mark */
+  for (c = SCRATCH_CLASSES - 1;
+       c >= 0 && pool->free_bytes > SCRATCH_HIGH_WATER; c--)
+    while (pool->free[c] && pool->free_bytes > SCRATCH_HIGH_WATER)
+      {
+        pool->free_bytes -= scratch_class_size (c);
+        scratch_free (g_trash_stack_pop (&pool->free[c]));
+        g_atomic_int_inc (&scratch_trims);
+      }
 }
 
 #if HAVE_GPU
@@ -503,24 +803,42 @@ iterator_gpu_texture_pool_release (GeglGpuTexture *texture)
 void
 gegl_buffer_iterator_cleanup (void)
 {
-  gint cnt;
-
-  if (buf_pool != NULL)
+  /* the pools of other threads are freed as the threads exit */
+  if (scratch_key != NULL)
     {
-      for (cnt = 0; cnt < buf_pool->len; cnt++)
+      ScratchPool *pool = g_private_get (scratch_key);
+
+      if (pool)
         {
-          BufInfo *info = &g_array_index (buf_pool, BufInfo, cnt);
-          gegl_free (info->buf);
-          info->buf = NULL;
+          g_private_set (scratch_key, NULL);
+          scratch_pool_free (pool);
         }
-
-      g_array_free (buf_pool, TRUE);
-      buf_pool = NULL;
     }
 
+  if (g_getenv ("GEGL_DEBUG_BUFS") != NULL)
+    g_warning ("iterator scratch: %i gets %.1f%% reused, %i mallocs "
+               "%i trimmed, peak %.1fmb, %.1fmb still allocated",
+               scratch_gets,
+               scratch_gets ? scratch_reuses * 100.0 / scratch_gets : 0.0,
+               scratch_mallocs, scratch_trims,
+               scratch_peak / 1024 / 1024.0,
+               scratch_bytes / 1024 / 1024.0);
+
+  if (g_getenv ("GEGL_DEBUG_BUFS") != NULL)
+    g_warning ("iterator: %.1f%% of %.1f mpixels read and %.1f%% of "
+               "%.1f mpixels written in place",
+               100.0 * stats_direct_read /
+                 MAX (stats_direct_read + stats_copied_read, 1),
+               (stats_direct_read + stats_copied_read) / 1000000.0,
+               100.0 * stats_direct_write /
+                 MAX (stats_direct_write + stats_copied_write, 1),
+               (stats_direct_write + stats_copied_write) / 1000000.0);
+
 #if HAVE_GPU
   if (gpu_texture_pool != NULL)
     {
+      gint cnt;
+
       for (cnt = 0; cnt < gpu_texture_pool->len; cnt++)
         {
           GpuTextureInfo *info = &g_array_index (gpu_texture_pool,
@@ -539,12 +857,8 @@ gegl_buffer_iterator_cleanup (void)
 
 
 
-#if DEBUG_DIRECT
-static glong direct_read = 0;
-static glong direct_write = 0;
-static glong in_direct_read = 0;
-static glong in_direct_write = 0;
-#endif
+static gboolean gegl_buffer_iterator_split_next (_GeglBufferIterator *i);
+
 
 gboolean
 gegl_buffer_iterator_next (GeglBufferIterator *iterator)
@@ -556,10 +870,13 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
 
   if (i->is_done)
     g_error ("%s called on finished buffer iterator", G_STRFUNC);
+  if (i->parent)
+    return gegl_buffer_iterator_split_next (i);
+
   if (i->iteration_no == 0)
     {
 #if ENABLE_MT
-      for (no=0; no<i->iterable_count; no++)
+      for (no=0; no<i->iterable_count && !i->is_chunk; no++)
         {
           gint j;
           gboolean found = FALSE;
@@ -579,15 +896,19 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
       /* complete pending write work */
       for (no=0; no<i->iterable_count;no++)
         {
-          gboolean direct_access
+          gint     holder = i->share[no] >= 0 ? i->share[no] : no;
+#if HAVE_GPU
+          gboolean full_width
             = (i->flags[no] & GEGL_BUFFER_SCAN_COMPATIBLE
                && i->flags[no] & GEGL_BUFFER_FORMAT_COMPATIBLE
                && i->roi[no].width
                     == i->i[no].buffer->tile_storage->tile_width);
+#endif
+          gboolean direct_access = gegl_buffer_iterator_is_direct (i, no);
 
 #if HAVE_GPU
           gboolean gpu_direct_access
-            = (direct_access && i->roi[no].height
+            = (full_width && i->roi[no].height
                  == i->i[no].buffer->tile_storage->tile_height);
 #endif
 
@@ -596,29 +917,24 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
             {
               if (direct_access)
                 {
-#if DEBUG_DIRECT
                   if (i->flags[no] & GEGL_BUFFER_WRITE)
-                    direct_write += i->roi[no].width * i->roi[no].height;
-#endif
+                    i->direct_write += i->roi[no].width * i->roi[no].height;
                 }
               else
                 {
                   if (i->flags[no] & GEGL_BUFFER_WRITE)
                     {
-#if DEBUG_DIRECT
-                      in_direct_write += i->roi[no].width * i->roi[no].height;
-#endif
-                      gegl_buffer_set_unlocked (i->buffer[no],
-                                                &(i->roi[no]),
-                                                i->format[no],
-                                                i->data[no],
-                                                GEGL_AUTO_ROWSTRIDE);
+                      i->copied_write += i->roi[no].width * i->roi[no].height;
+                      if (i->i[holder].tile != NULL)
+                        gegl_buffer_iterator_copy_tile (i, no, TRUE);
+                      else
+                        gegl_buffer_set_unlocked (i->buffer[no],
+                                                  &(i->roi[no]),
+                                                  i->format[no],
+                                                  i->data[no],
+                                                  GEGL_AUTO_ROWSTRIDE);
                     }
 
-                  /* XXX: might be inefficient given the current
-                   * implementation, it should be easy to reimplement the
-                   * pool as a hash table though
-                   */
                   iterator_buf_pool_release (i->data[no]);
                 }
 
@@ -631,18 +947,14 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
             {
               if (gpu_direct_access)
                 {
-#if DEBUG_DIRECT
                   if (i->flags[no] & GEGL_BUFFER_GPU_WRITE)
-                    direct_write += i->roi[no].width * i->roi[no].height;
-#endif
+                    i->direct_write += i->roi[no].width * i->roi[no].height;
                 }
               else
                 {
                   if (i->flags[no] & GEGL_BUFFER_GPU_WRITE)
                     {
-#if DEBUG_DIRECT
-                      in_direct_write += i->roi[no].width * i->roi[no].height;
-#endif
+                      i->copied_write += i->roi[no].width * i->roi[no].height;
                       gegl_buffer_gpu_set (i->buffer[no],
                                            &i->roi[no],
                                            i->gpu_data[no]);
@@ -674,6 +986,7 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
 
           gint tile_width  = i->i[no].buffer->tile_storage->tile_width;
           gint tile_height = i->i[no].buffer->tile_storage->tile_height;
+          gint holder      = i->share[no] >= 0 ? i->share[no] : no;
 
           gboolean direct_access;
           gboolean gpu_direct_access;
@@ -685,28 +998,32 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
           if (res != result)
             g_error ("%i==%i != 0==%i\n", no, res, result);
 
-          direct_access = (i->flags[no] & GEGL_BUFFER_FORMAT_COMPATIBLE
-                           && i->roi[no].width == tile_width);
+          direct_access = gegl_buffer_iterator_is_direct (i, no);
 
-          gpu_direct_access = (i->roi[no].height == tile_height
-                               && direct_access);
+          gpu_direct_access = (i->flags[no] & GEGL_BUFFER_FORMAT_COMPATIBLE
+                               && i->roi[no].width == tile_width
+                               && i->roi[no].height == tile_height);
 
           if (i->flags[no] & GEGL_BUFFER_READ
               || i->flags[no] & GEGL_BUFFER_WRITE)
             {
               if (direct_access)
                 {
-                  i->data[no] = i->i[no].sub_data;
-#if DEBUG_DIRECT
-                  direct_read += i->roi[no].width * i->roi[no].height;
-#endif
+                  i->data[no]      = i->i[holder].sub_data;
+                  i->rowstride[no] = tile_width *
+                    babl_format_get_bytes_per_pixel (i->format[no]);
+                  i->direct_read += i->roi[no].width * i->roi[no].height;
                 }
               else
                 {
-                  /* unref held tile to prevent lock contention */
-                  if (i->i[no].tile != NULL)
+                  /* unref held tile to prevent lock contention, unless
+                   * later iterables are served from it
+                   */
+                  if (i->i[no].tile != NULL &&
+                      !gegl_buffer_iterator_lends_tile (i, no))
                     {
-                      gegl_tile_unlock (i->i[no].tile);
+                      if (i->i[no].locked)
+                        gegl_tile_unlock (i->i[no].tile);
 
                       gegl_tile_unref (i->i[no].tile);
                       i->i[no].tile = NULL;
@@ -714,19 +1031,23 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
                       i->i[no].sub_data = NULL;
                     }
 
+                  i->rowstride[no] = i->roi[no].width *
+                    babl_format_get_bytes_per_pixel (i->format[no]);
                   i->data[no] = iterator_buf_pool_get (
-                                  i->roi[no].width * i->roi[no].height *
-                              babl_format_get_bytes_per_pixel (i->format[no]));
+                                  i->rowstride[no] * i->roi[no].height);
 
                   if (i->flags[no] & GEGL_BUFFER_READ)
-                    gegl_buffer_get_unlocked (i->buffer[no],
-                                              1.0, &(i->roi[no]),
-                                              i->format[no], 
-                                              i->data[no],
-                                              GEGL_AUTO_ROWSTRIDE);
-#if DEBUG_DIRECT
-                  in_direct_read += i->roi[no].width * i->roi[no].height;
-#endif
+                    {
+                      if (i->i[holder].tile != NULL)
+                        gegl_buffer_iterator_copy_tile (i, no, FALSE);
+                      else
+                        gegl_buffer_get_unlocked (i->buffer[no],
+                                                  1.0, &(i->roi[no]),
+                                                  i->format[no],
+                                                  i->data[no],
+                                                  GEGL_AUTO_ROWSTRIDE);
+                    }
+                  i->copied_read += i->roi[no].width * i->roi[no].height;
                 }
             }
 
@@ -737,16 +1058,15 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
               if (gpu_direct_access)
                 {
                   i->gpu_data[no] = i->i[no].gpu_data;
-#if DEBUG_DIRECT
-                  direct_read += i->roi[no].width * i->roi[no].height;
-#endif
+                  i->direct_read += i->roi[no].width * i->roi[no].height;
                 }
               else
                 {
                   /* unref held tile to prevent lock contention */
                   if (i->i[no].tile != NULL)
                     {
-                      gegl_tile_unlock (i->i[no].tile);
+                      if (i->i[no].locked)
+                        gegl_tile_unlock (i->i[no].tile);
 
                       gegl_tile_unref (i->i[no].tile);
                       i->i[no].tile = NULL;
@@ -764,9 +1084,7 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
                                          1.0,
                                          &i->roi[no],
                                          i->gpu_data[no]);
-#if DEBUG_DIRECT
-                  in_direct_read += i->roi[no].width * i->roi[no].height;
-#endif
+                  i->copied_read += i->roi[no].width * i->roi[no].height;
                 }
             }
 #endif
@@ -781,9 +1099,10 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
           if (i->flags[no] & GEGL_BUFFER_READ
               || i->flags[no] & GEGL_BUFFER_WRITE)
             {
-              i->data[no] = iterator_buf_pool_get (i->roi[no].width *
-                                                   i->roi[no].height *
-                               babl_format_get_bytes_per_pixel (i->format[no]));
+              i->rowstride[no] = i->roi[no].width *
+                babl_format_get_bytes_per_pixel (i->format[no]);
+              i->data[no] = iterator_buf_pool_get (i->rowstride[no] *
+                                                   i->roi[no].height);
 
               if (i->flags[no] & GEGL_BUFFER_READ)
                 gegl_buffer_get (i->buffer[no],
@@ -792,9 +1111,7 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
                                  i->format[no],
                                  i->data[no],
                                  GEGL_AUTO_ROWSTRIDE);
-#if DEBUG_DIRECT
-              in_direct_read += i->roi[no].width * i->roi[no].height;
-#endif
+              i->copied_read += i->roi[no].width * i->roi[no].height;
             }
 
 #if HAVE_GPU
@@ -811,9 +1128,7 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
                                      1.0,
                                      &i->roi[no],
                                      i->gpu_data[no]);
-#if DEBUG_DIRECT
-              in_direct_read += i->roi[no].width * i->roi[no].height;
-#endif
+              i->copied_read += i->roi[no].width * i->roi[no].height;
             }
 #endif
         }
@@ -827,7 +1142,7 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
     {
 
 #if ENABLE_MT
-      for (no=0; no<i->iterable_count;no++)
+      for (no=0; no<i->iterable_count && !i->is_chunk; no++)
         {
           gint j;
           gboolean found = FALSE;
@@ -848,11 +1163,13 @@ gegl_buffer_iterator_next (GeglBufferIterator *iterator)
           i->buffer[no] = NULL;
         }
 
-#if DEBUG_DIRECT
-      g_print ("%f %f\n",
-               100.0 * direct_read / (in_direct_read + direct_read),
-               100.0 * direct_write / (in_direct_write + direct_write));
-#endif
+      g_static_mutex_lock (&direct_mutex);
+      stats_direct_read  += i->direct_read;
+      stats_direct_write += i->direct_write;
+      stats_copied_read  += i->copied_read;
+      stats_copied_write += i->copied_write;
+      g_static_mutex_unlock (&direct_mutex);
+
       i->is_done = TRUE;
     }
 
@@ -877,6 +1194,10 @@ gegl_buffer_iterator_free (GeglBufferIterator *iterator)
 
   _GeglBufferIterator *i = (gpointer) iterator;
 
+  if (i->chunk)
+    gegl_buffer_iterator_free ((GeglBufferIterator *) i->chunk);
+  g_free (i->chunks);
+
   for (cnt = 0; cnt < i->iterable_count; cnt++)
     {
       if (i->buffer[cnt] != NULL)
@@ -891,3 +1212,139 @@ gegl_buffer_iterator_free (GeglBufferIterator *iterator)
 
   g_free (i);
 }
+
+/* divides the first rect into runs of up to GEGL_ITERATOR_CHUNK_TILES tiles
+ * along the tile rows of the first buffer, every chunk starts and ends on
+ * tile boundaries unless it touches the edge of the rect.
+ */
+static void
+gegl_buffer_iterator_make_chunks (_GeglBufferIterator *i)
+{
+  GeglBuffer *buffer      = i->buffer[0];
+  gint        tile_width  = buffer->tile_storage->tile_width;
+  gint        tile_height = buffer->tile_storage->tile_height;
+  gint        shift_x     = buffer->shift_x;
+  gint        shift_y     = buffer->shift_y;
+  gint        x1          = i->rect[0].x + i->rect[0].width;
+  gint        y1          = i->rect[0].y + i->rect[0].height;
+  GArray     *chunks      = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
+  gint        x, y;
+
+  for (y = i->rect[0].y; y < y1; )
+    {
+      gint next_y = MIN (y + tile_height -
+                         gegl_tile_offset (y + shift_y, tile_height), y1);
+
+      for (x = i->rect[0].x; x < x1; )
+        {
+          GeglRectangle chunk = { x, y, 0, next_y - y };
+          gint          next_x = x;
+          gint          tiles;
+
+          for (tiles = 0; tiles < GEGL_ITERATOR_CHUNK_TILES && next_x < x1;
+               tiles++)
+            next_x += tile_width - gegl_tile_offset (next_x + shift_x,
+                                                     tile_width);
+          next_x = MIN (next_x, x1);
+
+          chunk.width = next_x - x;
+          g_array_append_val (chunks, chunk);
+          x = next_x;
+        }
+      y = next_y;
+    }
+
+  i->n_chunks   = chunks->len;
+  i->next_chunk = 0;
+  i->chunks     = (GeglRectangle *) g_array_free (chunks, FALSE);
+}
+
+GeglBufferIterator *
+gegl_buffer_iterator_split (GeglBufferIterator *iterator)
+{
+  _GeglBufferIterator *i = (gpointer) iterator;
+  _GeglBufferIterator *split;
+
+  g_return_val_if_fail (i->iterable_count > 0, NULL);
+  g_return_val_if_fail (i->iteration_no == 0 && i->parent == NULL, NULL);
+
+  if (i->chunks == NULL)
+    gegl_buffer_iterator_make_chunks (i);
+
+  split = g_new0 (_GeglBufferIterator, 1);
+  split->parent         = i;
+  split->iterable_count = i->iterable_count;
+  return (GeglBufferIterator *) split;
+}
+
+/* starts a regular iteration over one chunk of the parent, the other
+ * iterables are offset the same way they are relative to the first one
+ */
+static _GeglBufferIterator *
+gegl_buffer_iterator_chunk_new (_GeglBufferIterator *parent,
+                                const GeglRectangle *chunk)
+{
+  _GeglBufferIterator *i = g_new0 (_GeglBufferIterator, 1);
+  gint                 no;
+
+  for (no = 0; no < parent->iterable_count; no++)
+    {
+      GeglRectangle roi = *chunk;
+
+      roi.x += parent->rect[no].x - parent->rect[0].x;
+      roi.y += parent->rect[no].y - parent->rect[0].y;
+
+      gegl_buffer_iterator_add ((GeglBufferIterator *) i,
+                                parent->buffer[no], &roi,
+                                parent->format[no],
+                                parent->flags[no] &
+                                  ~(GEGL_BUFFER_SCAN_COMPATIBLE |
+                                    GEGL_BUFFER_FORMAT_COMPATIBLE));
+    }
+  i->is_chunk = TRUE;
+  return i;
+}
+
+static gboolean
+gegl_buffer_iterator_split_next (_GeglBufferIterator *i)
+{
+  _GeglBufferIterator *parent = i->parent;
+  gint                 no;
+
+  if (i->is_done)
+    g_error ("%s called on finished buffer iterator", G_STRFUNC);
+
+  for (;;)
+    {
+      gint n;
+
+      if (i->chunk)
+        {
+          if (gegl_buffer_iterator_next ((GeglBufferIterator *) i->chunk))
+            {
+              i->length = i->chunk->length;
+              for (no = 0; no < i->iterable_count; no++)
+                {
+                  i->data[no]      = i->chunk->data[no];
+                  i->roi[no]       = i->chunk->roi[no];
+                  i->rowstride[no] = i->chunk->rowstride[no];
+#if HAVE_GPU
+                  i->gpu_data[no] = i->chunk->gpu_data[no];
+#endif
+                }
+              i->iteration_no++;
+              return TRUE;
+            }
+          gegl_buffer_iterator_free ((GeglBufferIterator *) i->chunk);
+          i->chunk = NULL;
+        }
+
+      n = g_atomic_int_exchange_and_add (&parent->next_chunk, 1);
+      if (n >= parent->n_chunks)
+        break;
+      i->chunk = gegl_buffer_iterator_chunk_new (parent, &parent->chunks[n]);
+    }
+
+  i->is_done = TRUE;
+  return FALSE;
+}
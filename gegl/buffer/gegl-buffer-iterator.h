@@ -35,13 +35,20 @@
 #define GEGL_BUFFER_ALL_WRITE     (GEGL_BUFFER_WRITE | GEGL_BUFFER_GPU_WRITE)
 #define GEGL_BUFFER_ALL           (GEGL_BUFFER_READ_ALL | GEGL_BUFFER_WRITE_ALL)
 
+/* the caller walks the data of this iterable using rowstride[], this lets
+ * the iterator hand out rectangles within a tile in place instead of
+ * copying them when they are narrower than the tile
+ */
+#define GEGL_BUFFER_STRIDED       (1 << 4)
+
 typedef struct GeglBufferIterator
 {
   gint            length;
 
-  gpointer        data    [GEGL_BUFFER_MAX_ITERABLES];
-  GeglRectangle   roi     [GEGL_BUFFER_MAX_ITERABLES];
-  GeglGpuTexture *gpu_data[GEGL_BUFFER_MAX_ITERABLES];
+  gpointer        data     [GEGL_BUFFER_MAX_ITERABLES];
+  GeglRectangle   roi      [GEGL_BUFFER_MAX_ITERABLES];
+  gint            rowstride[GEGL_BUFFER_MAX_ITERABLES]; /* in bytes */
+  GeglGpuTexture *gpu_data [GEGL_BUFFER_MAX_ITERABLES];
 
 } GeglBufferIterator;
 
@@ -54,7 +61,9 @@ typedef struct GeglBufferIterator
  * @flags: whether we need reading or writing to this buffer. One of
  * GEGL_BUFFER_READ, GEGL_BUFFER_WRITE, GEGL_BUFFER_READWRITE,
  * GEGL_BUFFER_GPU_READ, GEGL_BUFFER_GPU_WRITE, GEGL_BUFFER_GPU_READWRITE,
- * GEGL_BUFFER_ALL_READ, GEGL_BUFFER_ALL_WRITE and GEGL_BUFFER_ALL.
+ * GEGL_BUFFER_ALL_READ, GEGL_BUFFER_ALL_WRITE and GEGL_BUFFER_ALL, or'ed
+ * with GEGL_BUFFER_STRIDED when the data will be accessed with the rowstride
+ * of the iterable instead of as length consecutive pixels.
  *
  * Create a new buffer iterator, this buffer will be iterated through
  * in linear chunks, some chunks might be full tiles the coordinates, see
@@ -108,6 +117,23 @@ gint                gegl_buffer_iterator_add     (GeglBufferIterator  *iterator,
  */
 gboolean            gegl_buffer_iterator_next    (GeglBufferIterator *iterator);
 
+/**
+ * gegl_buffer_iterator_split:
+ * @iterator: a #GeglBufferIterator with all buffers added that has not been
+ * iterated.
+ *
+ * Creates an iterator sharing the work of @iterator with all other iterators
+ * split from it. The split iterators take tile aligned chunks of the region
+ * from a common cursor, every thread can iterate its own split iterator with
+ * gegl_buffer_iterator_next and between them they visit every pixel once.
+ * Only the tiles of the chunks being processed are locked, not the whole
+ * buffers. Split iterators have to be freed with gegl_buffer_iterator_free
+ * before @iterator, @iterator itself is not iterated.
+ *
+ * Returns: a new buffer iterator.
+ */
+GeglBufferIterator *gegl_buffer_iterator_split   (GeglBufferIterator *iterator);
+
 void                gegl_buffer_iterator_cleanup (void);
 
 #ifdef EXAMPLE
@@ -84,23 +84,23 @@ gegl_buffer_linear_new_from_data (const gpointer       data,
   {
     GeglTile *tile = gegl_tile_new_bare (); 
 
-    tile->rev        = 1;
-    tile->stored_rev = 1;
+    tile->rev = 1;
+    gegl_tile_mark_as_stored (tile);
     tile->tile_storage = buffer->tile_storage;
     tile->x = 0;
     tile->y = 0;
     tile->z = 0;
     tile->data       = (gpointer)data;
+    /* the pixels are owned by the caller */
+    tile->destroy_notify = NULL;
     tile->size       = babl_format_get_bytes_per_pixel (format) * rowstride * extent->height;
-    tile->next_shared = tile;
-    tile->prev_shared = tile;
 
     {
       GeglTileHandlerCache *cache = g_object_get_data (G_OBJECT (buffer->tile_storage), "cache");
       if (cache)
         gegl_tile_handler_cache_insert (cache, tile, 0, 0, 0);
     }
-    g_object_unref (tile);
+    gegl_tile_unref (tile);
   }
 
   return buffer;
@@ -108,162 +108,441 @@ gegl_buffer_linear_new_from_data (const gpointer       data,
 
 /* the information kept about a linear buffer, multiple requests can
  * be handled by the same structure, the multiple clients would have
- * an immediate shared access to the linear buffer.
+ * an immediate shared access to the linear buffer. Direct views point
+ * into the data of the tile they are locked on, copies are allocated
+ * at mem and written back on close when opened for writing. Views of
+ * the tile of a direct view are served from it and keep it open.
  */
-typedef struct {
+typedef struct _BufferInfo BufferInfo;
+
+struct _BufferInfo {
   gpointer       buf;
+  gpointer       mem;
+  GeglTile      *tile;
+  GeglRectangle  tile_rect;  /* the part of the buffer in tile */
+  BufferInfo    *direct;     /* the direct view this one is served from */
   GeglRectangle  extent;
   const Babl    *format;
+  gint           rowstride;
+  guint          flags;
+  gint           alignment;
   gint           refs;
-} BufferInfo;
+};
+
+/* the largest alignment that can be asked for */
+#define LINEAR_MAX_ALIGNMENT 64
 
-/* FIXME: make this use direct data access in more cases than the
- * case of the base buffer.
+/* The views of the buffers of a storage belong to one thread at a time,
+ * the storage mutex is held from the first view a thread opens to the
+ * last one it closes. The tile of a direct view stays locked for writing
+ * while it is open, the views of the thread that lie within it are served
+ * from the view, and its other accesses to the tile go through the lock
+ * of the view, see gegl_buffer_linear_lock_tile.
  */
-gpointer *
-gegl_buffer_linear_open (GeglBuffer          *buffer,
-                         const GeglRectangle *extent,   /* if NULL, use buf  */
-                         gint                *rowstride,/* returns rowstride */
-                         const Babl          *format)   /* if NULL, from buf */
+static void
+linear_lock (GeglBuffer *buffer)
 {
-  if (!format)
-    format = buffer->format;
+  GeglTileStorage *storage = buffer->tile_storage;
 
-  if (extent == NULL)
-    extent=&buffer->extent;
-
-  /*gegl_buffer_lock (buffer);*/
+  if (g_atomic_pointer_get (&storage->linear_owner) != g_thread_self ())
+    {
+      /*gegl_buffer_lock (buffer);*/
 #if ENABLE_MT
-  g_mutex_lock (buffer->tile_storage->mutex);
+      g_mutex_lock (storage->mutex);
 #endif
-  if (extent->x     == buffer->extent.x &&
-      extent->y     == buffer->extent.y &&
-      extent->width == buffer->tile_width &&
-      extent->height <= buffer->tile_height &&
-      buffer->format == format)
+      g_atomic_pointer_set (&storage->linear_owner, g_thread_self ());
+    }
+  storage->linear_depth++;
+}
+
+static void
+linear_unlock (GeglBuffer *buffer)
+{
+  GeglTileStorage *storage = buffer->tile_storage;
+
+  if (--storage->linear_depth == 0)
     {
-      GeglTile *tile;
+      g_atomic_pointer_set (&storage->linear_owner, NULL);
+      /*gegl_buffer_unlock (buffer);*/
+#if ENABLE_MT
+      g_mutex_unlock (storage->mutex);
+#endif
+    }
+}
 
-      g_assert (buffer->tile_width <= buffer->tile_storage->tile_width);
-      g_assert (buffer->tile_height == buffer->tile_storage->tile_height);
+/* whether tile is locked by a direct view of the calling thread, the
+ * owner is compared first to keep the accesses of other threads cheap
+ */
+static inline gboolean
+linear_holds_tile (GeglTile *tile)
+{
+  GeglTileStorage *storage = tile->tile_storage;
+  gpointer         owner;
+
+  if (storage == NULL)
+    return FALSE;
+  owner = g_atomic_pointer_get (&storage->linear_owner);
+  return owner != NULL && owner == (gpointer) g_thread_self () &&
+         g_slist_find (storage->linear_tiles, tile) != NULL;
+}
 
-      tile = g_object_get_data (G_OBJECT (buffer), "linear-tile");
-      g_assert (tile == NULL); /* We need to reference count returned direct
-                                * linear buffers to allow multiple open like
-                                * the copying case.
-                                */
-      tile = gegl_tile_source_get_tile ((GeglTileSource*) (buffer),
-                                        0,0,0);
-      g_assert (tile);
-      gegl_tile_lock (tile, GEGL_TILE_LOCK_READWRITE);
+gboolean
+gegl_buffer_linear_lock_tile (GeglTile         *tile,
+                              GeglTileLockMode  lock_mode)
+{
+  /* the GPU data of the tile is only synced when it is locked */
+  if (!(lock_mode & (GEGL_TILE_LOCK_GPU_READ | GEGL_TILE_LOCK_GPU_WRITE)) &&
+      linear_holds_tile (tile))
+    return FALSE;
 
-      g_object_set_data (G_OBJECT (buffer), "linear-tile", tile);
+  gegl_tile_lock (tile, lock_mode);
+  return TRUE;
+}
 
-      if(rowstride)*rowstride = buffer->tile_storage->tile_width * babl_format_get_bytes_per_pixel (format);
-      return (gpointer)gegl_tile_get_data (tile);
-    }
-  /* first check if there is a linear buffer, share the existing buffer if one
-   * exists.
-   */
+gboolean
+gegl_buffer_linear_has_views (GeglTileStorage *storage)
+{
+  return g_atomic_pointer_get (&storage->linear_owner) != NULL;
+}
+
+/* returns the direct view whose tile rect touches, expects the caller to
+ * own the views of the buffer
+ */
+static BufferInfo *
+linear_find_direct (GeglBuffer          *buffer,
+                    const GeglRectangle *rect)
+{
+  GList *iter;
+
+  for (iter = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
+       iter; iter = iter->next)
     {
-      GList *linear_buffers;
-      GList *iter;
-      BufferInfo *info = NULL;
-      linear_buffers = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
+      BufferInfo *info = iter->data;
 
-      for (iter = linear_buffers; iter; iter=iter->next)
-        {
-          info = iter->data;
-          if (info->format        == format           &&
-              info->extent.x      == buffer->extent.x &&
-              info->extent.y      == buffer->extent.y &&
-              info->extent.width  == buffer->extent.width &&
-              info->extent.height == buffer->extent.height
-              )
-            {
-              info->refs++;
-              g_print ("!!!!!! sharing a linear buffer!!!!!\n");
-              return info->buf;
-            }
-        }
+      if (info->tile && gegl_rectangle_intersect (NULL, &info->tile_rect, rect))
+        return info;
     }
-
-  {
-    BufferInfo *info = g_new0 (BufferInfo, 1);
-    GList *linear_buffers;
-    gint rs;
-    linear_buffers = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
-    linear_buffers = g_list_append (linear_buffers, info);
-    g_object_set_data (G_OBJECT (buffer), "linear-buffers", linear_buffers);
-
-    info->extent = *extent;
-    info->format = format;
-
-    rs = info->extent.width * babl_format_get_bytes_per_pixel (format);
-    if(rowstride)*rowstride = rs;
-
-    info->buf = gegl_malloc (rs * info->extent.height);
-    gegl_buffer_get_unlocked (buffer, 1.0, &info->extent, format, info->buf, rs);
-    return info->buf;
-  }
   return NULL;
 }
 
-void
-gegl_buffer_linear_close (GeglBuffer *buffer,
-                          gpointer    linear)
+static inline gboolean
+linear_aligned (gconstpointer ptr,
+                gint          rowstride,
+                gint          alignment)
+{
+  return ((gsize) ptr & (alignment - 1)) == 0 &&
+         (rowstride & (alignment - 1)) == 0;
+}
+
+/* returns the pixel at the top left of rect, which has to lie within the
+ * tile of direct
+ */
+static inline guchar *
+linear_direct_pixel (BufferInfo          *direct,
+                     const GeglRectangle *rect)
 {
-  GeglTile *tile;
-  tile = g_object_get_data (G_OBJECT (buffer), "linear-tile");
-  if (tile)
+  gint bpp = babl_format_get_bytes_per_pixel (direct->format);
+
+  return gegl_tile_get_data (direct->tile) +
+         (rect->y - direct->tile_rect.y) * direct->rowstride +
+         (rect->x - direct->tile_rect.x) * bpp;
+}
+
+static void
+linear_convert (const guchar *src,
+                gint          src_stride,
+                const Babl   *src_format,
+                guchar       *dst,
+                gint          dst_stride,
+                const Babl   *dst_format,
+                gint          width,
+                gint          height)
+{
+  Babl *fish = babl_fish ((gpointer) src_format, (gpointer) dst_format);
+
+  while (height--)
+    {
+      babl_process (fish, (gpointer) src, dst, width);
+      src += src_stride;
+      dst += dst_stride;
+    }
+}
+
+/* a view straight into the tile holding all of extent, when the rows of
+ * the tile satisfy the layout asked for: packed rows without an
+ * alignment, aligned rows otherwise. The tile is locked for writing even
+ * for a read-only view, the thread may write to the rest of it.
+ */
+static gboolean
+linear_open_direct (GeglBuffer *buffer,
+                    BufferInfo *info)
+{
+  GeglTileStorage *storage     = buffer->tile_storage;
+  gint             tile_width  = storage->tile_width;
+  gint             tile_height = storage->tile_height;
+  gint             bpp         = babl_format_get_bytes_per_pixel (info->format);
+  gint             tile_stride = tile_width * bpp;
+  gint             x           = info->extent.x + buffer->shift_x;
+  gint             y           = info->extent.y + buffer->shift_y;
+  gint             offset_x    = gegl_tile_offset (x, tile_width);
+  gint             offset_y    = gegl_tile_offset (y, tile_height);
+  GeglTile        *tile;
+  guchar          *data;
+
+  if (info->format != buffer->format ||
+      offset_x + info->extent.width  > tile_width ||
+      offset_y + info->extent.height > tile_height ||
+      !gegl_rectangle_contains (&buffer->abyss, &info->extent))
+    return FALSE;
+
+  if (info->alignment == 0 ?
+      tile_stride != info->extent.width * bpp :
+      (tile_stride & (info->alignment - 1)) != 0)
+    return FALSE;
+
+  tile = gegl_tile_source_get_tile ((GeglTileSource *) buffer,
+                                    gegl_tile_index (x, tile_width),
+                                    gegl_tile_index (y, tile_height), 0);
+  if (!tile)
+    return FALSE;
+
+  /* held by a direct view of another buffer of the storage */
+  if (g_slist_find (storage->linear_tiles, tile))
+    {
+      gegl_tile_unref (tile);
+      return FALSE;
+    }
+
+  gegl_tile_lock (tile, GEGL_TILE_LOCK_READWRITE);
+  data = gegl_tile_get_data (tile) + (offset_y * tile_width + offset_x) * bpp;
+
+  if (info->alignment && !linear_aligned (data, tile_stride, info->alignment))
     {
       gegl_tile_unlock (tile);
-      g_object_set_data (G_OBJECT (buffer), "linear-tile", NULL);
-      tile = NULL;
+      gegl_tile_unref (tile);
+      return FALSE;
     }
+
+  storage->linear_tiles  = g_slist_prepend (storage->linear_tiles, tile);
+  info->tile             = tile;
+  info->tile_rect.x      = info->extent.x - offset_x;
+  info->tile_rect.y      = info->extent.y - offset_y;
+  info->tile_rect.width  = tile_width;
+  info->tile_rect.height = tile_height;
+  info->buf              = data;
+  info->rowstride        = tile_stride;
+  return TRUE;
+}
+
+/* a view of part of the tile of an open direct view, pointing into the
+ * tile when the layout allows it
+ */
+static gboolean
+linear_open_borrowed (BufferInfo *direct,
+                      BufferInfo *info)
+{
+  gint    bpp  = babl_format_get_bytes_per_pixel (info->format);
+  guchar *data = linear_direct_pixel (direct, &info->extent);
+
+  direct->refs++;
+  info->direct = direct;
+
+  if (info->format != direct->format ||
+      (info->alignment == 0 ?
+       direct->rowstride != info->extent.width * bpp :
+       !linear_aligned (data, direct->rowstride, info->alignment)))
+    return FALSE;
+
+  info->buf       = data;
+  info->rowstride = direct->rowstride;
+  return TRUE;
+}
+
+static void
+linear_open_copy (GeglBuffer *buffer,
+                  BufferInfo *info)
+{
+  gint   alignment = MAX (info->alignment, 16);
+  gint   rs        = info->extent.width *
+                     babl_format_get_bytes_per_pixel (info->format);
+  gsize  start;
+
+  if (info->alignment)
+    rs = (rs + alignment - 1) & ~(alignment - 1);
+
+  info->mem       = g_malloc (rs * info->extent.height + alignment);
+  start           = ((gsize) info->mem + alignment - 1) & ~(gsize) (alignment - 1);
+  info->buf       = (guchar *) info->mem + (start - (gsize) info->mem);
+  info->rowstride = rs;
+
+  if (!(info->flags & GEGL_BUFFER_READ))
+    return;
+
+  if (info->direct)
+    linear_convert (linear_direct_pixel (info->direct, &info->extent),
+                    info->direct->rowstride, info->direct->format,
+                    info->buf, rs, info->format,
+                    info->extent.width, info->extent.height);
   else
-    {
-      GList *linear_buffers;
-      GList *iter;
-      BufferInfo *info = NULL;
-      linear_buffers = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
+    gegl_buffer_get_unlocked (buffer, 1.0, &info->extent, info->format,
+                              info->buf, rs);
+}
+
+/* drops a reference to a view, writing it back and releasing it with
+ * the last one
+ */
+static void
+linear_release (GeglBuffer *buffer,
+                BufferInfo *info)
+{
+  GList *linear_buffers;
 
-      for (iter = linear_buffers; iter; iter=iter->next)
+  /* there are still others holding a reference to this linear buffer */
+  if (--info->refs > 0)
+    return;
+
+  if (info->tile)
+    {
+      buffer->tile_storage->linear_tiles =
+        g_slist_remove (buffer->tile_storage->linear_tiles, info->tile);
+      gegl_tile_unlock (info->tile);
+      gegl_tile_unref (info->tile);
+    }
+  else if (info->mem)
+    {
+      if (info->flags & GEGL_BUFFER_WRITE)
         {
-          info = iter->data;
-          if (info->buf == linear)
-            {
-              info->refs--;
-
-              if (info->refs>0)
-                {
-                  g_print ("EEeeek! %s\n", G_STRLOC);
-                return; /* there are still others holding a reference to
-                         * this linear buffer
-                         */
-                }
-
-              gegl_buffer_set_unlocked (buffer, &info->extent, info->format, info->buf, 0);
-              break;
-            }
+          if (info->direct)
+            linear_convert (info->buf, info->rowstride, info->format,
+                            linear_direct_pixel (info->direct, &info->extent),
+                            info->direct->rowstride, info->direct->format,
+                            info->extent.width, info->extent.height);
           else
-            {
-              info = NULL;
-            }
+            gegl_buffer_set_unlocked (buffer, &info->extent, info->format,
+                                      info->buf, info->rowstride);
         }
+      g_free (info->mem);
+    }
+
+  if (info->direct)
+    linear_release (buffer, info->direct);
 
-      if (info)
+  linear_buffers = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
+  linear_buffers = g_list_remove (linear_buffers, info);
+  g_object_set_data (G_OBJECT (buffer), "linear-buffers", linear_buffers);
+  g_free (info);
+}
+
+gpointer
+gegl_buffer_linear_open_full (GeglBuffer          *buffer,
+                              const GeglRectangle *extent,
+                              gint                *rowstride,
+                              const Babl          *format,
+                              guint                flags,
+                              gint                 alignment)
+{
+  BufferInfo *info;
+  BufferInfo *direct;
+  GList      *linear_buffers;
+  GList      *iter;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (alignment >= 0 &&
+                        alignment <= LINEAR_MAX_ALIGNMENT &&
+                        (alignment & (alignment - 1)) == 0, NULL);
+  g_return_val_if_fail (alignment == 0 || rowstride != NULL, NULL);
+
+  if (!format)
+    format = buffer->format;
+
+  if (extent == NULL)
+    extent=&buffer->extent;
+
+  linear_lock (buffer);
+
+  /* first check if there is a linear buffer, share the existing buffer if one
+   * exists.
+   */
+  linear_buffers = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
+  for (iter = linear_buffers; iter; iter=iter->next)
+    {
+      info = iter->data;
+      if (info->format        == format         &&
+          info->alignment     == alignment      &&
+          (info->flags & flags) == flags        &&
+          gegl_rectangle_equal (&info->extent, extent))
         {
-          linear_buffers = g_list_remove (linear_buffers, linear);
-          gegl_free (info->buf);
-          g_free (info);
+          info->refs++;
+          if (rowstride)
+            *rowstride = info->rowstride;
+          return info->buf;
         }
+    }
+
+  info = g_new0 (BufferInfo, 1);
+  info->extent    = *extent;
+  info->format    = format;
+  info->flags     = flags;
+  info->alignment = alignment;
+  info->refs      = 1;
 
-      g_object_set_data (G_OBJECT (buffer), "linear-buffers", linear_buffers);
+  /* a view within the tile of a direct view is served from it, other
+   * views touching the tile are copies accessing it under its lock
+   */
+  direct = linear_find_direct (buffer, extent);
+  if (direct == NULL)
+    {
+      if (!linear_open_direct (buffer, info))
+        linear_open_copy (buffer, info);
     }
-  /*gegl_buffer_unlock (buffer);*/
-#if ENABLE_MT
-  g_mutex_unlock (buffer->tile_storage->mutex);
-#endif
-  return;
+  else if (!gegl_rectangle_contains (&direct->tile_rect, extent) ||
+           !linear_open_borrowed (direct, info))
+    {
+      linear_open_copy (buffer, info);
+    }
+
+  linear_buffers = g_list_append (linear_buffers, info);
+  g_object_set_data (G_OBJECT (buffer), "linear-buffers", linear_buffers);
+
+  if (rowstride)
+    *rowstride = info->rowstride;
+  return info->buf;
+}
+
+gpointer *
+gegl_buffer_linear_open (GeglBuffer          *buffer,
+                         const GeglRectangle *extent,   /* if NULL, use buf  */
+                         gint                *rowstride,/* returns rowstride */
+                         const Babl          *format)   /* if NULL, from buf */
+{
+  return gegl_buffer_linear_open_full (buffer, extent, rowstride, format,
+                                       GEGL_BUFFER_READWRITE, 0);
+}
+
+void
+gegl_buffer_linear_close (GeglBuffer *buffer,
+                          gpointer    linear)
+{
+  GList      *linear_buffers;
+  GList      *iter;
+  BufferInfo *info = NULL;
+
+  linear_buffers = g_object_get_data (G_OBJECT (buffer), "linear-buffers");
+
+  for (iter = linear_buffers; iter; iter=iter->next)
+    {
+      info = iter->data;
+      if (info->buf == linear)
+        break;
+      info = NULL;
+    }
+
+  if (!info)
+    {
+      g_warning ("%s: %p is not an open linear buffer", G_STRFUNC, linear);
+      return;
+    }
+
+  linear_release (buffer, info);
+  linear_unlock (buffer);
 }
@@ -48,6 +48,7 @@
 #include "gegl-cache.h"
 #include "gegl-region.h"
 #include "gegl-buffer-index.h"
+#include "gegl-tile-codec.h"
 #include "gegl-debug.h"
 
 #include <glib/gprintf.h>
@@ -84,6 +85,21 @@ static void seekto(LoadInfo *info, gint offset)
     }
 }
 
+static gsize
+load_read (LoadInfo *info,
+           guchar   *dest,
+           gsize     length)
+{
+#if HAVE_GIO
+  return g_input_stream_read (info->i, dest, length, NULL, NULL);
+#else
+  ssize_t sz_read = read (info->i, dest, length);
+  if (sz_read == -1)
+    return 0;
+  return sz_read;
+#endif
+}
+
 static void
 load_info_destroy (LoadInfo *info)
 {
@@ -185,6 +201,7 @@ static GeglBufferItem *read_block (int           i,
   GeglBufferItem *ret;
   gsize           byte_read = 0;
   gint            own_size=0;
+  gint            alloc_size;
 
   if (*offset==0)
     return NULL;
@@ -215,11 +232,17 @@ static GeglBufferItem *read_block (int           i,
         case GEGL_FLAG_FREE_TILE:
           own_size = sizeof (GeglBufferTile); 
           break;
+        case GEGL_FLAG_COMPRESSED_TILE:
+          own_size = sizeof (GeglBufferCompressedTile);
+          break;
         default:
           g_warning ("skipping unknown type of entry flags=%i", block.flags);
           break;
      }
 
+  /* tile entries can be turned into compressed ones in place */
+  alloc_size = own_size ? MAX (own_size, (gint) sizeof (GeglBufferCompressedTile)) : 0;
+
   if (block.length != own_size)
     {
       GEGL_NOTE(GEGL_DEBUG_BUFFER_LOAD, "read block of size %i which is different from expected %i only using available expected",
@@ -232,7 +255,7 @@ static GeglBufferItem *read_block (int           i,
       /* we discard any excess information that might have been added in later
        * versions
        */
-      ret = g_malloc (own_size);
+      ret = g_malloc0 (alloc_size);
       memcpy (ret, &block, sizeof (GeglBufferBlock));
 #if HAVE_GIO
       byte_read += g_input_stream_read (i, ((gchar*)ret) + sizeof(GeglBufferBlock),
@@ -250,7 +273,7 @@ static GeglBufferItem *read_block (int           i,
     }
   else if (block.length < own_size)
     {
-      ret = g_malloc (own_size);
+      ret = g_malloc0 (alloc_size);
       memcpy (ret, &block, sizeof (GeglBufferBlock));
 #if HAVE_GIO
       byte_read += g_input_stream_read (i, ((gchar*)ret) + sizeof(GeglBufferBlock),
@@ -379,8 +402,10 @@ gegl_buffer_load (const gchar *path)
 
   /* load each tile */
   {
-    GList *iter;
-    gint   i = 0;
+    GList  *iter;
+    gint    i = 0;
+    guchar *compressed_data = NULL;
+    gint    compressed_size = 0;
     for (iter = info->tiles; iter; iter = iter->next)
       {
         GeglBufferTile *entry = iter->data;
@@ -393,7 +418,7 @@ gegl_buffer_load (const gchar *path)
                                           entry->y,
                                           entry->z);
 
-        if (info->offset != entry->offset)
+        if (info->offset != entry->offset && entry->offset != 0)
           {
             seekto (info, entry->offset);
           }
@@ -406,22 +431,39 @@ gegl_buffer_load (const gchar *path)
         data = gegl_tile_get_data (tile);
         g_assert (data);
 
-#if HAVE_GIO
-        info->offset += g_input_stream_read (info->i, data, info->tile_size,
-                                          NULL, NULL);
-#else
-        {
-          ssize_t sz_read = read (info->i, data, info->tile_size);
-          if(sz_read != -1)
-            info->offset += sz_read;
-        }
-#endif
+        if (entry->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+          {
+            GeglBufferCompressedTile *compressed = iter->data;
+            guchar                   *src        = compressed->pixel;
+            gint                      size       = info->header.bytes_per_pixel;
+
+            /* uniform tiles carry their pixel in the entry */
+            if (compressed->size)
+              {
+                size = compressed->size;
+                if (size > compressed_size)
+                  {
+                    compressed_data = g_realloc (compressed_data, size);
+                    compressed_size = size;
+                  }
+                src = compressed_data;
+                info->offset += load_read (info, compressed_data, size);
+              }
+            gegl_tile_codec_decompress (compressed->codec, src, size,
+                                        data, info->tile_size,
+                                        info->header.bytes_per_pixel);
+          }
+        else
+          {
+            info->offset += load_read (info, data, info->tile_size);
+          }
         /*g_assert (info->offset == entry->offset + info->tile_size);*/
 
         gegl_tile_unlock (tile);
-        g_object_unref (G_OBJECT (tile));
+        gegl_tile_unref (tile);
         i++;
       }
+    g_free (compressed_data);
     GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "%i tiles loaded",i);
   }
   GEGL_NOTE (GEGL_DEBUG_BUFFER_LOAD, "buffer loaded %s", info->path);
@@ -0,0 +1,146 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-buffer-types.h"
+#include "gegl-buffer.h"
+#include "gegl-buffer-private.h"
+#include "gegl-buffer-pool.h"
+#include "gegl-tile.h"
+#include "gegl-tile-storage.h"
+#include "gegl-utils.h"
+
+#define MAX_POOLED 32  /* released buffers kept for reuse */
+
+static GStaticMutex  pool_mutex = G_STATIC_MUTEX_INIT;
+static GQueue        pool       = G_QUEUE_INIT; /* most recently released
+                                                   buffer first */
+
+static volatile gint stats_gets     = 0;
+static volatile gint stats_hits     = 0;
+static volatile gint stats_releases = 0;
+static volatile gint stats_evicted  = 0;
+
+GeglBuffer *
+gegl_buffer_pool_get (const GeglRectangle *extent,
+                      const Babl          *format)
+{
+  GeglBuffer *buffer = NULL;
+  GList      *iter;
+
+  g_atomic_int_inc (&stats_gets);
+
+  g_static_mutex_lock (&pool_mutex);
+  for (iter = pool.head; iter; iter = g_list_next (iter))
+    {
+      GeglBuffer *pooled = iter->data;
+
+      if (pooled->format == format &&
+          gegl_rectangle_equal (&pooled->extent, extent))
+        {
+          buffer = pooled;
+          g_queue_delete_link (&pool, iter);
+          break;
+        }
+    }
+  g_static_mutex_unlock (&pool_mutex);
+
+  if (buffer)
+    {
+      g_atomic_int_inc (&stats_hits);
+      return buffer;
+    }
+
+  buffer = gegl_buffer_new_ram (extent, format);
+  buffer->pooled = TRUE;
+  return buffer;
+}
+
+void
+gegl_buffer_pool_release (GeglBuffer *buffer)
+{
+  GeglBuffer *evicted = NULL;
+
+  g_return_if_fail (GEGL_IS_BUFFER (buffer));
+
+  /* whoever else holds a reference might still use the contents, tiles
+   * of lower zoom levels are not dropped by gegl_buffer_void
+   */
+  if (!buffer->pooled ||
+      g_atomic_int_get ((volatile gint *) &G_OBJECT (buffer)->ref_count) != 1 ||
+      buffer->tile_storage->seen_zoom)
+    {
+      g_object_unref (buffer);
+      return;
+    }
+
+  g_atomic_int_inc (&stats_releases);
+
+  /* make it read as a new buffer again */
+  gegl_buffer_sample_cleanup (buffer);
+  if (buffer->hot_tile)
+    {
+      gegl_tile_unref (buffer->hot_tile);
+      buffer->hot_tile = NULL;
+    }
+  gegl_buffer_void (buffer);
+
+  g_static_mutex_lock (&pool_mutex);
+  g_queue_push_head (&pool, buffer);
+  if (pool.length > MAX_POOLED)
+    evicted = g_queue_pop_tail (&pool);
+  g_static_mutex_unlock (&pool_mutex);
+
+  if (evicted)
+    {
+      g_atomic_int_inc (&stats_evicted);
+      g_object_unref (evicted);
+    }
+}
+
+void
+gegl_buffer_pool_stats (void)
+{
+  gint gets = MAX (stats_gets, 1);
+
+  g_warning ("buffer pool: %i requests, %.1f%% reused, %i released "
+             "%i evicted",
+             stats_gets,
+             stats_hits * 100.0 / gets,
+             stats_releases, stats_evicted);
+}
+
+void
+gegl_buffer_pool_cleanup (void)
+{
+  GList *buffers;
+  GList *iter;
+
+  g_static_mutex_lock (&pool_mutex);
+  buffers = pool.head;
+  g_queue_init (&pool);
+  g_static_mutex_unlock (&pool_mutex);
+
+  for (iter = buffers; iter; iter = g_list_next (iter))
+    g_object_unref (iter->data);
+  g_list_free (buffers);
+}
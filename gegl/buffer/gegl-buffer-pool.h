@@ -0,0 +1,44 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_BUFFER_POOL_H__
+#define __GEGL_BUFFER_POOL_H__
+
+#include "gegl-buffer.h"
+
+G_BEGIN_DECLS
+
+/* The intermediate results of an evaluation are stored in RAM buffers
+ * taken from a pool. A buffer released by its last user has its tiles
+ * dropped and is kept for the next request with the same extent and
+ * format, sparing the construction of a tile storage and handler chain.
+ * The least recently released buffers are destroyed when the pool is
+ * full.
+ */
+GeglBuffer * gegl_buffer_pool_get     (const GeglRectangle *extent,
+                                       const Babl          *format);
+
+/* drops a reference to buffer, when it was the last one and buffer came
+ * from the pool it is kept for reuse
+ */
+void         gegl_buffer_pool_release (GeglBuffer          *buffer);
+
+void         gegl_buffer_pool_stats   (void);
+void         gegl_buffer_pool_cleanup (void);
+
+G_END_DECLS
+
+#endif
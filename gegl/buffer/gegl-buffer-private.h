@@ -49,6 +49,8 @@ struct _GeglBuffer
 
   GeglTile         *hot_tile; /* cached tile for speeding up gegl_buffer_get_pixel
                                  and gegl_buffer_set_pixel (1x1 sized gets/sets)*/
+  gint              hot_tile_generation; /* the hot_tile_generation of the
+                                            storage hot_tile was fetched at */
 
   GeglSampler      *sampler; /* cached sampler for speeding up random
                                 access interpolated fetches from the
@@ -68,6 +70,9 @@ struct _GeglBuffer
 
   gint              lock_count;
 
+  gboolean          pooled; /* created by gegl_buffer_pool_get, goes back to
+                               the pool when released by its last user */
+
   gchar            *alloc_stack_trace; /* Stack trace for allocation,
                                           useful for debugging */
 };
@@ -95,6 +100,8 @@ void              gegl_tile_cache_init    (void);
 
 void              gegl_tile_cache_destroy (void);
 
+void              gegl_tile_cache_stats   (void);
+
 GeglTileBackend * gegl_buffer_backend     (GeglBuffer *buffer);
 
 gboolean          gegl_buffer_is_shared   (GeglBuffer *buffer);
@@ -114,10 +121,26 @@ void              gegl_buffer_get_unlocked (GeglBuffer          *buffer,
                                             gpointer             dest_buf,
                                             gint                 rowstride);
 
+/* locks a tile for an access of the pixels of a buffer, the tiles of the
+ * direct linear views of the calling thread are accessed under the lock
+ * of the view instead. Returns whether the tile is to be unlocked after
+ * the access.
+ */
+gboolean          gegl_buffer_linear_lock_tile (GeglTile         *tile,
+                                                GeglTileLockMode  lock_mode);
+
+/* whether linear views of the buffers of storage are open, the tiles of
+ * their direct views can not be replaced in the cache
+ */
+gboolean          gegl_buffer_linear_has_views (GeglTileStorage  *storage);
+
 GeglBuffer *
 gegl_buffer_new_ram (const GeglRectangle *extent,
                      const Babl          *format);
 
+/* drops all the tiles of the buffer, it reads as empty afterwards */
+void              gegl_buffer_void        (GeglBuffer          *buffer);
+
 GType gegl_sampler_type_from_interpolation (GeglInterpolation interpolation);
 
 void            gegl_buffer_sampler           (GeglBuffer     *buffer,
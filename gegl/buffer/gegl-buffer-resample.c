@@ -0,0 +1,391 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+#include <babl/babl.h>
+
+#include "gegl-types.h"
+#include "gegl-cpuaccel.h"
+#include "gegl-simd.h"
+#include "gegl-buffer-resample.h"
+
+typedef enum
+{
+  RESAMPLE_U8,
+  RESAMPLE_U16,
+  RESAMPLE_FLOAT
+} ResampleType;
+
+/* The up to three source pixels contributing along one axis, indices are
+ * stored as byte offsets and are clamped to the source, so pixels past
+ * the edges repeat the edge pixel.
+ */
+typedef struct
+{
+  gint   offset[3];
+  gfloat weight[3];
+} ResampleTap;
+
+typedef void (*ResampleTapFunc) (ResampleTap *tap,
+                                 gdouble      pos,
+                                 gdouble      scale,
+                                 gint         length,
+                                 gint         stride);
+
+static void
+box_tap (ResampleTap *tap,
+         gdouble      pos,
+         gdouble      scale,
+         gint         length,
+         gint         stride)
+{
+  gdouble footprint = 1.0 / scale;
+  gint    center    = floor (pos);
+  gdouble d         = pos - center;
+  gdouble left      = MAX (footprint / 2 - d, 0.0);
+  gdouble right     = MAX (footprint / 2 - (1.0 - d), 0.0);
+
+  tap->offset[0] = CLAMP (center - 1, 0, length - 1) * stride;
+  tap->offset[1] = CLAMP (center,     0, length - 1) * stride;
+  tap->offset[2] = CLAMP (center + 1, 0, length - 1) * stride;
+
+  tap->weight[0] = left / footprint;
+  tap->weight[1] = (footprint - left - right) / footprint;
+  tap->weight[2] = right / footprint;
+}
+
+static void
+bilinear_tap (ResampleTap *tap,
+              gdouble      pos,
+              gdouble      scale,
+              gint         length,
+              gint         stride)
+{
+  /* pixel centers are at .5 */
+  gdouble t     = pos - 0.5;
+  gint    first = floor (t);
+  gdouble frac  = t - first;
+
+  tap->offset[0] = CLAMP (first,     0, length - 1) * stride;
+  tap->offset[1] = CLAMP (first + 1, 0, length - 1) * stride;
+  tap->offset[2] = tap->offset[1];
+
+  tap->weight[0] = 1.0 - frac;
+  tap->weight[1] = frac;
+  tap->weight[2] = 0.0;
+}
+
+static inline gfloat
+load_component (const guchar *src,
+                gint          c,
+                ResampleType  type)
+{
+  switch (type)
+    {
+      case RESAMPLE_U8:  return src[c];
+      case RESAMPLE_U16: return ((const guint16 *) src)[c];
+      default:           return ((const gfloat *) src)[c];
+    }
+}
+
+static inline void
+store_component (guchar       *dst,
+                 gint          c,
+                 gfloat        value,
+                 ResampleType  type)
+{
+  switch (type)
+    {
+      case RESAMPLE_U8:
+        dst[c] = MIN (value + 0.5f, 255.0f);
+        break;
+      case RESAMPLE_U16:
+        ((guint16 *) dst)[c] = MIN (value + 0.5f, 65535.0f);
+        break;
+      default:
+        ((gfloat *) dst)[c] = value;
+    }
+}
+
+/* type and n_taps are constants once resample () is inlined into the
+ * public functions, letting the compiler specialize the loops for them
+ */
+static inline void
+resample_row (guchar             *dst,
+              const guchar      **rows,
+              const gfloat       *row_weight,
+              const ResampleTap  *taps,
+              gint                n_taps,
+              gint                dest_w,
+              gint                components,
+              gint                bpp,
+              ResampleType        type)
+{
+  gint x, c, i, j;
+
+  for (x = 0; x < dest_w; x++)
+    {
+      for (c = 0; c < components; c++)
+        {
+          gfloat sum = 0.0;
+
+          for (j = 0; j < n_taps; j++)
+            {
+              gfloat h = 0.0;
+
+              for (i = 0; i < n_taps; i++)
+                h += taps[x].weight[i] *
+                     load_component (rows[j] + taps[x].offset[i], c, type);
+              sum += row_weight[j] * h;
+            }
+          store_component (dst, c, sum, type);
+        }
+      dst += bpp;
+    }
+}
+
+#ifdef HAS_G4FLOAT
+
+static inline g4float
+load_pixel4 (const guchar *src,
+             ResampleType  type)
+{
+  g4float v;
+
+  switch (type)
+    {
+      case RESAMPLE_U8:
+        return g4float (src[0], src[1], src[2], src[3]);
+      case RESAMPLE_U16:
+        {
+          const guint16 *s = (const guint16 *) src;
+          return g4float (s[0], s[1], s[2], s[3]);
+        }
+      default:
+        memcpy (&v, src, sizeof (v));
+        return v;
+    }
+}
+
+static inline void
+store_pixel4 (guchar       *dst,
+              g4float       v,
+              ResampleType  type)
+{
+  switch (type)
+    {
+      case RESAMPLE_U8:
+        v += g4float_half;
+        dst[0] = MIN (g4floatR (v), 255.0f);
+        dst[1] = MIN (g4floatG (v), 255.0f);
+        dst[2] = MIN (g4floatB (v), 255.0f);
+        dst[3] = MIN (g4floatA (v), 255.0f);
+        break;
+      case RESAMPLE_U16:
+        {
+          guint16 *d = (guint16 *) dst;
+
+          v += g4float_half;
+          d[0] = MIN (g4floatR (v), 65535.0f);
+          d[1] = MIN (g4floatG (v), 65535.0f);
+          d[2] = MIN (g4floatB (v), 65535.0f);
+          d[3] = MIN (g4floatA (v), 65535.0f);
+        }
+        break;
+      default:
+        memcpy (dst, &v, sizeof (v));
+    }
+}
+
+/* four component pixels, all components of a pixel are filtered at once */
+static inline void
+resample_row4 (guchar             *dst,
+               const guchar      **rows,
+               const gfloat       *row_weight,
+               const ResampleTap  *taps,
+               gint                n_taps,
+               gint                dest_w,
+               gint                bpp,
+               ResampleType        type)
+{
+  gint x, j;
+
+  for (x = 0; x < dest_w; x++)
+    {
+      const ResampleTap *tap = &taps[x];
+      g4float            sum = g4float_zero;
+
+      for (j = 0; j < n_taps; j++)
+        {
+          const guchar *row = rows[j];
+          g4float       h;
+
+          h = load_pixel4 (row + tap->offset[0], type) * g4float_all (tap->weight[0]) +
+              load_pixel4 (row + tap->offset[1], type) * g4float_all (tap->weight[1]);
+          if (n_taps == 3)
+            h += load_pixel4 (row + tap->offset[2], type) * g4float_all (tap->weight[2]);
+
+          sum += h * g4float_all (row_weight[j]);
+        }
+      store_pixel4 (dst, sum, type);
+      dst += bpp;
+    }
+}
+
+#endif
+
+static gboolean
+resample_use_simd (void)
+{
+#ifdef HAS_G4FLOAT
+  return (gegl_cpu_accel_get_support () & (GEGL_CPU_ACCEL_X86_SSE2 |
+                                           GEGL_CPU_ACCEL_PPC_ALTIVEC)) != 0;
+#else
+  return FALSE;
+#endif
+}
+
+static inline gboolean
+resample (gpointer         dest_buf,
+          gconstpointer    source_buf,
+          gint             dest_w,
+          gint             dest_h,
+          gint             source_w,
+          gint             source_h,
+          gdouble          offset_x,
+          gdouble          offset_y,
+          gdouble          scale,
+          const Babl      *format,
+          gint             rowstride,
+          ResampleTapFunc  tap_func,
+          gint             n_taps)
+{
+  const Babl   *component  = babl_format_get_type (format, 0);
+  gint          components = babl_format_get_n_components (format);
+  gint          bpp        = babl_format_get_bytes_per_pixel (format);
+  gint          s_rowstride = source_w * bpp;
+  gboolean      vector;
+  ResampleType  type;
+  ResampleTap  *taps;
+  gint          x, y;
+
+  if (component == babl_type ("u8"))
+    type = RESAMPLE_U8;
+  else if (component == babl_type ("u16"))
+    type = RESAMPLE_U16;
+  else if (component == babl_type ("float"))
+    type = RESAMPLE_FLOAT;
+  else
+    return FALSE;
+
+  if (rowstride == GEGL_AUTO_ROWSTRIDE)
+    rowstride = dest_w * bpp;
+
+  vector = components == 4 && resample_use_simd ();
+
+  /* the horizontal taps are the same for every row */
+  taps = g_new (ResampleTap, dest_w);
+  for (x = 0; x < dest_w; x++)
+    tap_func (&taps[x], (x + offset_x) / scale, scale, source_w, bpp);
+
+  for (y = 0; y < dest_h; y++)
+    {
+      guchar       *dst = (guchar *) dest_buf + y * rowstride;
+      const guchar *rows[3];
+      ResampleTap   row_tap;
+
+      tap_func (&row_tap, (y + offset_y) / scale, scale, source_h, s_rowstride);
+      rows[0] = (const guchar *) source_buf + row_tap.offset[0];
+      rows[1] = (const guchar *) source_buf + row_tap.offset[1];
+      rows[2] = (const guchar *) source_buf + row_tap.offset[2];
+
+#ifdef HAS_G4FLOAT
+      if (vector)
+        switch (type)
+          {
+            case RESAMPLE_U8:
+              resample_row4 (dst, rows, row_tap.weight, taps, n_taps,
+                             dest_w, bpp, RESAMPLE_U8);
+              break;
+            case RESAMPLE_U16:
+              resample_row4 (dst, rows, row_tap.weight, taps, n_taps,
+                             dest_w, bpp, RESAMPLE_U16);
+              break;
+            case RESAMPLE_FLOAT:
+              resample_row4 (dst, rows, row_tap.weight, taps, n_taps,
+                             dest_w, bpp, RESAMPLE_FLOAT);
+              break;
+          }
+      else
+#endif
+        switch (type)
+          {
+            case RESAMPLE_U8:
+              resample_row (dst, rows, row_tap.weight, taps, n_taps,
+                            dest_w, components, bpp, RESAMPLE_U8);
+              break;
+            case RESAMPLE_U16:
+              resample_row (dst, rows, row_tap.weight, taps, n_taps,
+                            dest_w, components, bpp, RESAMPLE_U16);
+              break;
+            case RESAMPLE_FLOAT:
+              resample_row (dst, rows, row_tap.weight, taps, n_taps,
+                            dest_w, components, bpp, RESAMPLE_FLOAT);
+              break;
+          }
+    }
+
+  g_free (taps);
+  return TRUE;
+}
+
+gboolean
+gegl_buffer_resample_box (gpointer       dest_buf,
+                          gconstpointer  source_buf,
+                          gint           dest_w,
+                          gint           dest_h,
+                          gint           source_w,
+                          gint           source_h,
+                          gdouble        offset_x,
+                          gdouble        offset_y,
+                          gdouble        scale,
+                          const Babl    *format,
+                          gint           rowstride)
+{
+  return resample (dest_buf, source_buf, dest_w, dest_h, source_w, source_h,
+                   offset_x, offset_y, scale, format, rowstride, box_tap, 3);
+}
+
+gboolean
+gegl_buffer_resample_bilinear (gpointer       dest_buf,
+                               gconstpointer  source_buf,
+                               gint           dest_w,
+                               gint           dest_h,
+                               gint           source_w,
+                               gint           source_h,
+                               gdouble        offset_x,
+                               gdouble        offset_y,
+                               gdouble        scale,
+                               const Babl    *format,
+                               gint           rowstride)
+{
+  return resample (dest_buf, source_buf, dest_w, dest_h, source_w, source_h,
+                   offset_x, offset_y, scale, format, rowstride, bilinear_tap, 2);
+}
@@ -0,0 +1,66 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_BUFFER_RESAMPLE_H__
+#define __GEGL_BUFFER_RESAMPLE_H__
+
+#include <glib.h>
+#include <babl/babl.h>
+
+G_BEGIN_DECLS
+
+/* Resamplers used by gegl_buffer_get when scale != 1.0, source_buf holds
+ * source_w x source_h pixels of format packed without padding, and dest
+ * pixel (x, y) is centered on the source coordinate
+ * ((x + offset_x) / scale, (y + offset_y) / scale).
+ *
+ * The box filter averages the 1.0 / scale wide footprint of each
+ * destination pixel and is meant for scales between 0.5 and 1.0, the
+ * bilinear filter interpolates between the four nearest pixels and is
+ * meant for magnification. Both presume premultiplied alpha if there is
+ * alpha, and return FALSE without touching dest_buf for formats whose
+ * components are not u8, u16 or float.
+ *
+ * Pixels with four components are processed as vectors on CPUs that
+ * support it.
+ */
+gboolean gegl_buffer_resample_box      (gpointer       dest_buf,
+                                        gconstpointer  source_buf,
+                                        gint           dest_w,
+                                        gint           dest_h,
+                                        gint           source_w,
+                                        gint           source_h,
+                                        gdouble        offset_x,
+                                        gdouble        offset_y,
+                                        gdouble        scale,
+                                        const Babl    *format,
+                                        gint           rowstride);
+
+gboolean gegl_buffer_resample_bilinear (gpointer       dest_buf,
+                                        gconstpointer  source_buf,
+                                        gint           dest_w,
+                                        gint           dest_h,
+                                        gint           source_w,
+                                        gint           source_h,
+                                        gdouble        offset_x,
+                                        gdouble        offset_y,
+                                        gdouble        scale,
+                                        const Babl    *format,
+                                        gint           rowstride);
+
+G_END_DECLS
+
+#endif
@@ -48,6 +48,8 @@
 #include "gegl-utils.h"
 #include "gegl-buffer-save.h"
 #include "gegl-buffer-index.h"
+#include "gegl-tile-codec.h"
+#include "gegl-config.h"
 
 typedef struct
 {
@@ -77,7 +79,7 @@ gegl_tile_entry_new (gint x,
                      gint y,
                      gint z)
 {
-  GeglBufferTile *entry = g_malloc (sizeof(GeglBufferTile));
+  GeglBufferTile *entry = g_malloc0 (sizeof (GeglBufferCompressedTile));
   entry->block.flags = GEGL_FLAG_TILE;
   entry->block.length = sizeof (GeglBufferTile);
 
@@ -123,6 +125,20 @@ static gsize write_block (SaveInfo        *info,
    return ret;
 }
 
+static void
+save_write (SaveInfo      *info,
+            gconstpointer  data,
+            gsize          length)
+{
+#if HAVE_GIO
+  info->offset += g_output_stream_write (info->o, data, length, NULL, NULL);
+#else
+  ssize_t ret = write (info->o, data, length);
+  if (ret != -1)
+    info->offset += ret;
+#endif
+}
+
 static void
 save_info_destroy (SaveInfo *info)
 {
@@ -222,7 +238,6 @@ gegl_buffer_save (GeglBuffer          *buffer,
 {
   SaveInfo *info = g_slice_new0 (SaveInfo);
 
-  glong prediction = 0; 
   gint bpp;
 
   GEGL_BUFFER_SANITY;
@@ -250,7 +265,6 @@ gegl_buffer_save (GeglBuffer          *buffer,
                            bpp,
                            buffer->tile_storage->format
                            );
-  info->header.next = (prediction += sizeof (GeglBufferHeader));
 
 
   info->tile_size = info->header.tile_width  *
@@ -323,34 +337,82 @@ gegl_buffer_save (GeglBuffer          *buffer,
   /* sort the list of tiles into zorder */
   info->tiles = g_list_sort (info->tiles, z_order_compare);
 
-  /* set the offset in the file each tile will be stored on */
+  /* the tiles are written first, their offsets and compressed sizes are
+   * only known after that, the index follows them and the header is
+   * rewritten to point at it last.
+   */
+  info->header.next = 0;
+  save_write (info, &info->header, sizeof (GeglBufferHeader));
+  g_assert (info->offset == sizeof (GeglBufferHeader));
+
+  /* save each tile */
   {
-    GList *iter;
-    gint   predicted_offset = sizeof (GeglBufferHeader) +
-                              sizeof (GeglBufferTile) * (info->entry_count);
+    GList        *iter;
+    gint          i = 0;
+    GeglTileCodec max_codec;
+    guchar       *compressed_data;
+
+    max_codec = gegl_tile_codec_from_string (gegl_config ()->tile_compression);
+    compressed_data = g_malloc (info->tile_size);
+
     for (iter = info->tiles; iter; iter = iter->next)
       {
-        GeglBufferTile *entry = iter->data;
-        entry->block.next = iter->next?
-                            (prediction += sizeof (GeglBufferTile)):0;
-        entry->offset = predicted_offset;
-        predicted_offset += info->tile_size;
-      }
-  }
+        GeglBufferTile           *entry      = iter->data;
+        GeglBufferCompressedTile *compressed = iter->data;
+        guchar                   *data;
+        GeglTile                 *tile;
+        GeglTileCodec             codec;
+        gint                      size;
+        gboolean                  locked;
 
-  /* save the header */
-#if HAVE_GIO
-  info->offset += g_output_stream_write (info->o, &info->header, sizeof (GeglBufferHeader), NULL, NULL);
-#else
-  {
-    ssize_t ret = write (info->o, &info->header, sizeof (GeglBufferHeader));
-	if (ret != -1)
-      info->offset += ret;
+        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
+                                          entry->x,
+                                          entry->y,
+                                          entry->z);
+        g_assert (tile);
+        locked = gegl_buffer_linear_lock_tile (tile, GEGL_TILE_LOCK_READ);
+
+        data = gegl_tile_get_data (tile);
+        g_assert (data);
+
+        codec = gegl_tile_codec_compress (max_codec, data, info->tile_size,
+                                          info->header.bytes_per_pixel,
+                                          compressed_data, &size);
+        if (codec == GEGL_TILE_CODEC_NONE)
+          {
+            entry->offset = info->offset;
+            save_write (info, data, info->tile_size);
+          }
+        else
+          {
+            entry->block.flags  = GEGL_FLAG_COMPRESSED_TILE;
+            entry->block.length = sizeof (GeglBufferCompressedTile);
+            compressed->codec   = codec;
+
+            if (codec == GEGL_TILE_CODEC_UNIFORM &&
+                size <= GEGL_BUFFER_INLINE_PIXEL)
+              {
+                memcpy (compressed->pixel, compressed_data, size);
+                compressed->size = 0;
+                entry->offset    = 0;
+              }
+            else
+              {
+                compressed->size = size;
+                entry->offset    = info->offset;
+                save_write (info, compressed_data, size);
+              }
+          }
+        if (locked)
+          gegl_tile_unlock (tile);
+        gegl_tile_unref (tile);
+        i++;
+      }
+    g_free (compressed_data);
   }
-#endif
-  g_assert (info->offset == info->header.next);
 
   /* save the index */
+  info->header.next = info->offset;
   {
     GList *iter;
     for (iter = info->tiles; iter; iter = iter->next)
@@ -363,44 +425,13 @@ gegl_buffer_save (GeglBuffer          *buffer,
   }
   write_block (info, NULL); /* terminate the index */
 
-  /* update header to point to start of new index (already done for
-   * this serial saver, and the header is already written.
-   */
-
-  /* save each tile */
-  {
-    GList *iter;
-    gint   i = 0;
-    for (iter = info->tiles; iter; iter = iter->next)
-      {
-        GeglBufferTile *entry = iter->data;
-        guchar          *data;
-        GeglTile        *tile;
-
-        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (buffer),
-                                          entry->x,
-                                          entry->y,
-                                          entry->z);
-        g_assert (tile);
-        gegl_tile_lock (tile, GEGL_TILE_LOCK_READ);
-
-        data = gegl_tile_get_data (tile);
-        g_assert (data);
-
-        g_assert (info->offset == entry->offset);
+  /* update the header to point to the start of the index */
 #if HAVE_GIO
-        info->offset += g_output_stream_write (info->o, data, info->tile_size, NULL, NULL);
+  g_seekable_seek (G_SEEKABLE (info->o), 0, G_SEEK_SET, NULL, NULL);
 #else
-        { 
-          ssize_t ret = write (info->o, data, info->tile_size);
-	      if (ret != -1)
-            info->offset += ret;
-        }
+  lseek (info->o, 0, SEEK_SET);
 #endif
-        gegl_tile_unlock (tile);
-        g_object_unref (G_OBJECT (tile));
-        i++;
-      }
-  }
+  save_write (info, &info->header, sizeof (GeglBufferHeader));
+
   save_info_destroy (info);
 }
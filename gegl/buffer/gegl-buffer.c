@@ -353,8 +353,6 @@ gint gegl_buffer_leaks (void)
   return allocated_buffers - de_allocated_buffers;
 }
 
-static void gegl_buffer_void (GeglBuffer *buffer);
-
 static void
 gegl_buffer_dispose (GObject *object)
 {
@@ -721,24 +719,12 @@ gegl_buffer_get_tile (GeglTileSource *source,
         buffer->max_z = z;
 
       /* storing information in tile, to enable the dispose function of the
-       * tile instance to "hook" back to the storage with correct
-       * coordinates.
+       * tile instance to "hook" back to the storage. The coordinates are
+       * set by the cache before the tile is shared, writing z here would
+       * race with the revision sharing its word in other threads.
        */
-      {
-#if ENABLE_MT
-        g_mutex_lock (tile->mutex);
-#endif
-        if (!tile->tile_storage)
-          {
-            tile->tile_storage = buffer->tile_storage;
-          }
-        tile->x = x;
-        tile->y = y;
-        tile->z = z;
-#if ENABLE_MT
-        g_mutex_unlock (tile->mutex);
-#endif
-      }
+      if (!tile->tile_storage)
+        tile->tile_storage = buffer->tile_storage;
     }
 
   return tile;
@@ -938,6 +924,8 @@ gegl_buffer_init (GeglBuffer *buffer)
   buffer->max_y = 0;
   buffer->max_z = 0;
 
+  buffer->pooled = FALSE;
+
   buffer->path = NULL;
   buffer->tile_width = 128;
   buffer->tile_height = 64;
@@ -1136,7 +1124,7 @@ static const void *gegl_buffer_internal_get_format (GeglBuffer *buffer)
   return gegl_buffer_backend (buffer)->format;
 }
 
-static void
+void
 gegl_buffer_void (GeglBuffer *buffer)
 {
   gint width       = buffer->extent.width;
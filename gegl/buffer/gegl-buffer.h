@@ -249,6 +249,45 @@ void            gegl_buffer_gpu_set           (GeglBuffer           *buffer,
                                                const GeglRectangle  *rect,
                                                const GeglGpuTexture *src);
 
+/**
+ * gegl_buffer_get_pixels:
+ * @buffer: the buffer to retrieve data from.
+ * @n_pixels: the number of pixels to fetch.
+ * @coords: @n_pixels pairs of x and y coordinates.
+ * @format: the BablFormat to store in @dest, if NULL the format of the
+ * buffer.
+ * @dest: memory for @n_pixels packed pixels of @format.
+ *
+ * Fetch a batch of arbitrarily placed pixels, the pixel at coords[i*2],
+ * coords[i*2+1] is stored as the i'th pixel of @dest. Pixels in the abyss
+ * are zeroed. Every tile touched is fetched once however the pixels are
+ * ordered, which makes this much faster than fetching the pixels one by
+ * one with 1x1 rectangles.
+ */
+void            gegl_buffer_get_pixels        (GeglBuffer          *buffer,
+                                               gint                 n_pixels,
+                                               const gint          *coords,
+                                               const Babl          *format,
+                                               gpointer             dest);
+
+/**
+ * gegl_buffer_set_pixels:
+ * @buffer: the buffer to modify.
+ * @n_pixels: the number of pixels to store.
+ * @coords: @n_pixels pairs of x and y coordinates.
+ * @format: the BablFormat of @src, if NULL the format of the buffer.
+ * @src: @n_pixels packed pixels of @format.
+ *
+ * Store a batch of arbitrarily placed pixels, the counterpart of
+ * gegl_buffer_get_pixels(). Pixels in the abyss are dropped, when a
+ * coordinate occurs more than once the last of its pixels is kept.
+ */
+void            gegl_buffer_set_pixels        (GeglBuffer          *buffer,
+                                               gint                 n_pixels,
+                                               const gint          *coords,
+                                               const Babl          *format,
+                                               gconstpointer        src);
+
 
 /**
  * gegl_buffer_get_format:
@@ -418,6 +457,33 @@ gpointer       *gegl_buffer_linear_open      (GeglBuffer          *buffer,
                                               gint                *rowstride,
                                               const Babl          *format);
 
+/**
+ * gegl_buffer_linear_open_full:
+ * @buffer: a #GeglBuffer.
+ * @extent: region to open, pass NULL for entire buffer.
+ * @rowstride: return location for rowstride, required if @alignment is not 0.
+ * @format: desired format or NULL to use buffers format.
+ * @flags: GEGL_BUFFER_READ if the initial contents are needed,
+ * GEGL_BUFFER_WRITE if changes are to be written back, or both.
+ * @alignment: 0 for rows of pixels without padding, or a power of two up to
+ * 64 that the start of the data and the rowstride are multiples of.
+ *
+ * Like gegl_buffer_linear_open, but without reading the buffer when only
+ * writing and without writing back when only reading. When @extent lies
+ * within a single tile of @format and the rows of the tile have the
+ * layout asked for, the tile is accessed directly, also for buffers that
+ * were not created with gegl_buffer_linear_new. The data must be accessed
+ * with the returned rowstride when an alignment is given.
+ *
+ * Returns: a pointer to the top left pixel of @extent.
+ */
+gpointer        gegl_buffer_linear_open_full (GeglBuffer          *buffer,
+                                              const GeglRectangle *extent,
+                                              gint                *rowstride,
+                                              const Babl          *format,
+                                              guint                flags,
+                                              gint                 alignment);
+
 /**
  * gegl_buffer_linear_close:
  * @buffer: a #GeglBuffer.
@@ -246,6 +246,7 @@ node_invalidated (GeglNode            *source,
   GeglCache *cache = GEGL_CACHE (data);
   GeglRectangle expanded = gegl_rectangle_expand (rect);
 
+  g_atomic_int_inc (&cache->generation);
   {
     GeglRegion *region;
     region = gegl_region_rectangle (&expanded);
@@ -385,6 +386,7 @@ gegl_cache_invalidate (GeglCache           *self,
     }
 #endif
 
+  g_atomic_int_inc (&self->generation);
 
   if (roi)
     {
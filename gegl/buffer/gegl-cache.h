@@ -38,6 +38,8 @@ struct _GeglCache
   GeglNode     *node;
   const void   *format;
   GeglRegion   *valid_region;
+  gint          generation;   /* bumped by every invalidation, pixels
+                                 computed across one are stale */
 };
 
 struct _GeglCacheClass
@@ -0,0 +1,364 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-config.h"
+#include "gegl-utils.h"
+#include "gegl-tile-alloc.h"
+
+#define MAX_CLASSES     8  /* distinct tile sizes that are pooled */
+#define MAGAZINE_SIZE   8  /* blocks of a class kept by each thread */
+#define MAGAZINE_BYTES  (2 * 1024 * 1024) /* bytes kept by each thread */
+#define BLOCK_HEADER   16  /* keeps the data as aligned as gegl_malloc does */
+
+/* Every block starts with a header recording its size class, -1 for
+ * sizes that did not get a class. While a block sits in the depot the
+ * header is overwritten by the trash stack link and restored when the
+ * block is handed out again.
+ */
+typedef struct
+{
+  gint size_class;
+} BlockHeader;
+
+typedef struct
+{
+  gint    n_blocks[MAX_CLASSES];
+  guchar *blocks[MAX_CLASSES][MAGAZINE_SIZE];
+  gsize   bytes;  /* in all of the magazines, at most MAGAZINE_BYTES */
+} ThreadCache;
+
+static GStaticMutex  depot_mutex = G_STATIC_MUTEX_INIT;
+static GOnce         init_once   = G_ONCE_INIT;
+static GPrivate     *thread_cache_key;
+
+/* size classes are only ever appended, by gegl_tile_alloc_register for
+ * the tile sizes of the backends created, readers look at the first
+ * n_classes entries without taking the lock
+ */
+static gsize         class_size[MAX_CLASSES];
+static volatile gint n_classes = 0;
+
+static GTrashStack  *depot[MAX_CLASSES];
+static gint          depot_blocks[MAX_CLASSES];
+static gsize         depot_bytes = 0;
+static gsize         depot_peak  = 0;
+static gsize         depot_limit = 0;
+
+static volatile gint stats_allocs      = 0;
+static volatile gint stats_thread_hits = 0;
+static volatile gint stats_depot_hits  = 0;
+static volatile gint stats_mallocs     = 0;
+static volatile gint stats_releases    = 0;
+static volatile gint stats_unpooled    = 0;
+
+static inline guchar *
+block_new (gsize size,
+           gint  size_class)
+{
+  guchar *block = gegl_malloc (size + BLOCK_HEADER);
+
+  ((BlockHeader *) block)->size_class = size_class;
+  g_atomic_int_inc (&stats_mallocs);
+  return block;
+}
+
+static inline void
+block_release (guchar *block)
+{
+  g_atomic_int_inc (&stats_releases);
+  gegl_free (block);
+}
+
+/* moves count blocks from the top of the thread cache to the depot,
+ * blocks that would take the depot over its limit are released.
+ */
+static void
+depot_flush (ThreadCache *cache,
+             gint         size_class,
+             gint         count)
+{
+  gsize size = class_size[size_class];
+
+  g_static_mutex_lock (&depot_mutex);
+  while (count-- && cache->n_blocks[size_class])
+    {
+      guchar *block = cache->blocks[size_class][--cache->n_blocks[size_class]];
+
+      cache->bytes -= size;
+      if (depot_bytes + size > depot_limit)
+        {
+          block_release (block);
+          continue;
+        }
+      g_trash_stack_push (&depot[size_class], block);
+      depot_blocks[size_class]++;
+      depot_bytes += size;
+      if (depot_bytes > depot_peak)
+        depot_peak = depot_bytes;
+    }
+  g_static_mutex_unlock (&depot_mutex);
+}
+
+/* refills up to half a magazine from the depot, as far as the thread
+ * cache has room, returns the number of blocks that were moved
+ */
+static gint
+depot_refill (ThreadCache *cache,
+              gint         size_class)
+{
+  gsize size  = class_size[size_class];
+  gint  moved = 0;
+
+  g_static_mutex_lock (&depot_mutex);
+  while (depot_blocks[size_class] &&
+         (moved == 0 ||
+          (moved < MAGAZINE_SIZE / 2 && cache->bytes + size <= MAGAZINE_BYTES)))
+    {
+      guchar *block = g_trash_stack_pop (&depot[size_class]);
+
+      ((BlockHeader *) block)->size_class = size_class;
+      depot_blocks[size_class]--;
+      depot_bytes -= size;
+      cache->bytes += size;
+      cache->blocks[size_class][cache->n_blocks[size_class]++] = block;
+      moved++;
+    }
+  g_static_mutex_unlock (&depot_mutex);
+  return moved;
+}
+
+static void
+thread_cache_free (gpointer data)
+{
+  ThreadCache *cache = data;
+  gint         i;
+
+  for (i = 0; i < g_atomic_int_get (&n_classes); i++)
+    depot_flush (cache, i, MAGAZINE_SIZE);
+  g_slice_free (ThreadCache, cache);
+}
+
+static inline ThreadCache *
+thread_cache_get (void)
+{
+  ThreadCache *cache = g_private_get (thread_cache_key);
+
+  if (G_UNLIKELY (cache == NULL))
+    {
+      cache = g_slice_new0 (ThreadCache);
+      g_private_set (thread_cache_key, cache);
+    }
+  return cache;
+}
+
+static gint
+size_class_register (gsize size)
+{
+  gint i;
+
+  g_static_mutex_lock (&depot_mutex);
+  for (i = 0; i < n_classes; i++)
+    if (class_size[i] == size)
+      break;
+
+  if (i == n_classes)
+    {
+      if (n_classes < MAX_CLASSES)
+        {
+          class_size[i] = size;
+          /* publish the size before the count */
+          g_atomic_int_add (&n_classes, 1);
+        }
+      else
+        {
+          i = -1;
+        }
+    }
+  g_static_mutex_unlock (&depot_mutex);
+  return i;
+}
+
+/* sizes nobody registered are not pooled, returns -1 for those */
+static inline gint
+size_class_lookup (gsize size)
+{
+  gint n = g_atomic_int_get (&n_classes);
+  gint i;
+
+  for (i = 0; i < n; i++)
+    if (class_size[i] == size)
+      return i;
+  return -1;
+}
+
+static gpointer
+tile_alloc_init (gpointer data)
+{
+  GeglConfig *config = gegl_config ();
+  gint        pixels = config->tile_width * config->tile_height;
+
+  thread_cache_key = g_private_new (thread_cache_free);
+  depot_limit      = config->cache_size / 8;
+
+  /* the tiles of 8bit and float RGBA buffers, by far the most common */
+  size_class_register (pixels * 4);
+  size_class_register (pixels * 16);
+  return NULL;
+}
+
+gpointer
+gegl_tile_alloc (gsize size)
+{
+  ThreadCache *cache;
+  guchar      *block;
+  gint         size_class;
+
+  g_once (&init_once, tile_alloc_init, NULL);
+  g_atomic_int_inc (&stats_allocs);
+
+  size_class = size_class_lookup (size);
+  if (size_class < 0)
+    {
+      g_atomic_int_inc (&stats_unpooled);
+      return block_new (size, -1) + BLOCK_HEADER;
+    }
+
+  cache = thread_cache_get ();
+  if (cache->n_blocks[size_class])
+    g_atomic_int_inc (&stats_thread_hits);
+  else if (depot_refill (cache, size_class))
+    g_atomic_int_inc (&stats_depot_hits);
+  else
+    return block_new (size, size_class) + BLOCK_HEADER;
+
+  block = cache->blocks[size_class][--cache->n_blocks[size_class]];
+  cache->bytes -= class_size[size_class];
+  return block + BLOCK_HEADER;
+}
+
+void
+gegl_tile_free (gpointer data)
+{
+  ThreadCache *cache;
+  guchar      *block;
+  gint         size_class;
+
+  if (data == NULL)
+    return;
+
+  block      = (guchar *) data - BLOCK_HEADER;
+  size_class = ((BlockHeader *) block)->size_class;
+
+  if (size_class < 0)
+    {
+      block_release (block);
+      return;
+    }
+
+  cache = thread_cache_get ();
+  if (cache->n_blocks[size_class] == MAGAZINE_SIZE)
+    depot_flush (cache, size_class, MAGAZINE_SIZE / 2);
+  cache->blocks[size_class][cache->n_blocks[size_class]++] = block;
+  cache->bytes += class_size[size_class];
+
+  /* the other magazines were within the limit before, emptying this one
+   * brings the thread back under it
+   */
+  if (cache->bytes > MAGAZINE_BYTES)
+    depot_flush (cache, size_class, MAGAZINE_SIZE);
+}
+
+void
+gegl_tile_alloc_register (gsize size)
+{
+  g_once (&init_once, tile_alloc_init, NULL);
+
+  if (size_class_lookup (size) < 0)
+    size_class_register (size);
+}
+
+void
+gegl_tile_alloc_trim (gsize max_pooled)
+{
+  gint i;
+
+  g_once (&init_once, tile_alloc_init, NULL);
+
+  g_static_mutex_lock (&depot_mutex);
+  depot_limit = max_pooled;
+
+  /* release from the largest classes first, they free the most memory
+   * for the fewest calls into the system allocator
+   */
+  while (depot_bytes > depot_limit)
+    {
+      gint largest = -1;
+
+      for (i = 0; i < n_classes; i++)
+        if (depot_blocks[i] &&
+            (largest < 0 || class_size[i] > class_size[largest]))
+          largest = i;
+
+      if (largest < 0)
+        break;
+
+      block_release (g_trash_stack_pop (&depot[largest]));
+      depot_blocks[largest]--;
+      depot_bytes -= class_size[largest];
+    }
+  g_static_mutex_unlock (&depot_mutex);
+}
+
+void
+gegl_tile_alloc_cleanup (void)
+{
+  ThreadCache *cache;
+
+  if (thread_cache_key == NULL)
+    return;
+
+  /* the blocks cached by the calling thread, worker threads hand theirs
+   * back when they exit
+   */
+  cache = g_private_get (thread_cache_key);
+  if (cache)
+    {
+      g_private_set (thread_cache_key, NULL);
+      thread_cache_free (cache);
+    }
+  gegl_tile_alloc_trim (0);
+}
+
+void
+gegl_tile_alloc_stats (void)
+{
+  gint allocs = MAX (stats_allocs, 1);
+
+  g_warning ("tile data: %i allocations, %.1f%% from thread caches "
+             "%.1f%% from the depot, %i mallocs %i frees %i unpooled, "
+             "depot peak %.1fmb",
+             stats_allocs,
+             stats_thread_hits * 100.0 / allocs,
+             stats_depot_hits * 100.0 / allocs,
+             stats_mallocs, stats_releases, stats_unpooled,
+             depot_peak / 1024 / 1024.0);
+}
@@ -0,0 +1,50 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_TILE_ALLOC_H__
+#define __GEGL_TILE_ALLOC_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Tile data is allocated from per size class free lists, every thread
+ * keeps a few blocks of each class for itself, up to a couple of
+ * megabytes, and exchanges them in batches with a global depot. The
+ * sizes of the tiles produced by the configured tile dimensions are
+ * known up front, backends register the sizes of their tiles, other
+ * sizes go straight to the system allocator. The returned memory is
+ * 16 byte aligned like the memory returned by gegl_malloc, but the two
+ * can not be mixed.
+ */
+gpointer gegl_tile_alloc          (gsize    size);
+void     gegl_tile_free           (gpointer data);
+
+/* makes blocks of size pooled, while there are classes left */
+void     gegl_tile_alloc_register (gsize    size);
+
+/* return pooled blocks to the system until no more than max_pooled bytes
+ * are kept in the depot, max_pooled also becomes the limit for blocks
+ * freed later.
+ */
+void     gegl_tile_alloc_trim     (gsize    max_pooled);
+
+void     gegl_tile_alloc_stats    (void);
+void     gegl_tile_alloc_cleanup  (void);
+
+G_END_DECLS
+
+#endif
@@ -26,6 +26,27 @@
 #include <fcntl.h>
 #include <unistd.h>
 #endif
+#if HAVE_SYS_MMAN_H && HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define USE_MMAP 1
+#else
+#define USE_MMAP 0
+#endif
+#if ENABLE_MT && !defined (G_OS_WIN32)
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#define USE_IO_THREAD 1
+#else
+#define USE_IO_THREAD 0
+#endif
 #include <string.h>
 #include <errno.h>
 
@@ -33,12 +54,78 @@
 #include <glib/gprintf.h>
 
 #include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-config.h"
 #include "gegl-tile-backend.h"
 #include "gegl-tile-backend-file.h"
 #include "gegl-buffer-index.h"
+#include "gegl-tile-codec.h"
 #include "gegl-debug.h"
-#include "gegl-types-internal.h"
+#if HAVE_GPU
+#include "gegl-gpu-init.h"
+#endif
+
+#if ENABLE_MT
+#define INDEX_READER_LOCK(self)   g_static_rw_lock_reader_lock (&(self)->index_lock)
+#define INDEX_READER_UNLOCK(self) g_static_rw_lock_reader_unlock (&(self)->index_lock)
+#define INDEX_WRITER_LOCK(self)   g_static_rw_lock_writer_lock (&(self)->index_lock)
+#define INDEX_WRITER_UNLOCK(self) g_static_rw_lock_writer_unlock (&(self)->index_lock)
+
+#define READ_LOCK(self)   g_static_mutex_lock (&(self)->read_mutex)
+#define READ_UNLOCK(self) g_static_mutex_unlock (&(self)->read_mutex)
+#else
+#define INDEX_READER_LOCK(self)
+#define INDEX_READER_UNLOCK(self)
+#define INDEX_WRITER_LOCK(self)
+#define INDEX_WRITER_UNLOCK(self)
 
+#define READ_LOCK(self)
+#define READ_UNLOCK(self)
+#endif
+
+#if USE_MMAP
+/* the swap file is mapped in windows of this many bytes, and grown a
+ * window at a time
+ */
+#define GEGL_MAP_WINDOW_SIZE (32 * 1024 * 1024)
+
+/* the alignment tile data handed out straight from a window needs, the
+ * same as the one of gegl_malloc
+ */
+#define GEGL_MAP_ALIGN       16
+
+#if ENABLE_MT
+#define MAP_LOCK(self)   g_mutex_lock ((self)->map_mutex)
+#define MAP_UNLOCK(self) g_mutex_unlock ((self)->map_mutex)
+#else
+#define MAP_LOCK(self)
+#define MAP_UNLOCK(self)
+#endif
+
+/* a slot of the swap file that a tile is using as its data, the slot
+ * is not reused before the tile (and all its clones) are gone.
+ */
+typedef struct
+{
+  GeglTileBackendFile *self;
+  guint                offset;
+  gboolean             released;  /* the entry gave up the slot */
+} GeglMapPin;
+#endif
+
+/* a run of unused bytes in the file */
+typedef struct
+{
+  guint          offset;
+  guint          length;
+  GSequenceIter *by_offset; /* in free_extents */
+  GSequenceIter *by_size;   /* in extents_by_size */
+} GeglSwapExtent;
+
+/* on idle, a swap file that is more than half holes gets up to this many
+ * tiles moved towards its start
+ */
+#define GEGL_SWAP_COMPACT_STEP 64
 
 struct _GeglTileBackendFile
 {
@@ -62,8 +149,33 @@ struct _GeglTileBackendFile
    */
   GHashTable      *index;
 
-  /* list of offsets to tiles that are free */
-  GSList          *free_list;
+#if ENABLE_MT
+  /* protects the index and the offsets of its entries, tiles are read
+   * under the reader lock while set, voided or moved by compaction under
+   * the writer lock. Taken before the map lock.
+   */
+  GStaticRWLock    index_lock;
+
+  /* the seek and read of gegl_tile_backend_file_read_at on the shared
+   * input stream, readers of the index read tiles concurrently
+   */
+  GStaticMutex     read_mutex;
+#endif
+
+  /* the holes in the file as GeglSwapExtents sorted by offset, adjacent
+   * holes are merged and a hole ending at next_pre_alloc is given back to
+   * it.
+   */
+  GSequence       *free_extents;
+
+  /* the same holes sorted by size, new tiles go into the smallest hole
+   * they fit in, the lowest one of that size, which keeps the larger
+   * holes for runs of tiles and the file dense at its start.
+   */
+  GSequence       *extents_by_size;
+
+  /* the number of bytes in free_extents */
+  guint            free_bytes;
 
   /* offset to next pre allocated tile slot */
   guint            next_pre_alloc;
@@ -113,6 +225,48 @@ struct _GeglTileBackendFile
   /* for reading */
   int              i;
 #endif
+
+#if USE_MMAP
+  /* tiles are copied to and from memory mappings of the file instead of
+   * being read and written, set up by ensure_exist() for swap files.
+   */
+  gboolean         use_mmap;
+  int              map_fd;
+
+  /* the mapped windows, indexed by offset / GEGL_MAP_WINDOW_SIZE, NULL
+   * for windows not mapped yet
+   */
+  GPtrArray       *windows;
+
+  /* the GeglMapPins of slots in use as tile data, keyed by offset */
+  GHashTable      *pinned;
+#if ENABLE_MT
+  /* protects the windows, the pins and the free extents, pins are released
+   * from whichever thread drops the last reference to a tile
+   */
+  GMutex          *map_mutex;
+#endif
+#endif
+
+#if USE_IO_THREAD
+  /* tile writes and read-aheads are handed to the swap I/O thread, set
+   * up by ensure_exist() for swap files that are not memory mapped, all
+   * of it is protected by swap_io_mutex.
+   */
+  gboolean         use_io_thread;
+  int              io_fd;
+
+  /* the GeglSwapIO of the latest write to each slot that has not hit
+   * the file yet, keyed by offset
+   */
+  GHashTable      *pending;
+
+  /* the GeglSwapIO reads ahead of slots likely to be needed soon */
+  GHashTable      *readahead;
+
+  /* the number of writes queued or being written */
+  gint             n_writes;
+#endif
 };
 
 
@@ -122,19 +276,801 @@ static gboolean gegl_tile_backend_file_write_block  (GeglTileBackendFile *self,
 static void     gegl_tile_backend_file_dbg_alloc    (int                  size);
 static void     gegl_tile_backend_file_dbg_dealloc  (int                  size);
 
+/* the holes in all swap files, for the stats */
+static gint swap_hole_bytes   = 0;
+static gint swap_hole_extents = 0;
 
-static void inline
-gegl_tile_backend_file_file_entry_read (GeglTileBackendFile *self,
-                                        GeglBufferTile      *entry,
-                                        guchar              *dest)
+static gint
+gegl_tile_backend_file_extent_compare (gconstpointer a,
+                                       gconstpointer b,
+                                       gpointer      user_data)
+{
+  const GeglSwapExtent *ea = a;
+  const GeglSwapExtent *eb = b;
+
+  if (ea->offset < eb->offset)
+    return -1;
+  return ea->offset > eb->offset;
+}
+
+/* the smallest extents first, the lowest of those of the same size first */
+static gint
+gegl_tile_backend_file_extent_size_compare (gconstpointer a,
+                                            gconstpointer b,
+                                            gpointer      user_data)
+{
+  const GeglSwapExtent *ea = a;
+  const GeglSwapExtent *eb = b;
+
+  if (ea->length != eb->length)
+    return ea->length < eb->length ? -1 : 1;
+  return gegl_tile_backend_file_extent_compare (a, b, user_data);
+}
+
+static void
+gegl_tile_backend_file_extent_free (gpointer data)
+{
+  g_slice_free (GeglSwapExtent, data);
+}
+
+static void
+gegl_tile_backend_file_remove_extent (GeglTileBackendFile *self,
+                                      GeglSwapExtent      *extent)
+{
+  g_sequence_remove (extent->by_size);
+  g_sequence_remove (extent->by_offset);
+  g_atomic_int_add (&swap_hole_extents, -1);
+}
+
+/* the length, or the offset and the length, of extent changed */
+static inline void
+gegl_tile_backend_file_extent_resized (GeglTileBackendFile *self,
+                                       GeglSwapExtent      *extent)
+{
+  g_sequence_sort_changed (extent->by_size,
+                           gegl_tile_backend_file_extent_size_compare, NULL);
+}
+
+/* returns length bytes at offset to the free space, called with the map
+ * lock held when there is one.
+ */
+static void
+gegl_tile_backend_file_free_extent (GeglTileBackendFile *self,
+                                    guint                offset,
+                                    guint                length)
+{
+  GeglSwapExtent  key    = { offset, length };
+  GeglSwapExtent *prev   = NULL;
+  GeglSwapExtent *next   = NULL;
+  GeglSwapExtent *extent;
+  GSequenceIter  *iter;
+
+  iter = g_sequence_search (self->free_extents, &key,
+                            gegl_tile_backend_file_extent_compare, NULL);
+  if (!g_sequence_iter_is_begin (iter))
+    prev = g_sequence_get (g_sequence_iter_prev (iter));
+  if (!g_sequence_iter_is_end (iter))
+    next = g_sequence_get (iter);
+
+  self->free_bytes += length;
+  g_atomic_int_add (&swap_hole_bytes, length);
+
+  if (prev && prev->offset + prev->length == offset)
+    {
+      prev->length += length;
+      if (next && offset + length == next->offset)
+        {
+          prev->length += next->length;
+          gegl_tile_backend_file_remove_extent (self, next);
+        }
+      extent = prev;
+      gegl_tile_backend_file_extent_resized (self, extent);
+    }
+  else if (next && offset + length == next->offset)
+    {
+      next->offset  = offset;
+      next->length += length;
+      extent = next;
+      gegl_tile_backend_file_extent_resized (self, extent);
+    }
+  else
+    {
+      extent = g_slice_new (GeglSwapExtent);
+
+      extent->offset    = offset;
+      extent->length    = length;
+      extent->by_offset = g_sequence_insert_before (iter, extent);
+      extent->by_size   = g_sequence_insert_sorted (self->extents_by_size, extent,
+                                                    gegl_tile_backend_file_extent_size_compare,
+                                                    NULL);
+      g_atomic_int_add (&swap_hole_extents, 1);
+    }
+
+  /* a hole at the end of the file is no hole */
+  if (extent->offset + extent->length == self->next_pre_alloc)
+    {
+      self->next_pre_alloc = extent->offset;
+      self->free_bytes    -= extent->length;
+      g_atomic_int_add (&swap_hole_bytes, -(gint) extent->length);
+      gegl_tile_backend_file_remove_extent (self, extent);
+    }
+}
+
+/* takes length bytes from the smallest hole they fit in, the lowest of
+ * those, called with the map lock held when there is one.
+ */
+static gboolean
+gegl_tile_backend_file_take_extent (GeglTileBackendFile *self,
+                                    guint                length,
+                                    guint               *offset)
+{
+  GeglSwapExtent  key = { 0, length };
+  GeglSwapExtent *extent;
+  GSequenceIter  *iter;
+
+  /* no hole is at offset 0, the header is there, this finds the first
+   * hole of at least length bytes
+   */
+  iter = g_sequence_search (self->extents_by_size, &key,
+                            gegl_tile_backend_file_extent_size_compare, NULL);
+  if (g_sequence_iter_is_end (iter))
+    return FALSE;
+
+  extent            = g_sequence_get (iter);
+  *offset           = extent->offset;
+  extent->offset   += length;
+  extent->length   -= length;
+  self->free_bytes -= length;
+  g_atomic_int_add (&swap_hole_bytes, -(gint) length);
+
+  if (extent->length == 0)
+    gegl_tile_backend_file_remove_extent (self, extent);
+  else
+    gegl_tile_backend_file_extent_resized (self, extent);
+  return TRUE;
+}
+
+static void
+gegl_tile_backend_file_clear_extents (GeglTileBackendFile *self)
+{
+  g_atomic_int_add (&swap_hole_bytes, -(gint) self->free_bytes);
+  g_atomic_int_add (&swap_hole_extents,
+                    -g_sequence_get_length (self->free_extents));
+  g_sequence_remove_range (g_sequence_get_begin_iter (self->extents_by_size),
+                           g_sequence_get_end_iter (self->extents_by_size));
+  g_sequence_remove_range (g_sequence_get_begin_iter (self->free_extents),
+                           g_sequence_get_end_iter (self->free_extents));
+  self->free_bytes = 0;
+}
+
+#if USE_MMAP
+/* returns a pointer to the slot at offset in the mapped file, mapping
+ * its window when needed. Returns NULL, and turns memory mapping off for
+ * the rest of the file's life, if the window cannot be mapped.
+ */
+static guchar *
+gegl_tile_backend_file_map_slot (GeglTileBackendFile *self,
+                                 guint                offset)
+{
+  guint   window = offset / GEGL_MAP_WINDOW_SIZE;
+  guchar *data;
+
+  MAP_LOCK (self);
+  if (window >= self->windows->len)
+    g_ptr_array_set_size (self->windows, window + 1);
+
+  data = g_ptr_array_index (self->windows, window);
+  if (data == NULL)
+    {
+      data = mmap (NULL, GEGL_MAP_WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, self->map_fd,
+                   (off_t) window * GEGL_MAP_WINDOW_SIZE);
+      if (data == MAP_FAILED)
+        {
+          g_warning ("unable to map swap file %s: %s, falling back to "
+                     "reading and writing", self->path, g_strerror (errno));
+          self->use_mmap = FALSE;
+          MAP_UNLOCK (self);
+          return NULL;
+        }
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "mapped window %i of %s",
+                 window, self->path);
+      g_ptr_array_index (self->windows, window) = data;
+    }
+  MAP_UNLOCK (self);
+
+  return data + offset % GEGL_MAP_WINDOW_SIZE;
+}
+
+static void
+gegl_tile_backend_file_unpin (gpointer        pixels,
+#if HAVE_GPU
+                              GeglGpuTexture *gpu_data,
+#endif
+                              gpointer        data)
+{
+  GeglMapPin          *pin  = data;
+  GeglTileBackendFile *self = pin->self;
+
+  MAP_LOCK (self);
+  if (pin->released)
+    gegl_tile_backend_file_free_extent (self, pin->offset,
+                                        GEGL_TILE_BACKEND (self)->tile_size);
+  else
+    g_hash_table_remove (self->pinned, GUINT_TO_POINTER (pin->offset));
+  MAP_UNLOCK (self);
+
+  g_slice_free (GeglMapPin, pin);
+  g_object_unref (self);
+}
+
+/* the entry is moving away from its slot or going away, returns TRUE if
+ * a tile is still using the slot, the slot is then put on the free list
+ * once the tile is gone instead of now.
+ */
+static gboolean
+gegl_tile_backend_file_release_slot (GeglTileBackendFile *self,
+                                     guint                offset)
+{
+  GeglMapPin *pin;
+
+  if (!self->pinned)
+    return FALSE;
+
+  MAP_LOCK (self);
+  pin = g_hash_table_lookup (self->pinned, GUINT_TO_POINTER (offset));
+  if (pin)
+    {
+      g_hash_table_remove (self->pinned, GUINT_TO_POINTER (offset));
+      pin->released = TRUE;
+    }
+  MAP_UNLOCK (self);
+
+  return pin != NULL;
+}
+
+/* hands out a tile that uses the slot of entry in the mapped file as its
+ * data, saving the copy. Returns NULL when the tile has to be read into
+ * memory of its own instead.
+ */
+static GeglTile *
+gegl_tile_backend_file_get_mapped_tile (GeglTileBackendFile *self,
+                                        GeglBufferTile      *entry)
+{
+  GeglTile   *tile;
+  GeglMapPin *pin;
+  guchar     *slot;
+
+  if (!self->use_mmap ||
+      entry->block.flags != GEGL_FLAG_TILE ||
+      entry->offset % GEGL_MAP_ALIGN != 0)
+    return NULL;
+#if HAVE_GPU
+  /* the tile would need a texture of its own */
+  if (gegl_gpu_is_accelerated ())
+    return NULL;
+#endif
+
+  slot = gegl_tile_backend_file_map_slot (self, entry->offset);
+  if (slot == NULL)
+    return NULL;
+
+  MAP_LOCK (self);
+  if (g_hash_table_lookup (self->pinned, GUINT_TO_POINTER (entry->offset)))
+    {
+      /* another tile is already using the slot, two tiles that do not
+       * know about each other must not share their data
+       */
+      MAP_UNLOCK (self);
+      return NULL;
+    }
+  pin           = g_slice_new (GeglMapPin);
+  pin->self     = g_object_ref (self);
+  pin->offset   = entry->offset;
+  pin->released = FALSE;
+  g_hash_table_insert (self->pinned, GUINT_TO_POINTER (entry->offset), pin);
+  MAP_UNLOCK (self);
+
+  tile = gegl_tile_new_bare ();
+  tile->size                = GEGL_TILE_BACKEND (self)->tile_size;
+  tile->data                = slot;
+  tile->destroy_notify      = gegl_tile_backend_file_unpin;
+  tile->destroy_notify_data = pin;
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "mapped entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)entry->offset);
+  return tile;
+}
+#endif
+
+#if USE_IO_THREAD
+/* The swap I/O thread is shared by all file backends. Stored tiles are
+ * copied to a queue and written behind the renderer's back, runs of
+ * adjacent slots with a single vectored write, and the tiles iterators
+ * are about to visit are read ahead into memory.
+ */
+
+/* the most requests in flight, stores block while the queue is full */
+#define GEGL_SWAP_IO_QUEUE     64
+
+/* the most writes merged into one vectored write */
+#define GEGL_SWAP_IO_BATCH     16
+
+/* the most read-ahead tiles a file holds on to */
+#define GEGL_SWAP_READAHEAD    32
+
+typedef enum
+{
+  GEGL_SWAP_IO_WRITE,
+  GEGL_SWAP_IO_READ
+} GeglSwapIOKind;
+
+typedef enum
+{
+  GEGL_SWAP_IO_QUEUED,
+  GEGL_SWAP_IO_RUNNING,
+  GEGL_SWAP_IO_DONE
+} GeglSwapIOState;
+
+typedef struct
+{
+  GeglTileBackendFile *self;    /* reffed until the request has run */
+  GeglSwapIOKind       kind;
+  GeglSwapIOState      state;
+  gboolean             stale;   /* nobody wants the result of the read */
+  guint                offset;
+  guchar              *data;    /* a copy of the tile written, or the
+                                 * tile read */
+} GeglSwapIO;
+
+static GStaticMutex swap_io_init_mutex = G_STATIC_MUTEX_INIT;
+static GThread     *swap_io_thread     = NULL;
+static GMutex      *swap_io_mutex      = NULL;
+static GCond       *swap_io_queued     = NULL; /* requests were queued */
+static GCond       *swap_io_finished   = NULL; /* requests have run */
+static GQueue      *swap_io_queue      = NULL;
+static gint         swap_io_in_flight  = 0;
+static gboolean     swap_io_quit       = FALSE;
+
+static gboolean
+swap_io_pread (int     fd,
+               guchar *data,
+               gint    size,
+               goffset offset)
+{
+  while (size > 0)
+    {
+      gssize done = pread (fd, data, size, offset);
+
+      if (done < 0 && errno == EINTR)
+        continue;
+      if (done <= 0)
+        return FALSE;
+      data   += done;
+      size   -= done;
+      offset += done;
+    }
+  return TRUE;
+}
+
+static gboolean
+swap_io_pwrite (int     fd,
+                guchar *data,
+                gint    size,
+                goffset offset)
+{
+  while (size > 0)
+    {
+      gssize done = pwrite (fd, data, size, offset);
+
+      if (done < 0 && errno == EINTR)
+        continue;
+      if (done <= 0)
+        return FALSE;
+      data   += done;
+      size   -= done;
+      offset += done;
+    }
+  return TRUE;
+}
+
+/* writes the run of adjacent slots in batch */
+static gboolean
+swap_io_write_batch (int          fd,
+                     GeglSwapIO **batch,
+                     gint         n,
+                     gint         tile_size)
+{
+  gssize written = 0;
+  gint   i;
+
+#if HAVE_PWRITEV
+  if (n > 1)
+    {
+      struct iovec iov[GEGL_SWAP_IO_BATCH];
+
+      for (i = 0; i < n; i++)
+        {
+          iov[i].iov_base = batch[i]->data;
+          iov[i].iov_len  = tile_size;
+        }
+      do
+        written = pwritev (fd, iov, n, batch[0]->offset);
+      while (written < 0 && errno == EINTR);
+
+      if (written < 0)
+        written = 0;
+    }
+#endif
+
+  /* finish what a short vectored write left, one slot at a time */
+  for (i = written / tile_size; i < n; i++)
+    {
+      gint skip = (i == written / tile_size) ? written % tile_size : 0;
+
+      if (!swap_io_pwrite (fd, batch[i]->data + skip, tile_size - skip,
+                           (goffset) batch[i]->offset + skip))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* moves the queued writes that extend the run of slots in batch from the
+ * queue to batch, keeping batch sorted by offset. Returns the length of
+ * the run.
+ */
+static gint
+swap_io_gather (GeglSwapIO **batch,
+                gint         tile_size)
+{
+  gint     n     = 1;
+  gboolean found = TRUE;
+
+  while (found && n < GEGL_SWAP_IO_BATCH)
+    {
+      GList *iter;
+
+      found = FALSE;
+      for (iter = swap_io_queue->head; iter; iter = iter->next)
+        {
+          GeglSwapIO *io = iter->data;
+
+          if (io->kind != GEGL_SWAP_IO_WRITE ||
+              io->self != batch[0]->self)
+            continue;
+
+          if (io->offset == batch[n - 1]->offset + tile_size)
+            {
+              batch[n++] = io;
+            }
+          else if (io->offset + tile_size == batch[0]->offset)
+            {
+              memmove (batch + 1, batch, n * sizeof (GeglSwapIO *));
+              batch[0] = io;
+              n++;
+            }
+          else
+            continue;
+
+          io->state = GEGL_SWAP_IO_RUNNING;
+          g_queue_delete_link (swap_io_queue, iter);
+          found = TRUE;
+          break;
+        }
+    }
+  return n;
+}
+
+static gpointer
+swap_io_thread_func (gpointer data)
+{
+  g_mutex_lock (swap_io_mutex);
+  while (TRUE)
+    {
+      GeglSwapIO          *batch[GEGL_SWAP_IO_BATCH];
+      GeglSwapIO          *io;
+      GeglTileBackendFile *self;
+      gint                 tile_size;
+      gint                 n = 1;
+      gint                 i;
+      gboolean             success;
+
+      io = g_queue_pop_head (swap_io_queue);
+      if (io == NULL)
+        {
+          if (swap_io_quit)
+            break;
+          g_cond_wait (swap_io_queued, swap_io_mutex);
+          continue;
+        }
+
+      self      = io->self;
+      tile_size = GEGL_TILE_BACKEND (self)->tile_size;
+      io->state = GEGL_SWAP_IO_RUNNING;
+      batch[0]  = io;
+      if (io->kind == GEGL_SWAP_IO_WRITE)
+        n = swap_io_gather (batch, tile_size);
+      g_mutex_unlock (swap_io_mutex);
+
+      if (io->kind == GEGL_SWAP_IO_READ)
+        {
+          io->data = gegl_malloc (tile_size);
+          success  = swap_io_pread (self->io_fd, io->data, tile_size,
+                                    io->offset);
+        }
+      else
+        {
+          success = swap_io_write_batch (self->io_fd, batch, n, tile_size);
+        }
+      if (!success)
+        g_warning ("swap I/O on %s failed: %s", self->path, g_strerror (errno));
+
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "%s %i tiles at %i",
+                 io->kind == GEGL_SWAP_IO_READ ? "read ahead" : "wrote",
+                 n, (gint)batch[0]->offset);
+
+      g_mutex_lock (swap_io_mutex);
+      for (i = 0; i < n; i++)
+        {
+          io = batch[i];
+          io->state = GEGL_SWAP_IO_DONE;
+
+          if (io->kind == GEGL_SWAP_IO_WRITE)
+            {
+              if (g_hash_table_lookup (self->pending,
+                                       GUINT_TO_POINTER (io->offset)) == io)
+                g_hash_table_remove (self->pending,
+                                     GUINT_TO_POINTER (io->offset));
+              self->n_writes--;
+              g_free (io->data);
+              g_slice_free (GeglSwapIO, io);
+            }
+          else if (io->stale || !success)
+            {
+              if (!io->stale)
+                g_hash_table_remove (self->readahead,
+                                     GUINT_TO_POINTER (io->offset));
+              gegl_free (io->data);
+              g_slice_free (GeglSwapIO, io);
+            }
+          /* else the read is left for the tile to pick up */
+        }
+      swap_io_in_flight -= n;
+      g_cond_broadcast (swap_io_finished);
+      g_mutex_unlock (swap_io_mutex);
+
+      /* dropping the last reference finalizes the backend, keep that out
+       * of the lock
+       */
+      for (i = 0; i < n; i++)
+        g_object_unref (self);
+
+      g_mutex_lock (swap_io_mutex);
+    }
+  g_mutex_unlock (swap_io_mutex);
+
+  return NULL;
+}
+
+static void
+swap_io_init (void)
+{
+  g_static_mutex_lock (&swap_io_init_mutex);
+  if (swap_io_thread == NULL)
+    {
+      swap_io_mutex    = g_mutex_new ();
+      swap_io_queued   = g_cond_new ();
+      swap_io_finished = g_cond_new ();
+      swap_io_queue    = g_queue_new ();
+      swap_io_quit     = FALSE;
+      swap_io_thread   = g_thread_create (swap_io_thread_func, NULL,
+                                          TRUE, NULL);
+    }
+  g_static_mutex_unlock (&swap_io_init_mutex);
+}
+
+/* forgets about the read-ahead of a slot, expects swap_io_mutex to be
+ * held
+ */
+static void
+swap_io_drop_readahead (GeglTileBackendFile *self,
+                        guint                offset)
+{
+  GeglSwapIO *io = g_hash_table_lookup (self->readahead,
+                                        GUINT_TO_POINTER (offset));
+
+  if (io == NULL)
+    return;
+
+  g_hash_table_remove (self->readahead, GUINT_TO_POINTER (offset));
+  switch (io->state)
+    {
+      case GEGL_SWAP_IO_QUEUED:
+        g_queue_remove (swap_io_queue, io);
+        swap_io_in_flight--;
+        g_object_unref (io->self); /* the caller has a reference too */
+        g_slice_free (GeglSwapIO, io);
+        break;
+      case GEGL_SWAP_IO_RUNNING:
+        io->stale = TRUE; /* the I/O thread frees it */
+        break;
+      case GEGL_SWAP_IO_DONE:
+        gegl_free (io->data);
+        g_slice_free (GeglSwapIO, io);
+        break;
+    }
+}
+
+/* queues a write of the tile data in source to the slot at offset,
+ * returns FALSE if the write has to be done synchronously
+ */
+static gboolean
+swap_io_queue_write (GeglTileBackendFile *self,
+                     guint                offset,
+                     guchar              *source)
+{
+  gint        tile_size = GEGL_TILE_BACKEND (self)->tile_size;
+  GeglSwapIO *io;
+
+  if (!self->use_io_thread)
+    return FALSE;
+
+  g_mutex_lock (swap_io_mutex);
+  swap_io_drop_readahead (self, offset);
+
+  io = g_hash_table_lookup (self->pending, GUINT_TO_POINTER (offset));
+  if (io && io->state == GEGL_SWAP_IO_QUEUED)
+    {
+      /* the slot has not been written yet, just update what is written */
+      memcpy (io->data, source, tile_size);
+      g_mutex_unlock (swap_io_mutex);
+      return TRUE;
+    }
+
+  while (swap_io_in_flight >= GEGL_SWAP_IO_QUEUE)
+    g_cond_wait (swap_io_finished, swap_io_mutex);
+
+  io         = g_slice_new0 (GeglSwapIO);
+  io->self   = g_object_ref (self);
+  io->kind   = GEGL_SWAP_IO_WRITE;
+  io->state  = GEGL_SWAP_IO_QUEUED;
+  io->offset = offset;
+  io->data   = g_memdup (source, tile_size);
+
+  g_hash_table_insert (self->pending, GUINT_TO_POINTER (offset), io);
+  self->n_writes++;
+  swap_io_in_flight++;
+  g_queue_push_tail (swap_io_queue, io);
+  g_cond_signal (swap_io_queued);
+  g_mutex_unlock (swap_io_mutex);
+
+  return TRUE;
+}
+
+/* queues a read-ahead of the slot at offset, unless the I/O thread is
+ * busy enough already
+ */
+static void
+swap_io_queue_read (GeglTileBackendFile *self,
+                    guint                offset)
+{
+  GeglSwapIO *io;
+
+  g_mutex_lock (swap_io_mutex);
+  if (g_hash_table_lookup (self->readahead, GUINT_TO_POINTER (offset)) == NULL &&
+      g_hash_table_lookup (self->pending, GUINT_TO_POINTER (offset)) == NULL &&
+      g_hash_table_size (self->readahead) < GEGL_SWAP_READAHEAD &&
+      swap_io_in_flight < GEGL_SWAP_IO_QUEUE)
+    {
+      io         = g_slice_new0 (GeglSwapIO);
+      io->self   = g_object_ref (self);
+      io->kind   = GEGL_SWAP_IO_READ;
+      io->state  = GEGL_SWAP_IO_QUEUED;
+      io->offset = offset;
+
+      g_hash_table_insert (self->readahead, GUINT_TO_POINTER (offset), io);
+      swap_io_in_flight++;
+      g_queue_push_tail (swap_io_queue, io);
+      g_cond_signal (swap_io_queued);
+    }
+  g_mutex_unlock (swap_io_mutex);
+}
+
+/* serves a read of the slot at offset from a write that has not hit the
+ * file yet or from the read-ahead, returns FALSE if the slot has to be
+ * read from the file.
+ */
+static gboolean
+swap_io_read (GeglTileBackendFile *self,
+              guint                offset,
+              guchar              *dest)
+{
+  gint        tile_size = GEGL_TILE_BACKEND (self)->tile_size;
+  GeglSwapIO *io;
+  gboolean    found = FALSE;
+
+  if (!self->use_io_thread)
+    return FALSE;
+
+  g_mutex_lock (swap_io_mutex);
+  io = g_hash_table_lookup (self->pending, GUINT_TO_POINTER (offset));
+  if (io)
+    {
+      memcpy (dest, io->data, tile_size);
+      found = TRUE;
+    }
+  else
+    {
+      /* a read-ahead in progress is closer to done than a new read */
+      while ((io = g_hash_table_lookup (self->readahead,
+                                        GUINT_TO_POINTER (offset))) &&
+             io->state == GEGL_SWAP_IO_RUNNING)
+        g_cond_wait (swap_io_finished, swap_io_mutex);
+
+      if (io && io->state == GEGL_SWAP_IO_DONE)
+        {
+          memcpy (dest, io->data, tile_size);
+          found = TRUE;
+        }
+      swap_io_drop_readahead (self, offset);
+    }
+  g_mutex_unlock (swap_io_mutex);
+
+  return found;
+}
+
+/* waits for the queued writes of self to hit the file */
+static void
+swap_io_sync (GeglTileBackendFile *self)
+{
+  if (!self->use_io_thread)
+    return;
+
+  g_mutex_lock (swap_io_mutex);
+  while (self->n_writes > 0)
+    g_cond_wait (swap_io_finished, swap_io_mutex);
+  g_mutex_unlock (swap_io_mutex);
+}
+#endif
+
+void
+gegl_tile_backend_file_cleanup (void)
+{
+#if USE_IO_THREAD
+  g_static_mutex_lock (&swap_io_init_mutex);
+  if (swap_io_thread)
+    {
+      /* the thread runs what is queued before quitting */
+      g_mutex_lock (swap_io_mutex);
+      swap_io_quit = TRUE;
+      g_cond_signal (swap_io_queued);
+      g_mutex_unlock (swap_io_mutex);
+      g_thread_join (swap_io_thread);
+      swap_io_thread = NULL;
+
+      g_queue_free (swap_io_queue);
+      g_cond_free (swap_io_finished);
+      g_cond_free (swap_io_queued);
+      g_mutex_free (swap_io_mutex);
+      swap_io_queue    = NULL;
+      swap_io_finished = NULL;
+      swap_io_queued   = NULL;
+      swap_io_mutex    = NULL;
+    }
+  g_static_mutex_unlock (&swap_io_init_mutex);
+#endif
+}
+
+/* reads length bytes at offset bypassing the mapping and the I/O thread */
+static gboolean
+gegl_tile_backend_file_read_at (GeglTileBackendFile *self,
+                                goffset              offset,
+                                guchar              *dest,
+                                gint                 length)
 {
   gint     to_be_read;
   gboolean success;
-  gint     tile_size = GEGL_TILE_BACKEND (self)->tile_size;
-  goffset  offset = entry->offset;
-
-  gegl_tile_backend_file_ensure_exist (self);
 
+  READ_LOCK (self);
 #if HAVE_GIO
   success = g_seekable_seek (G_SEEKABLE (self->i),
                              offset, G_SEEK_SET,
@@ -144,10 +1080,11 @@ gegl_tile_backend_file_file_entry_read (GeglTileBackendFile *self,
 #endif
   if (success == FALSE)
     {
+      READ_UNLOCK (self);
       g_warning ("unable to seek to tile in buffer: %s", g_strerror (errno));
-      return;
+      return FALSE;
     }
-  to_be_read = tile_size;
+  to_be_read = length;
 
   while (to_be_read > 0)
     {
@@ -155,23 +1092,97 @@ gegl_tile_backend_file_file_entry_read (GeglTileBackendFile *self,
 
 #if HAVE_GIO
       byte_read = g_input_stream_read (G_INPUT_STREAM (self->i),
-                                       dest + tile_size - to_be_read, to_be_read,
+                                       dest + length - to_be_read, to_be_read,
                                        NULL, NULL);
 #else
-      byte_read = read (self->i, dest + tile_size - to_be_read, to_be_read);
+      byte_read = read (self->i, dest + length - to_be_read, to_be_read);
 #endif
       if (byte_read <= 0)
         {
-          g_message ("unable to read tile data from self: "
-                     "%s (%d/%d bytes read)",
-                     g_strerror (errno), byte_read, to_be_read);
+          READ_UNLOCK (self);
+          g_message ("unable to read tile data from self: "
+                     "%s (%d/%d bytes read)",
+                     g_strerror (errno), byte_read, to_be_read);
+          return FALSE;
+        }
+      to_be_read -= byte_read;
+    }
+  READ_UNLOCK (self);
+  return TRUE;
+}
+
+/* compressed entries are either uniform tiles kept in the entry itself or
+ * tiles written by gegl_buffer_save, neither is ever mapped or queued.
+ */
+static void
+gegl_tile_backend_file_compressed_entry_read (GeglTileBackendFile *self,
+                                              GeglBufferTile      *entry,
+                                              guchar              *dest)
+{
+  GeglTileBackend          *backend    = GEGL_TILE_BACKEND (self);
+  GeglBufferCompressedTile *compressed = (GeglBufferCompressedTile *) entry;
+
+  if (compressed->size == 0)
+    {
+      gegl_tile_codec_decompress (compressed->codec,
+                                  compressed->pixel, backend->px_size,
+                                  dest, backend->tile_size, backend->px_size);
+    }
+  else
+    {
+      guchar *data = g_malloc (compressed->size);
+
+      if (gegl_tile_backend_file_read_at (self, entry->offset,
+                                          data, compressed->size))
+        gegl_tile_codec_decompress (compressed->codec,
+                                    data, compressed->size,
+                                    dest, backend->tile_size, backend->px_size);
+      g_free (data);
+    }
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read compressed entry %i,%i,%i", entry->x, entry->y, entry->z);
+}
+
+static void inline
+gegl_tile_backend_file_file_entry_read (GeglTileBackendFile *self,
+                                        GeglBufferTile      *entry,
+                                        guchar              *dest)
+{
+  gint     tile_size = GEGL_TILE_BACKEND (self)->tile_size;
+  goffset  offset = entry->offset;
+
+  gegl_tile_backend_file_ensure_exist (self);
+
+  if (entry->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+    {
+      gegl_tile_backend_file_compressed_entry_read (self, entry, dest);
+      return;
+    }
+
+#if USE_MMAP
+  if (self->use_mmap)
+    {
+      guchar *slot = gegl_tile_backend_file_map_slot (self, offset);
+
+      if (slot)
+        {
+          memcpy (dest, slot, tile_size);
+          GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
           return;
         }
-      to_be_read -= byte_read;
     }
+#endif
+#if USE_IO_THREAD
+  if (swap_io_read (self, offset, dest))
+    {
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i from the queue", entry->x, entry->y, entry->z, (gint)offset);
+      return;
+    }
+#endif
 
-
-  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
+  if (gegl_tile_backend_file_read_at (self, offset, dest, tile_size))
+    {
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "read entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
+    }
 }
 
 static void inline
@@ -186,6 +1197,29 @@ gegl_tile_backend_file_file_entry_write (GeglTileBackendFile *self,
 
   gegl_tile_backend_file_ensure_exist (self);
 
+#if USE_MMAP
+  if (self->use_mmap)
+    {
+      guchar *slot = gegl_tile_backend_file_map_slot (self, offset);
+
+      if (slot)
+        {
+          /* nothing to do when the tile was modified in place */
+          if (slot != source)
+            memcpy (slot, source, tile_size);
+          GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "wrote entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
+          return;
+        }
+    }
+#endif
+#if USE_IO_THREAD
+  if (swap_io_queue_write (self, offset, source))
+    {
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "queued entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
+      return;
+    }
+#endif
+
 #if HAVE_GIO
   success = g_seekable_seek (G_SEEKABLE (self->o),
                              offset, G_SEEK_SET,
@@ -224,61 +1258,213 @@ gegl_tile_backend_file_file_entry_write (GeglTileBackendFile *self,
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "wrote entry %i,%i,%i at %i", entry->x, entry->y, entry->z, (gint)offset);
 }
 
-static inline GeglBufferTile *
-gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
+/* returns the offset of a free tile sized slot in the file */
+static guint
+gegl_tile_backend_file_alloc_slot (GeglTileBackendFile *self)
 {
-  GeglBufferTile *entry = gegl_tile_entry_new (0,0,0);
+  guint offset;
 
-  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Creating new entry");
-
-  gegl_tile_backend_file_ensure_exist (self);
-
-  if (self->free_list)
+#if USE_MMAP
+  MAP_LOCK (self);
+#endif
+  if (gegl_tile_backend_file_take_extent (self,
+                                          GEGL_TILE_BACKEND (self)->tile_size,
+                                          &offset))
     {
-      /* XXX: losing precision ? */
-      gint offset = GPOINTER_TO_INT (self->free_list->data);
-      entry->offset = offset;
-      self->free_list = g_slist_remove (self->free_list, self->free_list->data);
-
-      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "  set offset %i from free list", ((gint)entry->offset));
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "  set offset %i from a hole", (gint)offset);
     }
   else
     {
-      gint tile_size = GEGL_TILE_BACKEND (self)->tile_size;
+      gint  tile_size = GEGL_TILE_BACKEND (self)->tile_size;
+      guint gap       = 0;
+
+#if USE_MMAP
+      /* a tile has to be within a single window */
+      if (self->use_mmap &&
+          self->next_pre_alloc / GEGL_MAP_WINDOW_SIZE !=
+          (self->next_pre_alloc + tile_size - 1) / GEGL_MAP_WINDOW_SIZE)
+        {
+          guint window_start = (self->next_pre_alloc + tile_size - 1) /
+                               GEGL_MAP_WINDOW_SIZE * GEGL_MAP_WINDOW_SIZE;
+
+          gap                  = window_start - self->next_pre_alloc;
+          self->next_pre_alloc = window_start;
+        }
+#endif
 
-      entry->offset = self->next_pre_alloc;
-      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "  set offset %i (next allocation)", (gint)entry->offset);
+      offset = self->next_pre_alloc;
+      GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "  set offset %i (next allocation)", (gint)offset);
       self->next_pre_alloc += tile_size;
 
+      /* the end of the last window goes to the free space, it is reused
+       * once the slot in front of it or the one behind it is freed
+       */
+      if (gap)
+        gegl_tile_backend_file_free_extent (self, offset - gap, gap);
+
       if (self->next_pre_alloc >= self->total)
         {
-          self->total = self->total + 32 * tile_size;
+#if USE_MMAP
+          if (self->use_mmap)
+            {
+              guint total = (self->next_pre_alloc / GEGL_MAP_WINDOW_SIZE + 1) *
+                            GEGL_MAP_WINDOW_SIZE;
+
+              /* grow by whole windows, the file stays sparse until the
+               * slots are written to
+               */
+              GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "growing file to %i bytes", (gint)total);
+
+              if (ftruncate (self->map_fd, total) == 0)
+                {
+                  self->total = total;
+                }
+              else
+                {
+                  /* storing through a mapping past the end of the file
+                   * raises SIGBUS, the slots that are in the file stay
+                   * mapped and the file grows with plain writes from now
+                   * on
+                   */
+                  g_warning ("unable to grow swap file %s: %s, falling back "
+                             "to reading and writing",
+                             self->path, g_strerror (errno));
+                  self->use_mmap = FALSE;
+                }
+            }
+          else
+#endif
+            {
+              self->total = self->total + 32 * tile_size;
 
-          GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "growing file to %i bytes", (gint)self->total);
+              GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "growing file to %i bytes", (gint)self->total);
 
 #if HAVE_GIO
-          g_assert (g_seekable_truncate (G_SEEKABLE (self->o),
-                                         self->total, NULL,NULL));
+              g_assert (g_seekable_truncate (G_SEEKABLE (self->o),
+                                             self->total, NULL,NULL));
 #else
-          g_assert (ftruncate (self->o, self->total) == 0);
+              g_assert (ftruncate (self->o, self->total) == 0);
 #endif
+            }
         }
     }
-  gegl_tile_backend_file_dbg_alloc (GEGL_TILE_BACKEND (self)->tile_size);
+#if USE_MMAP
+  MAP_UNLOCK (self);
+#endif
+  return offset;
+}
+
+/* Only entries of uncompressed tiles own a tile sized slot in the file,
+ * the data of compressed tiles is kept in the entry or was written by
+ * gegl_buffer_save and is too small to be reused for other tiles.
+ */
+#define ENTRY_HAS_SLOT(entry) ((entry)->block.flags == GEGL_FLAG_TILE && \
+                               (entry)->offset != 0)
+
+static inline GeglBufferTile *
+gegl_tile_backend_file_file_entry_new (GeglTileBackendFile *self)
+{
+  GeglBufferTile *entry = gegl_tile_entry_new (0,0,0);
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "Creating new entry");
+
+  gegl_tile_backend_file_ensure_exist (self);
+
+  /* the slot is allocated when the tile turns out not to be uniform */
+  entry->offset = 0;
   return entry;
 }
 
+static void
+gegl_tile_backend_file_entry_alloc_slot (GeglTileBackendFile *self,
+                                         GeglBufferTile      *entry)
+{
+  entry->block.flags  = GEGL_FLAG_TILE;
+  entry->block.length = sizeof (GeglBufferTile);
+  entry->offset       = gegl_tile_backend_file_alloc_slot (self);
+
+  gegl_tile_backend_file_dbg_alloc (GEGL_TILE_BACKEND (self)->tile_size);
+}
+
+static void
+gegl_tile_backend_file_free_slot (GeglTileBackendFile *self,
+                                  guint                offset)
+{
+#if USE_MMAP
+  if (!gegl_tile_backend_file_release_slot (self, offset))
+    {
+      MAP_LOCK (self);
+      gegl_tile_backend_file_free_extent (self, offset,
+                                          GEGL_TILE_BACKEND (self)->tile_size);
+      MAP_UNLOCK (self);
+    }
+#else
+  gegl_tile_backend_file_free_extent (self, offset,
+                                      GEGL_TILE_BACKEND (self)->tile_size);
+#endif
+#if USE_IO_THREAD
+  if (self->use_io_thread)
+    {
+      g_mutex_lock (swap_io_mutex);
+      swap_io_drop_readahead (self, offset);
+      g_mutex_unlock (swap_io_mutex);
+    }
+#endif
+}
+
+static void
+gegl_tile_backend_file_entry_free_slot (GeglTileBackendFile *self,
+                                        GeglBufferTile      *entry)
+{
+  /* XXX: EEEk, throwing away bits */
+  gegl_tile_backend_file_free_slot (self, entry->offset);
+  entry->offset = 0;
+
+  gegl_tile_backend_file_dbg_dealloc (GEGL_TILE_BACKEND (self)->tile_size);
+}
+
+/* stores a tile of a single color in its entry, without using any space
+ * in the file. Returns FALSE when the tile isn't uniform or the backend
+ * doesn't compress tiles.
+ */
+static gboolean
+gegl_tile_backend_file_entry_store_uniform (GeglTileBackendFile *self,
+                                            GeglBufferTile      *entry,
+                                            guchar              *data)
+{
+  GeglTileBackend          *backend    = GEGL_TILE_BACKEND (self);
+  GeglBufferCompressedTile *compressed = (GeglBufferCompressedTile *) entry;
+  gint                      size;
+
+  if (backend->compression < GEGL_TILE_CODEC_UNIFORM ||
+      backend->px_size > GEGL_BUFFER_INLINE_PIXEL)
+    return FALSE;
+
+  if (gegl_tile_codec_compress (GEGL_TILE_CODEC_UNIFORM, data,
+                                backend->tile_size, backend->px_size,
+                                compressed->pixel, &size) !=
+      GEGL_TILE_CODEC_UNIFORM)
+    return FALSE;
+
+  if (ENTRY_HAS_SLOT (entry))
+    gegl_tile_backend_file_entry_free_slot (self, entry);
+
+  entry->block.flags  = GEGL_FLAG_COMPRESSED_TILE;
+  entry->block.length = sizeof (GeglBufferCompressedTile);
+  entry->offset       = 0;
+  compressed->codec   = GEGL_TILE_CODEC_UNIFORM;
+  compressed->size    = 0;
+  return TRUE;
+}
+
 static inline void
 gegl_tile_backend_file_file_entry_destroy (GeglBufferTile      *entry,
                                            GeglTileBackendFile *self)
 {
-  /* XXX: EEEk, throwing away bits */
-  guint offset = entry->offset;
-  self->free_list = g_slist_prepend (self->free_list,
-                                     GUINT_TO_POINTER (offset));
-  g_hash_table_remove (self->index, entry);
+  if (ENTRY_HAS_SLOT (entry))
+    gegl_tile_backend_file_entry_free_slot (self, entry);
 
-  gegl_tile_backend_file_dbg_dealloc (GEGL_TILE_BACKEND (self)->tile_size);
+  g_hash_table_remove (self->index, entry);
   g_free (entry);
 }
 
@@ -394,6 +1580,8 @@ static gint allocs         = 0;
 static gint file_size      = 0;
 static gint peak_allocs    = 0;
 static gint peak_file_size = 0;
+static gint compact_moves  = 0;
+static gint compact_bytes  = 0;
 
 void
 gegl_tile_backend_file_stats (void)
@@ -401,6 +1589,12 @@ gegl_tile_backend_file_stats (void)
   g_warning ("leaked: %i chunks (%f mb)  peak: %i (%i bytes %fmb))",
              allocs, file_size / 1024 / 1024.0,
              peak_allocs, peak_file_size, peak_file_size / 1024 / 1024.0);
+  g_warning ("holes: %i extents (%f mb, %.1f%% of the swap)  compaction: "
+             "%i tiles moved, %f mb given back",
+             swap_hole_extents, swap_hole_bytes / 1024 / 1024.0,
+             file_size + swap_hole_bytes ?
+               100.0 * swap_hole_bytes / (file_size + swap_hole_bytes) : 0.0,
+             compact_moves, compact_bytes / 1024 / 1024.0);
 }
 
 static void
@@ -453,19 +1647,54 @@ gegl_tile_backend_file_get_tile (GeglTileSource *self,
 
   backend           = GEGL_TILE_BACKEND (self);
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
+
+  INDEX_READER_LOCK (tile_backend_file);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
 
   if (!entry)
-    return NULL;
+    {
+      INDEX_READER_UNLOCK (tile_backend_file);
+      return NULL;
+    }
+
+  /* tiles of a single color share their data until written to */
+  if (entry->block.flags == GEGL_FLAG_COMPRESSED_TILE)
+    {
+      GeglBufferCompressedTile *compressed = (GeglBufferCompressedTile *) entry;
+
+      if (compressed->codec == GEGL_TILE_CODEC_UNIFORM &&
+          compressed->size == 0)
+        {
+          tile = gegl_tile_new_uniform (backend->tile_width,
+                                        backend->tile_height,
+                                        backend->format, compressed->pixel);
+          tile->rev = entry->rev;
+          gegl_tile_mark_as_stored (tile);
+          INDEX_READER_UNLOCK (tile_backend_file);
+          return tile;
+        }
+    }
+
+#if USE_MMAP
+  tile = gegl_tile_backend_file_get_mapped_tile (tile_backend_file, entry);
+  if (tile)
+    {
+      tile->rev = entry->rev;
+      gegl_tile_mark_as_stored (tile);
+      INDEX_READER_UNLOCK (tile_backend_file);
+      return tile;
+    }
+#endif
 
   tile = gegl_tile_new (backend->tile_width,
                         backend->tile_height,
                         backend->format);
 
-  tile->rev        = entry->rev;
-  tile->stored_rev = entry->rev;
+  tile->rev = entry->rev;
+  gegl_tile_mark_as_stored (tile);
 
   gegl_tile_backend_file_file_entry_read (tile_backend_file, entry, tile->data);
+  INDEX_READER_UNLOCK (tile_backend_file);
   return tile;
 }
 
@@ -482,6 +1711,8 @@ gegl_tile_backend_file_set_tile (GeglTileSource *self,
 
   backend           = GEGL_TILE_BACKEND (self);
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
+
+  INDEX_WRITER_LOCK (tile_backend_file);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
 
   if (entry == NULL)
@@ -494,8 +1725,35 @@ gegl_tile_backend_file_set_tile (GeglTileSource *self,
     }
   entry->rev = tile->rev;
 
+  if (gegl_tile_backend_file_entry_store_uniform (tile_backend_file, entry,
+                                                  tile->data))
+    {
+      gegl_tile_mark_as_stored (tile);
+      INDEX_WRITER_UNLOCK (tile_backend_file);
+      return NULL;
+    }
+
+  if (!ENTRY_HAS_SLOT (entry))
+    {
+      gegl_tile_backend_file_entry_alloc_slot (tile_backend_file, entry);
+    }
+#if USE_MMAP
+  else if (tile_backend_file->use_mmap &&
+           tile->data != gegl_tile_backend_file_map_slot (tile_backend_file,
+                                                          entry->offset) &&
+           gegl_tile_backend_file_release_slot (tile_backend_file,
+                                                entry->offset))
+    {
+      /* an older version of the tile is still using the slot as its
+       * data, the new data goes elsewhere
+       */
+      entry->offset = gegl_tile_backend_file_alloc_slot (tile_backend_file);
+    }
+#endif
+
   gegl_tile_backend_file_file_entry_write (tile_backend_file, entry, tile->data);
-  tile->stored_rev = tile->rev;
+  gegl_tile_mark_as_stored (tile);
+  INDEX_WRITER_UNLOCK (tile_backend_file);
   return NULL;
 }
 
@@ -512,12 +1770,15 @@ gegl_tile_backend_file_void_tile (GeglTileSource *self,
 
   backend           = GEGL_TILE_BACKEND (self);
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
+
+  INDEX_WRITER_LOCK (tile_backend_file);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
 
   if (entry != NULL)
     {
       gegl_tile_backend_file_file_entry_destroy (entry, tile_backend_file);
     }
+  INDEX_WRITER_UNLOCK (tile_backend_file);
 
   return NULL;
 }
@@ -535,12 +1796,228 @@ gegl_tile_backend_file_exist_tile (GeglTileSource *self,
 
   backend           = GEGL_TILE_BACKEND (self);
   tile_backend_file = GEGL_TILE_BACKEND_FILE (backend);
+
+  INDEX_READER_LOCK (tile_backend_file);
   entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
+  INDEX_READER_UNLOCK (tile_backend_file);
 
   return entry!=NULL?((gpointer)0x1):NULL;
 }
 
 
+static gpointer
+gegl_tile_backend_file_prefetch (GeglTileSource *self,
+                                 gint            x,
+                                 gint            y,
+                                 gint            z)
+{
+  GeglTileBackendFile *tile_backend_file;
+  GeglBufferTile      *entry;
+  guint                offset = 0;
+
+  tile_backend_file = GEGL_TILE_BACKEND_FILE (self);
+
+  /* only a hint, a tile moved right after this is read from where it is */
+  INDEX_READER_LOCK (tile_backend_file);
+  entry             = gegl_tile_backend_file_lookup_entry (tile_backend_file, x, y, z);
+  if (entry && entry->block.flags == GEGL_FLAG_TILE)
+    offset = entry->offset;
+  INDEX_READER_UNLOCK (tile_backend_file);
+
+  if (offset == 0 || !tile_backend_file->exist)
+    return NULL;
+
+#if USE_MMAP
+  if (tile_backend_file->use_mmap)
+    {
+#if HAVE_MADVISE && defined (MADV_WILLNEED)
+      guchar *slot = gegl_tile_backend_file_map_slot (tile_backend_file,
+                                                      offset);
+      if (slot)
+        {
+          /* let the kernel page it in while we do something else */
+          gsize   page  = sysconf (_SC_PAGESIZE);
+          guchar *start = (guchar *) ((gsize) slot & ~(page - 1));
+
+          madvise (start,
+                   slot + GEGL_TILE_BACKEND (self)->tile_size - start,
+                   MADV_WILLNEED);
+        }
+#endif
+      return NULL;
+    }
+#endif
+#if USE_IO_THREAD
+  if (tile_backend_file->use_io_thread)
+    swap_io_queue_read (tile_backend_file, offset);
+#endif
+  return NULL;
+}
+
+static gint
+gegl_tile_backend_file_entry_offset_compare (gconstpointer a,
+                                             gconstpointer b)
+{
+  const GeglBufferTile *ea = a;
+  const GeglBufferTile *eb = b;
+
+  /* the last tile in the file first */
+  if (ea->offset > eb->offset)
+    return -1;
+  return ea->offset < eb->offset;
+}
+
+/* returns the offset of the lowest hole in the file, G_MAXUINT if there
+ * are none.
+ */
+static guint
+gegl_tile_backend_file_first_hole (GeglTileBackendFile *self)
+{
+  guint offset = G_MAXUINT;
+
+#if USE_MMAP
+  MAP_LOCK (self);
+#endif
+  if (g_sequence_get_length (self->free_extents) > 0)
+    {
+      GeglSwapExtent *extent;
+
+      extent = g_sequence_get (g_sequence_get_begin_iter (self->free_extents));
+      offset = extent->offset;
+    }
+#if USE_MMAP
+  MAP_UNLOCK (self);
+#endif
+  return offset;
+}
+
+/* gives the space after the last slot in use back to the file system */
+static void
+gegl_tile_backend_file_truncate (GeglTileBackendFile *self)
+{
+  guint total;
+
+#if USE_IO_THREAD
+  /* a late write to a slot past the end would grow the file again */
+  if (self->use_io_thread)
+    swap_io_sync (self);
+#endif
+#if USE_MMAP
+  if (self->use_mmap)
+    {
+      guint window;
+
+      MAP_LOCK (self);
+      /* slots pinned by tiles are never holes, so no tile is using the
+       * windows past next_pre_alloc
+       */
+      total = (self->next_pre_alloc / GEGL_MAP_WINDOW_SIZE + 1) *
+              GEGL_MAP_WINDOW_SIZE;
+      if (total < self->total)
+        {
+          for (window = total / GEGL_MAP_WINDOW_SIZE;
+               window < self->windows->len;
+               window++)
+            if (g_ptr_array_index (self->windows, window))
+              {
+                munmap (g_ptr_array_index (self->windows, window),
+                        GEGL_MAP_WINDOW_SIZE);
+                g_ptr_array_index (self->windows, window) = NULL;
+              }
+          if (ftruncate (self->map_fd, total) == 0)
+            {
+              g_atomic_int_add (&compact_bytes, self->total - total);
+              self->total = total;
+            }
+        }
+      MAP_UNLOCK (self);
+      return;
+    }
+#endif
+  total = self->next_pre_alloc;
+  if (total < self->total)
+    {
+#if HAVE_GIO
+      if (g_seekable_truncate (G_SEEKABLE (self->o), total, NULL, NULL))
+#else
+      if (ftruncate (self->o, total) == 0)
+#endif
+        {
+          g_atomic_int_add (&compact_bytes, self->total - total);
+          self->total = total;
+        }
+    }
+}
+
+/* moves tiles from the end of the file into the holes closer to its
+ * start, at most max_moves of them or all of them when max_moves is -1,
+ * and truncates the file after the last tile. Returns the number of
+ * tiles moved.
+ */
+static gint
+gegl_tile_backend_file_compact (GeglTileBackendFile *self,
+                                gint                 max_moves)
+{
+  GeglTileBackend *backend = GEGL_TILE_BACKEND (self);
+  GList           *entries;
+  GList           *iter;
+  guchar          *data;
+  gint             moved = 0;
+
+  /* other processes might be reading a shared file */
+  if (!self->exist || backend->shared || self->free_bytes == 0)
+    return 0;
+
+  GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "compacting %s, %i bytes in holes",
+             self->path, self->free_bytes);
+
+  /* readers must not see an entry between its move and its new offset,
+   * nor may it be voided under us
+   */
+  INDEX_WRITER_LOCK (self);
+  entries = g_hash_table_get_values (self->index);
+  entries = g_list_sort (entries, gegl_tile_backend_file_entry_offset_compare);
+  data    = gegl_malloc (backend->tile_size);
+
+  for (iter = entries; iter && moved != max_moves; iter = iter->next)
+    {
+      GeglBufferTile *entry  = iter->data;
+      guint           offset = entry->offset;
+
+      if (!ENTRY_HAS_SLOT (entry))
+        continue;
+      if (gegl_tile_backend_file_first_hole (self) > offset)
+        break;
+#if USE_MMAP
+      if (self->pinned)
+        {
+          gboolean pinned;
+
+          /* a tile is using the slot as its data */
+          MAP_LOCK (self);
+          pinned = g_hash_table_lookup (self->pinned,
+                                        GUINT_TO_POINTER (offset)) != NULL;
+          MAP_UNLOCK (self);
+          if (pinned)
+            continue;
+        }
+#endif
+      gegl_tile_backend_file_file_entry_read (self, entry, data);
+      entry->offset = gegl_tile_backend_file_alloc_slot (self);
+      gegl_tile_backend_file_file_entry_write (self, entry, data);
+      gegl_tile_backend_file_free_slot (self, offset);
+      moved++;
+    }
+  INDEX_WRITER_UNLOCK (self);
+  g_list_free (entries);
+  gegl_free (data);
+
+  gegl_tile_backend_file_truncate (self);
+
+  g_atomic_int_add (&compact_moves, moved);
+  return moved;
+}
+
 static gpointer
 gegl_tile_backend_file_flush (GeglTileSource *source,
                               GeglTile       *tile,
@@ -557,6 +2034,11 @@ gegl_tile_backend_file_flush (GeglTileSource *source,
 
   gegl_tile_backend_file_ensure_exist (self);
 
+#if USE_IO_THREAD
+  /* the index must not describe tiles that are not in the file yet */
+  swap_io_sync (self);
+#endif
+
   GEGL_NOTE (GEGL_DEBUG_TILE_BACKEND, "flushing %s", self->path);
 
 
@@ -564,6 +2046,7 @@ gegl_tile_backend_file_flush (GeglTileSource *source,
   self->header.next = self->next_pre_alloc; /* this is the offset
                                                we start handing
                                                out headers from*/
+  INDEX_READER_LOCK (self);
   tiles = g_hash_table_get_keys (self->index);
 
   if (tiles == NULL)
@@ -580,6 +2063,7 @@ gegl_tile_backend_file_flush (GeglTileSource *source,
       gegl_tile_backend_file_write_block (self, NULL); /* terminate the index */
       g_list_free (tiles);
     }
+  INDEX_READER_UNLOCK (self);
 
   gegl_tile_backend_file_write_header (self);
 #if HAVE_GIO
@@ -615,10 +2099,17 @@ gegl_tile_backend_file_command (GeglTileSource  *self,
         return gegl_tile_backend_file_set_tile (self, data, x, y, z);
 
       case GEGL_TILE_IDLE:
-        return NULL;       /* we could perhaps lazily be writing indexes
-                            * at some intervals, making it work as an
-                            * autosave for the buffer?
-                            */
+        {
+          GeglTileBackendFile *file = GEGL_TILE_BACKEND_FILE (self);
+
+          /* we could perhaps lazily be writing indexes at some intervals,
+           * making it work as an autosave for the buffer?
+           */
+          if (file->free_bytes > file->next_pre_alloc / 2 &&
+              gegl_tile_backend_file_compact (file, GEGL_SWAP_COMPACT_STEP))
+            return (gpointer) TRUE;
+          return NULL;
+        }
 
       case GEGL_TILE_VOID:
         return gegl_tile_backend_file_void_tile (self, data, x, y, z);
@@ -627,6 +2118,11 @@ gegl_tile_backend_file_command (GeglTileSource  *self,
         return gegl_tile_backend_file_exist_tile (self, data, x, y, z);
       case GEGL_TILE_FLUSH:
         return gegl_tile_backend_file_flush (self, data, x, y, z);
+      case GEGL_TILE_PREFETCH:
+        return gegl_tile_backend_file_prefetch (self, x, y, z);
+      case GEGL_TILE_COMPACT:
+        return GINT_TO_POINTER (
+          gegl_tile_backend_file_compact (GEGL_TILE_BACKEND_FILE (self), -1));
 
       default:
         g_assert (command < GEGL_TILE_LAST_COMMAND &&
@@ -684,6 +2180,57 @@ gegl_tile_backend_file_finalize (GObject *object)
 
   if (self->index)
     g_hash_table_unref (self->index);
+#if ENABLE_MT
+  g_static_rw_lock_free (&self->index_lock);
+  g_static_mutex_free (&self->read_mutex);
+#endif
+
+  gegl_tile_backend_file_clear_extents (self);
+  g_sequence_free (self->extents_by_size);
+  g_sequence_free (self->free_extents);
+
+#if USE_MMAP
+  /* the pins keep us alive, no tile is using a window anymore */
+  if (self->windows)
+    {
+      gint i;
+
+      for (i = 0; i < self->windows->len; i++)
+        if (g_ptr_array_index (self->windows, i))
+          munmap (g_ptr_array_index (self->windows, i), GEGL_MAP_WINDOW_SIZE);
+      g_ptr_array_free (self->windows, TRUE);
+    }
+  if (self->pinned)
+    g_hash_table_destroy (self->pinned);
+  if (self->map_fd != -1)
+    close (self->map_fd);
+#if ENABLE_MT
+  g_mutex_free (self->map_mutex);
+#endif
+#endif
+
+#if USE_IO_THREAD
+  /* queued requests hold a reference, only finished read-aheads are left */
+  if (self->readahead)
+    {
+      GList *reads = g_hash_table_get_values (self->readahead);
+      GList *iter;
+
+      for (iter = reads; iter; iter = iter->next)
+        {
+          GeglSwapIO *io = iter->data;
+
+          gegl_free (io->data);
+          g_slice_free (GeglSwapIO, io);
+        }
+      g_list_free (reads);
+      g_hash_table_destroy (self->readahead);
+    }
+  if (self->pending)
+    g_hash_table_destroy (self->pending);
+  if (self->io_fd != -1)
+    close (self->io_fd);
+#endif
 
   if (self->exist)
     {
@@ -819,7 +2366,7 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
           if (existing->tile.rev == item->tile.rev)
             {
               g_assert (existing->tile.offset == item->tile.offset);
-              existing->tile = item->tile;
+              existing->compressed = item->compressed;
               g_free (item);
               continue;
             }
@@ -846,8 +2393,7 @@ gegl_tile_backend_file_load_index (GeglTileBackendFile *self,
       g_hash_table_insert (self->index, iter->data, iter->data);
     }
   g_list_free (self->tiles);
-  g_slist_free (self->free_list);
-  self->free_list      = NULL;
+  gegl_tile_backend_file_clear_extents (self);
   self->next_pre_alloc = max; /* if bigger than own? */
   self->total          = max;
   self->tiles          = NULL;
@@ -1029,6 +2575,45 @@ gegl_tile_backend_file_ensure_exist (GeglTileBackendFile *self)
       g_assert (self->i != -1);
       g_assert (self->o != -1);
 #endif
+
+#if USE_MMAP
+      /* only files we create ourselves are mapped, files shared with
+       * other processes keep going through the streams
+       */
+      if (gegl_config ()->swap_mmap &&
+          backend->tile_size <= GEGL_MAP_WINDOW_SIZE)
+        {
+          self->map_fd = open (self->path, O_RDWR);
+          if (self->map_fd != -1)
+            {
+              self->use_mmap = TRUE;
+              self->windows  = g_ptr_array_new ();
+              self->pinned   = g_hash_table_new (NULL, NULL);
+            }
+          else
+            g_warning ("unable to open %s for mapping: %s",
+                       self->path, g_strerror (errno));
+        }
+#endif
+
+#if USE_IO_THREAD
+      /* without the mappings, tiles are written and read ahead in the
+       * background
+       */
+#if USE_MMAP
+      if (!self->use_mmap)
+#endif
+        {
+          self->io_fd = open (self->path, O_RDWR);
+          if (self->io_fd != -1)
+            {
+              swap_io_init ();
+              self->use_io_thread = TRUE;
+              self->pending       = g_hash_table_new (NULL, NULL);
+              self->readahead     = g_hash_table_new (NULL, NULL);
+            }
+        }
+#endif
     }
 }
 
@@ -1071,9 +2656,31 @@ gegl_tile_backend_file_init (GeglTileBackendFile *self)
   self->o              = -1;
 #endif
   self->index          = NULL;
-  self->free_list      = NULL;
+#if ENABLE_MT
+  g_static_rw_lock_init (&self->index_lock);
+  g_static_mutex_init (&self->read_mutex);
+#endif
+  self->free_extents   = g_sequence_new (gegl_tile_backend_file_extent_free);
+  self->extents_by_size = g_sequence_new (NULL);
+  self->free_bytes     = 0;
   self->next_pre_alloc = 256;  /* reserved space for header */
   self->total          = 256;  /* reserved space for header */
+#if USE_MMAP
+  self->use_mmap       = FALSE;
+  self->map_fd         = -1;
+  self->windows        = NULL;
+  self->pinned         = NULL;
+#if ENABLE_MT
+  self->map_mutex      = g_mutex_new ();
+#endif
+#endif
+#if USE_IO_THREAD
+  self->use_io_thread  = FALSE;
+  self->io_fd          = -1;
+  self->pending        = NULL;
+  self->readahead      = NULL;
+  self->n_writes       = 0;
+#endif
 }
 
 gboolean
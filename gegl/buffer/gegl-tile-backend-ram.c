@@ -24,10 +24,13 @@
 
 #include "gegl-tile-backend.h"
 #include "gegl-tile-backend-ram.h"
+#include "gegl-tile-codec.h"
 
 
 static void dbg_alloc (int size);
 static void dbg_dealloc (int size);
+static void dbg_realloc (int old_size,
+                         int size);
 
 /* These entries are kept in RAM for now, they should be written as an index to the
  * swap file, at a position specified by a header block, making the header grow up
@@ -43,6 +46,8 @@ struct _RamEntry
   gint    y;
   gint    z;
   guchar *offset;
+  gint    size;   /* bytes allocated at offset */
+  gint    codec;  /* the GeglTileCodec the data is compressed with */
 };
 
 static void inline
@@ -50,9 +55,13 @@ ram_entry_read (GeglTileBackendRam *ram,
                 RamEntry           *entry,
                 guchar             *dest)
 {
-  gint tile_size = GEGL_TILE_BACKEND (ram)->tile_size;
+  GeglTileBackend *backend = GEGL_TILE_BACKEND (ram);
 
-  memcpy (dest, entry->offset, tile_size);
+  if (entry->codec == GEGL_TILE_CODEC_NONE)
+    memcpy (dest, entry->offset, backend->tile_size);
+  else
+    gegl_tile_codec_decompress (entry->codec, entry->offset, entry->size,
+                                dest, backend->tile_size, backend->px_size);
 }
 
 static void inline
@@ -60,9 +69,37 @@ ram_entry_write (GeglTileBackendRam *ram,
                  RamEntry           *entry,
                  guchar             *source)
 {
-  gint tile_size = GEGL_TILE_BACKEND (ram)->tile_size;
+  GeglTileBackend *backend   = GEGL_TILE_BACKEND (ram);
+  gint             tile_size = backend->tile_size;
+  gint             old_size  = entry->size;
+  gboolean         reuse     = (old_size == tile_size);
+  guchar          *dest      = entry->offset;
+  gint             size;
+
+  /* compress into the existing allocation when it is a full tile, the
+   * compressed data is moved to an allocation of its own size afterwards.
+   */
+  if (!reuse)
+    dest = g_malloc (tile_size);
 
-  memcpy (entry->offset, source, tile_size);
+  entry->codec = gegl_tile_codec_compress (backend->compression, source,
+                                           tile_size, backend->px_size,
+                                           dest, &size);
+  if (entry->codec == GEGL_TILE_CODEC_NONE)
+    {
+      memcpy (dest, source, tile_size);
+      size = tile_size;
+    }
+  else
+    {
+      dest = g_realloc (dest, size);
+    }
+
+  if (!reuse)
+    g_free (entry->offset);
+  entry->offset = dest;
+  entry->size   = size;
+  dbg_realloc (old_size, size);
 }
 
 static inline RamEntry *
@@ -70,8 +107,11 @@ ram_entry_new (GeglTileBackendRam *ram)
 {
   RamEntry *self = g_slice_new (RamEntry);
 
-  self->offset = g_malloc (GEGL_TILE_BACKEND (ram)->tile_size);
-  dbg_alloc (GEGL_TILE_BACKEND (ram)->tile_size);
+  /* the data is allocated when the entry is first written */
+  self->offset = NULL;
+  self->size   = 0;
+  self->codec  = GEGL_TILE_CODEC_NONE;
+  dbg_alloc (0);
   return self;
 }
 
@@ -82,7 +122,7 @@ ram_entry_destroy (RamEntry           *entry,
   g_free (entry->offset);
   g_hash_table_remove (ram->entries, entry);
 
-  dbg_dealloc (GEGL_TILE_BACKEND (ram)->tile_size);
+  dbg_dealloc (entry->size);
   g_slice_free (RamEntry, entry);
 }
 
@@ -118,6 +158,14 @@ static void dbg_dealloc (gint size)
   ram_size -= size;
 }
 
+static void dbg_realloc (gint old_size,
+                         gint size)
+{
+  ram_size += size - old_size;
+  if (ram_size > peak_ram_size)
+    peak_ram_size = ram_size;
+}
+
 static inline RamEntry *
 lookup_entry (GeglTileBackendRam *self,
               gint         x,
@@ -155,14 +203,23 @@ get_tile (GeglTileSource *tile_store,
     if (!entry)
       return NULL;
 
-    tile = gegl_tile_new (backend->tile_width,
-                          backend->tile_height,
-                          backend->format);
-
-    tile->stored_rev = 1;
-    tile->rev        = 1;
-
-    ram_entry_read (tile_backend_ram, entry, tile->data);
+    /* tiles of a single color share their data until written to */
+    if (entry->codec == GEGL_TILE_CODEC_UNIFORM)
+      {
+        tile = gegl_tile_new_uniform (backend->tile_width,
+                                      backend->tile_height,
+                                      backend->format, entry->offset);
+      }
+    else
+      {
+        tile = gegl_tile_new (backend->tile_width,
+                              backend->tile_height,
+                              backend->format);
+        ram_entry_read (tile_backend_ram, entry, tile->data);
+      }
+
+    tile->rev = 1;
+    gegl_tile_mark_as_stored (tile);
   }
   return tile;
 }
@@ -190,7 +247,7 @@ gboolean set_tile (GeglTileSource *store,
   gegl_tile_lock (tile, GEGL_TILE_LOCK_READ);
   ram_entry_write (tile_backend_ram, entry, tile->data);
   gegl_tile_unlock (tile);
-  tile->stored_rev = tile->rev;
+  gegl_tile_mark_as_stored (tile);
   return TRUE;
 }
 
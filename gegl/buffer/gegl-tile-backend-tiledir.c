@@ -156,8 +156,8 @@ get_tile (GeglTileSource *tile_store,
                           backend->tile_height,
                           backend->format);
 
-    tile->stored_rev = 1;
-    tile->rev        = 1;
+    tile->rev = 1;
+    gegl_tile_mark_as_stored (tile);
 
     gio_entry_read (tile_backend_tiledir, &entry, tile->data);
     return tile;
@@ -183,7 +183,7 @@ set_tile (GeglTileSource *store,
   gegl_tile_lock (tile, GEGL_TILE_LOCK_READ);
   gio_entry_write (tile_backend_tiledir, &entry, tile->data);
   gegl_tile_unlock (tile);
-  tile->stored_rev = tile->rev;
+  gegl_tile_mark_as_stored (tile);
   return NULL;
 }
 
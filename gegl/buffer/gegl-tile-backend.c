@@ -21,8 +21,13 @@
 #include <string.h>
 
 #include <babl/babl.h>
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-config.h"
 #include "gegl-tile-source.h"
 #include "gegl-tile-backend.h"
+#include "gegl-tile-codec.h"
+#include "gegl-tile-alloc.h"
 
 G_DEFINE_TYPE (GeglTileBackend, gegl_tile_backend, GEGL_TYPE_TILE_SOURCE)
 static GObjectClass * parent_class = NULL;
@@ -34,7 +39,8 @@ enum
   PROP_TILE_HEIGHT,
   PROP_PX_SIZE,
   PROP_TILE_SIZE,
-  PROP_FORMAT
+  PROP_FORMAT,
+  PROP_COMPRESSION
 };
 
 static void
@@ -67,6 +73,10 @@ get_property (GObject    *gobject,
         g_value_set_pointer (value, backend->format);
         break;
 
+      case PROP_COMPRESSION:
+        g_value_set_int (value, backend->compression);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -95,6 +105,10 @@ set_property (GObject      *gobject,
         backend->format = g_value_get_pointer (value);
         break;
 
+      case PROP_COMPRESSION:
+        backend->compression = g_value_get_int (value);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -118,6 +132,12 @@ constructor (GType                  type,
 
   backend->px_size = babl_format_get_bytes_per_pixel (backend->format);
   backend->tile_size = backend->tile_width * backend->tile_height * backend->px_size;
+  gegl_tile_alloc_register (backend->tile_size);
+
+  /* -1 picks the codec configured in GeglConfig */
+  if (backend->compression < 0)
+    backend->compression =
+      gegl_tile_codec_from_string (gegl_config ()->tile_compression);
 
   return object;
 }
@@ -155,6 +175,11 @@ gegl_tile_backend_class_init (GeglTileBackendClass *klass)
                                    g_param_spec_pointer ("format", "format", "babl format",
                                                          G_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT_ONLY));
+  g_object_class_install_property (gobject_class, PROP_COMPRESSION,
+                                   g_param_spec_int ("compression", "compression", "GeglTileCodec used for stored tiles, -1 to use the configured one",
+                                                     -1, GEGL_TILE_CODEC_LAST - 1, -1,
+                                                     G_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
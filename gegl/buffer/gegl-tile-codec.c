@@ -0,0 +1,338 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gegl-tile-codec.h"
+#include "gegl-instrument.h"
+
+/* The run length encoding works on whole pixels, a control byte c below
+ * 128 is followed by c + 1 literal pixels, a control byte of 128 or above
+ * is followed by a single pixel repeated c - 126 times.
+ */
+#define RLE_MAX_LITERALS  128
+#define RLE_MAX_RUN       129
+
+/* compressed tiles that don't save at least an eighth of the space are
+ * stored as is, decompressing them would cost more than it is worth.
+ */
+#define MIN_SAVING(tile_size) ((tile_size) / 8)
+
+/* the number of pixels at the start of a tile compared before the whole
+ * tile is checked for being uniform, about a row of a tile
+ */
+#define UNIFORM_PROBE 64
+
+/* every thread counts in a record of its own, the records are only summed
+ * up when the statistics are printed
+ */
+typedef struct
+{
+  guint64 bytes_in;
+  guint64 bytes_out;
+  gint    tiles[GEGL_TILE_CODEC_LAST];
+  glong   compress_time;
+  glong   decompress_time;
+} CodecStats;
+
+static GStaticPrivate stats_key   = G_STATIC_PRIVATE_INIT;
+static GStaticMutex   stats_mutex = G_STATIC_MUTEX_INIT;
+static GSList        *stats_list  = NULL;
+
+static const gchar *codec_names[GEGL_TILE_CODEC_LAST] =
+{
+  "none",
+  "uniform",
+  "rle"
+};
+
+GeglTileCodec
+gegl_tile_codec_from_string (const gchar *name)
+{
+  gint i;
+
+  if (name)
+    for (i = 0; i < GEGL_TILE_CODEC_LAST; i++)
+      if (g_str_equal (name, codec_names[i]))
+        return i;
+
+  g_warning ("unknown tile compression '%s', falling back to 'none'",
+             name ? name : "(null)");
+  return GEGL_TILE_CODEC_NONE;
+}
+
+static CodecStats *
+codec_stats (void)
+{
+  CodecStats *stats = g_static_private_get (&stats_key);
+
+  if (G_UNLIKELY (stats == NULL))
+    {
+      /* kept when the thread exits, its counts are part of the totals */
+      stats = g_new0 (CodecStats, 1);
+      g_static_private_set (&stats_key, stats, NULL);
+
+      g_static_mutex_lock (&stats_mutex);
+      stats_list = g_slist_prepend (stats_list, stats);
+      g_static_mutex_unlock (&stats_mutex);
+    }
+  return stats;
+}
+
+static inline gboolean
+tile_is_uniform (const guchar *src,
+                 gint          tile_size,
+                 gint          px_size)
+{
+  gint probe = MIN (tile_size, UNIFORM_PROBE * px_size);
+
+  /* all pixels are equal exactly when each pixel equals the one after it,
+   * comparing the tile against itself shifted by one pixel checks that in
+   * a single pass. The first pixels and the last one rule out most tiles
+   * before the whole tile is compared.
+   */
+  return memcmp (src, src + px_size, probe - px_size) == 0 &&
+         memcmp (src, src + tile_size - px_size, px_size) == 0 &&
+         memcmp (src, src + px_size, tile_size - px_size) == 0;
+}
+
+static gint
+rle_encode (const guchar *src,
+            gint          tile_size,
+            gint          px_size,
+            guchar       *dest)
+{
+  gint n_pixels = tile_size / px_size;
+  gint limit    = tile_size - MIN_SAVING (tile_size);
+  gint out      = 0;
+  gint i        = 0;
+
+  while (i < n_pixels)
+    {
+      const guchar *pixel = src + i * px_size;
+      gint          run   = 1;
+
+      while (i + run < n_pixels && run < RLE_MAX_RUN &&
+             memcmp (pixel, pixel + run * px_size, px_size) == 0)
+        run++;
+
+      if (run > 1)
+        {
+          if (out + 1 + px_size > limit)
+            return -1;
+          dest[out++] = 128 + run - 2;
+          memcpy (dest + out, pixel, px_size);
+          out += px_size;
+        }
+      else
+        {
+          /* collect literals up to the start of the next run */
+          while (i + run < n_pixels && run < RLE_MAX_LITERALS &&
+                 (i + run + 1 >= n_pixels ||
+                  memcmp (pixel + run * px_size,
+                          pixel + (run + 1) * px_size, px_size) != 0))
+            run++;
+
+          if (out + 1 + run * px_size > limit)
+            return -1;
+          dest[out++] = run - 1;
+          memcpy (dest + out, pixel, run * px_size);
+          out += run * px_size;
+        }
+      i += run;
+    }
+  return out;
+}
+
+static gboolean
+rle_decode (const guchar *src,
+            gint          size,
+            guchar       *dest,
+            gint          tile_size,
+            gint          px_size)
+{
+  const guchar *end      = src + size;
+  guchar       *dest_end = dest + tile_size;
+
+  while (src < end)
+    {
+      gint control = *src++;
+
+      if (control < 128)
+        {
+          gint bytes = (control + 1) * px_size;
+
+          if (src + bytes > end || dest + bytes > dest_end)
+            return FALSE;
+          memcpy (dest, src, bytes);
+          src  += bytes;
+          dest += bytes;
+        }
+      else
+        {
+          gint run = control - 126;
+
+          if (src + px_size > end || dest + run * px_size > dest_end)
+            return FALSE;
+          while (run--)
+            {
+              memcpy (dest, src, px_size);
+              dest += px_size;
+            }
+          src += px_size;
+        }
+    }
+  return dest == dest_end;
+}
+
+GeglTileCodec
+gegl_tile_codec_compress (GeglTileCodec  max_codec,
+                          const guchar  *src,
+                          gint           tile_size,
+                          gint           px_size,
+                          guchar        *dest,
+                          gint          *size)
+{
+  GeglTileCodec codec = GEGL_TILE_CODEC_NONE;
+  CodecStats   *stats;
+  glong         ticks;
+
+  if (max_codec == GEGL_TILE_CODEC_NONE)
+    return GEGL_TILE_CODEC_NONE;
+
+  ticks = gegl_ticks ();
+  *size = tile_size;
+
+  if (tile_is_uniform (src, tile_size, px_size))
+    {
+      memcpy (dest, src, px_size);
+      *size = px_size;
+      codec = GEGL_TILE_CODEC_UNIFORM;
+    }
+  else if (max_codec >= GEGL_TILE_CODEC_RLE)
+    {
+      gint encoded = rle_encode (src, tile_size, px_size, dest);
+
+      if (encoded >= 0)
+        {
+          *size = encoded;
+          codec = GEGL_TILE_CODEC_RLE;
+        }
+    }
+  ticks = gegl_ticks () - ticks;
+
+  stats = codec_stats ();
+  stats->bytes_in  += tile_size;
+  stats->bytes_out += *size;
+  stats->tiles[codec]++;
+  stats->compress_time += ticks;
+
+  return codec;
+}
+
+gboolean
+gegl_tile_codec_decompress (GeglTileCodec  codec,
+                            const guchar  *src,
+                            gint           size,
+                            guchar        *dest,
+                            gint           tile_size,
+                            gint           px_size)
+{
+  gboolean ret   = FALSE;
+  glong    ticks = gegl_ticks ();
+
+  switch (codec)
+    {
+      case GEGL_TILE_CODEC_NONE:
+        if (size == tile_size)
+          {
+            memcpy (dest, src, tile_size);
+            ret = TRUE;
+          }
+        break;
+
+      case GEGL_TILE_CODEC_UNIFORM:
+        if (size == px_size)
+          {
+            gint filled = px_size;
+
+            /* double the initialized part on every step */
+            memcpy (dest, src, px_size);
+            while (filled < tile_size)
+              {
+                gint bytes = MIN (filled, tile_size - filled);
+                memcpy (dest + filled, dest, bytes);
+                filled += bytes;
+              }
+            ret = TRUE;
+          }
+        break;
+
+      case GEGL_TILE_CODEC_RLE:
+        ret = rle_decode (src, size, dest, tile_size, px_size);
+        break;
+
+      default:
+        break;
+    }
+
+  if (!ret)
+    g_warning ("corrupt %s compressed tile",
+               codec < GEGL_TILE_CODEC_LAST ? codec_names[codec] : "unknown");
+
+  ticks = gegl_ticks () - ticks;
+  codec_stats ()->decompress_time += ticks;
+
+  return ret;
+}
+
+void
+gegl_tile_codec_stats (void)
+{
+  CodecStats  total = { 0, };
+  GSList     *iter;
+  gint        i;
+
+  g_static_mutex_lock (&stats_mutex);
+  for (iter = stats_list; iter; iter = g_slist_next (iter))
+    {
+      CodecStats *stats = iter->data;
+
+      total.bytes_in        += stats->bytes_in;
+      total.bytes_out       += stats->bytes_out;
+      total.compress_time   += stats->compress_time;
+      total.decompress_time += stats->decompress_time;
+      for (i = 0; i < GEGL_TILE_CODEC_LAST; i++)
+        total.tiles[i] += stats->tiles[i];
+    }
+  g_static_mutex_unlock (&stats_mutex);
+
+  g_warning ("tile compression: %i uniform %i rle %i raw tiles, "
+             "%.1fmb stored in %.1fmb (ratio %.2f) "
+             "compress: %.3fs decompress: %.3fs",
+             total.tiles[GEGL_TILE_CODEC_UNIFORM],
+             total.tiles[GEGL_TILE_CODEC_RLE],
+             total.tiles[GEGL_TILE_CODEC_NONE],
+             total.bytes_in / 1024 / 1024.0,
+             total.bytes_out / 1024 / 1024.0,
+             total.bytes_out ? (gdouble) total.bytes_in / total.bytes_out : 1.0,
+             total.compress_time / 1000000.0,
+             total.decompress_time / 1000000.0);
+}
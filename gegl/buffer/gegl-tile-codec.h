@@ -0,0 +1,64 @@
+/* This file is part of GEGL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_TILE_CODEC_H__
+#define __GEGL_TILE_CODEC_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The codecs are ordered by how hard they try, a backend configured for
+ * a codec also uses the cheaper ones before it.
+ */
+typedef enum
+{
+  GEGL_TILE_CODEC_NONE    = 0, /* the raw pixels */
+  GEGL_TILE_CODEC_UNIFORM = 1, /* a single pixel covering the whole tile */
+  GEGL_TILE_CODEC_RLE     = 2, /* runs of identical pixels */
+  GEGL_TILE_CODEC_LAST
+} GeglTileCodec;
+
+GeglTileCodec gegl_tile_codec_from_string (const gchar   *name);
+
+/* compresses the tile_size bytes at src trying the codecs up to max_codec,
+ * dest has to hold tile_size bytes. Returns the codec used and stores the
+ * number of bytes written to dest in size, GEGL_TILE_CODEC_NONE means that
+ * the tile doesn't compress well and should be stored as is, the contents
+ * of dest are undefined then.
+ */
+GeglTileCodec gegl_tile_codec_compress    (GeglTileCodec  max_codec,
+                                           const guchar  *src,
+                                           gint           tile_size,
+                                           gint           px_size,
+                                           guchar        *dest,
+                                           gint          *size);
+
+/* expands size bytes compressed with codec into the tile_size bytes at
+ * dest, returns FALSE if src was not a valid encoding.
+ */
+gboolean      gegl_tile_codec_decompress  (GeglTileCodec  codec,
+                                           const guchar  *src,
+                                           gint           size,
+                                           guchar        *dest,
+                                           gint           tile_size,
+                                           gint           px_size);
+
+void          gegl_tile_codec_stats       (void);
+
+G_END_DECLS
+
+#endif
@@ -28,12 +28,9 @@
 #include "gegl-buffer-private.h"
 #include "gegl-tile.h"
 #include "gegl-tile-handler-cache.h"
+#include "gegl-tile-alloc.h"
 #include "gegl-debug.h"
 
-#if ENABLE_MT
-static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
-#endif
-
 struct _GeglTileHandlerCache
 {
   GeglTileHandler parent_instance;
@@ -43,7 +40,10 @@ struct _GeglTileHandlerCache
 
 G_DEFINE_TYPE (GeglTileHandlerCache, gegl_tile_handler_cache, GEGL_TYPE_TILE_HANDLER)
 
-typedef struct CacheItem
+typedef struct CacheItem CacheItem;
+typedef struct CacheList CacheList;
+
+struct CacheItem
 { 
   GeglTileHandlerCache *handler; /* The specific handler that cached this item*/
   GeglTile *tile;                /* The tile */
@@ -51,17 +51,89 @@ typedef struct CacheItem
   gint      x;                   /* The coordinates this tile was cached for */
   gint      y;
   gint      z;
-} CacheItem;
-
-static GQueue *cache_queue = NULL;
-static GHashTable *cache_ht = NULL;
-static gint    cache_wash_percentage = 20;
-#if 0
-static gint    cache_hits = 0;
-static gint    cache_misses = 0;
+
+  CacheList *list;               /* the shard list the item is on */
+  CacheItem *prev;               /* more recently used item in the list */
+  CacheItem *next;               /* less recently used item in the list */
+
+  gboolean   referenced;         /* CLOCK: hit since the hand last passed */
+  guint      priority;           /* COST: eviction priority, lowest goes */
+};
+
+struct CacheList
+{
+  CacheItem *head;    /* most recently used */
+  CacheItem *tail;    /* least recently used */
+  gint       length;
+};
+
+/* The cache is split in shards, each with its own lock, hash table and
+ * least recently used list. Items are spread over the shards by their
+ * hash, so that threads working on different tiles rarely contend for
+ * the same lock. Eviction is only approximately least recently used
+ * across the whole cache.
+ */
+#define CACHE_SHARDS 16  /* must be a power of two */
+
+typedef struct CacheShard
+{
+#if ENABLE_MT
+  GMutex     *mutex;
+#endif
+  GHashTable *ht;
+  CacheList   main;       /* all items, except 2Q's probation ones */
+  CacheList   probation;  /* 2Q: items that have been used only once */
+  GHashTable *ghost_ht;   /* 2Q: keys of items evicted from probation */
+  CacheList   ghosts;     /* 2Q: the same keys, latest eviction first */
+  guint       inflation;  /* COST: priority of the last evicted item */
+} CacheShard;
+
+typedef struct CacheStats
+{
+  volatile gint hits;
+  volatile gint misses;
+  volatile gint evictions;
+} CacheStats;
+
+/* the part of the shard that 2Q lets the probation list fill before
+ * evicting from it, in percent
+ */
+#define CACHE_2Q_PROBATION_PERCENTAGE 25
+
+/* how many keys of items evicted from probation 2Q remembers, in percent
+ * of the items in the shard. An item coming back while its key is still
+ * remembered skips probation.
+ */
+#define CACHE_2Q_GHOST_PERCENTAGE 50
+
+/* how many of the least recently used items the cost-aware policy
+ * compares when picking an item to evict
+ */
+#define CACHE_COST_WINDOW 16
+
+#if ENABLE_MT
+#define SHARD_LOCK(shard)   g_mutex_lock ((shard)->mutex)
+#define SHARD_UNLOCK(shard) g_mutex_unlock ((shard)->mutex)
+static GStaticMutex init_mutex = G_STATIC_MUTEX_INIT;
+#else
+#define SHARD_LOCK(shard)
+#define SHARD_UNLOCK(shard)
 #endif
 
-static gint    cache_total = 0;  /* approximate amount of bytes stored */
+static CacheShard      cache_shards[CACHE_SHARDS];
+static gboolean        cache_initialized = FALSE;
+static gint            cache_wash_percentage = 20;
+static GeglCachePolicy cache_policy = GEGL_CACHE_POLICY_LRU;
+static CacheStats      cache_stats[GEGL_CACHE_POLICY_LAST];
+
+static const gchar *cache_policy_names[GEGL_CACHE_POLICY_LAST] =
+{
+  "lru", "clock", "2q", "cost"
+};
+
+static volatile gint  cache_total = 0;  /* approximate amount of bytes stored */
+static volatile gint  trim_shard  = 0;  /* next shard to evict from */
+static volatile gint  wash_shard  = 0;  /* next shard to wash */
 
 
 
@@ -106,23 +178,362 @@ static gboolean equalfunc (gconstpointer a,
   return FALSE;
 }
 
+/* the lowest bits of the morton hash are always zero or dominated by the
+ * rarely changing z coordinate, mix them before picking a shard so that
+ * neighbouring tiles end up in different shards.
+ */
+static inline CacheShard *
+cache_shard (const CacheItem *item)
+{
+  guint hash = hashfunc (item);
+
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3b;
+  hash ^= hash >> 16;
+  return &cache_shards[hash & (CACHE_SHARDS - 1)];
+}
+
+/* the list manipulations below expect the shard to be locked */
+static inline void
+list_unlink (CacheItem *item)
+{
+  CacheList *list = item->list;
+
+  if (item->prev)
+    item->prev->next = item->next;
+  else
+    list->head = item->next;
+  if (item->next)
+    item->next->prev = item->prev;
+  else
+    list->tail = item->prev;
+  item->prev = item->next = NULL;
+  item->list = NULL;
+  list->length--;
+}
+
+static inline void
+list_push_head (CacheList *list,
+                CacheItem *item)
+{
+  item->list = list;
+  item->prev = NULL;
+  item->next = list->head;
+  if (list->head)
+    list->head->prev = item;
+  else
+    list->tail = item;
+  list->head = item;
+  list->length++;
+}
+
+static inline void
+list_move_to_head (CacheList *list,
+                   CacheItem *item)
+{
+  if (list->head == item)
+    return;
+  list_unlink (item);
+  list_push_head (list, item);
+}
+
+static inline void
+shard_remove (CacheShard *shard,
+              CacheItem  *item)
+{
+  list_unlink (item);
+  g_hash_table_remove (shard->ht, item);
+  g_atomic_int_add (&cache_total, -item->tile->size);
+}
+
+/* the ghosts are items without a tile that only keep the key */
+static inline void
+ghost_remove (CacheShard *shard,
+              CacheItem  *ghost)
+{
+  list_unlink (ghost);
+  g_hash_table_remove (shard->ghost_ht, ghost);
+  g_slice_free (CacheItem, ghost);
+}
+
+static void
+ghost_add (CacheShard *shard,
+           CacheItem  *item)
+{
+  CacheItem *ghost = g_slice_new0 (CacheItem);
+  gint       limit;
+
+  ghost->handler = item->handler;
+  ghost->x       = item->x;
+  ghost->y       = item->y;
+  ghost->z       = item->z;
+
+  list_push_head (&shard->ghosts, ghost);
+  g_hash_table_insert (shard->ghost_ht, ghost, ghost);
+
+  limit = (shard->main.length + shard->probation.length) *
+          CACHE_2Q_GHOST_PERCENTAGE / 100;
+  while (shard->ghosts.length > MAX (limit, 1))
+    ghost_remove (shard, shard->ghosts.tail);
+}
+
+/* how expensive an item is to bring back once evicted. A tile of mipmap
+ * level z is rebuilt from 4 tiles of level z-1, which are usually still
+ * around, so the weight grows by 4 for every level rather than with the
+ * 4^z tiles of level 0 beneath it. An exponential weight would let the
+ * higher levels outlive almost any number of evictions with the aging of
+ * policy_victim, the levels above 8 are weighted like level 8.
+ */
+static inline guint
+item_cost (CacheItem *item)
+{
+  return 1 + 4 * MIN (MAX (item->z, 0), 8);
+}
+
+/* The eviction policies, they only differ in where new items are put,
+ * what a hit does to an item and which item is evicted.
+ */
+static void
+policy_insert (CacheShard *shard,
+               CacheItem  *item)
+{
+  switch (cache_policy)
+    {
+      case GEGL_CACHE_POLICY_2Q:
+        {
+          CacheItem *ghost = g_hash_table_lookup (shard->ghost_ht, item);
+
+          /* evicted from probation not long ago, it is used again */
+          if (ghost)
+            {
+              ghost_remove (shard, ghost);
+              list_push_head (&shard->main, item);
+            }
+          else
+            {
+              list_push_head (&shard->probation, item);
+            }
+        }
+        break;
+      case GEGL_CACHE_POLICY_COST:
+        item->priority = shard->inflation + item_cost (item);
+        list_push_head (&shard->main, item);
+        break;
+      default:
+        list_push_head (&shard->main, item);
+        break;
+    }
+}
+
+static void
+policy_hit (CacheShard *shard,
+            CacheItem  *item)
+{
+  switch (cache_policy)
+    {
+      case GEGL_CACHE_POLICY_CLOCK:
+        /* no list manipulation on hits, the hand gives it a second chance */
+        item->referenced = TRUE;
+        break;
+      case GEGL_CACHE_POLICY_2Q:
+        /* used a second time, promote it out of probation */
+        list_move_to_head (&shard->main, item);
+        break;
+      case GEGL_CACHE_POLICY_COST:
+        item->priority = shard->inflation + item_cost (item);
+        list_move_to_head (&shard->main, item);
+        break;
+      default:
+        list_move_to_head (&shard->main, item);
+        break;
+    }
+}
+
+/* called for the victim before it is removed from the shard */
+static void
+policy_evict (CacheShard *shard,
+              CacheItem  *item)
+{
+  if (cache_policy == GEGL_CACHE_POLICY_2Q &&
+      item->list == &shard->probation)
+    ghost_add (shard, item);
+}
+
+/* returns the item the policy wants evicted, it is left in the shard */
+static CacheItem *
+policy_victim (CacheShard *shard)
+{
+  switch (cache_policy)
+    {
+      case GEGL_CACHE_POLICY_CLOCK:
+        {
+          gint       left = shard->main.length;
+          CacheItem *item = shard->main.tail;
+
+          while (item && item->referenced && left-- > 0)
+            {
+              item->referenced = FALSE;
+              list_move_to_head (&shard->main, item);
+              item = shard->main.tail;
+            }
+          return item;
+        }
+      case GEGL_CACHE_POLICY_2Q:
+        {
+          gint total = shard->main.length + shard->probation.length;
+
+          if (shard->probation.tail &&
+              (shard->main.tail == NULL ||
+               shard->probation.length * 100 >=
+               total * CACHE_2Q_PROBATION_PERCENTAGE))
+            return shard->probation.tail;
+          return shard->main.tail;
+        }
+      case GEGL_CACHE_POLICY_COST:
+        {
+          CacheItem *item   = shard->main.tail;
+          CacheItem *victim = item;
+          gint       i;
+
+          for (i = 0; item && i < CACHE_COST_WINDOW; i++, item = item->prev)
+            if (item->priority < victim->priority)
+              victim = item;
+          /* the priorities of the items that stay are relative to this,
+           * they age as more items are evicted (GreedyDual) */
+          if (victim)
+            shard->inflation = victim->priority;
+          return victim;
+        }
+      default:
+        return shard->main.tail;
+    }
+}
+
+static GeglCachePolicy
+policy_from_string (const gchar *name)
+{
+  gint i;
+
+  if (name)
+    for (i = 0; i < GEGL_CACHE_POLICY_LAST; i++)
+      if (!g_ascii_strcasecmp (name, cache_policy_names[i]))
+        return i;
+
+  if (name)
+    g_warning ("unknown cache policy '%s', using lru", name);
+  return GEGL_CACHE_POLICY_LRU;
+}
+
+GeglCachePolicy
+gegl_tile_cache_get_policy (void)
+{
+  return cache_policy;
+}
+
+void
+gegl_tile_cache_get_stats (GeglCachePolicy  policy,
+                           gint            *hits,
+                           gint            *misses,
+                           gint            *evictions)
+{
+  g_return_if_fail (policy < GEGL_CACHE_POLICY_LAST);
+
+  if (hits)
+    *hits = g_atomic_int_get (&cache_stats[policy].hits);
+  if (misses)
+    *misses = g_atomic_int_get (&cache_stats[policy].misses);
+  if (evictions)
+    *evictions = g_atomic_int_get (&cache_stats[policy].evictions);
+}
+
+void
+gegl_tile_cache_stats (void)
+{
+  gint i;
+
+  for (i = 0; i < GEGL_CACHE_POLICY_LAST; i++)
+    {
+      gint hits, misses, evictions;
+
+      gegl_tile_cache_get_stats (i, &hits, &misses, &evictions);
+      if (hits + misses == 0)
+        continue;
+      g_warning ("Tile cache (%s): hits:%i misses:%i (%.1f%% hits) evictions:%i",
+                 cache_policy_names[i], hits, misses,
+                 hits * 100.0 / (hits + misses), evictions);
+    }
+}
+
 
 void gegl_tile_cache_init (void)
 {
-  if (cache_queue == NULL)
-    cache_queue = g_queue_new ();
-  if (cache_ht == NULL)
-    cache_ht = g_hash_table_new (hashfunc, equalfunc);
+  gint i;
+
+  if (cache_initialized)
+    return;
+
+#if ENABLE_MT
+  g_static_mutex_lock (&init_mutex);
+#endif
+  if (!cache_initialized)
+    {
+      /* changing the policy of a populated cache would mix up the lists,
+       * it is only picked up here */
+      cache_policy = policy_from_string (gegl_config ()->cache_policy);
+
+      for (i = 0; i < CACHE_SHARDS; i++)
+        {
+          CacheShard *shard = &cache_shards[i];
+          CacheList   empty = { NULL, NULL, 0 };
+
+#if ENABLE_MT
+          shard->mutex = g_mutex_new ();
+#endif
+          shard->ht        = g_hash_table_new (hashfunc, equalfunc);
+          shard->ghost_ht  = g_hash_table_new (hashfunc, equalfunc);
+          shard->main      = empty;
+          shard->probation = empty;
+          shard->ghosts    = empty;
+          shard->inflation = 0;
+        }
+      cache_initialized = TRUE;
+    }
+#if ENABLE_MT
+  g_static_mutex_unlock (&init_mutex);
+#endif
 }
 
 void gegl_tile_cache_destroy (void)
 {
-  if (cache_queue)
-    g_queue_free (cache_queue);
-  if (cache_ht)
-    g_hash_table_destroy (cache_ht);
-  cache_queue = NULL;
-  cache_ht = NULL;
+  gint i;
+
+#if ENABLE_MT
+  g_static_mutex_lock (&init_mutex);
+#endif
+  if (cache_initialized)
+    {
+      for (i = 0; i < CACHE_SHARDS; i++)
+        {
+          CacheShard *shard = &cache_shards[i];
+
+          while (shard->ghosts.tail)
+            ghost_remove (shard, shard->ghosts.tail);
+          g_hash_table_destroy (shard->ht);
+          g_hash_table_destroy (shard->ghost_ht);
+#if ENABLE_MT
+          g_mutex_free (shard->mutex);
+          shard->mutex = NULL;
+#endif
+          shard->ht             = NULL;
+          shard->ghost_ht       = NULL;
+          shard->main.head      = shard->main.tail      = NULL;
+          shard->probation.head = shard->probation.tail = NULL;
+        }
+      cache_initialized = FALSE;
+    }
+#if ENABLE_MT
+  g_static_mutex_unlock (&init_mutex);
+#endif
 }
 
 static gboolean    gegl_tile_handler_cache_wash     (GeglTileHandlerCache *cache);
@@ -149,6 +560,11 @@ static void        gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cac
                                                      gint              x,
                                                      gint              y,
                                                      gint              z);
+static CacheItem * cache_lookup                    (GeglTileHandlerCache *cache,
+                                                     gint              x,
+                                                     gint              y,
+                                                     gint              z,
+                                                     CacheShard      **shard_ret);
 
 
 static void
@@ -160,53 +576,50 @@ finalize (GObject *object)
   G_OBJECT_CLASS (gegl_tile_handler_cache_parent_class)->finalize (object);
 }
 
-static void
-gegl_tile_handler_cache_dispose_buffer_tiles (gpointer itm,
-                                              gpointer userdata)
-{
-  CacheItem *item;
-  item = itm;
-  if (item->handler == userdata)
-    {
-      GeglTileHandlerCache *cache = userdata;
-      cache->free_list = g_slist_prepend (cache->free_list, item);
-      
-    }
-}
-
 static void
 dispose (GObject *object)
 {
   GeglTileHandlerCache *cache;
   CacheItem            *item;
   GSList               *iter;
+  gint                  i;
 
-#ifdef ENABLE_MT
-  g_static_mutex_lock (&mutex);
-#endif
   cache = GEGL_TILE_HANDLER_CACHE (object);
 
-  /* only throw out items belonging to this cache instance */
-
+  /* only throw out items belonging to this cache instance, the tiles
+   * are unreffed after the shards are unlocked since dropping the last
+   * reference might store the tile.
+   */
   cache->free_list = NULL;
-  g_queue_foreach (cache_queue, gegl_tile_handler_cache_dispose_buffer_tiles, cache);
-  for (iter = cache->free_list; iter; iter = g_slist_next (iter))
+  for (i = 0; i < CACHE_SHARDS; i++)
     {
-        item = iter->data;
-        if (item->tile)
+      CacheShard *shard    = &cache_shards[i];
+      CacheList  *lists[2] = { &shard->main, &shard->probation };
+      CacheItem  *next;
+      gint        l;
+
+      SHARD_LOCK (shard);
+      for (l = 0; l < 2; l++)
+        for (item = lists[l]->head; item; item = next)
           {
-            cache_total -= item->tile->size;
-            gegl_tile_unref (item->tile);
+            next = item->next;
+            if (item->handler == cache)
+              {
+                shard_remove (shard, item);
+                cache->free_list = g_slist_prepend (cache->free_list, item);
+              }
           }
-        g_queue_remove (cache_queue, item);
-        g_hash_table_remove (cache_ht, item);
+      SHARD_UNLOCK (shard);
+    }
+
+  for (iter = cache->free_list; iter; iter = g_slist_next (iter))
+    {
+        item = iter->data;
+        gegl_tile_unref (item->tile);
         g_slice_free (CacheItem, item);
     }
   g_slist_free (cache->free_list);
   cache->free_list = NULL;
-#ifdef ENABLE_MT
-  g_static_mutex_unlock (&mutex);
-#endif
 
   G_OBJECT_CLASS (gegl_tile_handler_cache_parent_class)->dispose (object);
 }
@@ -224,24 +637,65 @@ get_tile (GeglTileSource *tile_store,
   tile = gegl_tile_handler_cache_get_tile (cache, x, y, z);
   if (tile)
     {
-#if 0
-      cache_hits++;
-#endif
+      g_atomic_int_inc (&cache_stats[cache_policy].hits);
       return tile;
     }
-#if 0
-  cache_misses++;
-#endif
+  g_atomic_int_inc (&cache_stats[cache_policy].misses);
 
   if (source)
     tile = gegl_tile_source_get_tile (source, x, y, z);
 
   if (tile)
-    gegl_tile_handler_cache_insert (cache, tile, x, y, z);
+    {
+      /* tiles of the backend get their coordinates while no other thread
+       * can see them yet, z shares its word with the revision that is
+       * bumped under the tile lock. The handlers below the cache insert
+       * the tiles they make themselves with the coordinates set.
+       */
+      if (tile->x != x || tile->y != y || tile->z != z)
+        {
+          tile->x = x;
+          tile->y = y;
+          tile->z = z;
+        }
+      gegl_tile_handler_cache_insert (cache, tile, x, y, z);
+    }
 
   return tile;
 }
 
+/* stores all the dirty tiles of a cache instance */
+static void
+gegl_tile_handler_cache_flush (GeglTileHandlerCache *cache)
+{
+  GSList *dirty = NULL;
+  GSList *iter;
+  gint    i;
+
+  for (i = 0; i < CACHE_SHARDS; i++)
+    {
+      CacheShard *shard    = &cache_shards[i];
+      CacheList  *lists[2] = { &shard->main, &shard->probation };
+      CacheItem  *item;
+      gint        l;
+
+      SHARD_LOCK (shard);
+      for (l = 0; l < 2; l++)
+        for (item = lists[l]->head; item; item = item->next)
+          if (item->handler == cache &&
+              !gegl_tile_is_stored (item->tile))
+            dirty = g_slist_prepend (dirty, gegl_tile_ref (item->tile));
+      SHARD_UNLOCK (shard);
+    }
+
+  for (iter = dirty; iter; iter = g_slist_next (iter))
+    {
+      gegl_tile_store (iter->data);
+      gegl_tile_unref (iter->data);
+    }
+  g_slist_free (dirty);
+}
+
 static gpointer
 gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
                                  GeglTileCommand  command,
@@ -256,21 +710,7 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
   switch (command)
     {
       case GEGL_TILE_FLUSH:
-        {
-          GList     *link;
-
-          for (link = g_queue_peek_head_link (cache_queue); link; link = link->next)
-            {
-              CacheItem *item = link->data;
-              GeglTile  *tile = item->tile;
-
-              if (tile != NULL &&
-                  item->handler == cache)
-                {
-                  gegl_tile_store (tile);
-                }
-            }
-        }
+        gegl_tile_handler_cache_flush (cache);
         break;
       case GEGL_TILE_GET:
         /* XXX: we should perhaps store a NIL result, and place the empty
@@ -300,6 +740,18 @@ gegl_tile_handler_cache_command (GeglTileSource  *tile_store,
       case GEGL_TILE_VOID:
         gegl_tile_handler_cache_void (cache, x, y, z);
         break;
+      case GEGL_TILE_PREFETCH:
+        {
+          CacheShard *shard;
+          CacheItem  *item;
+
+          /* a plain lookup, a hint is no reason to count as a use */
+          item = cache_lookup (cache, x, y, z, &shard);
+          SHARD_UNLOCK (shard);
+          if (item)
+            return NULL;
+        }
+        break;
       default:
         break;
     }
@@ -327,36 +779,83 @@ gegl_tile_handler_cache_init (GeglTileHandlerCache *cache)
 /* write the least recently used dirty tile to disk if it
  * is in the wash_percentage (20%) least recently used tiles,
  * calling this function in an idle handler distributes the
- * tile flushing overhead over time.
+ * tile flushing overhead over time. The shards are visited in
+ * turn, washing the first one that has such a tile.
  */
 gboolean
 gegl_tile_handler_cache_wash (GeglTileHandlerCache *cache)
 {
   GeglTile  *last_dirty = NULL;
-  guint      count      = 0;
-  gint       length     = g_queue_get_length (cache_queue);
-  gint       wash_tiles = cache_wash_percentage * length / 100;
-  GList     *link;
+  gint       i;
 
-  for (link = g_queue_peek_head_link (cache_queue); link; link = link->next)
+  for (i = 0; i < CACHE_SHARDS && !last_dirty; i++)
     {
-      CacheItem *item = link->data;
-      GeglTile  *tile = item->tile;
-
-      count++;
-      if (!gegl_tile_is_stored (tile))
-        if (count > length - wash_tiles)
-          last_dirty = tile;
+      CacheShard *shard;
+      CacheItem  *item;
+      gint        wash_tiles;
+      gint        count = 0;
+
+      shard = &cache_shards[(g_atomic_int_exchange_and_add (&wash_shard, 1) &
+                             G_MAXINT) % CACHE_SHARDS];
+
+      SHARD_LOCK (shard);
+      /* the probation list of 2Q is evicted first, wash it first */
+      wash_tiles = cache_wash_percentage * shard->probation.length / 100;
+      for (item = shard->probation.tail; item && count < wash_tiles; item = item->prev)
+        {
+          count++;
+          if (!gegl_tile_is_stored (item->tile))
+            {
+              last_dirty = gegl_tile_ref (item->tile);
+              break;
+            }
+        }
+      count      = 0;
+      wash_tiles = cache_wash_percentage * shard->main.length / 100;
+      for (item = shard->main.tail;
+           item && !last_dirty && count < wash_tiles;
+           item = item->prev)
+        {
+          count++;
+          if (!gegl_tile_is_stored (item->tile))
+            last_dirty = gegl_tile_ref (item->tile);
+        }
+      SHARD_UNLOCK (shard);
     }
 
   if (last_dirty != NULL)
     {
       gegl_tile_store (last_dirty);
+      gegl_tile_unref (last_dirty);
       return TRUE;
     }
   return FALSE;
 }
 
+/* looks up the item for the given coordinates in its shard, the shard
+ * is returned in shard_ret and left locked.
+ */
+static CacheItem *
+cache_lookup (GeglTileHandlerCache  *cache,
+              gint                   x,
+              gint                   y,
+              gint                   z,
+              CacheShard           **shard_ret)
+{
+  CacheShard *shard;
+  CacheItem   pin;
+
+  pin.x = x;
+  pin.y = y;
+  pin.z = z;
+  pin.handler = cache;
+
+  shard = cache_shard (&pin);
+  SHARD_LOCK (shard);
+  *shard_ret = shard;
+  return g_hash_table_lookup (shard->ht, &pin);
+}
+
 /* returns the requested Tile if it is in the cache, NULL otherwize.
  */
 static GeglTile *
@@ -365,31 +864,35 @@ gegl_tile_handler_cache_get_tile (GeglTileHandlerCache *cache,
                                   gint                  y,
                                   gint                  z)
 {
-  CacheItem *result;
-  CacheItem pin;
+  CacheShard *shard;
+  CacheItem  *result;
+  GeglTile   *tile = NULL;
 
-  pin.x = x;
-  pin.y = y;
-  pin.z = z;
-  pin.handler = cache;
-
-#ifdef ENABLE_MT
-  g_static_mutex_lock (&mutex);
-#endif
-  result = g_hash_table_lookup (cache_ht, &pin);
+  result = cache_lookup (cache, x, y, z, &shard);
   if (result)
     {
-      g_queue_remove (cache_queue, result);
-      g_queue_push_head (cache_queue, result);
-#ifdef ENABLE_MT
-      g_static_mutex_unlock (&mutex);
-#endif
-      return gegl_tile_ref (result->tile);
+      policy_hit (shard, result);
+      tile = gegl_tile_ref (result->tile);
     }
-#ifdef ENABLE_MT
-  g_static_mutex_unlock (&mutex);
-#endif
-  return NULL;
+  SHARD_UNLOCK (shard);
+  return tile;
+}
+
+GeglTile *
+gegl_tile_handler_cache_peek (GeglTileHandlerCache *cache,
+                              gint                  x,
+                              gint                  y,
+                              gint                  z)
+{
+  CacheShard *shard;
+  CacheItem  *item;
+  GeglTile   *tile = NULL;
+
+  item = cache_lookup (cache, x, y, z, &shard);
+  if (item)
+    tile = gegl_tile_ref (item->tile);
+  SHARD_UNLOCK (shard);
+  return tile;
 }
 
 static gboolean
@@ -402,37 +905,45 @@ gegl_tile_handler_cache_has_tile (GeglTileHandlerCache *cache,
 
   if (tile)
     {
-      g_object_unref (G_OBJECT (tile));
+      gegl_tile_unref (tile);
       return TRUE;
     }
 
   return FALSE;
 }
 
+/* evicts the item the policy picks in one of the shards, the shards
+ * take turns to spread the evictions evenly.
+ */
 static gboolean
 gegl_tile_handler_cache_trim (GeglTileHandlerCache *cache)
 {
-  CacheItem *last_writable;
- 
-#ifdef ENABLE_MT
-  g_static_mutex_lock (&mutex);
-#endif
-  last_writable = g_queue_pop_tail (cache_queue);
+  CacheItem *last_writable = NULL;
+  gint       i;
+
+  for (i = 0; i < CACHE_SHARDS && !last_writable; i++)
+    {
+      CacheShard *shard;
+
+      shard = &cache_shards[(g_atomic_int_exchange_and_add (&trim_shard, 1) &
+                             G_MAXINT) % CACHE_SHARDS];
+      SHARD_LOCK (shard);
+      last_writable = policy_victim (shard);
+      if (last_writable != NULL)
+        {
+          policy_evict (shard, last_writable);
+          shard_remove (shard, last_writable);
+        }
+      SHARD_UNLOCK (shard);
+    }
 
   if (last_writable != NULL)
     {
-      g_hash_table_remove (cache_ht, last_writable);
-      cache_total  -= last_writable->tile->size;
-      g_object_unref (last_writable->tile);
+      g_atomic_int_inc (&cache_stats[cache_policy].evictions);
+      gegl_tile_unref (last_writable->tile);
       g_slice_free (CacheItem, last_writable);
-#ifdef ENABLE_MT
-      g_static_mutex_unlock (&mutex);
-#endif
       return TRUE;
     }
-#ifdef ENABLE_MT
-      g_static_mutex_unlock (&mutex);
-#endif
 
   return FALSE;
 }
@@ -443,38 +954,23 @@ gegl_tile_handler_cache_invalidate (GeglTileHandlerCache *cache,
                                     gint                  y,
                                     gint                  z)
 {
-  GList *link;
+  CacheShard *shard;
+  CacheItem  *item;
 
-#ifdef ENABLE_MT
-  g_static_mutex_lock (&mutex);
-#endif
-  for (link = g_queue_peek_head_link (cache_queue); link; link = link->next)
+  item = cache_lookup (cache, x, y, z, &shard);
+  if (item)
+    shard_remove (shard, item);
+  SHARD_UNLOCK (shard);
+
+  if (item)
     {
-      CacheItem *item = link->data;
-      GeglTile  *tile = item->tile;
-
-      if (tile != NULL &&
-          item->x == x &&
-          item->y == y &&
-          item->z == z &&
-          item->handler == cache)
-        {
-          cache_total  -= item->tile->size;
-          tile->tile_storage = NULL;
-          tile->stored_rev = tile->rev; /* to cheat it out of being stored */
-          g_object_unref (tile);
-          g_hash_table_remove (cache_ht, item);
-          g_slice_free (CacheItem, item);
-          g_queue_delete_link (cache_queue, link);
-#ifdef ENABLE_MT
-          g_static_mutex_unlock (&mutex);
-#endif
-          return;
-        }
+      GeglTile *tile = item->tile;
+
+      tile->tile_storage = NULL;
+      gegl_tile_mark_as_stored (tile); /* to cheat it out of being stored */
+      gegl_tile_unref (tile);
+      g_slice_free (CacheItem, item);
     }
-#ifdef ENABLE_MT
-  g_static_mutex_unlock (&mutex);
-#endif
 }
 
 
@@ -484,40 +980,23 @@ gegl_tile_handler_cache_void (GeglTileHandlerCache *cache,
                               gint                  y,
                               gint                  z)
 {
-  GList *link;
+  CacheShard *shard;
+  CacheItem  *item;
 
-  if (!cache_queue)
+  if (!cache_initialized)
     return;
 
-#ifdef ENABLE_MT
-  g_static_mutex_lock (&mutex);
-#endif
-  for (link = g_queue_peek_head_link (cache_queue); link; link = link->next)
+  item = cache_lookup (cache, x, y, z, &shard);
+  if (item)
+    shard_remove (shard, item);
+  SHARD_UNLOCK (shard);
+
+  if (item)
     {
-      CacheItem *item = link->data;
-      GeglTile  *tile = item->tile;
-
-      if (tile != NULL &&
-          item->x == x &&
-          item->y == y &&
-          item->z == z &&
-          item->handler == cache)
-        {
-          gegl_tile_void (tile);
-          cache_total -= item->tile->size;
-          gegl_tile_unref (tile);
-          g_hash_table_remove (cache_ht, item);
-          g_slice_free (CacheItem, item);
-          g_queue_delete_link (cache_queue, link);
-#ifdef ENABLE_MT
-          g_static_mutex_unlock (&mutex);
-#endif
-          return;
-        }
+      gegl_tile_void (item->tile);
+      gegl_tile_unref (item->tile);
+      g_slice_free (CacheItem, item);
     }
-#ifdef ENABLE_MT
-  g_static_mutex_unlock (&mutex);
-#endif
 }
 
 void
@@ -527,31 +1006,52 @@ gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
                                 gint                  y,
                                 gint                  z)
 {
-  CacheItem *item = g_slice_new (CacheItem);
-  guint      count;
+  CacheItem  *item = g_slice_new (CacheItem);
+  CacheItem  *old;
+  CacheShard *shard;
+  gboolean    evicted = FALSE;
 
   item->handler = cache;
   item->tile    = gegl_tile_ref (tile);
   item->x       = x;
   item->y       = y;
   item->z       = z;
+  item->list    = NULL;
+  item->prev    = NULL;
+  item->next    = NULL;
+  item->referenced = FALSE;
+  item->priority   = 0;
+
+  shard = cache_shard (item);
+  SHARD_LOCK (shard);
+  /* replacing an item for the same coordinates, keep the list and the
+   * hash table in agreement */
+  old = g_hash_table_lookup (shard->ht, item);
+  if (old)
+    shard_remove (shard, old);
+  g_atomic_int_add (&cache_total, item->tile->size);
+  policy_insert (shard, item);
+  g_hash_table_insert (shard->ht, item, item);
+  SHARD_UNLOCK (shard);
+
+  if (old)
+    {
+      gegl_tile_unref (old->tile);
+      g_slice_free (CacheItem, old);
+    }
 
-#if ENABLE_MT
-  g_static_mutex_lock (&mutex);
-#endif
-  cache_total  += item->tile->size;
-  g_queue_push_head (cache_queue, item);
-
-  count = g_queue_get_length (cache_queue);
-  g_hash_table_insert (cache_ht, item, item);
-
-  while (cache_total > gegl_config()->cache_size)
+  while (g_atomic_int_get (&cache_total) > gegl_config()->cache_size)
     {
       /*GEGL_NOTE(GEGL_DEBUG_CACHE, "cache_total:%i > cache_size:%i", cache_total, gegl_config()->cache_size);
       GEGL_NOTE(GEGL_DEBUG_CACHE, "%f%% hit:%i miss:%i  %i]", cache_hits*100.0/(cache_hits+cache_misses), cache_hits, cache_misses, g_queue_get_length (cache_queue));*/
-      gegl_tile_handler_cache_trim (cache);
+      if (!gegl_tile_handler_cache_trim (cache))
+        break;
+      evicted = TRUE;
     }
-#if ENABLE_MT
-  g_static_mutex_unlock (&mutex);
-#endif
+
+  /* the data of evicted tiles lands in the tile allocator, keep what it
+   * holds on to in proportion to the cache
+   */
+  if (evicted)
+    gegl_tile_alloc_trim (gegl_config()->cache_size / 8);
 }
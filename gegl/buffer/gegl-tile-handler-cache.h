@@ -38,6 +38,48 @@ struct _GeglTileHandlerCacheClass
   GeglTileHandlerClass parent_class;
 };
 
+/* the eviction policies of the tile cache, picked with the "cache-policy"
+ * property of GeglConfig
+ */
+typedef enum
+{
+  GEGL_CACHE_POLICY_LRU,   /* evict the least recently used tile */
+  GEGL_CACHE_POLICY_CLOCK, /* second chance, hits only set a bit */
+  GEGL_CACHE_POLICY_2Q,    /* tiles seen once are evicted first, a large
+                              scan doesn't flush the working set */
+  GEGL_CACHE_POLICY_COST,  /* keep tiles that are expensive to recreate,
+                              like mipmap levels, for longer */
+  GEGL_CACHE_POLICY_LAST
+} GeglCachePolicy;
+
 GType gegl_tile_handler_cache_get_type (void) G_GNUC_CONST;
 
+GeglCachePolicy gegl_tile_cache_get_policy (void);
+
+/* adds tile to the cache for the coordinates, replacing the tile that
+ * was cached for them
+ */
+void            gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
+                                                GeglTile             *tile,
+                                                gint                  x,
+                                                gint                  y,
+                                                gint                  z);
+
+/* returns a new reference to the tile cached for the coordinates or
+ * NULL, unlike GEGL_TILE_GET it doesn't ask the backend and doesn't
+ * count as a use of the tile.
+ */
+GeglTile *      gegl_tile_handler_cache_peek (GeglTileHandlerCache *cache,
+                                              gint                  x,
+                                              gint                  y,
+                                              gint                  z);
+
+/* counters are kept per policy for the lifetime of the process, any of
+ * the return locations can be NULL
+ */
+void            gegl_tile_cache_get_stats  (GeglCachePolicy  policy,
+                                            gint            *hits,
+                                            gint            *misses,
+                                            gint            *evictions);
+
 #endif
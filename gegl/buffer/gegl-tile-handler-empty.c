@@ -18,17 +18,11 @@
 #include "config.h"
 #include <glib.h>
 #include <glib-object.h>
-#include <string.h>
 
 #include "gegl-tile-handler.h"
 #include "gegl-tile-handler-empty.h"
 #include "gegl-tile-handler-cache.h"
 
-#if HAVE_GPU
-#include "gegl-gpu-init.h"
-#include "gegl-gpu-texture.h"
-#endif
-
 G_DEFINE_TYPE (GeglTileHandlerEmpty, gegl_tile_handler_empty, GEGL_TYPE_TILE_HANDLER)
 
 enum
@@ -132,7 +126,6 @@ constructor (GType                  type,
   GeglTileHandlerEmpty *empty;
   gint           tile_width;
   gint           tile_height;
-  gint           tile_size;
   Babl          *format;
 
   object = G_OBJECT_CLASS (gegl_tile_handler_empty_parent_class)->constructor (type, n_params, params);
@@ -142,19 +135,11 @@ constructor (GType                  type,
   g_assert (empty->backend);
   g_object_get (empty->backend, "tile-width", &tile_width,
                 "tile-height", &tile_height,
-                "tile-size", &tile_size,
                 "format", (gpointer) &format,
                 NULL);
 
-  empty->tile = gegl_tile_new (tile_width, tile_height, format);
-
-  /* FIXME: need babl format here */
-  memset (gegl_tile_get_data (empty->tile), 0x00, tile_size);
-
-#if HAVE_GPU
-  if (gegl_gpu_is_accelerated ())
-    gegl_gpu_texture_clear (empty->tile->gpu_data, NULL);
-#endif
+  /* the tiles handed out share the data of the zero tile of the format */
+  empty->tile = gegl_tile_new_uniform (tile_width, tile_height, format, NULL);
 
   return object;
 }
@@ -36,6 +36,8 @@ static char *commands[] =
   "-", /*void*/
   "flush",
   "refetch",
+  "prefetch",
+  "compact",
   "last command",
   "eeek",
   NULL
@@ -20,9 +20,14 @@
 #include <glib-object.h>
 #include <string.h>
 
+#include "gegl-buffer-private.h"
 #include "gegl-tile-handler.h"
 #include "gegl-tile-handler-zoom.h"
 #include "gegl-tile-handler-cache.h"
+#include "gegl-cpuaccel.h"
+#include "gegl-simd.h"
+#include "gegl-config.h"
+#include "process/gegl-scheduler.h"
 
 
 G_DEFINE_TYPE (GeglTileHandlerZoom, gegl_tile_handler_zoom, GEGL_TYPE_TILE_HANDLER)
@@ -43,26 +48,21 @@ void gegl_tile_handler_cache_insert (GeglTileHandlerCache *cache,
                                      gint                  x,
                                      gint                  y,
                                      gint                  z);
-static inline void set_blank (GeglTile *dst_tile,
-                              gint      width,
-                              gint      height,
-                              Babl     *format,
-                              gint      i,
-                              gint      j)
+/* sets a quadrant to the bpp bytes at pixel, or to zero if pixel is NULL */
+static inline void set_uniform (GeglTile     *dst_tile,
+                                gint          width,
+                                gint          height,
+                                Babl         *format,
+                                const guchar *pixel,
+                                gint          i,
+                                gint          j)
 {
   guchar *dst_data  = gegl_tile_get_data (dst_tile);
   gint    bpp       = babl_format_get_bytes_per_pixel (format);
   gint    rowstride = width * bpp;
-  gint    scanline;
+  guchar *dst       = dst_data + j * height / 2 * rowstride + i * rowstride / 2;
 
-  gint    bytes = width * bpp / 2;
-  guchar *dst   = dst_data + j * height / 2 * rowstride + i * rowstride / 2;
-
-  for (scanline = 0; scanline < height / 2; scanline++)
-    {
-      memset (dst, 0x0, bytes);
-      dst += rowstride;
-    }
+  gegl_tile_fill_rect (dst, rowstride, width / 2, height / 2, pixel, bpp);
 }
 
 /* fixme: make the api of this, as well as blank be the
@@ -100,6 +100,17 @@ static inline void set_half_nearest (GeglTile *dst_tile,
     }
 }
 
+static inline gboolean
+zoom_use_simd (void)
+{
+#ifdef HAS_G4FLOAT
+  return (gegl_cpu_accel_get_support () & (GEGL_CPU_ACCEL_X86_SSE2 |
+                                           GEGL_CPU_ACCEL_PPC_ALTIVEC)) != 0;
+#else
+  return FALSE;
+#endif
+}
+
 static inline void
 downscale_float (gint    components,
                  gint    width,
@@ -112,6 +123,38 @@ downscale_float (gint    components,
 
   if (!src_data || !dst_data)
     return;
+
+#ifdef HAS_G4FLOAT
+  if (components == 4 && zoom_use_simd ())
+    {
+      for (y = 0; y < height / 2; y++)
+        {
+          gint    x;
+          guchar *dst = dst_data + y * rowstride;
+          guchar *src = src_data + y * 2 * rowstride;
+
+          /* the tiles of linear buffers wrap data that need not be
+           * aligned, memcpy leaves it to the compiler to pick the loads
+           */
+          for (x = 0; x < width / 2; x++)
+            {
+              g4float a, b, c, d;
+
+              memcpy (&a, src, 16);
+              memcpy (&b, src + 16, 16);
+              memcpy (&c, src + rowstride, 16);
+              memcpy (&d, src + rowstride + 16, 16);
+              a = (a + b + c + d) * g4float_all (0.25);
+              memcpy (dst, &a, 16);
+
+              dst += 16;
+              src += 32;
+            }
+        }
+      return;
+    }
+#endif
+
   for (y = 0; y < height / 2; y++)
     {
       gint    x;
@@ -134,6 +177,8 @@ downscale_float (gint    components,
     }
 }
 
+#define U8_LANES G_GINT64_CONSTANT (0x00ff00ff00ff00ffU)
+
 static inline void
 downscale_u8 (gint    components,
               gint    width,
@@ -146,6 +191,44 @@ downscale_u8 (gint    components,
 
   if (!src_data || !dst_data)
     return;
+
+  if (components == 4)
+    {
+      /* a horizontal pair of pixels is loaded as one 64bit word, with
+       * every other byte masked out the sums of four components fit
+       * side by side in 16bit lanes. Gives the same results as the
+       * loop below.
+       */
+      for (y = 0; y < height / 2; y++)
+        {
+          gint    x;
+          guchar *dst = dst_data + y * rowstride;
+          guchar *src = src_data + y * 2 * rowstride;
+
+          for (x = 0; x < width / 2; x++)
+            {
+              guint64 top, bottom, even, odd;
+              guint32 pixel;
+
+              memcpy (&top, src, 8);
+              memcpy (&bottom, src + rowstride, 8);
+
+              even = (top & U8_LANES) + (bottom & U8_LANES);
+              odd  = ((top >> 8) & U8_LANES) + ((bottom >> 8) & U8_LANES);
+              even += even >> 32;
+              odd  += odd >> 32;
+
+              pixel = ((even >> 2) & 0x00ff00ff) |
+                      (((odd >> 2) & 0x00ff00ff) << 8);
+              memcpy (dst, &pixel, 4);
+
+              dst += 4;
+              src += 8;
+            }
+        }
+      return;
+    }
+
   for (y = 0; y < height / 2; y++)
     {
       gint    x;
@@ -168,6 +251,40 @@ downscale_u8 (gint    components,
     }
 }
 
+static inline void
+downscale_u16 (gint    components,
+               gint    width,
+               gint    height,
+               gint    rowstride,
+               guchar *src_data,
+               guchar *dst_data)
+{
+  gint y;
+
+  if (!src_data || !dst_data)
+    return;
+  for (y = 0; y < height / 2; y++)
+    {
+      gint     x;
+      guint16 *dst = (guint16 *) (dst_data + y * rowstride);
+      guint16 *src = (guint16 *) (src_data + y * 2 * rowstride);
+
+      for (x = 0; x < width / 2; x++)
+        {
+          int i;
+          for (i = 0; i < components; i++)
+            dst[i] = (src[i] +
+                      src[i + components] +
+                      src[i + (width * components)] +
+                      src[i + (width + 1) * components]) /
+                     4;
+
+          dst += components;
+          src += components * 2;
+        }
+    }
+}
+
 static void inline set_half (GeglTile * dst_tile,
                              GeglTile * src_tile,
                              gint       width,
@@ -192,12 +309,104 @@ static void inline set_half (GeglTile * dst_tile,
     {
       downscale_u8 (components, width, height, width * bpp, src_data, dst_data);
     }
+  else if (babl_format_get_type (format, 0) == babl_type ("u16"))
+    {
+      downscale_u16 (components, width, height, width * bpp, src_data, dst_data);
+    }
   else
     {
       set_half_nearest (dst_tile, src_tile, width, height, format, i, j);
     }
 }
 
+/* recomputes the quadrants of tile set in the quadrants mask (bit i + 2 * j
+ * for the quadrant at i, j) from the tiles of the level below, expects
+ * tile to be write locked.
+ */
+static void
+zoom_quadrants (GeglTileSource *gegl_tile_source,
+                GeglTile       *tile,
+                GeglTile       *source_tile[2][2],
+                gint            quadrants)
+{
+  GeglTileHandlerZoom *zoom   = GEGL_TILE_HANDLER_ZOOM (gegl_tile_source);
+  Babl                *format = (Babl *) (zoom->backend->format);
+  gint                 tile_width  = zoom->backend->tile_width;
+  gint                 tile_height = zoom->backend->tile_height;
+  gint                 i, j;
+
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 2; j++)
+      {
+        if (!(quadrants & (1 << (i + 2 * j))))
+          continue;
+
+        if (source_tile[i][j])
+          {
+            gboolean locked;
+
+            locked = gegl_buffer_linear_lock_tile (source_tile[i][j],
+                                                   GEGL_TILE_LOCK_READ);
+            /* the average of pixels of a single color is that color */
+            if (gegl_tile_is_uniform (source_tile[i][j]))
+              set_uniform (tile, tile_width, tile_height, format,
+                           gegl_tile_get_data (source_tile[i][j]), i, j);
+            else
+              set_half (tile, source_tile[i][j], tile_width, tile_height, format, i, j);
+            if (locked)
+              gegl_tile_unlock (source_tile[i][j]);
+            gegl_tile_unref (source_tile[i][j]);
+          }
+        else
+          {
+            set_uniform (tile, tile_width, tile_height, format, NULL, i, j);
+          }
+      }
+}
+
+/* checks whether the four tiles a mipmap tile is built from all have the
+ * same single color, missing tiles count as zero. The color is copied to
+ * pixel.
+ */
+static gboolean
+zoom_sources_uniform (GeglTile *source_tile[2][2],
+                      guchar   *pixel,
+                      gint      bpp)
+{
+  guchar *color = g_alloca (bpp);
+  gint    i, j;
+
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 2; j++)
+      {
+        GeglTile *source  = source_tile[i][j];
+        gboolean  uniform = TRUE;
+
+        if (source)
+          {
+            gboolean locked;
+
+            locked  = gegl_buffer_linear_lock_tile (source,
+                                                    GEGL_TILE_LOCK_READ);
+            uniform = gegl_tile_is_uniform (source);
+            if (uniform)
+              memcpy (color, gegl_tile_get_data (source), bpp);
+            if (locked)
+              gegl_tile_unlock (source);
+          }
+        else
+          {
+            memset (color, 0x00, bpp);
+          }
+
+        if (!uniform ||
+            ((i || j) && memcmp (color, pixel, bpp)))
+          return FALSE;
+        memcpy (pixel, color, bpp);
+      }
+  return TRUE;
+}
+
 static GeglTile *
 get_tile (GeglTileSource *gegl_tile_source,
           gint            x,
@@ -207,10 +416,12 @@ get_tile (GeglTileSource *gegl_tile_source,
   GeglTileSource      *source = GEGL_HANDLER (gegl_tile_source)->source;
   GeglTileHandlerZoom *zoom   = GEGL_TILE_HANDLER_ZOOM (gegl_tile_source);
   GeglTile            *tile   = NULL;
-  Babl                *format = (Babl *) (zoom->backend->format);
-  gint                 tile_width;
-  gint                 tile_height;
-  gint                 tile_size;
+  GeglTile            *source_tile[2][2] = { { NULL, NULL }, { NULL, NULL } };
+  gint                 quadrants = 0xf;
+  gboolean             uniform;
+  guchar              *pixel;
+  gint                 bpp;
+  gint                 i, j;
 
   if (source)
     {
@@ -218,7 +429,26 @@ get_tile (GeglTileSource *gegl_tile_source,
     }
 
   if (tile)
-    return tile;
+    {
+      if (z == 0 || !gegl_tile_get_dirty_quadrants (tile))
+        return tile;
+
+      /* parts of the level below changed since the tile was built, only
+       * those quadrants are recomputed. Another thread might have done
+       * so while we waited for the lock.
+       */
+      gegl_tile_lock (tile, GEGL_TILE_LOCK_WRITE);
+      quadrants = gegl_tile_take_dirty_quadrants (tile);
+
+      for (i = 0; i < 2; i++)
+        for (j = 0; j < 2; j++)
+          if (quadrants & (1 << (i + 2 * j)))
+            source_tile[i][j] = gegl_tile_source_get_tile (gegl_tile_source,
+                                                           x * 2 + i, y * 2 + j, z - 1);
+      zoom_quadrants (gegl_tile_source, tile, source_tile, quadrants);
+      gegl_tile_unlock (tile);
+      return tile;
+    }
 
   if (z == 0)/* at base level with no tile found->send null, and shared empty
                tile will be used instead */
@@ -230,77 +460,187 @@ get_tile (GeglTileSource *gegl_tile_source,
     zoom->tile_storage->seen_zoom = z;
 
   g_assert (zoom->backend);
-  g_object_get (zoom->backend, "tile-width", &tile_width,
-                "tile-height", &tile_height,
-                "tile-size", &tile_size,
-                NULL);
 
-  {
-    gint      i, j;
-    guchar   *data;
-    GeglTile *source_tile[2][2] = { { NULL, NULL }, { NULL, NULL } };
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 2; j++)
+      {
+        /* we get the tile from ourselves, to make successive rescales work
+         * correctly */
+          source_tile[i][j] = gegl_tile_source_get_tile (gegl_tile_source,
+                                                        x * 2 + i, y * 2 + j, z - 1);
+      }
 
-    for (i = 0; i < 2; i++)
-      for (j = 0; j < 2; j++)
-        {
-          /* we get the tile from ourselves, to make successive rescales work
-           * correctly */
-            source_tile[i][j] = gegl_tile_source_get_tile (gegl_tile_source,
-                                                          x * 2 + i, y * 2 + j, z - 1);
-        }
+  if (source_tile[0][0] == NULL &&
+      source_tile[0][1] == NULL &&
+      source_tile[1][0] == NULL &&
+      source_tile[1][1] == NULL)
+    {
+      return NULL;   /* no data from level below, return NULL and let GeglTileHandlerEmpty
+                        fill in the shared empty tile */
+    }
+
+  bpp     = babl_format_get_bytes_per_pixel (zoom->backend->format);
+  pixel   = g_alloca (bpp);
+  uniform = zoom_sources_uniform (source_tile, pixel, bpp);
 
-    if (source_tile[0][0] == NULL &&
-        source_tile[0][1] == NULL &&
-        source_tile[1][0] == NULL &&
-        source_tile[1][1] == NULL)
+  if (uniform)
+    {
+      /* a mipmap of tiles of a single color has that color, it shares the
+       * data of the other tiles of the color
+       */
+      tile = gegl_tile_new_uniform (zoom->backend->tile_width,
+                                    zoom->backend->tile_height,
+                                    zoom->backend->format, pixel);
+      for (i = 0; i < 2; i++)
+        for (j = 0; j < 2; j++)
+          if (source_tile[i][j])
+            gegl_tile_unref (source_tile[i][j]);
+    }
+  else
+    {
+      tile = gegl_tile_new (zoom->backend->tile_width,
+                            zoom->backend->tile_height,
+                            (Babl *) zoom->backend->format);
+    }
+
+  tile->x          = x;
+  tile->y          = y;
+  tile->z          = z;
+  tile->tile_storage = zoom->tile_storage;
+  tile->rev = 1;
+  gegl_tile_mark_as_stored (tile);
+
+  {
+    GeglTileHandlerCache *cache;
+    cache = g_object_get_data (G_OBJECT (gegl_tile_source), "cache");
+    if (cache)
       {
-        return NULL;   /* no data from level below, return NULL and let GeglTileHandlerEmpty
-                          fill in the shared empty tile */
+        gegl_tile_handler_cache_insert (cache, tile, x, y, z);
       }
+  }
 
-    g_assert (tile == NULL);
-    if (tile == NULL)
-      {
-        tile = gegl_tile_new (tile_width, tile_height, format);
+  if (!uniform)
+    {
+      gegl_tile_lock (tile, GEGL_TILE_LOCK_WRITE);
+      zoom_quadrants (gegl_tile_source, tile, source_tile, quadrants);
+      gegl_tile_unlock (tile);
+    }
 
-        tile->x          = x;
-        tile->y          = y;
-        tile->z          = z;
-        tile->tile_storage = zoom->tile_storage;
-        tile->stored_rev = 1;
-        tile->rev        = 1;
+  return tile;
+}
 
-        {
-          GeglTileHandlerCache *cache;
-          cache = g_object_get_data (G_OBJECT (gegl_tile_source), "cache");
-          if (cache)
-            {
-              gegl_tile_handler_cache_insert (cache, tile, x, y, z);
-            }
-        }
-      }
-    gegl_tile_lock (tile, GEGL_TILE_LOCK_WRITE);
-    data = gegl_tile_get_data (tile);
+void
+gegl_tile_handler_zoom_invalidate (GeglTileHandlerZoom *zoom,
+                                   gint                 x,
+                                   gint                 y)
+{
+  GeglTileHandlerCache *cache = g_object_get_data (G_OBJECT (zoom), "cache");
+  gint                  z;
+
+  for (z = 1; z <= zoom->tile_storage->seen_zoom; z++)
+    {
+      gint      i = x & 1;
+      gint      j = y & 1;
+      GeglTile *tile;
 
-    for (i = 0; i < 2; i++)
-      for (j = 0; j < 2; j++)
+      x >>= 1;
+      y >>= 1;
+
+      if (cache)
         {
-          if (source_tile[i][j])
-            {
-              gegl_tile_lock (source_tile[i][j], GEGL_TILE_LOCK_READ);
-              set_half (tile, source_tile[i][j], tile_width, tile_height, format, i, j);
-              gegl_tile_unlock (source_tile[i][j]);
-              g_object_unref (source_tile[i][j]);
-            }
-          else 
+          tile = gegl_tile_handler_cache_peek (cache, x, y, z);
+          if (tile)
             {
-              set_blank (tile, tile_width, tile_height, format, i, j);
+              gegl_tile_mark_quadrant_dirty (tile, i, j);
+              gegl_tile_unref (tile);
             }
         }
-    gegl_tile_unlock (tile);
-  }
+      /* whatever the backend holds for the tile is out of date */
+      gegl_tile_source_void (GEGL_TILE_SOURCE (zoom->backend), x, y, z);
+    }
+}
 
-  return tile;
+typedef struct
+{
+  GeglTileSource *source;
+  gint            x0;
+  gint            y0;
+  gint            z;
+  gint            columns;
+  gint            n_tiles;
+  volatile gint   next;
+} ZoomBuildLevel;
+
+static void
+zoom_build_task (gpointer task_data,
+                 gpointer user_data)
+{
+  ZoomBuildLevel *level = user_data;
+  gint            n;
+
+  while ((n = g_atomic_int_exchange_and_add (&level->next, 1)) < level->n_tiles)
+    {
+      GeglTile *tile;
+
+      tile = gegl_tile_source_get_tile (level->source,
+                                        level->x0 + n % level->columns,
+                                        level->y0 + n / level->columns,
+                                        level->z);
+      if (tile)
+        gegl_tile_unref (tile);
+    }
+}
+
+void
+gegl_tile_handler_zoom_build (GeglTileHandlerZoom *zoom,
+                              gint                 x0,
+                              gint                 y0,
+                              gint                 x1,
+                              gint                 y1,
+                              gint                 z)
+{
+  gint n_threads = gegl_scheduler_get_n_workers () + 1;
+  gint max_tiles = gegl_config ()->cache_size / zoom->backend->tile_size / 2;
+  gint start;
+  gint level;
+
+  if (n_threads < 2 || z < 1)
+    return;
+
+  /* the levels are built breadth first from the lowest one whose tiles
+   * fit in half the cache, so that they are still around when the next
+   * level is built from them. The levels below that are built depth
+   * first by the tasks of the first level.
+   */
+  for (start = 1; start < z; start++)
+    {
+      gint64 n_tiles = (gint64) (x1 - x0 + 1) * (y1 - y0 + 1) << (2 * (z - start));
+
+      if (n_tiles <= max_tiles)
+        break;
+    }
+
+  for (level = start; level <= z; level++)
+    {
+      gint              factor = 1 << (z - level);
+      ZoomBuildLevel    build;
+      GeglSchedulerJob *job;
+      gint              n;
+
+      build.source  = GEGL_TILE_SOURCE (zoom);
+      build.x0      = x0 * factor;
+      build.y0      = y0 * factor;
+      build.z       = level;
+      build.columns = (x1 - x0 + 1) * factor;
+      build.n_tiles = build.columns * (y1 - y0 + 1) * factor;
+      build.next    = 0;
+
+      job = gegl_scheduler_job_new (zoom_build_task, &build);
+      for (n = 0; n < MIN (n_threads, build.n_tiles); n++)
+        gegl_scheduler_job_push (job, GINT_TO_POINTER (n + 1));
+      gegl_scheduler_job_wait (job);
+      gegl_scheduler_job_free (job);
+    }
 }
 
 static gpointer
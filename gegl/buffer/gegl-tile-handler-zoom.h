@@ -49,6 +49,26 @@ struct _GeglTileHandlerZoomClass
 
 GType gegl_tile_handler_zoom_get_type (void) G_GNUC_CONST;
 
+/* the level 0 tile at x, y changed, marks the quadrants covering it in
+ * the cached tiles of the levels above as out of date. They are
+ * recomputed when the tiles are requested again.
+ */
+void  gegl_tile_handler_zoom_invalidate (GeglTileHandlerZoom *zoom,
+                                         gint                 x,
+                                         gint                 y);
+
+/* builds the tiles x0,y0 - x1,y1 (inclusive) of level z and the tiles
+ * they depend on in the levels below ahead of their use, with the tiles
+ * of each level spread over the worker threads. Does nothing when there
+ * are no worker threads, the tiles are then built on demand.
+ */
+void  gegl_tile_handler_zoom_build      (GeglTileHandlerZoom *zoom,
+                                         gint                 x0,
+                                         gint                 y0,
+                                         gint                 x1,
+                                         gint                 y1,
+                                         gint                 z);
+
 G_END_DECLS
 
 #endif
@@ -69,6 +69,8 @@ enum _GeglTileCommand
   GEGL_TILE_VOID,
   GEGL_TILE_FLUSH,
   GEGL_TILE_REFETCH,
+  GEGL_TILE_PREFETCH,
+  GEGL_TILE_COMPACT,
   GEGL_TILE_LAST_COMMAND
 };
 
@@ -164,6 +166,32 @@ void      gegl_tile_source_refetch   (GegTileSource *source,
                                       gint           x,
                                       gint           y,
                                       gint           z);
+/*   INTERNAL API
+ * gegl_tile_source_prefetch:
+ * @source: a GeglTileSource *
+ * @x: x coordinate
+ * @y: y coordinate
+ * @z: tile zoom level
+ *
+ * A hint that the tile is about to be requested, sources that keep tiles
+ * on disk can start bringing it in. Does not block and has no effect on
+ * tiles that are cached.
+ */
+void      gegl_tile_source_prefetch  (GegTileSource *source,
+                                      gint           x,
+                                      gint           y,
+                                      gint           z);
+/*   INTERNAL API
+ * gegl_tile_source_compact:
+ * @source: a GeglTileSource *
+ *
+ * Moves stored tiles into the holes left by tiles that went away and gives
+ * the space freed at the end of the swap back to the system. Backends also
+ * do a bit of this on idle when their swap is mostly holes.
+ *
+ * Returns: the number of tiles moved.
+ */
+gint      gegl_tile_source_compact   (GegTileSource *source);
 /*   INTERNAL API
  * gegl_tile_source_idle:
  * @source: a GeglTileSource *
@@ -194,6 +222,10 @@ gboolean  gegl_tile_source_idle      (GegTileSource *source);
    gegl_tile_source_command(source,GEGL_TILE_VOID,x,y,z,NULL)
 #define gegl_tile_source_refetch(source,x,y,z) \
    gegl_tile_source_command(source,GEGL_TILE_REFETCH,x,y,z,NULL)
+#define gegl_tile_source_prefetch(source,x,y,z) \
+   gegl_tile_source_command(source,GEGL_TILE_PREFETCH,x,y,z,NULL)
+#define gegl_tile_source_compact(source) \
+   GPOINTER_TO_INT(gegl_tile_source_command(source,GEGL_TILE_COMPACT,0,0,0,NULL))
 #define gegl_tile_source_idle(source) \
    (gboolean)gegl_tile_source_command(source,GEGL_TILE_IDLE,0,0,0,NULL)
 
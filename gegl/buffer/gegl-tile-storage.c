@@ -258,6 +258,7 @@ gegl_tile_storage_constructor (GType                  type,
     gegl_tile_handler_chain_add (tile_handler_chain,
                               g_object_new (GEGL_TYPE_TILE_HANDLER_LOG, NULL));
   g_object_set_data (G_OBJECT (tile_storage), "cache", cache);
+  g_object_set_data (G_OBJECT (tile_storage), "zoom", zoom);
   g_object_set_data (G_OBJECT (empty), "cache", cache);
   g_object_set_data (G_OBJECT (zoom), "cache", cache);
 
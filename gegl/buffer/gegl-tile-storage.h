@@ -43,6 +43,16 @@ struct _GeglTileStorage
   gint         height;
   gchar       *path;
   gint         seen_zoom; /* the maximum zoom level we've seen tiles for */
+  gint         hot_tile_generation; /* bumped when tiles are replaced in the
+                                     cache, invalidates the hot tiles of
+                                     all the buffers of the storage */
+
+  /* the linear views of the buffers of the storage belong to one thread at
+   * a time, see gegl-buffer-linear.c
+   */
+  volatile gpointer linear_owner; /* the GThread, read atomically */
+  gint         linear_depth;
+  GSList      *linear_tiles; /* the tiles locked by direct views */
 
   guint        idle_swapper;
 };
@@ -34,6 +34,8 @@
 #include "gegl-tile.h"
 #include "gegl-tile-source.h"
 #include "gegl-tile-storage.h"
+#include "gegl-tile-alloc.h"
+#include "gegl-tile-handler-zoom.h"
 
 #if HAVE_GPU
 #include "gegl-gpu-types.h"
@@ -42,6 +44,91 @@
 #endif
 #include "gegl-utils.h"
 
+/* The state word of a tile holds the number of read locks in its low
+ * bits. A write lock excludes all other locks and records whether the
+ * cpu and/or the gpu data is being written to. The dirty bits of a
+ * mipmap tile mark the quadrants that are out of date with the level
+ * below. The stored bit is set while the tile_storage holds the current
+ * contents of the tile, the uniform bit while all its pixels are equal.
+ */
+#define STATE_READERS     0x0000ffff
+#define STATE_WRITER      (1 << 16)
+#define STATE_WRITE_CPU   (1 << 17)
+#define STATE_WRITE_GPU   (1 << 18)
+#define STATE_DIRTY_SHIFT 19
+#define STATE_DIRTY       (0xf << STATE_DIRTY_SHIFT)
+#define STATE_STORED      (1 << 24)
+#define STATE_UNIFORM     (1 << 25)
+
+#if ENABLE_MT
+/* protects the next_shared rings of all tiles, they are only changed
+ * when tiles are cloned, written to after cloning or destroyed
+ */
+static GStaticMutex shared_mutex = G_STATIC_MUTEX_INIT;
+#define SHARED_LOCK()   g_static_mutex_lock (&shared_mutex)
+#define SHARED_UNLOCK() g_static_mutex_unlock (&shared_mutex)
+#else
+#define SHARED_LOCK()
+#define SHARED_UNLOCK()
+#endif
+
+/* Uniform tiles share the data of a prototype tile of their color, format
+ * and size, as its clones. Prototypes have data of their own, are never
+ * written to and belong to no storage. Only a few prototypes are kept,
+ * when the table is full the oldest one is dropped, the tiles sharing its
+ * data keep the data alive.
+ */
+#define UNIFORM_PROTOTYPES 16
+
+typedef struct
+{
+  GeglTile   *tile;
+  const Babl *format;
+} UniformPrototype;
+
+static GStaticMutex     uniform_mutex = G_STATIC_MUTEX_INIT;
+static UniformPrototype uniform_prototypes[UNIFORM_PROTOTYPES];
+static gint             uniform_next  = 0;
+
+static volatile gint    stats_uniform_new      = 0;
+static volatile gint    stats_uniform_shared   = 0;
+static volatile gint    stats_uniform_replaced = 0;
+
+static inline void
+tile_state_update (GeglTile *tile,
+                   gint      set,
+                   gint      clear)
+{
+  gint state;
+
+  do
+    state = g_atomic_int_get (&tile->state);
+  while (!g_atomic_int_compare_and_exchange (&tile->state, state,
+                                             (state | set) & ~clear));
+}
+
+/* the rings are short, finding the predecessor of a tile is cheaper than
+ * keeping a back pointer in every tile, expects the shared lock to be held
+ */
+static inline void
+shared_unlink (GeglTile *tile)
+{
+  GeglTile *prev = tile;
+
+  while (prev->next_shared != tile)
+    prev = prev->next_shared;
+  prev->next_shared = tile->next_shared;
+  tile->next_shared = tile;
+}
+
+static inline void
+shared_insert (GeglTile *src,
+               GeglTile *tile)
+{
+  tile->next_shared = src->next_shared;
+  src->next_shared  = tile;
+}
+
 static void
 default_free (gpointer        data,
 #if HAVE_GPU
@@ -50,7 +137,7 @@ default_free (gpointer        data,
               gpointer        userdata)
 {
   if (data != NULL)
-    gegl_free (data);
+    gegl_tile_free (data);
 
 #if HAVE_GPU
   if (gpu_data != NULL)
@@ -78,7 +165,15 @@ void gegl_tile_unref (GeglTile *tile)
 #endif
    )
     {
-      if (tile->next_shared == tile)
+      gboolean last;
+
+      SHARED_LOCK ();
+      last = tile->next_shared == tile;
+      if (!last)
+        shared_unlink (tile);
+      SHARED_UNLOCK ();
+
+      if (last)
         {
           /* no clones */
           if (tile->destroy_notify)
@@ -93,20 +188,8 @@ void gegl_tile_unref (GeglTile *tile)
           tile->gpu_data = NULL;
 #endif
         }
-      else
-        {
-          tile->prev_shared->next_shared = tile->next_shared;
-          tile->next_shared->prev_shared = tile->prev_shared;
-        }
     }
 
-#if ENABLE_MT
-  if (tile->mutex)
-    {
-      g_mutex_free (tile->mutex);
-      tile->mutex = NULL;
-    }
-#endif
   g_slice_free (GeglTile, tile);
 }
 
@@ -116,29 +199,9 @@ gegl_tile_new_bare (void)
   GeglTile *tile = g_slice_new0 (GeglTile);
 
   tile->ref_count = 1;
-  tile->tile_storage = NULL;
-  tile->stored_rev = 0;
-
-  tile->data     = NULL;
-#if HAVE_GPU 
-  tile->gpu_data = NULL;
-  tile->gpu_rev    = 0;
-#endif
-
-  tile->rev        = 0;
-  tile->stored_rev = 0;
-
-  tile->read_locks  = 0;
-  tile->write_locks = 0;
-  tile->lock_mode   = GEGL_TILE_LOCK_NONE;
-
-  tile->next_shared = tile;
-  tile->prev_shared = tile;
-
-#if ENABLE_MT
-  tile->mutex = g_mutex_new ();
-#endif
+  tile->state     = STATE_STORED;
 
+  tile->next_shared    = tile;
   tile->destroy_notify = default_free;
 
   return tile;
@@ -174,27 +237,20 @@ gegl_tile_dup (GeglTile *src)
   tile->data     = src->data;
   tile->size     = src->size;
 
+  if (g_atomic_int_get (&src->state) & STATE_UNIFORM)
+    tile->state |= STATE_UNIFORM;
+
+  /* the data is released by whichever clone goes last */
+  tile->destroy_notify      = src->destroy_notify;
+  tile->destroy_notify_data = src->destroy_notify_data;
+
   tile->tile_storage = src->tile_storage;
 
-  tile->rev        = 1;
-  tile->stored_rev = 1;
+  tile->rev = 1;
 
-  tile->next_shared              = src->next_shared;
-  src->next_shared               = tile;
-  tile->prev_shared              = src;
-#if ENABLE_MT
-  if (tile->next_shared != src)
-    {
-      g_mutex_lock (tile->next_shared->mutex);
-    }
-#endif
-  tile->next_shared->prev_shared = tile;
-#if ENABLE_MT
-  if (tile->next_shared != src)
-    {
-      g_mutex_unlock (tile->next_shared->mutex);
-    }
-#endif
+  SHARED_LOCK ();
+  shared_insert (src, tile);
+  SHARED_UNLOCK ();
 
   return tile;
 }
@@ -207,14 +263,14 @@ gegl_tile_new (gint        width,
   GeglTile *tile = gegl_tile_new_bare ();
 
   tile->size = width * height * babl_format_get_bytes_per_pixel (format);
-  tile->data = gegl_malloc (tile->size);
+  tile->data = gegl_tile_alloc (tile->size);
 
 #if HAVE_GPU
   if (gegl_gpu_is_accelerated ())
     tile->gpu_data = gegl_gpu_texture_new (width, height, format);
 #endif
 
-  tile->stored_rev = 1;
+  tile->state = 0;
 
   return tile;
 }
@@ -262,7 +318,7 @@ gegl_memdup (gpointer src,
              gsize    size)
 {
   gpointer ret;
-  ret = gegl_malloc (size);
+  ret = gegl_tile_alloc (size);
   memcpy (ret, src, size);
   return ret;
 }
@@ -270,16 +326,22 @@ gegl_memdup (gpointer src,
 static void
 gegl_tile_unclone (GeglTile *tile)
 {
-  if (tile->next_shared != tile)
+  gboolean shared;
+
+  SHARED_LOCK ();
+  shared = tile->next_shared != tile;
+  if (shared)
+    shared_unlink (tile);
+  SHARED_UNLOCK ();
+
+  if (shared)
     {
       /* the tile data is shared with other tiles,
        * create a local copy
        */
-      tile->data                     = gegl_memdup (tile->data, tile->size);
-      tile->prev_shared->next_shared = tile->next_shared;
-      tile->next_shared->prev_shared = tile->prev_shared;
-      tile->prev_shared              = tile;
-      tile->next_shared              = tile;
+      tile->data                = gegl_memdup (tile->data, tile->size);
+      tile->destroy_notify      = default_free;
+      tile->destroy_notify_data = NULL;
 
 #if HAVE_GPU
       if (gegl_gpu_is_accelerated ())
@@ -300,61 +362,59 @@ void
 gegl_tile_lock (GeglTile        *tile,
                 GeglTileLockMode lock_mode)
 {
+  gboolean write;
+
 #if HAVE_GPU
   if (!gegl_gpu_is_accelerated ())
     lock_mode &= ~GEGL_TILE_LOCK_GPU_READ & ~GEGL_TILE_LOCK_GPU_WRITE;
 #endif
 
-  if (tile->write_locks > 0)
+  if (lock_mode == GEGL_TILE_LOCK_NONE)
     {
-      if (lock_mode & GEGL_TILE_LOCK_WRITE
-          || lock_mode & GEGL_TILE_LOCK_GPU_WRITE)
-        {
-          g_print ("hm\n");
-          g_warning ("strange tile write-lock count: %i", tile->write_locks);
-        }
-
-      if (lock_mode & GEGL_TILE_LOCK_READ
-          || lock_mode & GEGL_TILE_LOCK_GPU_READ)
-        g_warning ("shouldn't lock for reading while write-lock (%i) is active",
-                   tile->write_locks);
+      g_warning ("%s called with lock_mode GEGL_TILE_LOCK_NONE", G_STRFUNC);
+      return;
     }
 
-  if (tile->read_locks > 0)
+  write = (lock_mode & GEGL_TILE_LOCK_ALL_WRITE) != 0;
+
+  for (;;)
     {
-      if (lock_mode & GEGL_TILE_LOCK_READ
-          || lock_mode & GEGL_TILE_LOCK_GPU_READ)
+      gint state = g_atomic_int_get (&tile->state);
+      gint locked;
+
+      if (state & STATE_WRITER || (write && state & STATE_READERS))
         {
-          g_print ("hm\n");
-          g_warning ("strange tile read-lock count: %i", tile->read_locks);
+#if ENABLE_MT
+          g_thread_yield ();
+          continue;
+#else
+          g_warning ("shouldn't lock a tile for %s while it is %s-locked",
+                     write ? "writing" : "reading",
+                     state & STATE_WRITER ? "write" : "read");
+#endif
         }
 
-      if (lock_mode & GEGL_TILE_LOCK_WRITE
-          || lock_mode & GEGL_TILE_LOCK_GPU_WRITE)
-        g_warning ("shouldn't lock for writing while read-lock (%i) is active",
-                   tile->read_locks);
-    }
+      /* a written tile is no longer known to be uniform, it gets a copy
+       * of the shared data of its color below
+       */
+      if (write)
+        locked = (state | STATE_WRITER |
+                  (lock_mode & GEGL_TILE_LOCK_WRITE ? STATE_WRITE_CPU : 0) |
+                  (lock_mode & GEGL_TILE_LOCK_GPU_WRITE ? STATE_WRITE_GPU : 0)) &
+                 ~STATE_UNIFORM;
+      else
+        locked = state + 1;
 
-  if (lock_mode != GEGL_TILE_LOCK_NONE)
-    {
-#if ENABLE_MT
-      g_mutex_lock (tile->mutex);
-#endif
+      if (g_atomic_int_compare_and_exchange (&tile->state, state, locked))
+        break;
     }
-  else
-    g_warning ("%s called with lock_mode GEGL_TILE_LOCK_NONE", G_STRFUNC);
 
-  if (lock_mode & GEGL_TILE_LOCK_READ
-      || lock_mode & GEGL_TILE_LOCK_GPU_READ)
+  if (!write)
     {
-      tile->read_locks++;
       total_read_locks++;
     }
-
-  if (lock_mode & GEGL_TILE_LOCK_WRITE
-      || lock_mode & GEGL_TILE_LOCK_GPU_WRITE)
+  else
     {
-      tile->write_locks++;
       total_write_locks++;
 
       /*fprintf (stderr, "global tile locking: %i %i\n", locks, unlocks);*/
@@ -382,21 +442,239 @@ gegl_tile_lock (GeglTile        *tile,
         }
     }
 #endif
+}
+
+void
+gegl_tile_fill_rect (guchar        *dst,
+                     gint           rowstride,
+                     gint           pixels,
+                     gint           rows,
+                     gconstpointer  pixel,
+                     gint           bpp)
+{
+  gint    bytes = pixels * bpp;
+  guchar *row   = dst;
+  gint    filled;
 
-  tile->lock_mode = lock_mode;
+  if (bytes <= 0 || rows <= 0)
+    return;
+
+  if (rowstride == bytes)
+    {
+      bytes *= rows;
+      rows   = 1;
+    }
+
+  if (pixel == NULL)
+    {
+      while (rows--)
+        {
+          memset (dst, 0x00, bytes);
+          dst += rowstride;
+        }
+      return;
+    }
+
+  /* the first row is filled by doubling its initialized part, the other
+   * rows are copies of it
+   */
+  memcpy (row, pixel, bpp);
+  for (filled = bpp; filled < bytes; filled *= 2)
+    memcpy (row + filled, row, MIN (filled, bytes - filled));
+
+  while (--rows)
+    {
+      dst += rowstride;
+      memcpy (dst, row, bytes);
+    }
+}
+
+static inline gboolean
+uniform_pixels (const guchar *data,
+                gint          size,
+                gint          bpp)
+{
+  /* all pixels are equal exactly when each pixel equals the one after it */
+  return size >= bpp && memcmp (data, data + bpp, size - bpp) == 0;
 }
 
+/* expects the uniform mutex to be held */
+static UniformPrototype *
+uniform_lookup (const Babl   *format,
+                gint          size,
+                const guchar *pixel,
+                gint          bpp)
+{
+  gint i;
+
+  for (i = 0; i < UNIFORM_PROTOTYPES; i++)
+    {
+      UniformPrototype *prototype = &uniform_prototypes[i];
+
+      if (prototype->tile &&
+          prototype->format == format &&
+          prototype->tile->size == size &&
+          memcmp (prototype->tile->data, pixel, bpp) == 0)
+        return prototype;
+    }
+  return NULL;
+}
+
+/* returns the prototype of the color of pixel, creating it when there is
+ * none, expects the uniform mutex to be held
+ */
+static GeglTile *
+uniform_prototype (gint          width,
+                   gint          height,
+                   const Babl   *format,
+                   gconstpointer pixel,
+                   gint          bpp)
+{
+  gint              size = width * height * bpp;
+  UniformPrototype *prototype;
+  GeglTile         *tile;
+
+  prototype = uniform_lookup (format, size, pixel, bpp);
+  if (prototype)
+    return prototype->tile;
+
+  prototype    = &uniform_prototypes[uniform_next];
+  uniform_next = (uniform_next + 1) % UNIFORM_PROTOTYPES;
+
+  if (prototype->tile)
+    gegl_tile_unref (prototype->tile);
+
+  tile = gegl_tile_new (width, height, format);
+  gegl_tile_fill_rect (tile->data, size, width * height, 1, pixel, bpp);
+  /* makes gegl_tile_dup upload the pixels to the GPU */
+  tile->rev = 1;
+  tile_state_update (tile, STATE_UNIFORM, 0);
+
+  prototype->tile   = tile;
+  prototype->format = format;
+  return tile;
+}
+
+GeglTile *
+gegl_tile_new_uniform (gint          width,
+                       gint          height,
+                       const Babl   *format,
+                       gconstpointer pixel)
+{
+  gint      bpp = babl_format_get_bytes_per_pixel (format);
+  GeglTile *tile;
+
+  if (pixel == NULL)
+    {
+      guchar *zero = g_alloca (bpp);
+
+      memset (zero, 0x00, bpp);
+      pixel = zero;
+    }
+
+  g_static_mutex_lock (&uniform_mutex);
+  tile = gegl_tile_dup (uniform_prototype (width, height, format, pixel, bpp));
+  g_static_mutex_unlock (&uniform_mutex);
+
+  g_atomic_int_inc (&stats_uniform_new);
+  return tile;
+}
+
+gboolean
+gegl_tile_is_uniform (GeglTile *tile)
+{
+  return (g_atomic_int_get (&tile->state) & STATE_UNIFORM) != 0;
+}
+
+/* called before a tile is written to its storage, when it is flushed or
+ * evicted, a tile whose pixels turn out to be all equal is marked uniform
+ * and gives up its data to become a clone of the prototype of its color.
+ * Tiles locked by someone else are left alone.
+ */
 static void
-_gegl_tile_void_pyramid (GeglTileSource *source,
-                         gint            x,
-                         gint            y,
-                         gint            z)
+gegl_tile_share_uniform (GeglTile *tile)
 {
-  if (z > ((GeglTileStorage*) source)->seen_zoom)
+  const Babl *format;
+  guchar     *old_data = NULL;
+  gint        uniform  = 0;
+  gint        state;
+  gint        bpp;
+
+  /* only data allocated by us can be replaced */
+  if (tile->data == NULL ||
+      tile->tile_storage == NULL ||
+      tile->destroy_notify != default_free)
+    return;
+
+#if HAVE_GPU
+  if (gegl_gpu_is_accelerated ())
     return;
+#endif
+
+  /* the data is only swapped while we hold the tile exclusively */
+  state = g_atomic_int_get (&tile->state);
+  if (state & (STATE_UNIFORM | STATE_WRITER | STATE_READERS) ||
+      !g_atomic_int_compare_and_exchange (&tile->state, state,
+                                          state | STATE_WRITER))
+    return;
+
+  format = tile->tile_storage->format;
+  bpp    = babl_format_get_bytes_per_pixel (format);
+
+  if (uniform_pixels (tile->data, tile->size, bpp))
+    {
+      GeglTile *prototype;
+
+      g_static_mutex_lock (&uniform_mutex);
+      prototype = uniform_prototype (tile->tile_storage->tile_width,
+                                     tile->tile_storage->tile_height,
+                                     format, tile->data, bpp);
+
+      /* clones of the tile keep sharing its data */
+      SHARED_LOCK ();
+      if (tile->next_shared == tile)
+        {
+          old_data   = tile->data;
+          tile->data = prototype->data;
+          shared_insert (prototype, tile);
+        }
+      SHARED_UNLOCK ();
+      g_static_mutex_unlock (&uniform_mutex);
 
-  gegl_tile_source_void (source, x, y, z);
-  _gegl_tile_void_pyramid (source, x / 2, y / 2, z + 1);
+      uniform = STATE_UNIFORM;
+      g_atomic_int_inc (&stats_uniform_shared);
+    }
+
+  tile_state_update (tile, uniform, STATE_WRITER);
+
+  if (old_data)
+    {
+      gegl_tile_free (old_data);
+      g_atomic_int_inc (&stats_uniform_replaced);
+    }
+}
+
+void
+gegl_tile_uniform_cleanup (void)
+{
+  gint i;
+
+  g_static_mutex_lock (&uniform_mutex);
+  for (i = 0; i < UNIFORM_PROTOTYPES; i++)
+    if (uniform_prototypes[i].tile)
+      {
+        gegl_tile_unref (uniform_prototypes[i].tile);
+        uniform_prototypes[i].tile = NULL;
+      }
+  g_static_mutex_unlock (&uniform_mutex);
+}
+
+void
+gegl_tile_uniform_stats (void)
+{
+  g_warning ("uniform tiles: %i created as such, %i found after writes "
+             "of which %i released their data",
+             stats_uniform_new, stats_uniform_shared, stats_uniform_replaced);
 }
 
 static void
@@ -406,10 +684,11 @@ gegl_tile_void_pyramid (GeglTile *tile)
       tile->tile_storage->seen_zoom &&
       tile->z == 0) /* we only accept voiding the base level */
     {
-      _gegl_tile_void_pyramid (GEGL_TILE_SOURCE (tile->tile_storage), 
-                               tile->x / 2,
-                               tile->y / 2,
-                               tile->z + 1);
+      GeglTileHandlerZoom *zoom;
+
+      zoom = g_object_get_data (G_OBJECT (tile->tile_storage), "zoom");
+      if (zoom)
+        gegl_tile_handler_zoom_invalidate (zoom, tile->x, tile->y);
       return;
     }
 }
@@ -417,76 +696,110 @@ gegl_tile_void_pyramid (GeglTile *tile)
 void
 gegl_tile_unlock (GeglTile *tile)
 {
-  if (tile->lock_mode & GEGL_TILE_LOCK_WRITE
-      || tile->lock_mode & GEGL_TILE_LOCK_GPU_WRITE)
-    {
-      total_write_unlocks++;
-
-      if (tile->write_locks == 0)
-        g_warning ("unlocked a tile with write-lock count == 0");
+  gint state = g_atomic_int_get (&tile->state);
 
-      tile->write_locks--;
-
-      if (tile->write_locks == 0)
-        {
-          guint rev     = tile->rev;
+  if (state & STATE_WRITER)
+    {
+      guint rev     = tile->rev;
+      gint  clear;
 #if HAVE_GPU
-          guint gpu_rev = tile->gpu_rev;
+      guint gpu_rev = tile->gpu_rev;
 
-          if (tile->lock_mode & GEGL_TILE_LOCK_GPU_WRITE)
-            tile->gpu_rev = MAX (gpu_rev, rev) + 1;
+      if (state & STATE_WRITE_GPU)
+        tile->gpu_rev = MAX (gpu_rev, rev) + 1;
 #endif
 
-          if (tile->lock_mode & GEGL_TILE_LOCK_WRITE)
-            tile->rev = 
+      total_write_unlocks++;
+
+      if (state & STATE_WRITE_CPU)
+        tile->rev = 
 #if HAVE_GPU 
-              MAX (rev, gpu_rev) + 1;
+          MAX (rev, gpu_rev) + 1;
 #else
           rev + 1;
 #endif
 
-          /* TODO: examine how this can be improved with h/w mipmaps */
-          if (tile->z == 0)
-            gegl_tile_void_pyramid (tile);
+      /* TODO: examine how this can be improved with h/w mipmaps */
+      if (tile->z == 0)
+        gegl_tile_void_pyramid (tile);
+
+      /* a quadrant invalidated while we held the lock marked the tile as
+       * stored so it is rebuilt rather than written out, that is kept
+       */
+      do
+        {
+          state = g_atomic_int_get (&tile->state);
+          clear = STATE_WRITER | STATE_WRITE_CPU | STATE_WRITE_GPU;
+          if (!(state & STATE_DIRTY))
+            clear |= STATE_STORED;
         }
+      while (!g_atomic_int_compare_and_exchange (&tile->state, state,
+                                                 state & ~clear));
     }
-
-  if (tile->lock_mode & GEGL_TILE_LOCK_READ
-      || tile->lock_mode & GEGL_TILE_LOCK_GPU_READ)
+  else if (state & STATE_READERS)
     {
       total_read_unlocks++;
-
-      if (tile->read_locks == 0)
-        g_warning ("unlocked a tile with read-lock count == 0");
-
-      tile->read_locks--;
+      g_atomic_int_add (&tile->state, -1);
+    }
+  else
+    {
+      g_warning ("unlocked a tile that was not locked");
     }
-#if ENABLE_MT
-  g_mutex_unlock (tile->mutex);
-#endif
-  tile->lock_mode = GEGL_TILE_LOCK_NONE;
 }
 
 gboolean
 gegl_tile_is_stored (GeglTile *tile)
 {
-  return tile->stored_rev == 
-#if HAVE_GPU
-    MAX (tile->rev, tile->gpu_rev);
-#else
-    tile->rev;
-#endif
+  return (g_atomic_int_get (&tile->state) & STATE_STORED) != 0;
+}
+
+void
+gegl_tile_mark_as_stored (GeglTile *tile)
+{
+  tile_state_update (tile, STATE_STORED, 0);
+}
+
+void
+gegl_tile_mark_as_unstored (GeglTile *tile)
+{
+  tile_state_update (tile, 0, STATE_STORED);
+}
+
+void
+gegl_tile_mark_quadrant_dirty (GeglTile *tile,
+                               gint      i,
+                               gint      j)
+{
+  /* with the stored bit set an evicted tile is dropped instead of its
+   * stale contents being written out, it is rebuilt when needed again
+   */
+  tile_state_update (tile, (1 << (STATE_DIRTY_SHIFT + i + 2 * j)) |
+                           STATE_STORED, 0);
+}
+
+gint
+gegl_tile_get_dirty_quadrants (GeglTile *tile)
+{
+  return (g_atomic_int_get (&tile->state) & STATE_DIRTY) >> STATE_DIRTY_SHIFT;
+}
+
+gint
+gegl_tile_take_dirty_quadrants (GeglTile *tile)
+{
+  gint state;
+
+  do
+    state = g_atomic_int_get (&tile->state);
+  while (!g_atomic_int_compare_and_exchange (&tile->state, state,
+                                             state & ~STATE_DIRTY));
+
+  return (state & STATE_DIRTY) >> STATE_DIRTY_SHIFT;
 }
 
 void
 gegl_tile_void (GeglTile *tile)
 {
-  tile->stored_rev   = 
-#if HAVE_GPU
-    MAX (tile->rev, tile->gpu_rev);
-#else
-    tile->rev;
-#endif
+  gegl_tile_mark_as_stored (tile);
   tile->tile_storage = NULL;
 
   if (tile->z == 0)
@@ -500,21 +813,24 @@ gegl_tile_cpy (GeglTile *src,
   gegl_tile_lock (src, GEGL_TILE_LOCK_ALL_READ);
   gegl_tile_lock (dst, GEGL_TILE_LOCK_ALL_WRITE);
 
-  default_free (dst->data,
+  if (dst->destroy_notify)
+    dst->destroy_notify (dst->data,
 #if HAVE_GPU
-   dst->gpu_data, 
+                         dst->gpu_data,
 #endif
-   NULL);
+                         dst->destroy_notify_data);
 
-  dst->next_shared              = src->next_shared;
-  src->next_shared              = dst;
-  dst->prev_shared              = src;
-  dst->next_shared->prev_shared = dst;
+  SHARED_LOCK ();
+  shared_unlink (dst);
+  shared_insert (src, dst);
+  SHARED_UNLOCK ();
 
   dst->data     = src->data;
 #if HAVE_GPU
   dst->gpu_data = src->gpu_data;
 #endif
+  dst->destroy_notify      = src->destroy_notify;
+  dst->destroy_notify_data = src->destroy_notify_data;
 
   gegl_tile_unlock (dst);
   gegl_tile_unlock (src);
@@ -528,6 +844,12 @@ gegl_tile_swp (GeglTile *a,
 #if HAVE_GPU
   GeglGpuTexture *tmp_gpu_data;
 #endif
+  gpointer        tmp_notify_data;
+  void          (*tmp_notify) (gpointer        pixels,
+#if HAVE_GPU
+                               GeglGpuTexture *gpu_data,
+#endif
+                               gpointer        data);
 
   gegl_tile_lock (a, GEGL_TILE_LOCK_ALL);
   gegl_tile_lock (b, GEGL_TILE_LOCK_ALL);
@@ -544,6 +866,13 @@ gegl_tile_swp (GeglTile *a,
   a->data  = b->data;
   b->data  = tmp_data;
 
+  tmp_notify             = a->destroy_notify;
+  a->destroy_notify      = b->destroy_notify;
+  b->destroy_notify      = tmp_notify;
+  tmp_notify_data        = a->destroy_notify_data;
+  a->destroy_notify_data = b->destroy_notify_data;
+  b->destroy_notify_data = tmp_notify_data;
+
 #if HAVE_GPU
   tmp_gpu_data = a->gpu_data;
   a->gpu_data  = b->gpu_data;
@@ -565,6 +894,8 @@ gegl_tile_store (GeglTile *tile)
   if (tile->tile_storage == NULL)
     return FALSE;
 
+  gegl_tile_share_uniform (tile);
+
   gegl_tile_lock (tile, GEGL_TILE_LOCK_ALL_READ);
   stored = gegl_tile_source_set_tile (GEGL_TILE_SOURCE (tile->tile_storage),
                                       tile->x,
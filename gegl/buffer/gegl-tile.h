@@ -47,66 +47,48 @@ typedef enum
 } GeglTileLockMode;
 
 
-/* the instance size of a GeglTile is a bit large, and should if possible be
- * trimmed down
+/* The tile header is kept to a single 64 byte cache line on 64bit hosts
+ * (GPU builds add two more fields), the members used on every pixel access
+ * come first. g_slice hands out blocks of this size from page aligned slabs
+ * which keeps the headers cache line aligned.
+ *
+ * Locking and the stored state are packed in the atomically updated state
+ * word: read locks are shared and counted in the low bits, a write lock is
+ * exclusive. The tiles sharing their data after gegl_tile_dup form a
+ * circular list through next_shared, it is short and only walked when a
+ * clone is written to or destroyed.
  */
 struct _GeglTile
 {
- /* GObject          parent_instance;*/
-  gint             ref_count;
-
   guchar          *data;         /* actual pixel data for tile,
                                   * a linear buffer
                                   */
-  gint             size;         /* The size of the linear buffer */
-#if HAVE_GPU
-  GeglGpuTexture  *gpu_data;     /* pixel data for tile, stored in the GPU */
-#endif
-
   GeglTileStorage *tile_storage; /* the buffer from which this tile was
                                   * retrieved, needed for the tile to be able
                                   * to store itself back (for instance when it
                                   * is unreffed for the last time)
                                   */
-  gint             x, y, z;
-
-  guint            rev;          /* this tile's revision */
-#if HAVE_GPU
-  guint            gpu_rev;      /* this tile's GPU data revision */ 
-#endif
-  guint            stored_rev;   /* what revision was the tile when it was
-                                  * committed to the tile_storage? (currently
-                                  * set to 1 when loaded from disk)
-                                  */
-
-  guint            read_locks;   /* number of times the tile is read-locked,
-                                  * should in theory just have the values 0/1,
-                                  * note that we might want to have shared
-                                  * reads though (not yet implemented)
-                                  */
-  gchar            write_locks;  /* number of times the tile is write-locked,
-                                  * should in theory just have the values 0/1
-                                  */
-  GeglTileLockMode lock_mode;
-
-  gchar            lock;        /* number of times the tile is write locked
-                                 * should in theory just have the values 0/1
-                                 */
-#if ENABLE_MT
-  GMutex          *mutex;
-#endif
-
-  /* the shared list is a doubly linked circular list */
   GeglTile        *next_shared;
-  GeglTile        *prev_shared;
 
   void (*destroy_notify) (gpointer        pixels,
 #if HAVE_GPU
                           GeglGpuTexture *gpu_data,
 #endif
                           gpointer        data);
-
   gpointer         destroy_notify_data;
+
+  volatile gint    ref_count;
+  volatile gint    state;        /* lock and stored bits, see gegl-tile.c */
+  gint             size;         /* The size of the linear buffer */
+
+  guint            rev : 24;     /* this tile's revision, wraps around */
+  gint             z   : 8;      /* mipmap level */
+  gint             x, y;
+
+#if HAVE_GPU
+  GeglGpuTexture  *gpu_data;     /* pixel data for tile, stored in the GPU */
+  guint            gpu_rev;      /* this tile's GPU data revision */
+#endif
 };
 
 
@@ -114,6 +96,14 @@ GeglTile      * gegl_tile_new_bare   (void);
 GeglTile      * gegl_tile_new        (gint width,
                                       gint height,
                                       const Babl *format);
+/* a tile of width x height pixels of format that all have the value at
+ * pixel, or are zero if pixel is NULL. The data is shared with the other
+ * tiles of that color and copied when the tile is locked for writing.
+ */
+GeglTile      * gegl_tile_new_uniform (gint          width,
+                                       gint          height,
+                                       const Babl   *format,
+                                       gconstpointer pixel);
 GeglTile      * gegl_tile_ref        (GeglTile *tile);
 void            gegl_tile_unref      (GeglTile *tile);
 
@@ -141,10 +131,42 @@ GeglGpuTexture *gegl_tile_get_gpu_data (GeglTile *tile);
 void            gegl_tile_unlock       (GeglTile *tile);
 
 gboolean        gegl_tile_is_stored    (GeglTile *tile);
+/* the contents of the tile are what the tile_storage holds */
+void            gegl_tile_mark_as_stored (GeglTile *tile);
+/* the tile_storage has to be updated with the contents of the tile */
+void            gegl_tile_mark_as_unstored (GeglTile *tile);
 gboolean        gegl_tile_store        (GeglTile *tile);
 void            gegl_tile_void         (GeglTile *tile);
+
+/* the quadrants of mipmap tiles that have to be recomputed from the level
+ * below, quadrant i, j is bit i + 2 * j of the returned masks. Taking the
+ * quadrants clears them.
+ */
+void            gegl_tile_mark_quadrant_dirty  (GeglTile *tile,
+                                                gint      i,
+                                                gint      j);
+gint            gegl_tile_get_dirty_quadrants  (GeglTile *tile);
+gint            gegl_tile_take_dirty_quadrants (GeglTile *tile);
 GeglTile       *gegl_tile_dup          (GeglTile *tile);
 
+/* whether all pixels of the tile are known to be equal, tiles are checked
+ * when a write lock is released, expects the tile to be locked
+ */
+gboolean        gegl_tile_is_uniform   (GeglTile *tile);
+
+/* sets rows rows of pixels pixels, rowstride bytes apart, to the bpp
+ * bytes at pixel, or to zero if pixel is NULL
+ */
+void            gegl_tile_fill_rect    (guchar        *dst,
+                                        gint           rowstride,
+                                        gint           pixels,
+                                        gint           rows,
+                                        gconstpointer  pixel,
+                                        gint           bpp);
+
+void            gegl_tile_uniform_stats   (void);
+void            gegl_tile_uniform_cleanup (void);
+
 /* computes the positive integer remainder (also for negative dividends) */
 #define GEGL_REMAINDER(dividend, divisor) \
                    (((dividend) < 0) ? \
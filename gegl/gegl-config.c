@@ -38,7 +38,10 @@ enum
   PROP_BABL_TOLERANCE,
   PROP_TILE_WIDTH,
   PROP_TILE_HEIGHT,
-  PROP_GPU_ENABLED
+  PROP_GPU_ENABLED,
+  PROP_CACHE_POLICY,
+  PROP_SWAP_MMAP,
+  PROP_TILE_COMPRESSION
 #if ENABLE_MT
   ,PROP_THREADS
 #endif
@@ -82,6 +85,18 @@ get_property (GObject    *gobject,
         g_value_set_string (value, config->swap);
         break;
 
+      case PROP_CACHE_POLICY:
+        g_value_set_string (value, config->cache_policy);
+        break;
+
+      case PROP_SWAP_MMAP:
+        g_value_set_boolean (value, config->swap_mmap);
+        break;
+
+      case PROP_TILE_COMPRESSION:
+        g_value_set_string (value, config->tile_compression);
+        break;
+
 #if HAVE_GPU
       case PROP_GPU_ENABLED:
         g_value_set_boolean (value, config->gpu_enabled);
@@ -142,6 +157,19 @@ set_property (GObject      *gobject,
          g_free (config->swap);
         config->swap = g_value_dup_string (value);
         break;
+      case PROP_CACHE_POLICY:
+        if (config->cache_policy)
+         g_free (config->cache_policy);
+        config->cache_policy = g_value_dup_string (value);
+        break;
+      case PROP_SWAP_MMAP:
+        config->swap_mmap = g_value_get_boolean (value);
+        break;
+      case PROP_TILE_COMPRESSION:
+        if (config->tile_compression)
+         g_free (config->tile_compression);
+        config->tile_compression = g_value_dup_string (value);
+        break;
 #if HAVE_GPU
       case PROP_GPU_ENABLED:
         config->gpu_enabled = g_value_get_boolean (value);
@@ -165,6 +193,10 @@ finalize (GObject *gobject)
 
   if (config->swap)
     g_free (config->swap);
+  if (config->cache_policy)
+    g_free (config->cache_policy);
+  if (config->tile_compression)
+    g_free (config->tile_compression);
 
   G_OBJECT_CLASS (gegl_config_parent_class)->finalize (gobject);
 }
@@ -197,6 +229,10 @@ gegl_config_class_init (GeglConfigClass *klass)
                                                      G_PARAM_READWRITE));
 
 
+  g_object_class_install_property (gobject_class, PROP_CACHE_POLICY,
+                                   g_param_spec_string ("cache-policy", "Cache policy", "eviction policy of the tile cache; lru, clock, 2q or cost, read when the cache is first used", "lru",
+                                                     G_PARAM_READWRITE));
+
   g_object_class_install_property (gobject_class, PROP_CHUNK_SIZE,
                                    g_param_spec_int ("chunk-size", "Chunk size",
                                      "the number of pixels processed simultaneously by GEGL.",
@@ -217,14 +253,22 @@ gegl_config_class_init (GeglConfigClass *klass)
                                    g_param_spec_string ("swap", "Swap", "where gegl stores it's swap files", NULL,
                                                      G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_SWAP_MMAP,
+                                   g_param_spec_boolean ("swap-mmap", "Memory mapped swap", "whether swap files are accessed through memory mappings when the platform supports it", TRUE,
+                                                     G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_COMPRESSION,
+                                   g_param_spec_string ("tile-compression", "Tile compression", "how tiles are compressed when stored in ram or swap; none, uniform or rle, read when a buffer is created", "uniform",
+                                                     G_PARAM_READWRITE));
+
 
   g_object_class_install_property (gobject_class, PROP_GPU_ENABLED,
                                    g_param_spec_string ("gpu-enabled", "GPU-support enabled", "whether or not GPU support is enabled", FALSE,
                                                      G_PARAM_READWRITE));
 #if ENABLE_MT
-  g_object_class_install_property (gobject_class, PROP_TILE_HEIGHT,
-                                   g_param_spec_int ("threads", "Number of concurrent evaluation threads", "default tile height for created buffers.",
-                                                     0, 16, 2,
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+                                   g_param_spec_int ("threads", "Number of concurrent evaluation threads", "the number of threads rendering is spread over.",
+                                                     0, 256, 2,
                                                      G_PARAM_READWRITE));
 #endif
 }
@@ -233,8 +277,11 @@ static void
 gegl_config_init (GeglConfig *self)
 {
   self->swap        = NULL;
+  self->swap_mmap   = TRUE;
   self->quality     = 1.0;
   self->cache_size  = 256 * 1024 * 1024;
+  self->cache_policy = g_strdup ("lru");
+  self->tile_compression = g_strdup ("uniform");
   self->chunk_size  = 512 * 512;
   self->tile_width  = 64;
   self->tile_height = 128;
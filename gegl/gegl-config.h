@@ -38,7 +38,10 @@ struct _GeglConfig
   GObject  parent_instance;
 
   gchar   *swap;
+  gboolean swap_mmap;  /* access swap files through memory mappings */
+  gchar   *tile_compression; /* codec used for tiles stored by backends */
   gint     cache_size;
+  gchar   *cache_policy; /* eviction policy of the tile cache */
   gint     chunk_size; /* The size of elements being processed at once */
   gdouble  quality;
   gdouble  babl_tolerance;
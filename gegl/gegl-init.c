@@ -92,7 +92,9 @@ guint gegl_debug_flags = 0;
 #include "operation/gegl-operations.h"
 #include "operation/gegl-extension-handler.h"
 #include "buffer/gegl-buffer-private.h"
+#include "buffer/gegl-buffer-pool.h"
 #include "gegl-config.h"
+#include "process/gegl-scheduler.h"
 
 #ifdef HAVE_GPU
 
@@ -212,6 +214,8 @@ gegl_init (gint    *argc,
 
 static gchar *cmd_gegl_swap        = NULL;
 static gchar *cmd_gegl_cache_size  = NULL;
+static gchar *cmd_gegl_cache_policy = NULL;
+static gchar *cmd_gegl_tile_compression = NULL;
 static gchar *cmd_gegl_chunk_size  = NULL;
 static gchar *cmd_gegl_quality     = NULL;
 static gchar *cmd_gegl_tile_size   = NULL;
@@ -238,6 +242,16 @@ static const GOptionEntry cmd_entries[]=
      G_OPTION_ARG_STRING, &cmd_gegl_cache_size,
      N_("How much memory to (approximately) use for caching imagery"), "<megabytes>"
     },
+    {
+     "gegl-cache-policy", 0, 0,
+     G_OPTION_ARG_STRING, &cmd_gegl_cache_policy,
+     N_("How the tile cache picks tiles to evict"), "<lru|clock|2q|cost>"
+    },
+    {
+     "gegl-tile-compression", 0, 0,
+     G_OPTION_ARG_STRING, &cmd_gegl_tile_compression,
+     N_("How tiles are compressed when stored"), "<none|uniform|rle>"
+    },
     {
      "gegl-tile-size", 0, 0,
      G_OPTION_ARG_STRING, &cmd_gegl_tile_size,
@@ -303,6 +317,12 @@ GeglConfig *gegl_config (void)
         config->quality = atof(g_getenv("GEGL_QUALITY"));
       if (g_getenv ("GEGL_CACHE_SIZE"))
         config->cache_size = atoi(g_getenv("GEGL_CACHE_SIZE"))* 1024*1024;
+      if (g_getenv ("GEGL_SWAP_MMAP"))
+        config->swap_mmap = !g_str_equal (g_getenv ("GEGL_SWAP_MMAP"), "no");
+      if (g_getenv ("GEGL_CACHE_POLICY"))
+        g_object_set (config, "cache-policy", g_getenv ("GEGL_CACHE_POLICY"), NULL);
+      if (g_getenv ("GEGL_TILE_COMPRESSION"))
+        g_object_set (config, "tile-compression", g_getenv ("GEGL_TILE_COMPRESSION"), NULL);
       if (g_getenv ("GEGL_CHUNK_SIZE"))
         config->chunk_size = atoi(g_getenv("GEGL_CHUNK_SIZE"));
       if (g_getenv ("GEGL_TILE_SIZE"))
@@ -332,6 +352,12 @@ void gegl_tile_backend_ram_stats (void);
 void gegl_tile_backend_tiledir_stats (void);
 #endif
 void gegl_tile_backend_file_stats (void);
+void gegl_tile_backend_file_cleanup (void);
+void gegl_tile_codec_stats (void);
+void gegl_tile_alloc_stats (void);
+void gegl_tile_alloc_cleanup (void);
+void gegl_tile_uniform_stats (void);
+void gegl_tile_uniform_cleanup (void);
 
 
 static void swap_clean (void)
@@ -377,10 +403,15 @@ gegl_exit (void)
 {
   glong timing = gegl_ticks ();
 
+  gegl_scheduler_cleanup ();
+  gegl_buffer_pool_cleanup ();
   gegl_tile_cache_destroy ();
+  gegl_tile_backend_file_cleanup ();
   gegl_operation_gtype_cleanup ();
   gegl_extension_handler_cleanup ();
   gegl_buffer_iterator_cleanup ();
+  gegl_tile_uniform_cleanup ();
+  gegl_tile_alloc_cleanup ();
 
   if (module_db != NULL)
     {
@@ -402,8 +433,13 @@ gegl_exit (void)
   if (g_getenv ("GEGL_DEBUG_BUFS") != NULL)
     {
       gegl_buffer_stats ();
+      gegl_buffer_pool_stats ();
+      gegl_tile_alloc_stats ();
+      gegl_tile_uniform_stats ();
+      gegl_tile_cache_stats ();
       gegl_tile_backend_ram_stats ();
       gegl_tile_backend_file_stats ();
+      gegl_tile_codec_stats ();
 #if HAVE_GIO
       gegl_tile_backend_tiledir_stats ();
 #endif
@@ -509,6 +545,10 @@ gegl_post_parse_hook (GOptionContext *context,
     config->quality = atof (cmd_gegl_quality);
   if (cmd_gegl_cache_size)
     config->cache_size = atoi (cmd_gegl_cache_size)*1024*1024;
+  if (cmd_gegl_cache_policy)
+    g_object_set (config, "cache-policy", cmd_gegl_cache_policy, NULL);
+  if (cmd_gegl_tile_compression)
+    g_object_set (config, "tile-compression", cmd_gegl_tile_compression, NULL);
   if (cmd_gegl_chunk_size)
     config->chunk_size = atoi (cmd_gegl_chunk_size);
   if (cmd_gegl_tile_size)
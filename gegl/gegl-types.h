@@ -37,6 +37,13 @@ typedef enum
   GEGL_BLIT_DIRTY    = 1 << 1
 } GeglBlitFlags;
 
+typedef enum
+{
+  GEGL_NODE_CACHE_POLICY_AUTO,
+  GEGL_NODE_CACHE_POLICY_NEVER,
+  GEGL_NODE_CACHE_POLICY_ALWAYS
+} GeglNodeCachePolicy;
+
 typedef struct _GeglConfig GeglConfig;
 typedef struct _GeglCurve  GeglCurve;
 typedef struct _GeglPath   GeglPath;
@@ -461,6 +461,36 @@ void          gegl_node_blit             (GeglNode            *node,
  */
 void          gegl_node_process          (GeglNode      *sink_node);
 
+/**
+ * gegl_node_set_cache_policy:
+ * @node: a #GeglNode
+ * @output_pad: the output pad whose results are concerned, usually "output".
+ * @policy: GEGL_NODE_CACHE_POLICY_AUTO, GEGL_NODE_CACHE_POLICY_NEVER or
+ * GEGL_NODE_CACHE_POLICY_ALWAYS.
+ *
+ * Controls whether the results computed for @output_pad are kept in a cache
+ * for later requests. With GEGL_NODE_CACHE_POLICY_AUTO, the default, GEGL caches
+ * the outputs of operations that allow it at first, and from then on only
+ * keeps the caches of nodes that are measured to be costly to recompute and
+ * that are read again before they change, other caches are dropped.
+ * GEGL_NODE_CACHE_POLICY_ALWAYS also caches operations that are normally not
+ * cached. Nodes with the "dont-cache" property set are never cached.
+ */
+void          gegl_node_set_cache_policy (GeglNode            *node,
+                                          const gchar         *output_pad,
+                                          GeglNodeCachePolicy  policy);
+
+/**
+ * gegl_node_get_cache_policy:
+ * @node: a #GeglNode
+ * @output_pad: the output pad to query.
+ *
+ * Returns the cache policy of @output_pad set with
+ * #gegl_node_set_cache_policy.
+ */
+GeglNodeCachePolicy gegl_node_get_cache_policy (GeglNode    *node,
+                                                const gchar *output_pad);
+
 
 /***
  * Reparenting:
@@ -841,6 +871,13 @@ void           gegl_processor_destroy       (GeglProcessor *processor);
  * "cache-size" "quality" and "swap", the two first is an integer denoting
  * number of bytes, the secons a double value between 0 and 1 and the last
  * the path of the directory to swap to (or "ram" to not use diskbased swap)
+ *
+ * "cache-policy" picks how tiles are evicted from the cache, one of "lru",
+ * "clock", "2q" or "cost", it has to be set before the first buffer is made.
+ *
+ * "tile-compression" picks how tiles are compressed when they are stored in
+ * ram or in the swap, "none", "uniform" (only tiles of a single color) or
+ * "rle", it is read when a buffer is created.
  */
 GeglConfig      * gegl_config (void);
 
@@ -35,6 +35,8 @@
 #include "gegl-visitable.h"
 #include "gegl-config.h"
 
+#include "buffer/gegl-region.h"
+
 #include "operation/gegl-operation.h"
 #include "operation/gegl-operations.h"
 #include "operation/gegl-operation-meta.h"
@@ -44,6 +46,7 @@
 #include "process/gegl-prepare-visitor.h"
 #include "process/gegl-finish-visitor.h"
 #include "process/gegl-processor.h"
+#include "process/gegl-scheduler.h"
 
 enum
 {
@@ -70,13 +73,45 @@ struct _GeglNodePrivate
   GeglNode       *parent;
   gchar          *name;
   GeglProcessor  *processor;
-  GeglEvalMgr    *eval_mgr[16];
+  GSList         *eval_mgrs; /* idle eval managers, one is taken for each
+                                piece of work evaluated concurrently */
   GHashTable     *contexts;
+  GSList         *caches;    /* GeglNodeCache of the output pads that have
+                                a cache or a cache policy */
+
+  /* measurements the automatic placement of caches is based on */
+  gdouble         usecs_per_mpixel; /* recent cost of processing */
+  gint            n_processed;
+  GeglRegion     *read_region; /* what evaluations asked of the output
+                                  since it last changed as a whole */
+  gint            rereads;   /* evaluations that asked for part of
+                                read_region again */
+  gint            fan_out;   /* most readers seen in one evaluation */
 };
 
+/* the cache state of an output pad, it is looked up by name since the
+ * pads are replaced when the operation of the node changes
+ */
+typedef struct
+{
+  gchar               *pad_name;
+  GeglCache           *cache;  /* unused for "output", that is node->cache */
+  GeglNodeCachePolicy  policy;
+  gboolean             pinned; /* handed out by gegl_node_get_pad_cache, the
+                                  caller relies on it, it is never dropped */
+} GeglNodeCache;
+
+/* outputs that take less than this to compute are not worth the memory of
+ * a cache, it is about the cost of a few point operations
+ */
+#define CACHE_MIN_USECS_PER_MPIXEL 20000.0
+
 
 static guint gegl_node_signals[LAST_SIGNAL] = {0};
 
+/* bumped whenever pads or connections are added or removed anywhere */
+static volatile gint structure_stamp = 0;
+
 
 static void            gegl_node_class_init               (GeglNodeClass *klass);
 static void            gegl_node_init                     (GeglNode      *self);
@@ -234,15 +269,30 @@ gegl_node_dispose (GObject *gobject)
       self->cache = NULL;
     }
 
-  {
-    gint i;
-    for (i=0; i<4; i++)
-      if (self->priv->eval_mgr[i])
-        {
-          g_object_unref (self->priv->eval_mgr[i]);
-          self->priv->eval_mgr[i] = NULL;
-        }
-  }
+  while (self->priv->caches)
+    {
+      GeglNodeCache *entry = self->priv->caches->data;
+
+      if (entry->cache)
+        g_object_unref (entry->cache);
+      g_free (entry->pad_name);
+      g_slice_free (GeglNodeCache, entry);
+      self->priv->caches = g_slist_delete_link (self->priv->caches,
+                                                self->priv->caches);
+    }
+
+  if (self->priv->read_region)
+    {
+      gegl_region_destroy (self->priv->read_region);
+      self->priv->read_region = NULL;
+    }
+
+  if (self->priv->eval_mgrs)
+    {
+      g_slist_foreach (self->priv->eval_mgrs, (GFunc) g_object_unref, NULL);
+      g_slist_free (self->priv->eval_mgrs);
+      self->priv->eval_mgrs = NULL;
+    }
 
   if (self->priv->processor)
     {
@@ -438,6 +488,8 @@ gegl_node_add_pad (GeglNode *self,
 
   if (gegl_pad_is_input (pad))
     self->input_pads = g_slist_prepend (self->input_pads, pad);
+
+  g_atomic_int_inc (&structure_stamp);
 }
 
 void
@@ -456,6 +508,7 @@ gegl_node_remove_pad (GeglNode *self,
     self->input_pads = g_slist_remove (self->input_pads, pad);
 
   g_object_unref (pad);
+  g_atomic_int_inc (&structure_stamp);
 }
 
 static gboolean
@@ -528,15 +581,49 @@ gegl_node_invalidated (GeglNode            *node,
                        const GeglRectangle *rect,
                        gboolean             clear_cache)
 {
+  GSList *caches = NULL;
+  GSList *iter;
+
   g_return_if_fail (GEGL_IS_NODE (node));
   g_return_if_fail (rect != NULL);
 
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  /* a change of the whole output makes the cached pixels useless */
+  if (gegl_rectangle_contains (rect, &node->have_rect))
+    {
+      if (node->priv->read_region)
+        {
+          gegl_region_destroy (node->priv->read_region);
+          node->priv->read_region = NULL;
+        }
+      node->priv->rereads = 0;
+    }
+
   if (node->cache)
+    caches = g_slist_prepend (caches, g_object_ref (node->cache));
+  for (iter = node->priv->caches; iter; iter = g_slist_next (iter))
+    {
+      GeglNodeCache *entry = iter->data;
+
+      if (entry->cache)
+        caches = g_slist_prepend (caches, g_object_ref (entry->cache));
+    }
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
+
+  for (iter = caches; iter; iter = g_slist_next (iter))
     {
+      GeglCache *cache = iter->data;
+
       if (rect && clear_cache)
-        gegl_buffer_clear (GEGL_BUFFER (node->cache), rect);
-      gegl_cache_invalidate (node->cache, rect);
+        gegl_buffer_clear (GEGL_BUFFER (cache), rect);
+      gegl_cache_invalidate (cache, rect);
+      g_object_unref (cache);
     }
+  g_slist_free (caches);
   node->valid_have_rect = FALSE;
 
   g_signal_emit (node, gegl_node_signals[INVALIDATED], 0,
@@ -642,6 +729,7 @@ gegl_node_connect_from (GeglNode    *sink,
 
       g_signal_connect (G_OBJECT (real_source), "invalidated",
                         G_CALLBACK (gegl_node_source_invalidated), sink_pad);
+      g_atomic_int_inc (&structure_stamp);
 
       gegl_node_property_changed (G_OBJECT (real_source->operation), NULL, real_source);
 
@@ -704,6 +792,7 @@ gegl_node_disconnect (GeglNode    *sink,
       source->priv->sink_connections = g_slist_remove (source->priv->sink_connections, connection);
 
       gegl_connection_destroy (connection);
+      g_atomic_int_inc (&structure_stamp);
 
       return TRUE;
     }
@@ -772,6 +861,15 @@ gegl_node_get_num_sinks (GeglNode *self)
   return g_slist_length (self->priv->sink_connections);
 }
 
+/* Compiled evaluation plans remember the stamp they were compiled at and
+ * are recompiled when it has moved on.
+ */
+gint
+gegl_node_get_structure_stamp (void)
+{
+  return g_atomic_int_get (&structure_stamp);
+}
+
 /**
  * gegl_node_get_sinks:
  * @self: a #GeglNode.
@@ -821,12 +919,44 @@ gegl_node_link_many (GeglNode *source,
   va_end (var_args);
 }
 
-static void gegl_node_ensure_eval_mgr (GeglNode    *self,
-                                       const gchar *pad,
-                                       gint         no)
+/* Eval managers are not reentrant, every piece of work that is evaluated
+ * concurrently takes an idle eval manager from the node (or creates a new
+ * one) and hands it back when it is done.
+ */
+static GeglEvalMgr *
+gegl_node_acquire_eval_mgr (GeglNode *self)
 {
-  if (!self->priv->eval_mgr[no])
-    self->priv->eval_mgr[no] = gegl_eval_mgr_new (self, pad);
+  GeglEvalMgr *eval_mgr = NULL;
+
+#if ENABLE_MT
+  g_mutex_lock (self->mutex);
+#endif
+  if (self->priv->eval_mgrs)
+    {
+      eval_mgr = self->priv->eval_mgrs->data;
+      self->priv->eval_mgrs = g_slist_delete_link (self->priv->eval_mgrs,
+                                                   self->priv->eval_mgrs);
+    }
+#if ENABLE_MT
+  g_mutex_unlock (self->mutex);
+#endif
+
+  if (!eval_mgr)
+    eval_mgr = gegl_eval_mgr_new (self, "output");
+  return eval_mgr;
+}
+
+static void
+gegl_node_release_eval_mgr (GeglNode    *self,
+                            GeglEvalMgr *eval_mgr)
+{
+#if ENABLE_MT
+  g_mutex_lock (self->mutex);
+#endif
+  self->priv->eval_mgrs = g_slist_prepend (self->priv->eval_mgrs, eval_mgr);
+#if ENABLE_MT
+  g_mutex_unlock (self->mutex);
+#endif
 }
 
 /* Will set the eval_mgr's roi to the supplied roi if defined, otherwise
@@ -835,75 +965,123 @@ static void gegl_node_ensure_eval_mgr (GeglNode    *self,
  */
 static GeglBuffer *
 gegl_node_apply_roi (GeglNode            *self,
-                     const gchar         *output_pad_name,
-                     const GeglRectangle *roi,
-                     gint                 tid)
-{
-  /* This is a potential spot to multiplex paralell processing,
-   * doing so, might cause a lot of tile overlap between
-   * processes if were not careful (wouldn't neccesarily be totally
-   * bad if that happens though.
-   */
+                     GeglEvalMgr         *eval_mgr,
+                     const GeglRectangle *roi)
+{
   GeglBuffer *buffer;
 
-  //g_print ("%i %i %i %i %i\n", tid, roi->x, roi->y, roi->width, roi->height);
-
   if (roi)
     {
-      self->priv->eval_mgr[tid]->roi = *roi;
+      eval_mgr->roi = *roi;
     }
   else
     {
-      self->priv->eval_mgr[tid]->roi = gegl_node_get_bounding_box (self);
+      eval_mgr->roi = gegl_node_get_bounding_box (self);
     }
-  buffer = gegl_eval_mgr_apply (self->priv->eval_mgr[tid]);
+  buffer = gegl_eval_mgr_apply (eval_mgr);
   return buffer;
 }
 
 
 #if ENABLE_MT
-typedef struct ThreadData
+/* The number of work units a blit is cut into per thread, more units
+ * balance the load better when parts of the graph are much more expensive
+ * than others, at the price of more graph traversals.
+ */
+#define GEGL_BLIT_UNITS_PER_THREAD 8
+
+typedef struct BlitJob
 {
   GeglNode      *node;
-  gint           tid;
-  GeglRectangle  roi;
-  const gchar   *pad;
-
-  const Babl          *format;
-  gpointer             destination_buf;
-  gint                 rowstride;
-  GeglBlitFlags        flags;
-} ThreadData;
+  const Babl    *format;
+  gint           rowstride;
+} BlitJob;
 
-static GThreadPool *pool = NULL;
-static GMutex *mutex = NULL;
-static GCond  *cond = NULL;
-static gint    remaining_tasks = 0;
+typedef struct BlitUnit
+{
+  GeglRectangle  roi;
+  gpointer       destination_buf;
+} BlitUnit;
 
-static void spawnrender (gpointer data,
-                         gpointer foo)
+static void
+gegl_node_blit_unit (gpointer task_data,
+                     gpointer user_data)
 {
-  ThreadData *td = data;
-  GeglBuffer * buffer;
-  buffer = gegl_node_apply_roi (td->node, td->pad, &td->roi, td->tid);
+  BlitUnit    *unit = task_data;
+  BlitJob     *job  = user_data;
+  GeglEvalMgr *eval_mgr;
+  GeglBuffer  *buffer;
 
-  if ((buffer ) && td->destination_buf)
+  eval_mgr = gegl_node_acquire_eval_mgr (job->node);
+  buffer = gegl_node_apply_roi (job->node, eval_mgr, &unit->roi);
+  gegl_node_release_eval_mgr (job->node, eval_mgr);
+
+  if (buffer && unit->destination_buf)
     {
-      gegl_buffer_get (buffer, 1.0, &td->roi, td->format, td->destination_buf, td->rowstride);
+      gegl_buffer_get (buffer, 1.0, &unit->roi, job->format,
+                       unit->destination_buf, job->rowstride);
     }
 
   /* and unrefing to ultimately clean it off from the graph */
   if (buffer)
     g_object_unref (buffer);
+}
 
-  g_mutex_lock (mutex);
-  remaining_tasks --;
-  if (remaining_tasks == 0)
+/* rounds value down to a multiple of step, also for negative values */
+static inline gint
+gegl_node_blit_align (gint value,
+                      gint step)
+{
+  if (value < 0)
+    return -((-value + step - 1) / step) * step;
+  return (value / step) * step;
+}
+
+/* Cuts roi into rectangles aligned with the default tile grid, the units
+ * are grown (but never past chunk-size pixels) until there are not many
+ * more of them than needed to keep all threads busy.
+ */
+static GArray *
+gegl_node_blit_split (const GeglRectangle *roi,
+                      gint                 threads)
+{
+  GArray *units       = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
+  gint    unit_width  = MAX (gegl_config ()->tile_width, 1);
+  gint    unit_height = MAX (gegl_config ()->tile_height, 1);
+  gint    max_units   = threads * GEGL_BLIT_UNITS_PER_THREAD;
+  gint    max_pixels  = gegl_config ()->chunk_size;
+  gint    x, y;
+
+  if (threads <= 1)
+    {
+      g_array_append_val (units, *roi);
+      return units;
+    }
+
+  while (((roi->width + unit_width - 1) / unit_width) *
+         ((roi->height + unit_height - 1) / unit_height) > max_units &&
+         unit_width * unit_height <= max_pixels / 2)
     {
-      /* we were the last task, we're not busy rendering any more */
-      g_cond_signal (cond);
+      if (unit_width <= unit_height)
+        unit_width *= 2;
+      else
+        unit_height *= 2;
     }
-  g_mutex_unlock (mutex);
+
+  for (y = gegl_node_blit_align (roi->y, unit_height);
+       y < roi->y + roi->height;
+       y += unit_height)
+    for (x = gegl_node_blit_align (roi->x, unit_width);
+         x < roi->x + roi->width;
+         x += unit_width)
+      {
+        GeglRectangle cell = { x, y, unit_width, unit_height };
+        GeglRectangle unit;
+
+        if (gegl_rectangle_intersect (&unit, &cell, roi))
+          g_array_append_val (units, unit);
+      }
+  return units;
 }
 #endif
 
@@ -917,22 +1095,10 @@ gegl_node_blit (GeglNode            *self,
                 gint                 rowstride,
                 GeglBlitFlags        flags)
 {
-#if ENABLE_MT
-  gint threads;
-#endif
   g_return_if_fail (GEGL_IS_NODE (self));
   g_return_if_fail (roi != NULL);
 
 #if ENABLE_MT
-  threads = gegl_config ()->threads;
-  
-  if (pool == NULL)
-    {
-      pool = g_thread_pool_new (spawnrender, NULL, threads, TRUE, NULL);
-      mutex = g_mutex_new ();
-      cond = g_cond_new ();
-    }
-
 #if 0
   if (flags == GEGL_BLIT_DEFAULT)
     flags = GEGL_BLIT_CACHE;
@@ -944,88 +1110,59 @@ gegl_node_blit (GeglNode            *self,
                               */
   if (flags == GEGL_BLIT_DEFAULT)
     {
-      ThreadData data[16];
-      gint i;
-
-      /* Subdivide along the largest of width/height, this should be further
-       * extended similar to the subdivizion done in GeglProcessor, to get as
-       * square as possible subregions.
-       */
-      gboolean horizontal = roi->width > roi->height;
-
-      gint rowskip = 0;
+      GeglSchedulerJob *sched_job;
+      BlitJob           job;
+      BlitUnit         *units;
+      GArray           *rects;
+      gint              bpp;
+      guint             i;
 
       if (!format)
         format = babl_format ("RGBA float"); /* XXX: This probably duplicates
                                                 another hardcoded format, they
                                                 should be turned into a
                                                 constant. */
-      if (horizontal)
-        rowskip = (roi->width/threads) * babl_format_get_bytes_per_pixel (format);
+      bpp = babl_format_get_bytes_per_pixel (format);
 
       if (rowstride == GEGL_AUTO_ROWSTRIDE)
-        rowstride = roi->width * babl_format_get_bytes_per_pixel (format);
-
-      data[0].node = self;
-      data[0].pad = "output";
-      data[0].format = format;
-      data[0].destination_buf = destination_buf;
-      data[0].rowstride = rowstride;
-      data[0].flags = flags;
-
-      for (i=0;i<threads;i++)
-        {
-          data[i] = data[0];
-          data[i].roi = *roi;
-          gegl_node_ensure_eval_mgr (self, "output", i);
-          if (horizontal)
-            {
-              data[i].roi.width = roi->width / threads;
-              data[i].roi.x = roi->x + roi->width/threads * i;
-            }
-          else
-            {
-              data[i].roi.height = roi->height / threads;
-              data[i].roi.y = roi->y + roi->height/threads * i;
-            }
+        rowstride = roi->width * bpp;
 
-          data[i].tid = i;
-          if (horizontal)
-            data[i].destination_buf = ((gchar*)destination_buf + rowskip * i);
-          else
-            data[i].destination_buf = ((gchar*)destination_buf + rowstride * (roi->height/threads) * i);
-        }
-      if (horizontal)
-        data[threads-1].roi.width = roi->width - (roi->width / threads)*(threads-1);
-      else
-        data[threads-1].roi.height = roi->height - (roi->height / threads)*(threads-1);
+      job.node      = self;
+      job.format    = format;
+      job.rowstride = rowstride;
 
-      remaining_tasks+=threads;
+      rects = gegl_node_blit_split (roi, gegl_scheduler_get_n_workers () + 1);
+      units = g_new (BlitUnit, rects->len);
 
-      if (threads==1)
-        {
-          for (i=0; i<threads; i++)
-              spawnrender (&data[i], NULL);
-        }
-      else
+      /* every blit is its own job, concurrent blits from other threads
+       * share the workers but not the completion tracking.
+       */
+      sched_job = gegl_scheduler_job_new (gegl_node_blit_unit, &job);
+      for (i = 0; i < rects->len; i++)
         {
-          for (i=0; i<threads-1; i++)
-            g_thread_pool_push (pool, &data[i], NULL);
-          spawnrender (&data[threads-1], NULL);
-
-          g_mutex_lock (mutex);
-          while (remaining_tasks!=0)
-            g_cond_wait (cond, mutex);
-          g_mutex_unlock (mutex);
+          units[i].roi = g_array_index (rects, GeglRectangle, i);
+          units[i].destination_buf = NULL;
+          if (destination_buf)
+            units[i].destination_buf = (gchar*) destination_buf +
+                                 (units[i].roi.y - roi->y) * rowstride +
+                                 (units[i].roi.x - roi->x) * bpp;
+          gegl_scheduler_job_push (sched_job, &units[i]);
         }
+      gegl_scheduler_job_wait (sched_job);
+      gegl_scheduler_job_free (sched_job);
+
+      g_free (units);
+      g_array_free (rects, TRUE);
     }
 #else
     if (flags == GEGL_BLIT_DEFAULT)
     {
-      GeglBuffer *buffer;
+      GeglBuffer  *buffer;
+      GeglEvalMgr *eval_mgr;
 
-      gegl_node_ensure_eval_mgr (self, "output", 0);
-      buffer = gegl_node_apply_roi (self, "output", roi, 0);
+      eval_mgr = gegl_node_acquire_eval_mgr (self);
+      buffer = gegl_node_apply_roi (self, eval_mgr, roi);
+      gegl_node_release_eval_mgr (self, eval_mgr);
       if (buffer && destination_buf)
         {
           if (destination_buf)
@@ -1772,7 +1909,11 @@ gegl_node_process (GeglNode *self)
 
   input   = gegl_node_get_producer (self, "input", NULL);
   defined = gegl_node_get_bounding_box (input);
-  buffer  = gegl_node_apply_roi (input, "output", &defined, 3);
+  {
+    GeglEvalMgr *eval_mgr = gegl_node_acquire_eval_mgr (input);
+    buffer = gegl_node_apply_roi (input, eval_mgr, &defined);
+    gegl_node_release_eval_mgr (input, eval_mgr);
+  }
 
   g_assert (GEGL_IS_BUFFER (buffer));
   context = gegl_node_add_context (self, &defined);
@@ -2011,36 +2152,354 @@ gegl_node_computed_event (GeglCache *self,
   g_signal_emit (node, gegl_node_signals[COMPUTED], 0, foo, NULL, NULL);
 }
 
+/* looks up the cache state of an output pad, NULL when it has neither a
+ * cache nor a cache policy, must be called with the node's mutex held
+ */
+static GeglNodeCache *
+gegl_node_find_cache_entry (GeglNode    *node,
+                            const gchar *pad_name)
+{
+  GSList *iter;
+
+  for (iter = node->priv->caches; iter; iter = g_slist_next (iter))
+    {
+      GeglNodeCache *entry = iter->data;
+
+      if (!strcmp (entry->pad_name, pad_name))
+        return entry;
+    }
+  return NULL;
+}
+
+/* like gegl_node_find_cache_entry, creating the entry when it is not there
+ * yet
+ */
+static GeglNodeCache *
+gegl_node_get_cache_entry (GeglNode    *node,
+                           const gchar *pad_name)
+{
+  GeglNodeCache *entry = gegl_node_find_cache_entry (node, pad_name);
+
+  if (entry)
+    return entry;
+
+  entry           = g_slice_new0 (GeglNodeCache);
+  entry->pad_name = g_strdup (pad_name);
+  entry->policy   = GEGL_NODE_CACHE_POLICY_AUTO;
+  node->priv->caches = g_slist_prepend (node->priv->caches, entry);
+  return entry;
+}
+
+/* the cache of the "output" pad stays in node->cache where the processor
+ * and gegl_node_blit look for it
+ */
+static GeglCache **
+gegl_node_cache_slot (GeglNode      *node,
+                      GeglNodeCache *entry)
+{
+  if (!strcmp (entry->pad_name, "output"))
+    return &node->cache;
+  return &entry->cache;
+}
+
+static GeglCache *
+gegl_node_new_cache (GeglNode    *node,
+                     const gchar *pad_name)
+{
+  GeglCache  *cache;
+  GeglPad    *pad;
+  const Babl *format;
+
+  pad = gegl_node_get_pad (node, pad_name);
+  g_assert (pad);
+  format = gegl_pad_get_format (pad);
+  if (!format)
+    {
+      format = babl_format ("RGBA float");
+    }
+
+  cache = g_object_new (GEGL_TYPE_CACHE,
+                        "node", node,
+                        "format", format,
+                        NULL);
+  if (!strcmp (pad_name, "output"))
+    g_signal_connect (G_OBJECT (cache), "computed",
+                      (GCallback) gegl_node_computed_event,
+                      node);
+  return cache;
+}
+
+/* whether the results of the output pad of entry are to be computed into
+ * its cache, entry is NULL for a pad that has no cache state yet, must be
+ * called with the node's mutex held
+ */
+static gboolean
+gegl_node_wants_cache (GeglNode      *node,
+                       GeglNodeCache *entry)
+{
+  GeglNodePrivate     *priv   = node->priv;
+  GeglNodeCachePolicy  policy = entry ? entry->policy
+                                      : GEGL_NODE_CACHE_POLICY_AUTO;
+
+  if (node->dont_cache)
+    return FALSE;
+
+  switch (policy)
+    {
+      case GEGL_NODE_CACHE_POLICY_NEVER:
+        return FALSE;
+      case GEGL_NODE_CACHE_POLICY_ALWAYS:
+        return TRUE;
+      default:
+        break;
+    }
+
+  if (!node->operation ||
+      GEGL_OPERATION_GET_CLASS (node->operation)->no_cache)
+    return FALSE;
+
+  if (entry && entry->pinned)
+    return TRUE;
+
+  /* nothing is known about the node yet, cache as a start */
+  if (priv->n_processed == 0)
+    return TRUE;
+
+  /* only worth it when recomputing is expensive and the same pixels are
+   * read again, by another reader or by a later evaluation
+   */
+  return priv->usecs_per_mpixel >= CACHE_MIN_USECS_PER_MPIXEL &&
+         (priv->rereads > 0 || priv->fan_out > 1);
+}
+
+GeglCache *
+gegl_node_get_pad_cache (GeglNode    *node,
+                         const gchar *pad_name)
+{
+  GeglNodeCache  *entry;
+  GeglCache     **slot;
+  GeglPad        *pad;
+
+  g_return_val_if_fail (GEGL_IS_NODE (node), NULL);
+  g_return_val_if_fail (pad_name != NULL, NULL);
+
+  pad = gegl_node_get_pad (node, pad_name);
+  g_return_val_if_fail (pad && gegl_pad_is_output (pad), NULL);
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  entry = gegl_node_get_cache_entry (node, pad_name);
+  slot  = gegl_node_cache_slot (node, entry);
+  if (!*slot)
+    *slot = gegl_node_new_cache (node, pad_name);
+  entry->pinned = TRUE;
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
+
+  return *slot;
+}
+
 GeglCache *
 gegl_node_get_cache (GeglNode *node)
 {
+  return gegl_node_get_pad_cache (node, "output");
+}
+
+GeglCache *
+gegl_node_ref_cache (GeglNode    *node,
+                     const gchar *pad_name)
+{
+  GeglNodeCache *entry;
+  GeglCache     *cache = NULL;
+
   g_return_val_if_fail (GEGL_IS_NODE (node), NULL);
+  g_return_val_if_fail (pad_name != NULL, NULL);
 
-  if (!node->cache)
-    {
-      GeglPad    *pad;
-      const Babl *format;
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  entry = gegl_node_find_cache_entry (node, pad_name);
+  if (entry)
+    cache = *gegl_node_cache_slot (node, entry);
+  if (cache)
+    g_object_ref (cache);
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
 
-      /* XXX: it should be possible to have cache for other pads than
-       * only "output" pads
-       */
-      pad = gegl_node_get_pad (node, "output");
-      g_assert (pad);
-      format = gegl_pad_get_format (pad);
-      if (!format)
-        {
-          format = babl_format ("RGBA float");
-        }
+  return cache;
+}
+
+GeglCache *
+gegl_node_place_cache (GeglNode    *node,
+                       const gchar *pad_name)
+{
+  GeglNodeCache  *entry;
+  GeglCache     **slot;
+  GeglCache      *cache   = NULL;
+  GeglCache      *dropped = NULL;
+
+  g_return_val_if_fail (GEGL_IS_NODE (node), NULL);
+  g_return_val_if_fail (pad_name != NULL, NULL);
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  entry = gegl_node_find_cache_entry (node, pad_name);
+  if (gegl_node_wants_cache (node, entry))
+    {
+      if (!entry)
+        entry = gegl_node_get_cache_entry (node, pad_name);
+      slot = gegl_node_cache_slot (node, entry);
+      if (!*slot)
+        *slot = gegl_node_new_cache (node, pad_name);
+      cache = g_object_ref (*slot);
+    }
+  else if (entry && !entry->pinned)
+    {
+      /* evaluations still reading from it hold references of their own */
+      slot    = gegl_node_cache_slot (node, entry);
+      dropped = *slot;
+      *slot   = NULL;
+    }
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
 
-      node->cache = g_object_new (GEGL_TYPE_CACHE,
-                                  "node", node,
-                                  "format", format,
-                                  NULL);
-      g_signal_connect (G_OBJECT (node->cache), "computed",
-                        (GCallback) gegl_node_computed_event,
-                        node);
+  if (dropped)
+    {
+      GEGL_NOTE (GEGL_DEBUG_CACHE, "dropping the cache of %s.%s",
+                 gegl_node_get_debug_name (node), pad_name);
+      g_object_unref (dropped);
     }
-  return node->cache;
+  return cache;
+}
+
+gboolean
+gegl_node_use_cache (GeglNode    *node,
+                     const gchar *pad_name)
+{
+  gboolean use_cache;
+
+  g_return_val_if_fail (GEGL_IS_NODE (node), FALSE);
+  g_return_val_if_fail (pad_name != NULL, FALSE);
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  use_cache = gegl_node_wants_cache (node,
+                                     gegl_node_find_cache_entry (node, pad_name));
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
+
+  return use_cache;
+}
+
+void
+gegl_node_set_cache_policy (GeglNode            *node,
+                            const gchar         *output_pad,
+                            GeglNodeCachePolicy  policy)
+{
+  g_return_if_fail (GEGL_IS_NODE (node));
+  g_return_if_fail (output_pad != NULL);
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  gegl_node_get_cache_entry (node, output_pad)->policy = policy;
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
+}
+
+GeglNodeCachePolicy
+gegl_node_get_cache_policy (GeglNode    *node,
+                            const gchar *output_pad)
+{
+  GeglNodeCachePolicy  policy = GEGL_NODE_CACHE_POLICY_AUTO;
+  GeglNodeCache       *entry;
+
+  g_return_val_if_fail (GEGL_IS_NODE (node), GEGL_NODE_CACHE_POLICY_AUTO);
+  g_return_val_if_fail (output_pad != NULL, GEGL_NODE_CACHE_POLICY_AUTO);
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  entry = gegl_node_find_cache_entry (node, output_pad);
+  if (entry)
+    policy = entry->policy;
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
+
+  return policy;
+}
+
+void
+gegl_node_record_read (GeglNode            *node,
+                       const GeglRectangle *rect,
+                       gint                 n_readers)
+{
+  GeglNodePrivate *priv;
+
+  g_return_if_fail (GEGL_IS_NODE (node));
+  g_return_if_fail (rect != NULL);
+
+  priv = node->priv;
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  /* the chunks of one rendering each ask for pixels of their own, only
+   * pixels asked for again, by a later rendering or as the margin of a
+   * neighbouring chunk, are saved by a cache
+   */
+  if (!priv->read_region)
+    priv->read_region = gegl_region_new ();
+  if (gegl_region_rect_in (priv->read_region, rect) !=
+      GEGL_OVERLAP_RECTANGLE_OUT)
+    priv->rereads++;
+  gegl_region_union_with_rect (priv->read_region, rect);
+  priv->fan_out = MAX (priv->fan_out, n_readers);
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
+}
+
+void
+gegl_node_record_process (GeglNode            *node,
+                          const GeglRectangle *rect,
+                          glong                usecs)
+{
+  GeglNodePrivate *priv;
+  gdouble          cost;
+
+  g_return_if_fail (GEGL_IS_NODE (node));
+  g_return_if_fail (rect != NULL);
+
+  if (rect->width <= 0 || rect->height <= 0)
+    return;
+
+  priv = node->priv;
+  cost = usecs * 1000000.0 / ((gdouble) rect->width * rect->height);
+
+#if ENABLE_MT
+  g_mutex_lock (node->mutex);
+#endif
+  /* weighted towards the recent measurements, the cost changes with the
+   * properties of the operation
+   */
+  if (priv->n_processed == 0)
+    priv->usecs_per_mpixel = cost;
+  else
+    priv->usecs_per_mpixel = (priv->usecs_per_mpixel * 3 + cost) / 4;
+  priv->n_processed++;
+#if ENABLE_MT
+  g_mutex_unlock (node->mutex);
+#endif
 }
 
 const gchar *
@@ -66,9 +66,10 @@ struct _GeglNode
    */
   gboolean        is_graph;
 
-  /* For a node, the cache should be created at first demand if
-   * applicable, and the cache object reused for all subsequent
-   * requests for the cache object.
+  /* For a node, the cache of the "output" pad should be created at
+   * first demand if applicable, and the cache object reused for
+   * subsequent requests until it is dropped as not worth keeping. The
+   * caches of other output pads are kept in the private part.
    */
   GeglCache      *cache;
 
@@ -151,6 +152,7 @@ GSList      * gegl_node_get_pads            (GeglNode      *self);
 GSList      * gegl_node_get_input_pads      (GeglNode      *self);
 GSList      * gegl_node_get_sinks           (GeglNode      *self);
 gint          gegl_node_get_num_sinks       (GeglNode      *self);
+gint          gegl_node_get_structure_stamp (void);
 GeglNode    * gegl_node_get_producer        (GeglNode      *self,
                                              gchar         *pad_name,
                                              gchar        **output_pad);
@@ -214,6 +216,40 @@ gint          gegl_node_get_consumers       (GeglNode      *node,
                                              const gchar ***pads);
 
 GeglCache   * gegl_node_get_cache           (GeglNode      *node);
+
+/* the cache of an output pad, created on first demand, the caller relies
+ * on it to stay in place
+ */
+GeglCache   * gegl_node_get_pad_cache       (GeglNode      *node,
+                                             const gchar   *pad_name);
+/* a new reference to the cache of an output pad, NULL when it has none */
+GeglCache   * gegl_node_ref_cache           (GeglNode      *node,
+                                             const gchar   *pad_name);
+/* a new reference to the cache results of the output pad are to be
+ * computed into, NULL when the pad is not to be cached, in which case an
+ * unused cache is dropped
+ */
+GeglCache   * gegl_node_place_cache         (GeglNode      *node,
+                                             const gchar   *pad_name);
+gboolean      gegl_node_use_cache           (GeglNode      *node,
+                                             const gchar   *pad_name);
+void          gegl_node_set_cache_policy    (GeglNode            *node,
+                                             const gchar         *output_pad,
+                                             GeglNodeCachePolicy  policy);
+GeglNodeCachePolicy
+              gegl_node_get_cache_policy    (GeglNode      *node,
+                                             const gchar   *output_pad);
+
+/* measurements for the placement of caches, rect of the output of the
+ * node was computed or read from the cache for n_readers, or computed for
+ * rect in usecs
+ */
+void          gegl_node_record_read         (GeglNode      *node,
+                                             const GeglRectangle *rect,
+                                             gint           n_readers);
+void          gegl_node_record_process      (GeglNode      *node,
+                                             const GeglRectangle *rect,
+                                             glong          usecs);
 void          gegl_node_invalidated         (GeglNode      *node,
                                              const GeglRectangle *rect,
                                              gboolean             clean_cache);
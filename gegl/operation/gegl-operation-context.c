@@ -31,6 +31,7 @@
 #include "gegl-config.h"
 
 #include "operation/gegl-operation.h"
+#include "gegl-buffer-pool.h"
 
 static GValue * gegl_operation_context_get_value    (GeglOperationContext *self,
                                                 const gchar     *property_name);
@@ -135,9 +136,18 @@ property_new (const gchar *property_name)
 static void
 property_destroy (Property *property)
 {
+  GeglBuffer *buffer = NULL;
+
+  /* a buffer no one else holds on to goes back to the buffer pool */
+  if (G_VALUE_HOLDS (&property->value, GEGL_TYPE_BUFFER))
+    buffer = g_value_dup_object (&property->value);
+
   g_free (property->name);
   g_value_unset (&property->value); /* does an unref */
   g_slice_free (Property, property);
+
+  if (buffer)
+    gegl_buffer_pool_release (buffer);
 }
 
 static gint
@@ -363,7 +373,6 @@ gegl_operation_context_get_target (GeglOperationContext *context,
       format = babl_format ("RGBA float");
     }
   g_assert (format != NULL);
-  g_assert (!strcmp (padname, "output"));
 
   result = &context->result_rect;
 
@@ -372,29 +381,27 @@ gegl_operation_context_get_target (GeglOperationContext *context,
     {
       output = g_object_ref (emptybuf());
     }
-  else if (node->dont_cache == FALSE &&
-      ! GEGL_OPERATION_CLASS (G_OBJECT_GET_CLASS (operation))->no_cache)
+  else
     {
-      GeglBuffer    *cache;
-      cache = GEGL_BUFFER (gegl_node_get_cache (node));
+      GeglCache *cache = gegl_node_place_cache (node, padname);
 
       /* Only use the cache if the result is within the cache
        * extent. This is certainly not optimal. My gut feeling is that
        * the current caching mechanism needs to be redesigned
        */
-      if (gegl_rectangle_contains (gegl_buffer_get_extent (cache), result))
+      if (cache &&
+          gegl_rectangle_contains (gegl_buffer_get_extent (GEGL_BUFFER (cache)),
+                                   result))
         {
-          output = g_object_ref (cache);
+          output = GEGL_BUFFER (cache);
         }
       else
         {
-          output = gegl_buffer_new_ram (result, format);
+          if (cache)
+            g_object_unref (cache);
+          output = gegl_buffer_pool_get (result, format);
         }
     }
-  else
-    {
-      output = gegl_buffer_new_ram (result, format);
-    }
 
   gegl_operation_context_take_object (context, padname, G_OBJECT (output));
   return output;
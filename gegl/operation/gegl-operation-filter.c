@@ -245,8 +245,9 @@ gegl_operation_filter_process (GeglOperation   *operation,
     {
       success = klass->process (operation, input, output, result);
 
-      if (output == GEGL_BUFFER (operation->node->cache))
-        gegl_cache_computed (operation->node->cache, result);
+      if (GEGL_IS_CACHE (output) &&
+          GEGL_CACHE (output)->node == operation->node)
+        gegl_cache_computed (GEGL_CACHE (output), result);
 
       if (input != NULL)
         g_object_unref (input);
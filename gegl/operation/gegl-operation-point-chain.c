@@ -0,0 +1,293 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-operation-point-chain.h"
+#include "gegl-operation-point-composer.h"
+#include "gegl-operation-point-filter.h"
+#include "gegl-operation-point-private.h"
+#include "gegl-utils.h"
+
+#include "gegl-gpu-types.h"
+#include "gegl-gpu-init.h"
+
+/* the number of pixels passed through all of the operations at a time,
+ * small enough for the intermediate results to stay in the cache
+ */
+#define POINT_CHAIN_RUN 1024
+
+typedef struct
+{
+  GeglOperation     **operations;
+  gint                n_operations;
+  gint                read;
+  gint               *aux;      /* the iterable of the aux of every
+                                   operation, or -1 */
+  gint               *bpp;      /* the bytes per pixel of the input of
+                                   every operation, then of the output */
+  gint               *aux_bpp;
+  gint                max_bpp;  /* of the intermediate results */
+} PointChainJob;
+
+/* the intermediate results of one thread, the operations write into the
+ * two buffers in turn
+ */
+typedef struct
+{
+  guchar *data[2];
+  gint    size;
+} PointChainScratch;
+
+gboolean
+gegl_operation_point_chain_can_fuse (GeglOperation *operation)
+{
+  GeglOperationClass *operation_class = GEGL_OPERATION_GET_CLASS (operation);
+  GeglOperationClass *base_class;
+
+  if (!operation_class->no_cache)
+    return FALSE;
+
+  if (GEGL_IS_OPERATION_POINT_FILTER (operation))
+    {
+      base_class = g_type_class_peek (GEGL_TYPE_OPERATION_POINT_FILTER);
+
+      return operation_class->process == base_class->process &&
+             GEGL_OPERATION_FILTER_CLASS (operation_class)->process ==
+             GEGL_OPERATION_FILTER_CLASS (base_class)->process &&
+             GEGL_OPERATION_POINT_FILTER_CLASS (operation_class)->process;
+    }
+  else if (GEGL_IS_OPERATION_POINT_COMPOSER (operation))
+    {
+      base_class = g_type_class_peek (GEGL_TYPE_OPERATION_POINT_COMPOSER);
+
+      return operation_class->process == base_class->process &&
+             GEGL_OPERATION_COMPOSER_CLASS (operation_class)->process ==
+             GEGL_OPERATION_COMPOSER_CLASS (base_class)->process &&
+             GEGL_OPERATION_POINT_COMPOSER_CLASS (operation_class)->process;
+    }
+  return FALSE;
+}
+
+gboolean
+gegl_operation_point_chain_can_process (GeglOperation **operations,
+                                        gint            n_operations)
+{
+  gint n;
+
+#if HAVE_GPU
+  /* the operations would rather process on the gpu one by one */
+  if (gegl_gpu_is_accelerated ())
+    return FALSE;
+#endif
+
+  for (n = 0; n < n_operations; n++)
+    {
+      const Babl *in_format  = gegl_operation_get_format (operations[n], "input");
+      const Babl *out_format = gegl_operation_get_format (operations[n], "output");
+
+      if (!in_format || !out_format)
+        return FALSE;
+      if (GEGL_IS_OPERATION_POINT_COMPOSER (operations[n]) &&
+          !gegl_operation_get_format (operations[n], "aux"))
+        return FALSE;
+      if (n + 1 < n_operations &&
+          out_format != gegl_operation_get_format (operations[n + 1], "input"))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* passes a band of rows of the current data of the iterator through all
+ * of the operations, the band starts at row y of the data
+ */
+static inline void
+gegl_operation_point_chain_process_band (PointChainJob      *job,
+                                         GeglBufferIterator *i,
+                                         PointChainScratch  *scratch,
+                                         gint                y,
+                                         GeglRectangle      *band)
+{
+  gint    samples = band->width * band->height;
+  guchar *in      = (guchar *) i->data[job->read] + y * i->rowstride[job->read];
+  gint    n;
+
+  for (n = 0; n < job->n_operations; n++)
+    {
+      GeglOperation *operation = job->operations[n];
+      guchar        *out;
+
+      if (n == job->n_operations - 1)
+        out = (guchar *) i->data[0] + y * i->rowstride[0];
+      else
+        out = scratch->data[n & 1];
+
+      if (GEGL_IS_OPERATION_POINT_COMPOSER (operation))
+        {
+          guchar *aux = NULL;
+
+          if (job->aux[n] >= 0)
+            aux = (guchar *) i->data[job->aux[n]] + y * i->rowstride[job->aux[n]];
+
+          GEGL_OPERATION_POINT_COMPOSER_GET_CLASS (operation)->process (
+            operation, in, aux, out, samples, band);
+        }
+      else
+        {
+          GEGL_OPERATION_POINT_FILTER_GET_CLASS (operation)->process (
+            operation, in, out, samples, band);
+        }
+      in = out;
+    }
+}
+
+static void
+gegl_operation_point_chain_scratch_clear (PointChainScratch *scratch)
+{
+  if (scratch->data[0])
+    {
+      gegl_free (scratch->data[0]);
+      gegl_free (scratch->data[1]);
+    }
+}
+
+static void
+gegl_operation_point_chain_scratch_free (gpointer data)
+{
+  gegl_operation_point_chain_scratch_clear (data);
+  g_slice_free (PointChainScratch, data);
+}
+
+/* processes the current data of the iterator in bands of rows, single
+ * rows when it is accessed in place within tiles wider than the region
+ */
+static void
+gegl_operation_point_chain_process_data (gpointer            job_data,
+                                         GeglBufferIterator *i,
+                                         gpointer           *scratch_data)
+{
+  PointChainJob     *job     = job_data;
+  PointChainScratch *scratch = *scratch_data;
+  gint               width   = i->roi[0].width;
+  gint               height  = i->roi[0].height;
+  gboolean           compact = TRUE;
+  gint               rows;
+  gint               size;
+  gint               y;
+  gint               n;
+
+  if (i->rowstride[job->read] != width * job->bpp[0] ||
+      i->rowstride[0]         != width * job->bpp[job->n_operations])
+    compact = FALSE;
+  for (n = 0; n < job->n_operations; n++)
+    if (job->aux[n] >= 0 &&
+        i->rowstride[job->aux[n]] != width * job->aux_bpp[n])
+      compact = FALSE;
+
+  rows = compact ? MAX (1, POINT_CHAIN_RUN / width) : 1;
+  size = rows * width * job->max_bpp;
+
+  if (scratch == NULL)
+    scratch = *scratch_data = g_slice_new0 (PointChainScratch);
+
+  if (size > scratch->size)
+    {
+      gegl_operation_point_chain_scratch_clear (scratch);
+      scratch->data[0] = gegl_malloc (size);
+      scratch->data[1] = gegl_malloc (size);
+      scratch->size    = size;
+    }
+
+  for (y = 0; y < height; y += rows)
+    {
+      GeglRectangle band = i->roi[0];
+
+      band.y     += y;
+      band.height = MIN (rows, height - y);
+      gegl_operation_point_chain_process_band (job, i, scratch, y, &band);
+    }
+}
+
+gboolean
+gegl_operation_point_chain_process (GeglOperation       **operations,
+                                    gint                  n_operations,
+                                    GeglBuffer           *input,
+                                    GeglBuffer          **aux,
+                                    GeglBuffer           *output,
+                                    const GeglRectangle  *result)
+{
+  PointChainJob       job;
+  GeglBufferIterator *i;
+  const Babl         *out_format;
+  gint                n;
+
+  g_return_val_if_fail (n_operations > 0, FALSE);
+
+  if (result->width <= 0 || result->height <= 0)
+    return TRUE;
+
+  out_format = gegl_operation_get_format (operations[n_operations - 1],
+                                          "output");
+
+  job.operations   = operations;
+  job.n_operations = n_operations;
+  job.aux          = g_new (gint, n_operations);
+  job.bpp          = g_new (gint, n_operations + 1);
+  job.aux_bpp      = g_new0 (gint, n_operations);
+  job.max_bpp      = 0;
+
+  i = gegl_buffer_iterator_new (output, result, out_format,
+                                GEGL_BUFFER_WRITE | GEGL_BUFFER_STRIDED);
+  job.read = gegl_buffer_iterator_add (i, input, result,
+                         gegl_operation_get_format (operations[0], "input"),
+                         GEGL_BUFFER_READ | GEGL_BUFFER_STRIDED);
+
+  for (n = 0; n < n_operations; n++)
+    {
+      const Babl *in_format = gegl_operation_get_format (operations[n], "input");
+
+      job.bpp[n] = babl_format_get_bytes_per_pixel (in_format);
+      if (n > 0)
+        job.max_bpp = MAX (job.max_bpp, job.bpp[n]);
+
+      job.aux[n] = -1;
+      if (aux[n])
+        {
+          const Babl *aux_format = gegl_operation_get_format (operations[n], "aux");
+
+          job.aux[n]     = gegl_buffer_iterator_add (i, aux[n], result, aux_format,
+                                                     GEGL_BUFFER_READ | GEGL_BUFFER_STRIDED);
+          job.aux_bpp[n] = babl_format_get_bytes_per_pixel (aux_format);
+        }
+    }
+  job.bpp[n_operations] = babl_format_get_bytes_per_pixel (out_format);
+
+  gegl_operation_point_iterate (i, output, result,
+                                gegl_operation_point_chain_process_data,
+                                gegl_operation_point_chain_scratch_free, &job);
+
+  gegl_buffer_iterator_free (i);
+
+  g_free (job.aux);
+  g_free (job.bpp);
+  g_free (job.aux_bpp);
+  return TRUE;
+}
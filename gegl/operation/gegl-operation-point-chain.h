@@ -0,0 +1,59 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_OPERATION_POINT_CHAIN_H__
+#define __GEGL_OPERATION_POINT_CHAIN_H__
+
+#include "gegl-types-internal.h"
+#include "gegl-buffer-iterator.h"
+
+G_BEGIN_DECLS
+
+/* A point chain is a run of point filters and point composers where each
+ * operation reads the output of the previous one on its "input" pad. The
+ * chain is processed in a single pass over the region, every chunk goes
+ * through all of the pixel processing functions while it is still in the
+ * cache, and no buffers are created for the intermediate results.
+ */
+
+/* the iterator needs one iterable for the output, one for the input of the
+ * chain and one for the aux of every point composer in it
+ */
+#define GEGL_OPERATION_POINT_CHAIN_MAX_AUX (GEGL_BUFFER_MAX_ITERABLES - 2)
+
+/* TRUE for point operations whose processing is entirely done by their
+ * pixel processing function, operations with fast paths of their own, or
+ * writing their output to a cache, can not be part of a chain
+ */
+gboolean gegl_operation_point_chain_can_fuse    (GeglOperation        *operation);
+
+/* TRUE when the formats of the prepared operations line up */
+gboolean gegl_operation_point_chain_can_process (GeglOperation       **operations,
+                                                 gint                  n_operations);
+
+/* aux holds the aux buffer of every operation, NULL for point filters and
+ * for point composers without aux
+ */
+gboolean gegl_operation_point_chain_process     (GeglOperation       **operations,
+                                                 gint                  n_operations,
+                                                 GeglBuffer           *input,
+                                                 GeglBuffer          **aux,
+                                                 GeglBuffer           *output,
+                                                 const GeglRectangle  *result);
+
+G_END_DECLS
+
+#endif /* __GEGL_OPERATION_POINT_CHAIN_H__ */
@@ -27,8 +27,19 @@
 #include "gegl-utils.h"
 #include "graph/gegl-node.h"
 #include "graph/gegl-pad.h"
+#include "gegl-operation-point-private.h"
 #include <string.h>
 
+typedef struct
+{
+  GeglOperation *operation;
+  gint           read;
+  gint           aux;
+  gint           in_bpp;
+  gint           aux_bpp;
+  gint           out_bpp;
+} PointComposerJob;
+
 static gboolean gegl_operation_point_composer_process 
                               (GeglOperation       *operation,
                                GeglBuffer          *input,
@@ -119,8 +130,9 @@ gegl_operation_composer_process2 (GeglOperation        *operation,
         {
           success = klass->process (operation, input, aux, output, result);
 
-          if (output == GEGL_BUFFER (operation->node->cache))
-            gegl_cache_computed (operation->node->cache, result);
+          if (GEGL_IS_CACHE (output) &&
+              GEGL_CACHE (output)->node == operation->node)
+            gegl_cache_computed (GEGL_CACHE (output), result);
         }
       if (input)
          g_object_unref (input);
@@ -131,6 +143,49 @@ gegl_operation_composer_process2 (GeglOperation        *operation,
   return success;
 }
 
+/* processes the current data of the iterator, row by row when it is
+ * accessed in place within tiles wider than the region
+ */
+static void
+gegl_operation_point_composer_process_data (gpointer            job_data,
+                                            GeglBufferIterator *i,
+                                            gpointer           *scratch)
+{
+  PointComposerJob                *job   = job_data;
+  GeglOperationPointComposerClass *point_composer_class;
+  gint                             width = i->roi[0].width;
+  guchar                          *in    = i->data[job->read];
+  guchar                          *aux   = job->aux >= 0 ? i->data[job->aux] : NULL;
+  guchar                          *out   = i->data[0];
+
+  point_composer_class = GEGL_OPERATION_POINT_COMPOSER_GET_CLASS (job->operation);
+
+  if (i->rowstride[job->read] == width * job->in_bpp &&
+      (job->aux < 0 || i->rowstride[job->aux] == width * job->aux_bpp) &&
+      i->rowstride[0] == width * job->out_bpp)
+    {
+      point_composer_class->process (job->operation, in, aux, out,
+                                     i->length, &i->roi[0]);
+    }
+  else
+    {
+      GeglRectangle row = i->roi[0];
+      gint          y;
+
+      row.height = 1;
+      for (y = 0; y < i->roi[0].height; y++)
+        {
+          point_composer_class->process (job->operation, in, aux, out,
+                                         width, &row);
+          in  += i->rowstride[job->read];
+          if (aux)
+            aux += i->rowstride[job->aux];
+          out += i->rowstride[0];
+          row.y++;
+        }
+    }
+}
+
 static gboolean
 gegl_operation_point_composer_process (GeglOperation       *operation,
                                        GeglBuffer          *input,
@@ -138,33 +193,32 @@ gegl_operation_point_composer_process (GeglOperation       *operation,
                                        GeglBuffer          *output,
                                        const GeglRectangle *result)
 {
-  GeglOperationPointComposerClass *point_composer_class = GEGL_OPERATION_POINT_COMPOSER_GET_CLASS (operation);
   const Babl *in_format  = gegl_operation_get_format (operation, "input");
   const Babl *aux_format = gegl_operation_get_format (operation, "aux");
   const Babl *out_format = gegl_operation_get_format (operation, "output");
 
   if ((result->width > 0) && (result->height > 0))
     {
-      GeglBufferIterator *i = gegl_buffer_iterator_new (output, result, out_format, GEGL_BUFFER_WRITE);
-      gint read  = gegl_buffer_iterator_add (i, input,  result, in_format, GEGL_BUFFER_READ);
+      PointComposerJob    job;
+      GeglBufferIterator *i = gegl_buffer_iterator_new (output, result, out_format, GEGL_BUFFER_WRITE | GEGL_BUFFER_STRIDED);
 
-      if (aux)
-        {
-          gint foo = gegl_buffer_iterator_add (i, aux,  result, aux_format, GEGL_BUFFER_READ);
+      job.operation = operation;
+      job.read      = gegl_buffer_iterator_add (i, input,  result, in_format, GEGL_BUFFER_READ | GEGL_BUFFER_STRIDED);
+      job.aux       = -1;
+      job.in_bpp    = babl_format_get_bytes_per_pixel (in_format);
+      job.aux_bpp   = 0;
+      job.out_bpp   = babl_format_get_bytes_per_pixel (out_format);
 
-          while (gegl_buffer_iterator_next (i))
-            {
-               point_composer_class->process (operation, i->data[read], i->data[foo], i->data[0], i->length, &(i->roi[0]));
-            }
-        }
-      else
+      if (aux)
         {
-          while (gegl_buffer_iterator_next (i))
-            {
-               point_composer_class->process (operation, i->data[read], NULL, i->data[0], i->length, &(i->roi[0]));
-            }
+          job.aux     = gegl_buffer_iterator_add (i, aux,  result, aux_format, GEGL_BUFFER_READ | GEGL_BUFFER_STRIDED);
+          job.aux_bpp = babl_format_get_bytes_per_pixel (aux_format);
         }
 
+      gegl_operation_point_iterate (i, output, result,
+                                    gegl_operation_point_composer_process_data,
+                                    NULL, &job);
+
       gegl_buffer_iterator_free (i);
       return TRUE;
     }
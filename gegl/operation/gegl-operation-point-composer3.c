@@ -121,8 +121,9 @@ gegl_operation_composer3_process2 (GeglOperation        *operation,
         {
           success = klass->process (operation, input, aux, aux2, output, result);
 
-          if (output == GEGL_BUFFER (operation->node->cache))
-            gegl_cache_computed (operation->node->cache, result);
+          if (GEGL_IS_CACHE (output) &&
+              GEGL_CACHE (output)->node == operation->node)
+            gegl_cache_computed (GEGL_CACHE (output), result);
         }
       if (input)
          g_object_unref (input);
@@ -29,12 +29,19 @@
 #include "gegl-utils.h"
 #include <string.h>
 
-#include "gegl-buffer-private.h"
-#include "gegl-tile-storage.h"
+#include "gegl-operation-point-private.h"
 
 #include "gegl-gpu-types.h"
 #include "gegl-gpu-init.h"
 
+typedef struct
+{
+  GeglOperation *operation;
+  gint           read;
+  gint           in_bpp;
+  gint           out_bpp;
+} PointFilterJob;
+
 static gboolean gegl_operation_point_filter_process
                               (GeglOperation       *operation,
                                GeglBuffer          *input,
@@ -65,6 +72,49 @@ gegl_operation_point_filter_init (GeglOperationPointFilter *self)
 {
 }
 
+/* processes the current data of the iterator, row by row when it is
+ * accessed in place within tiles wider than the region
+ */
+static void
+gegl_operation_point_filter_process_data (gpointer            job_data,
+                                          GeglBufferIterator *i,
+                                          gpointer           *scratch)
+{
+  PointFilterJob                *job       = job_data;
+  GeglOperation                 *operation = job->operation;
+  gint                           read      = job->read;
+  gint                           width     = i->roi[0].width;
+  GeglOperationPointFilterClass *point_filter_class;
+
+  point_filter_class = GEGL_OPERATION_POINT_FILTER_GET_CLASS (operation);
+
+  if (i->rowstride[read] == width * job->in_bpp &&
+      i->rowstride[0]    == width * job->out_bpp)
+    {
+      point_filter_class->process (operation,
+                                   i->data[read],
+                                   i->data[0],
+                                   i->length,
+                                   &i->roi[0]);
+    }
+  else
+    {
+      GeglRectangle  row = i->roi[0];
+      guchar        *in  = i->data[read];
+      guchar        *out = i->data[0];
+      gint           y;
+
+      row.height = 1;
+      for (y = 0; y < i->roi[0].height; y++)
+        {
+          point_filter_class->process (operation, in, out, width, &row);
+          in  += i->rowstride[read];
+          out += i->rowstride[0];
+          row.y++;
+        }
+    }
+}
+
 static gboolean
 gegl_operation_point_filter_process (GeglOperation       *operation,
                                      GeglBuffer          *input,
@@ -73,12 +123,12 @@ gegl_operation_point_filter_process (GeglOperation       *operation,
 {
   const Babl *in_format  = gegl_operation_get_format (operation, "input");
   const Babl *out_format = gegl_operation_get_format (operation, "output");
+  gint        in_bpp     = babl_format_get_bytes_per_pixel (in_format);
+  gint        out_bpp    = babl_format_get_bytes_per_pixel (out_format);
 
   GeglOperationClass            *operation_class;
-  GeglOperationPointFilterClass *point_filter_class;
 
   operation_class    = GEGL_OPERATION_GET_CLASS (operation);
-  point_filter_class = GEGL_OPERATION_POINT_FILTER_GET_CLASS (operation);
 
   if (result->width > 0 && result->height > 0)
     {
@@ -96,9 +146,9 @@ gegl_operation_point_filter_process (GeglOperation       *operation,
 #if HAVE_GPU
                                 use_gpu
                                   ? GEGL_BUFFER_GPU_WRITE
-                                  : GEGL_BUFFER_WRITE
+                                  : GEGL_BUFFER_WRITE | GEGL_BUFFER_STRIDED
 #else
-                                  GEGL_BUFFER_WRITE
+                                  GEGL_BUFFER_WRITE | GEGL_BUFFER_STRIDED
 #endif
                                   );
 
@@ -109,9 +159,11 @@ gegl_operation_point_filter_process (GeglOperation       *operation,
 #if HAVE_GPU
                                              use_gpu
                                                ? GEGL_BUFFER_GPU_READ
-                                               : GEGL_BUFFER_READ
+                                               : GEGL_BUFFER_READ |
+                                                 GEGL_BUFFER_STRIDED
 #else
-                                               GEGL_BUFFER_READ
+                                               GEGL_BUFFER_READ |
+                                               GEGL_BUFFER_STRIDED
 #endif
                                                );
 
@@ -128,12 +180,16 @@ gegl_operation_point_filter_process (GeglOperation       *operation,
       else
         {
 #endif
-          while (gegl_buffer_iterator_next (i))
-            point_filter_class->process (operation,
-                                         i->data[read],
-                                         i->data[0],
-                                         i->length,
-                                         &i->roi[0]);
+          PointFilterJob job;
+
+          job.operation = operation;
+          job.read      = read;
+          job.in_bpp    = in_bpp;
+          job.out_bpp   = out_bpp;
+
+          gegl_operation_point_iterate (i, output, result,
+                                        gegl_operation_point_filter_process_data,
+                                        NULL, &job);
 #if HAVE_GPU
         }
 #endif
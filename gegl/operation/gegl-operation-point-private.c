@@ -0,0 +1,99 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-operation-point-private.h"
+
+#include "gegl-buffer-private.h"
+#include "gegl-tile-storage.h"
+
+#include "process/gegl-scheduler.h"
+
+typedef struct
+{
+  GeglBufferIterator     *iterator;
+  GeglOperationPointFunc  func;
+  GDestroyNotify          scratch_free;
+  gpointer                job;
+} PointIterateJob;
+
+static void
+gegl_operation_point_iterate_drain (PointIterateJob    *job,
+                                    GeglBufferIterator *i)
+{
+  gpointer scratch = NULL;
+
+  while (gegl_buffer_iterator_next (i))
+    job->func (job->job, i, &scratch);
+
+  if (scratch && job->scratch_free)
+    job->scratch_free (scratch);
+}
+
+/* run by every thread taking part in processing a region, each drains
+ * the chunks of the shared iterator through its own split iterator
+ */
+static void
+gegl_operation_point_iterate_task (gpointer task_data,
+                                   gpointer user_data)
+{
+  PointIterateJob    *job = user_data;
+  GeglBufferIterator *i   = gegl_buffer_iterator_split (job->iterator);
+
+  gegl_operation_point_iterate_drain (job, i);
+  gegl_buffer_iterator_free (i);
+}
+
+void
+gegl_operation_point_iterate (GeglBufferIterator     *iterator,
+                              GeglBuffer             *output,
+                              const GeglRectangle    *result,
+                              GeglOperationPointFunc  func,
+                              GDestroyNotify          scratch_free,
+                              gpointer                job)
+{
+  gint              n_threads = gegl_scheduler_get_n_workers () + 1;
+  GeglSchedulerJob *sched_job;
+  PointIterateJob   iterate;
+  gint              n;
+
+  iterate.iterator     = iterator;
+  iterate.func         = func;
+  iterate.scratch_free = scratch_free;
+  iterate.job          = job;
+
+  /* spreading the work is not worth it for a few tiles */
+  if (n_threads < 2 ||
+      result->width * result->height <
+      2 * output->tile_storage->tile_width * output->tile_storage->tile_height)
+    {
+      gegl_operation_point_iterate_drain (&iterate, iterator);
+      return;
+    }
+
+  sched_job = gegl_scheduler_job_new (gegl_operation_point_iterate_task,
+                                      &iterate);
+  for (n = 0; n < n_threads; n++)
+    gegl_scheduler_job_push (sched_job, GINT_TO_POINTER (n + 1));
+  gegl_scheduler_job_wait (sched_job);
+  gegl_scheduler_job_free (sched_job);
+}
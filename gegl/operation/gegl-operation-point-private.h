@@ -0,0 +1,47 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_OPERATION_POINT_PRIVATE_H__
+#define __GEGL_OPERATION_POINT_PRIVATE_H__
+
+#include "gegl-types-internal.h"
+#include "gegl-buffer-iterator.h"
+
+G_BEGIN_DECLS
+
+/* processes the current data of iterator, scratch is state of the calling
+ * thread's own, NULL until the function sets it
+ */
+typedef void (*GeglOperationPointFunc) (gpointer            job,
+                                        GeglBufferIterator *iterator,
+                                        gpointer           *scratch);
+
+/* runs func on every chunk of iterator, spread over the scheduler workers
+ * and the calling thread when result spans more than a few tiles of
+ * output. Every thread drains the chunks through its own split iterator
+ * and hands its scratch to scratch_free, when set, once done. The
+ * iterator is not freed.
+ */
+void gegl_operation_point_iterate (GeglBufferIterator     *iterator,
+                                   GeglBuffer             *output,
+                                   const GeglRectangle    *result,
+                                   GeglOperationPointFunc  func,
+                                   GDestroyNotify          scratch_free,
+                                   gpointer                job);
+
+G_END_DECLS
+
+#endif /* __GEGL_OPERATION_POINT_PRIVATE_H__ */
@@ -139,8 +139,9 @@ gegl_operation_source_process (GeglOperation       *operation,
   output = gegl_operation_context_get_target (context, "output");
   success = klass->process (operation, output, result);
 
-  if (output == GEGL_BUFFER (operation->node->cache))
-    gegl_cache_computed (operation->node->cache, result);
+  if (GEGL_IS_CACHE (output) &&
+      GEGL_CACHE (output)->node == operation->node)
+    gegl_cache_computed (GEGL_CACHE (output), result);
 
   return success;
 }
@@ -170,16 +170,15 @@ gegl_operation_set_need_rect (GeglOperation       *operation,
 
   {
     GeglOperationContext *child_context = gegl_node_get_context (child, context_id);
+    GeglCache            *cache;
+
     gegl_rectangle_bounding_box (&child_need, &child_context->need_rect, region);
     gegl_rectangle_intersect (&child_need, &child->have_rect, &child_need);
 
       /* If we're cached */
-      if (child->cache)
+      cache = gegl_node_ref_cache (child, gegl_pad_get_name (output_pad));
+      if (cache)
         {
-          GeglCache *cache = child->cache;
-          GeglRectangle valid_box;
-          gegl_region_get_clipbox (cache->valid_region, &valid_box);
-
           if (child_need.width == 0  ||
               child_need.height == 0 ||
               gegl_region_rect_in (cache->valid_region, &child_need) == GEGL_OVERLAP_RECTANGLE_IN)
@@ -189,6 +188,7 @@ gegl_operation_set_need_rect (GeglOperation       *operation,
               child_need.width = 0;
               child_need.height = 0;
             }
+          g_object_unref (cache);
         }
 
     gegl_node_set_need_rect (child, context_id, &child_need);
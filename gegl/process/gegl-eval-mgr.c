@@ -19,23 +19,24 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <glib-object.h>
 
 #include "gegl.h"
+#include "gegl-debug.h"
 #include "gegl-types-internal.h"
 #include "gegl-eval-mgr.h"
-#include "gegl-eval-visitor.h"
-#include "gegl-debug-rect-visitor.h"
-#include "gegl-need-visitor.h"
-#include "gegl-have-visitor.h"
+#include "gegl-eval-plan.h"
+#include "gegl-scheduler.h"
 #include "gegl-instrument.h"
+#include "gegl-utils.h"
 #include "graph/gegl-node.h"
-#include "gegl-prepare-visitor.h"
-#include "gegl-finish-visitor.h"
 #include "graph/gegl-pad.h"
-#include "graph/gegl-visitable.h"
 #include "operation/gegl-operation.h"
-#include <stdlib.h>
+#include "operation/gegl-operation-context.h"
+#include "operation/gegl-operation-point-chain.h"
+#include "operation/gegl-operation-point-composer.h"
+#include "operation/gegl-operation-sink.h"
 
 
 static void gegl_eval_mgr_class_init (GeglEvalMgrClass *klass);
@@ -56,14 +57,9 @@ static void
 gegl_eval_mgr_init (GeglEvalMgr *self)
 {
   GeglRectangle roi = { 0, 0, -1, -1 };
-  gpointer     context_id = self;
 
   self->roi = roi;
-  self->prepare_visitor = g_object_new (GEGL_TYPE_PREPARE_VISITOR, "id", context_id, NULL);
-  self->have_visitor = g_object_new (GEGL_TYPE_HAVE_VISITOR, "id", context_id, NULL);
-  self->eval_visitor = g_object_new (GEGL_TYPE_EVAL_VISITOR, "id", context_id, NULL);
-  self->need_visitor = g_object_new (GEGL_TYPE_NEED_VISITOR, "id", context_id, NULL);
-  self->finish_visitor = g_object_new (GEGL_TYPE_FINISH_VISITOR, "id", context_id, NULL);
+  self->plan = NULL;
   self->state = UNINITIALIZED;
 }
 
@@ -71,26 +67,10 @@ static void
 gegl_eval_mgr_finalize (GObject *self_object)
 {
   GeglEvalMgr *self = GEGL_EVAL_MGR (self_object);
-#if 0
-  GeglNode    *root;
-  GeglPad     *pad;
-  root=self->node;
-  pad = gegl_node_get_pad (root, self->pad_name);
-  /* Use the redirect output NOP of a graph instead of a graph if a traversal
-   * is attempted directly on a graph */
-  if (pad && pad->node != self->node)
-    root = pad->node;
-  else
-    root = self->node;
-
-  gegl_visitor_reset (self->finish_visitor);
-  gegl_visitor_dfs_traverse (self->finish_visitor, GEGL_VISITABLE (root));
-#endif
 
-  g_object_unref (self->prepare_visitor);
-  g_object_unref (self->eval_visitor);
-  g_object_unref (self->need_visitor);
-  g_object_unref (self->finish_visitor);
+  if (self->plan)
+    gegl_eval_plan_free (self->plan);
+  g_free (self->pad_name);
 
   G_OBJECT_CLASS (gegl_eval_mgr_parent_class)->finalize (self_object);
 }
@@ -122,53 +102,511 @@ gegl_eval_mgr_change_notification (GObject             *gobject,
   return FALSE;
 }
 
+/* adds a context to every node, calls the operations' prepare methods and
+ * sets the "needed rectangles" to empty ones
+ */
+static void
+gegl_eval_mgr_prepare (GeglEvalMgr *self)
+{
+  GeglEvalPlan *plan       = self->plan;
+  gpointer      context_id = self;
+  gint          i;
+
+  for (i = 0; i < plan->n_nodes; i++)
+    {
+      GeglEvalPlanNode *entry = &plan->nodes[i];
+      GeglNode         *node  = entry->node;
+      GeglRectangle     empty = { 0, };
+      glong             time  = gegl_ticks ();
+
+      entry->context = gegl_node_add_context (node, context_id);
+
+      if (entry->graph && entry->graph->operation)
+        {
+#if ENABLE_MT
+          g_mutex_lock (entry->graph->mutex);
+#endif
+          /* issuing a prepare on the graph, FIXME: we might need to do
+           * a cycle of prepares as deep as the nesting of graphs,.
+           * (or find a better way to do this) */
+          gegl_operation_prepare (entry->graph->operation);
+#if ENABLE_MT
+          g_mutex_unlock (entry->graph->mutex);
+#endif
+        }
+
+#if ENABLE_MT
+      g_mutex_lock (node->mutex);
+#endif
+      gegl_operation_prepare (node->operation);
+#if ENABLE_MT
+      g_mutex_unlock (node->mutex);
+#endif
+      gegl_operation_context_set_need_rect (entry->context, &empty);
+
+      time = gegl_ticks () - time;
+      gegl_instrument ("process", gegl_node_get_operation (node), time);
+      gegl_instrument (gegl_node_get_operation (node), "prepare", time);
+    }
+}
+
+/* sets up the nodes' bounding boxes */
+static void
+gegl_eval_mgr_have (GeglEvalMgr *self)
+{
+  GeglEvalPlan *plan = self->plan;
+  gint          i;
+
+  for (i = 0; i < plan->n_nodes; i++)
+    {
+      GeglNode     *node = plan->nodes[i].node;
+      GeglRectangle rect;
+      glong         time = gegl_ticks ();
+
+#if ENABLE_MT
+      g_mutex_lock (node->mutex);
+#endif
+      rect = gegl_operation_get_bounding_box (node->operation);
+      node->have_rect = rect;
+#if ENABLE_MT
+      g_mutex_unlock (node->mutex);
+#endif
+
+      time = gegl_ticks () - time;
+      gegl_instrument ("process", gegl_node_get_operation (node), time);
+      gegl_instrument (gegl_node_get_operation (node), "defined-region", time);
+    }
+}
+
+/* sets the contexts' result_rect and refs, every node is visited after
+ * all of the nodes that read from it
+ */
+static void
+gegl_eval_mgr_need (GeglEvalMgr *self)
+{
+  GeglEvalPlan *plan       = self->plan;
+  gpointer      context_id = self;
+  gint          i;
+
+  for (i = plan->n_nodes - 1; i >= 0; i--)
+    {
+      GeglNode             *node    = plan->nodes[i].node;
+      GeglOperationContext *context = plan->nodes[i].context;
+
+      gegl_operation_calc_need_rects (node->operation, context_id);
+      if (!context->cached)
+        {
+          gegl_rectangle_intersect (&context->result_rect, &node->have_rect, &context->need_rect);
+          /* here we expand to the size requested by the operation to be cached */
+          context->result_rect = gegl_operation_get_cached_region (node->operation, &context->result_rect);
+        }
+
+      GEGL_NOTE (GEGL_DEBUG_PROCESS,
+                 "For \"%s\" have_rect = %d, %d %d×%d need_rect = %d, %d %d×%d result_rect = %d, %d %d×%d\n",
+                 gegl_node_get_debug_name (node),
+                 node->have_rect.x, node->have_rect.y, node->have_rect.width, node->have_rect.height,
+                 context->need_rect.x, context->need_rect.y, context->need_rect.width, context->need_rect.height,
+                 context->result_rect.x, context->result_rect.y, context->result_rect.width, context->result_rect.height);
+
+      /* only the readers that are part of the plan ever drop their
+       * reference, counting the others would keep the output alive until
+       * the contexts are removed
+       */
+      context->refs = plan->nodes[i].n_sinks;
+    }
+}
+
+extern long babl_total_usecs;
+
+static void gegl_eval_mgr_eval_fused (GeglEvalMgr *self,
+                                      gint         tail);
+
+/* this is where the real computations for GEGL happen */
+static void
+gegl_eval_mgr_eval_step (GeglEvalMgr      *self,
+                         GeglEvalPlanStep *step)
+{
+  GeglEvalPlan         *plan      = self->plan;
+  GeglPad              *pad       = step->pad;
+  GeglNode             *node      = plan->nodes[step->node].node;
+  GeglOperationContext *context   = plan->nodes[step->node].context;
+  GeglOperation        *operation = node->operation;
+
+  if (gegl_pad_is_output (pad))
+    {
+      GeglCache *cache = NULL;
+
+      gegl_node_record_read (node, &context->need_rect,
+                             plan->nodes[step->node].n_sinks);
+
+      /* the cache might have been dropped by a concurrent evaluation
+       * since the need rects were computed, then it is processed after all
+       */
+      if (context->cached)
+        cache = gegl_node_ref_cache (node, gegl_pad_get_name (pad));
+
+      /* processing only really happens for output pads */
+      if (cache)
+        {
+          GEGL_NOTE (GEGL_DEBUG_PROCESS, "Using cache for pad '%s' on \"%s\"", gegl_pad_get_name (pad), gegl_node_get_debug_name (node));
+          gegl_operation_context_take_object (context,
+                                              gegl_pad_get_name (pad),
+                                              G_OBJECT (cache));
+        }
+      else
+        {
+          glong time      = gegl_ticks ();
+          glong babl_time = babl_total_usecs;
+
+          /* Make the operation do it's actual processing */
+          GEGL_NOTE (GEGL_DEBUG_PROCESS, "Processing pad '%s' on \"%s\"", gegl_pad_get_name (pad), gegl_node_get_debug_name (node));
+          if (plan->nodes[step->node].fused_head >= 0)
+            gegl_eval_mgr_eval_fused (self, step->node);
+          else
+            gegl_operation_process (operation, context, gegl_pad_get_name (pad),
+                                    &context->result_rect);
+          babl_time = babl_total_usecs - babl_time;
+          time      = gegl_ticks () - time;
+
+          gegl_instrument ("process", gegl_node_get_operation (node), time);
+          gegl_instrument (gegl_node_get_operation (node), "babl", babl_time);
+          gegl_node_record_process (node, &context->result_rect, time);
+        }
+    }
+  else if (step->source_pad)
+    {
+      /* the work needed to be done on input pads is to set the
+       * data from the corresponding output pad it is connected to
+       */
+      GValue                value          = { 0 };
+      GParamSpec           *prop_spec      = gegl_pad_get_param_spec (pad);
+      GeglPad              *source_pad     = step->source_pad;
+      GeglNode             *source_node    = plan->nodes[step->source_node].node;
+      GeglOperationContext *source_context = plan->nodes[step->source_node].context;
+
+      g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (prop_spec));
+
+      gegl_operation_context_get_property (source_context,
+                                           gegl_pad_get_name (source_pad),
+                                           &value);
+
+      if (!g_value_get_object (&value) &&
+          !g_object_get_data (G_OBJECT (source_node), "graph"))
+        g_warning ("eval-mgr encountered a NULL buffer passed from: %s.%s-[%p]",
+                   gegl_node_get_debug_name (source_node),
+                   gegl_pad_get_name (source_pad),
+                   g_value_get_object (&value));
+
+      gegl_operation_context_set_property (context,
+                                           gegl_pad_get_name (pad),
+                                           &value);
+      /* reference counting for this source dropped to zero, freeing up,
+       * the sinks of a node might be evaluated concurrently
+       */
+      if (g_atomic_int_dec_and_test (&source_context->refs) &&
+          g_value_get_object (&value))
+        {
+          gegl_operation_context_remove_property (source_context,
+                                                  gegl_pad_get_name (source_pad));
+        }
+
+      g_value_unset (&value);
+
+      /* processing for sink operations that accepts partial consumption
+         and thus probably are being processed by the processor from the
+         this very operation.
+       */
+      if (GEGL_IS_OPERATION_SINK (operation) &&
+          !gegl_operation_sink_needs_full (operation))
+        {
+          GEGL_NOTE (GEGL_DEBUG_PROCESS, "Processing pad '%s' on \"%s\"", gegl_pad_get_name (pad), gegl_node_get_debug_name (node));
+          gegl_operation_process (operation, context, "output",
+                                  &context->result_rect);
+        }
+    }
+}
+
+/* processes the run of point operations ending in the node tail in a
+ * single pass. When the prepared operations turn out not to line up the
+ * steps left out of the evaluation are done after all, one operation at
+ * a time.
+ */
+static void
+gegl_eval_mgr_eval_fused (GeglEvalMgr *self,
+                          gint         tail)
+{
+  GeglEvalPlan         *plan         = self->plan;
+  GeglEvalPlanNode     *entry        = &plan->nodes[tail];
+  GeglOperationContext *context      = entry->context;
+  GeglRectangle        *result       = &context->result_rect;
+  GeglOperation       **operations;
+  GeglBuffer          **aux;
+  GeglBuffer           *input        = NULL;
+  GeglBuffer           *output;
+  gboolean              fuse         = TRUE;
+  gint                  n_operations = 1;
+  gint                  i;
+  gint                  n;
+
+  for (i = entry->fused_head; plan->nodes[i].fused_into >= 0;
+       i = plan->nodes[i].fused_into)
+    n_operations++;
+
+  operations = g_newa (GeglOperation *, n_operations);
+  aux        = g_newa (GeglBuffer *, n_operations);
+
+  for (i = entry->fused_head, n = 0; n < n_operations;
+       i = plan->nodes[i].fused_into, n++)
+    {
+      GeglOperationContext *member = plan->nodes[i].context;
+
+      operations[n] = plan->nodes[i].node->operation;
+      aux[n]        = NULL;
+
+      /* the intermediate results would have been cropped differently,
+       * or are wanted in a cache
+       */
+      if (member->cached ||
+          !gegl_rectangle_equal (&member->result_rect, result) ||
+          (i != tail && gegl_node_use_cache (plan->nodes[i].node, "output")))
+        fuse = FALSE;
+    }
+
+  if (result->width == 0 || result->height == 0 ||
+      !gegl_operation_point_chain_can_process (operations, n_operations))
+    fuse = FALSE;
+
+  if (fuse)
+    {
+      input = gegl_operation_context_get_source (plan->nodes[entry->fused_head].context,
+                                                 "input");
+      if (!input)
+        fuse = FALSE;
+    }
+
+  if (!fuse)
+    {
+      for (i = entry->fused_head; i != tail; i = plan->nodes[i].fused_into)
+        {
+          gegl_eval_mgr_eval_step (self, &plan->steps[plan->nodes[i].output_step]);
+          gegl_eval_mgr_eval_step (self, &plan->steps[plan->nodes[i].link_step]);
+        }
+      gegl_operation_process (entry->node->operation, context, "output",
+                              result);
+      return;
+    }
+
+  GEGL_NOTE (GEGL_DEBUG_PROCESS, "Processing %d point operations in one pass up to \"%s\"", n_operations, gegl_node_get_debug_name (entry->node));
+
+  for (i = entry->fused_head, n = 0; n < n_operations;
+       i = plan->nodes[i].fused_into, n++)
+    if (GEGL_IS_OPERATION_POINT_COMPOSER (operations[n]))
+      aux[n] = gegl_operation_context_get_source (plan->nodes[i].context,
+                                                  "aux");
+
+  output = gegl_operation_context_get_target (context, "output");
+  gegl_operation_point_chain_process (operations, n_operations,
+                                      input, aux, output, result);
+  if (GEGL_IS_CACHE (output) &&
+      GEGL_CACHE (output)->node == entry->node)
+    gegl_cache_computed (GEGL_CACHE (output), result);
+
+  g_object_unref (input);
+  for (n = 0; n < n_operations; n++)
+    if (aux[n])
+      g_object_unref (aux[n]);
+}
+
+static void
+gegl_eval_mgr_release_node_inputs (GeglEvalMgr      *self,
+                                   GeglEvalPlanNode *entry)
+{
+  GeglEvalPlan *plan = self->plan;
+  gint          i;
+
+  for (i = 0; i < entry->n_steps; i++)
+    {
+      GeglEvalPlanStep *step = &plan->steps[plan->node_steps[entry->first_step + i]];
+
+      if (!step->fused && step->source_pad && gegl_pad_is_input (step->pad))
+        gegl_operation_context_remove_property (entry->context,
+                                                gegl_pad_get_name (step->pad));
+    }
+}
+
+/* once the last step of a node is done its inputs are dead, dropping them
+ * right away lets the buffers no other context holds on to go back to the
+ * buffer pool, where the nodes evaluated later pick them up again. The
+ * inputs of a run of point operations are read by its last node.
+ */
+static void
+gegl_eval_mgr_release_inputs (GeglEvalMgr *self,
+                              gint         index)
+{
+  GeglEvalPlan *plan = self->plan;
+  gint          i;
+
+  if (plan->nodes[index].fused_into >= 0)
+    return;
+
+  if (plan->nodes[index].fused_head >= 0)
+    for (i = plan->nodes[index].fused_head; i != index;
+         i = plan->nodes[i].fused_into)
+      gegl_eval_mgr_release_node_inputs (self, &plan->nodes[i]);
+
+  gegl_eval_mgr_release_node_inputs (self, &plan->nodes[index]);
+}
+
+/* evaluates all the pads of a node, its sources have to be done */
+static void
+gegl_eval_mgr_eval_node (GeglEvalMgr      *self,
+                         GeglEvalPlanNode *entry)
+{
+  GeglEvalPlan *plan = self->plan;
+  gint          i;
+
+  for (i = 0; i < entry->n_steps; i++)
+    {
+      GeglEvalPlanStep *step = &plan->steps[plan->node_steps[entry->first_step + i]];
+
+      if (!step->fused)
+        gegl_eval_mgr_eval_step (self, step);
+    }
+  gegl_eval_mgr_release_inputs (self, entry - plan->nodes);
+}
+
+typedef struct EvalJob
+{
+  GeglEvalMgr      *mgr;
+  GeglSchedulerJob *job;
+} EvalJob;
+
+/* evaluates a node and queues the nodes reading from it that have all
+ * their sources done, branches of the graph that do not depend on each
+ * other end up being evaluated on different threads
+ */
+static void
+gegl_eval_mgr_eval_task (gpointer task_data,
+                         gpointer user_data)
+{
+  GeglEvalPlanNode *entry = task_data;
+  EvalJob          *job   = user_data;
+  GeglEvalPlan     *plan  = job->mgr->plan;
+  gint              i;
+
+  gegl_eval_mgr_eval_node (job->mgr, entry);
+
+  for (i = 0; i < entry->n_sinks; i++)
+    {
+      GeglEvalPlanNode *sink = &plan->nodes[plan->sinks[entry->first_sink + i]];
+
+      if (g_atomic_int_dec_and_test (&sink->pending))
+        gegl_scheduler_job_push (job->job, sink);
+    }
+}
+
+static void
+gegl_eval_mgr_eval (GeglEvalMgr *self)
+{
+  GeglEvalPlan *plan = self->plan;
+  EvalJob       job;
+  gint          i;
+
+  /* a chain of nodes gains nothing from going through the scheduler */
+  if (!plan->branches || gegl_scheduler_get_n_workers () == 0)
+    {
+      for (i = 0; i < plan->n_steps; i++)
+        {
+          GeglEvalPlanStep *step = &plan->steps[i];
+
+          if (step->fused)
+            continue;
+          gegl_eval_mgr_eval_step (self, step);
+          if (plan->nodes[step->node].last_step == i)
+            gegl_eval_mgr_release_inputs (self, step->node);
+        }
+      return;
+    }
+
+  for (i = 0; i < plan->n_nodes; i++)
+    plan->nodes[i].pending = plan->nodes[i].n_sources;
+
+  job.mgr = self;
+  job.job = gegl_scheduler_job_new (gegl_eval_mgr_eval_task, &job);
+
+  /* the leaves, nodes without steps are not part of the evaluation */
+  for (i = 0; i < plan->n_nodes; i++)
+    if (plan->nodes[i].n_steps && plan->nodes[i].n_sources == 0)
+      gegl_scheduler_job_push (job.job, &plan->nodes[i]);
+
+  gegl_scheduler_job_wait (job.job);
+  gegl_scheduler_job_free (job.job);
+}
+
+/* removes the contexts again */
+static void
+gegl_eval_mgr_finish (GeglEvalMgr *self)
+{
+  GeglEvalPlan *plan       = self->plan;
+  gpointer      context_id = self;
+  gint          i;
+
+  for (i = 0; i < plan->n_nodes; i++)
+    {
+      gegl_node_remove_context (plan->nodes[i].node, context_id);
+      plan->nodes[i].context = NULL;
+    }
+}
 
 GeglBuffer *
 gegl_eval_mgr_apply (GeglEvalMgr *self)
 {
-  GeglNode    *root;
-  GeglBuffer  *buffer;
-  GeglPad     *pad;
-  glong        time       = gegl_ticks ();
-  gpointer     context_id = self;
+  GeglEvalPlan         *plan;
+  GeglNode             *root;
+  GeglOperationContext *root_context;
+  GeglBuffer           *buffer     = NULL;
+  glong                 time       = gegl_ticks ();
 
   g_assert (GEGL_IS_EVAL_MGR (self));
 
   gegl_instrument ("gegl", "process", 0);
 
-  root=self->node;
-  pad = gegl_node_get_pad (root, self->pad_name);
-  /* Use the redirect output NOP of a graph instead of a graph if a traversal
-   * is attempted directly on a graph */
-  if (pad && pad->node != self->node)
-    root = pad->node;
-  else
-    root = self->node;
-  g_assert (root);
+  /* the graph is only walked again when its structure changed, a changed
+   * structure might also have changed the bounding boxes
+   */
+  if (self->plan && !gegl_eval_plan_is_current (self->plan))
+    {
+      gegl_eval_plan_free (self->plan);
+      self->plan = NULL;
+      if (self->state == NEED_CONTEXT_SETUP_TRAVERSAL)
+        self->state = NEED_REDO_PREPARE_AND_HAVE_RECT_TRAVERSAL;
+    }
+  if (!self->plan)
+    self->plan = gegl_eval_plan_new (self->node, self->pad_name);
 
+  plan = self->plan;
+  root = plan->root;
   g_object_ref (root);
 
-  /* do the necessary set-up work (all using depth first traversal) */
+  /* do the necessary set-up work */
   switch (self->state)
     {
       case UNINITIALIZED:
         /* Set up the node's context and "needed rectangle"*/
-        gegl_visitor_reset (self->prepare_visitor);
-        gegl_visitor_dfs_traverse (self->prepare_visitor, GEGL_VISITABLE (root));
+        gegl_eval_mgr_prepare (self);
         /* No idea why there is a second call */
-        gegl_visitor_reset (self->prepare_visitor);
-        gegl_visitor_dfs_traverse (self->prepare_visitor, GEGL_VISITABLE (root));
+        gegl_eval_mgr_prepare (self);
       case NEED_REDO_PREPARE_AND_HAVE_RECT_TRAVERSAL:
         /* sets up the node's rect (bounding box) */
-        gegl_visitor_reset (self->have_visitor);
-        gegl_visitor_dfs_traverse (self->have_visitor, GEGL_VISITABLE (root));
+        gegl_eval_mgr_have (self);
       case NEED_CONTEXT_SETUP_TRAVERSAL:
-
-        gegl_visitor_reset (self->prepare_visitor);
-        gegl_visitor_dfs_traverse (self->prepare_visitor, GEGL_VISITABLE (root));      
+        gegl_eval_mgr_prepare (self);
         self->state = NEED_CONTEXT_SETUP_TRAVERSAL;
      }
 
+  /* the root is the last node of the plan */
+  root_context = plan->nodes[plan->n_nodes - 1].context;
+
   /* set up the root node */
   if (self->roi.width == -1 &&
       self->roi.height == -1)
@@ -176,68 +614,38 @@ gegl_eval_mgr_apply (GeglEvalMgr *self)
       self->roi = root->have_rect;
     }
 
-  gegl_node_set_need_rect (root, context_id, &self->roi);
-
-  /* set up the context's rectangle (breadth first traversal) */
-  gegl_visitor_reset (self->need_visitor);
+  gegl_operation_context_set_need_rect (root_context, &self->roi);
 
-  /* should the need rect be moved into the context, making this
-   * part of gegl re-entrable without locking?.. or does that
-   * hamper other useful API that depends on the need_rect to be
-   * in the nodes?
+  /* set up the context's rectangles, should the need rect be moved into
+   * the context, making this part of gegl re-entrable without locking?..
+   * or does that hamper other useful API that depends on the need_rect to
+   * be in the nodes?
    */
-  gegl_visitor_bfs_traverse (self->need_visitor, GEGL_VISITABLE (root));
-
-#if 0
-  if (g_getenv ("GEGL_DEBUG_RECTS") != NULL)
-    {
-      GeglVisitor *debug_rect_visitor;
-
-      g_warning ("---------------------");
-      debug_rect_visitor = g_object_new (GEGL_TYPE_DEBUG_RECT_VISITOR, "id", context_id, NULL);
-      gegl_visitor_dfs_traverse (debug_rect_visitor, GEGL_VISITABLE (root));
-      g_object_unref (debug_rect_visitor);
-    }
-#endif
+  gegl_eval_mgr_need (self);
 
   /* now let's do the real work */
-  gegl_visitor_reset (self->eval_visitor);
-  if (pad)
-    {
-      gegl_visitor_dfs_traverse (self->eval_visitor, GEGL_VISITABLE (pad));
-    }
-  else
-    { /* pull on the input of our sink if no pad of the given pad-name
-         was available, we take this as an indication that we're in fact
-         doing processing on a sink (and the ROI inidcates the data to
-         be written, note that GEGL might subdivide this roi
-         in its processing.
-       */
-      GeglPad *pad = gegl_node_get_pad (root, "input");
-      gegl_visitor_dfs_traverse (self->eval_visitor, GEGL_VISITABLE (pad));
-    }
+  gegl_eval_mgr_eval (self);
 
-  if (pad)
+  if (plan->pad)
     {
-      /* extract return buffer before running finish visitor */
+      /* extract return buffer before the contexts are removed */
       GValue value = { 0, };
       g_value_init (&value, G_TYPE_OBJECT);
-      gegl_operation_context_get_property (gegl_node_get_context (root, context_id),
-                                      "output", &value);
+      gegl_operation_context_get_property (root_context, "output", &value);
       buffer = g_value_get_object (&value);
-      g_object_ref (buffer);/* salvage buffer from finalization */
+      if (buffer)
+        g_object_ref (buffer);/* salvage buffer from finalization */
       g_value_unset (&value);
     }
 
   /* do the clean up */
-  gegl_visitor_reset (self->finish_visitor);
-  gegl_visitor_dfs_traverse (self->finish_visitor, GEGL_VISITABLE (root));
+  gegl_eval_mgr_finish (self);
 
   g_object_unref (root);
   time = gegl_ticks () - time;
   gegl_instrument ("gegl", "process", time);
 
-  if (!pad || !G_IS_OBJECT (buffer))
+  if (!plan->pad || !G_IS_OBJECT (buffer))
     {
       return NULL;
     }
@@ -21,6 +21,7 @@
 
 #include "gegl-types-internal.h"
 #include "buffer/gegl-buffer-types.h"
+#include "gegl-eval-plan.h"
 
 G_BEGIN_DECLS
 
@@ -63,13 +64,10 @@ struct _GeglEvalMgr
    */
   GeglEvalMgrStates state;
 
-  /* we keep these objects around, they are too expensive to throw away */
-  GeglVisitor *prepare_visitor;
-  GeglVisitor *need_visitor;
-  GeglVisitor *eval_visitor;
-  GeglVisitor *have_visitor;
-  GeglVisitor *finish_visitor;
-
+  /* the graph below node flattened, compiled on first use and again
+   * when the structure of the graph changes
+   */
+  GeglEvalPlan *plan;
 };
 
 struct _GeglEvalMgrClass
@@ -0,0 +1,346 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <glib-object.h>
+
+#include "gegl.h"
+#include "gegl-types-internal.h"
+#include "gegl-eval-plan.h"
+#include "graph/gegl-node.h"
+#include "graph/gegl-pad.h"
+#include "operation/gegl-operation.h"
+#include "operation/gegl-operation-point-composer.h"
+#include "operation/gegl-operation-point-chain.h"
+
+
+/* appends the sources of node and then node itself, like the depth first
+ * traversal of the visitors does. slots maps the nodes seen so far to
+ * their index, -1 while they are still being added.
+ */
+static void
+plan_add_node (GArray     *nodes,
+               GHashTable *slots,
+               GeglNode   *node)
+{
+  GeglEvalPlanNode  entry = { 0, };
+  GSList           *depends_on;
+  GSList           *llink;
+  const gchar      *name;
+
+  g_hash_table_insert (slots, node, GINT_TO_POINTER (-1));
+
+  depends_on = gegl_node_get_depends_on (node);
+  for (llink = depends_on; llink; llink = g_slist_next (llink))
+    if (!g_hash_table_lookup_extended (slots, llink->data, NULL, NULL))
+      plan_add_node (nodes, slots, llink->data);
+  g_slist_free (depends_on);
+
+  entry.node = node;
+  name = gegl_node_get_name (node);
+  if (name && !strcmp (name, "proxynop-output"))
+    {
+      entry.graph = g_object_get_data (G_OBJECT (node), "graph");
+      g_assert (entry.graph);
+    }
+
+  g_hash_table_insert (slots, node, GINT_TO_POINTER (nodes->len));
+  g_array_append_val (nodes, entry);
+}
+
+static gint
+plan_slot (GHashTable *slots,
+           GeglNode   *node)
+{
+  gpointer slot;
+
+  if (!g_hash_table_lookup_extended (slots, node, NULL, &slot))
+    g_assert_not_reached ();
+  return GPOINTER_TO_INT (slot);
+}
+
+/* appends the pads that pad depends on and then pad, in the order the
+ * eval visitor visits them
+ */
+static void
+plan_add_pad (GArray     *steps,
+              GHashTable *slots,
+              GHashTable *visited,
+              GeglPad    *pad)
+{
+  GeglEvalPlanStep  step;
+  GSList           *depends_on;
+  GSList           *llink;
+
+  g_hash_table_insert (visited, pad, pad);
+
+  depends_on = gegl_pad_get_depends_on (pad);
+  for (llink = depends_on; llink; llink = g_slist_next (llink))
+    if (!g_hash_table_lookup (visited, llink->data))
+      plan_add_pad (steps, slots, visited, llink->data);
+  g_slist_free (depends_on);
+
+  step.pad         = pad;
+  step.node        = plan_slot (slots, gegl_pad_get_node (pad));
+  step.source_pad  = NULL;
+  step.source_node = -1;
+  step.fused       = FALSE;
+
+  if (gegl_pad_is_input (pad))
+    {
+      step.source_pad = gegl_pad_get_connected_to (pad);
+      if (step.source_pad)
+        step.source_node = plan_slot (slots,
+                                      gegl_pad_get_node (step.source_pad));
+    }
+  g_array_append_val (steps, step);
+}
+
+/* groups the steps by node and links every node to the nodes reading
+ * from it, the dependencies of a parallel evaluation, and finds the step
+ * after which the inputs of every node are no longer needed
+ */
+static void
+plan_link_nodes (GeglEvalPlan *plan)
+{
+  gint i;
+
+  for (i = 0; i < plan->n_steps; i++)
+    {
+      GeglEvalPlanStep *step = &plan->steps[i];
+
+      plan->nodes[step->node].n_steps++;
+      if (step->source_node >= 0)
+        {
+          plan->nodes[step->node].n_sources++;
+          plan->nodes[step->source_node].n_sinks++;
+        }
+    }
+
+  plan->node_steps = g_new (gint, MAX (plan->n_steps, 1));
+  plan->sinks      = g_new (gint, MAX (plan->n_steps, 1));
+
+  /* turn the counts into offsets, the counts are rebuilt while filling */
+  {
+    gint steps = 0;
+    gint sinks = 0;
+
+    for (i = 0; i < plan->n_nodes; i++)
+      {
+        GeglEvalPlanNode *entry = &plan->nodes[i];
+
+        if (entry->n_sources > 1)
+          plan->branches = TRUE;
+
+        entry->first_step = steps;
+        entry->first_sink = sinks;
+        steps += entry->n_steps;
+        sinks += entry->n_sinks;
+        entry->n_steps = 0;
+        entry->n_sinks = 0;
+      }
+  }
+
+  for (i = 0; i < plan->n_steps; i++)
+    {
+      GeglEvalPlanStep *step  = &plan->steps[i];
+      GeglEvalPlanNode *entry = &plan->nodes[step->node];
+
+      plan->node_steps[entry->first_step + entry->n_steps++] = i;
+      if (step->source_node >= 0)
+        {
+          GeglEvalPlanNode *source = &plan->nodes[step->source_node];
+
+          plan->sinks[source->first_sink + source->n_sinks++] = step->node;
+        }
+    }
+
+  /* the steps of a node are grouped in the order they are evaluated */
+  for (i = 0; i < plan->n_nodes; i++)
+    {
+      GeglEvalPlanNode *entry = &plan->nodes[i];
+
+      entry->last_step = -1;
+      if (entry->n_steps)
+        entry->last_step = plan->node_steps[entry->first_step +
+                                            entry->n_steps - 1];
+    }
+}
+
+/* finds the runs of point operations that can be processed in a single
+ * pass, a node is fused into the node reading its output when that is the
+ * only reader and reads it on its "input" pad
+ */
+static void
+plan_fuse_point_ops (GeglEvalPlan *plan)
+{
+  gboolean *fusable = g_new0 (gboolean, MAX (plan->n_nodes, 1));
+  gboolean *fed     = g_new0 (gboolean, MAX (plan->n_nodes, 1));
+  gint     *n_aux   = g_new0 (gint, MAX (plan->n_nodes, 1));
+  gint      i;
+
+  for (i = 0; i < plan->n_nodes; i++)
+    {
+      GeglEvalPlanNode *entry     = &plan->nodes[i];
+      GeglOperation    *operation = entry->node->operation;
+
+      entry->fused_into  = -1;
+      entry->fused_head  = -1;
+      entry->output_step = -1;
+      entry->link_step   = -1;
+
+      fusable[i] = operation && gegl_operation_point_chain_can_fuse (operation);
+      if (fusable[i] && GEGL_IS_OPERATION_POINT_COMPOSER (operation))
+        n_aux[i] = 1;
+    }
+
+  /* the sources of a node come before it, n_aux[i] is complete for the
+   * run ending in i by the time i is looked at
+   */
+  for (i = 0; i < plan->n_nodes; i++)
+    {
+      GeglEvalPlanNode *entry       = &plan->nodes[i];
+      GeglEvalPlanNode *sink;
+      gint              output_step = -1;
+      gint              link_step   = -1;
+      gint              j;
+      gint              k;
+
+      if (!fusable[i] ||
+          entry->n_sinks != 1 ||
+          gegl_node_get_num_sinks (entry->node) != 1)
+        continue;
+
+      j    = plan->sinks[entry->first_sink];
+      sink = &plan->nodes[j];
+      if (!fusable[j] ||
+          n_aux[i] + n_aux[j] > GEGL_OPERATION_POINT_CHAIN_MAX_AUX)
+        continue;
+
+      for (k = 0; k < entry->n_steps; k++)
+        {
+          gint s = plan->node_steps[entry->first_step + k];
+
+          if (gegl_pad_is_output (plan->steps[s].pad))
+            output_step = s;
+        }
+      for (k = 0; k < sink->n_steps; k++)
+        {
+          gint s = plan->node_steps[sink->first_step + k];
+
+          if (plan->steps[s].source_node == i &&
+              !strcmp (gegl_pad_get_name (plan->steps[s].pad), "input"))
+            link_step = s;
+        }
+      if (output_step < 0 || link_step < 0 ||
+          plan->steps[link_step].source_pad != plan->steps[output_step].pad)
+        continue;
+
+      entry->fused_into  = j;
+      entry->output_step = output_step;
+      entry->link_step   = link_step;
+      plan->steps[output_step].fused = TRUE;
+      plan->steps[link_step].fused   = TRUE;
+      fed[j]    = TRUE;
+      n_aux[j] += n_aux[i];
+    }
+
+  for (i = 0; i < plan->n_nodes; i++)
+    if (plan->nodes[i].fused_into >= 0 && !fed[i])
+      {
+        gint j = i;
+
+        while (plan->nodes[j].fused_into >= 0)
+          j = plan->nodes[j].fused_into;
+        plan->nodes[j].fused_head = i;
+      }
+
+  g_free (fusable);
+  g_free (fed);
+  g_free (n_aux);
+}
+
+GeglEvalPlan *
+gegl_eval_plan_new (GeglNode    *node,
+                    const gchar *pad_name)
+{
+  GeglEvalPlan *plan  = g_slice_new0 (GeglEvalPlan);
+  GArray       *nodes = g_array_new (FALSE, FALSE, sizeof (GeglEvalPlanNode));
+  GArray       *steps = g_array_new (FALSE, FALSE, sizeof (GeglEvalPlanStep));
+  GHashTable   *slots;
+  GHashTable   *visited;
+  GeglPad      *pad;
+
+  /* read before looking at the graph, a change made while compiling
+   * leaves the plan stale rather than silently wrong
+   */
+  plan->stamp = gegl_node_get_structure_stamp ();
+
+  /* Use the redirect output NOP of a graph instead of a graph if a
+   * traversal is attempted directly on a graph
+   */
+  pad = gegl_node_get_pad (node, pad_name);
+  if (pad && pad->node != node)
+    plan->root = pad->node;
+  else
+    plan->root = node;
+  g_assert (plan->root);
+  plan->pad = pad;
+
+  slots   = g_hash_table_new (g_direct_hash, g_direct_equal);
+  visited = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  plan_add_node (nodes, slots, plan->root);
+
+  /* pull on the input of our sink if no pad of the given name was
+   * available, we take this as an indication that we're in fact doing
+   * processing on a sink
+   */
+  if (!pad)
+    pad = gegl_node_get_pad (plan->root, "input");
+  if (pad)
+    plan_add_pad (steps, slots, visited, pad);
+
+  g_hash_table_destroy (visited);
+  g_hash_table_destroy (slots);
+
+  plan->n_nodes = nodes->len;
+  plan->nodes   = (GeglEvalPlanNode *) g_array_free (nodes, FALSE);
+  plan->n_steps = steps->len;
+  plan->steps   = (GeglEvalPlanStep *) g_array_free (steps, FALSE);
+
+  plan_link_nodes (plan);
+  plan_fuse_point_ops (plan);
+  return plan;
+}
+
+void
+gegl_eval_plan_free (GeglEvalPlan *plan)
+{
+  g_free (plan->nodes);
+  g_free (plan->steps);
+  g_free (plan->node_steps);
+  g_free (plan->sinks);
+  g_slice_free (GeglEvalPlan, plan);
+}
+
+gboolean
+gegl_eval_plan_is_current (GeglEvalPlan *plan)
+{
+  return plan->stamp == gegl_node_get_structure_stamp ();
+}
@@ -0,0 +1,115 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_EVAL_PLAN_H__
+#define __GEGL_EVAL_PLAN_H__
+
+#include "gegl-types-internal.h"
+
+G_BEGIN_DECLS
+
+/* An evaluation plan is the graph below a node flattened into arrays, in
+ * the orders the prepare, have, need, eval and finish visitors would
+ * traverse it. Evaluating from a plan avoids rediscovering the graph,
+ * and looking up the operation contexts of the nodes, on every request.
+ *
+ * A plan only depends on the structure of the graph, it stays valid
+ * until a pad or connection is added or removed anywhere.
+ */
+
+typedef struct _GeglEvalPlan GeglEvalPlan;
+
+typedef struct
+{
+  GeglNode             *node;
+  GeglNode             *graph;   /* for the output proxy of a graph, the
+                                    graph, which is prepared along with it */
+  GeglOperationContext *context; /* only set during an evaluation */
+
+  /* the steps evaluating the pads of the node are
+   * node_steps[first_step .. first_step + n_steps - 1], the nodes reading
+   * from it are sinks[first_sink .. first_sink + n_sinks - 1], once for
+   * every connection.
+   */
+  gint                  first_step;
+  gint                  n_steps;
+  gint                  first_sink;
+  gint                  n_sinks;
+  gint                  n_sources; /* connected input pads among the steps */
+  gint                  last_step; /* after it the inputs of the node are
+                                      dead, -1 when it has no steps */
+  volatile gint         pending;   /* sources not yet evaluated, only used
+                                      during a parallel evaluation */
+
+  /* a run of point operations, each reading the output of the previous
+   * one, is processed in a single pass by its last node. The output of
+   * the others is never evaluated, output_step and link_step are the
+   * steps left out, evaluating their output pad and the "input" pad of
+   * fused_into.
+   */
+  gint                  fused_into; /* the next node of the run, or -1 */
+  gint                  fused_head; /* for the last node of a run, the first
+                                       one, otherwise -1 */
+  gint                  output_step;
+  gint                  link_step;
+} GeglEvalPlanNode;
+
+typedef struct
+{
+  GeglPad  *pad;
+  gint      node;         /* index of the node of pad */
+  GeglPad  *source_pad;   /* the output pad connected to an input pad */
+  gint      source_node;  /* index of the node of source_pad, or -1 */
+  gboolean  fused;        /* left out, part of a run of point operations */
+} GeglEvalPlanStep;
+
+struct _GeglEvalPlan
+{
+  gint              stamp;
+
+  GeglNode         *root;
+  GeglPad          *pad;     /* the pad evaluated, NULL for sinks */
+
+  /* depth first order, the sources of a node come before it and the
+   * root is last, walked backwards every node comes before its sources
+   */
+  GeglEvalPlanNode *nodes;
+  gint              n_nodes;
+
+  /* the pads in the order they are evaluated */
+  GeglEvalPlanStep *steps;
+  gint              n_steps;
+
+  /* the indices of the steps grouped by node, and of the nodes reading
+   * from every node, see GeglEvalPlanNode
+   */
+  gint             *node_steps;
+  gint             *sinks;
+
+  /* TRUE when some node reads from more than one other node, the graph
+   * then has branches that can be evaluated independently
+   */
+  gboolean          branches;
+};
+
+GeglEvalPlan * gegl_eval_plan_new        (GeglNode     *node,
+                                          const gchar  *pad_name);
+void           gegl_eval_plan_free       (GeglEvalPlan *plan);
+gboolean       gegl_eval_plan_is_current (GeglEvalPlan *plan);
+
+G_END_DECLS
+
+#endif /* __GEGL_EVAL_PLAN_H__ */
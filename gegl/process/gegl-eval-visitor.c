@@ -76,9 +76,10 @@ gegl_eval_visitor_visit_pad (GeglVisitor *self,
       if (context->cached)
         {
           GEGL_NOTE (GEGL_DEBUG_PROCESS, "Using cache for pad '%s' on \"%s\"", gegl_pad_get_name (pad), gegl_node_get_debug_name (node));
-          gegl_operation_context_set_object (context,
-                                             gegl_pad_get_name (pad),
-                                             G_OBJECT (node->cache));
+          gegl_operation_context_take_object (context,
+                                              gegl_pad_get_name (pad),
+                                              G_OBJECT (gegl_node_ref_cache (node,
+                                                        gegl_pad_get_name (pad))));
         }
       else
         {
@@ -29,6 +29,7 @@
 
 #include "gegl-config.h"
 #include "gegl-processor.h"
+#include "gegl-scheduler.h"
 #include "gegl-types-internal.h"
 #include "gegl-utils.h"
 
@@ -39,7 +40,8 @@ enum
   PROP_NODE,
   PROP_CHUNK_SIZE,
   PROP_PROGRESS,
-  PROP_RECTANGLE
+  PROP_RECTANGLE,
+  PROP_THREADED
 };
 
 
@@ -79,9 +81,33 @@ struct _GeglProcessor
   GThread         *thread;
   gboolean         thread_done;
   gdouble          progress;
+
+  /* when threaded, chunks of the dirty rectangles are rendered by the
+   * scheduler's workers, finished chunks are merged into the cache's
+   * valid region by the thread calling gegl_processor_work
+   */
+  gboolean          threaded;
+  GeglSchedulerJob *job;
+  GeglRegion       *inflight_region; /* chunks handed to the workers */
+  gint              n_inflight;
+  GSList           *finished;        /* GeglProcessorChunks done but not
+                                        yet merged */
+#if ENABLE_MT
+  GMutex           *mutex;           /* protects finished */
+#endif
 };
 
 
+/* a chunk handed to the workers, with the generation of the cache it
+ * was handed out in
+ */
+typedef struct
+{
+  GeglRectangle rect;
+  gint          generation;
+} GeglProcessorChunk;
+
+
 G_DEFINE_TYPE (GeglProcessor, gegl_processor, G_TYPE_OBJECT)
 
 
@@ -89,6 +115,11 @@ static void
 gegl_processor_class_init (GeglProcessorClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  gboolean      threaded      = FALSE;
+
+#if ENABLE_MT
+  threaded = gegl_config ()->threads > 1;
+#endif
 
   gobject_class->finalize     = gegl_processor_finalize;
   gobject_class->constructor  = gegl_processor_constructor;
@@ -123,6 +154,14 @@ gegl_processor_class_init (GeglProcessorClass *klass)
                                                      1, 1024 * 1024, gegl_config()->chunk_size, 
                                                      G_PARAM_READWRITE |
                                                      G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (gobject_class, PROP_THREADED,
+                                   g_param_spec_boolean ("threaded",
+                                                         "threaded",
+                                                         "Render chunks concurrently on GEGL's worker threads.",
+                                                         threaded,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT));
 }
 
 static void
@@ -134,6 +173,10 @@ gegl_processor_init (GeglProcessor *processor)
   processor->queued_region    = NULL;
   processor->dirty_rectangles = NULL;
   processor->chunk_size       = 128 * 128;
+  processor->inflight_region  = gegl_region_new ();
+#if ENABLE_MT
+  processor->mutex            = g_mutex_new ();
+#endif
 }
 
 /* Initialises the fields processor->input, processor->valid_region
@@ -155,11 +198,26 @@ gegl_processor_constructor (GType                  type,
   return object;
 }
 
+static void gegl_processor_collect (GeglProcessor *processor);
+
 static void
 gegl_processor_finalize (GObject *self_object)
 {
   GeglProcessor *processor = GEGL_PROCESSOR (self_object);
 
+  if (processor->job)
+    {
+      /* the chunks in flight reference the processor */
+      gegl_scheduler_job_wait (processor->job);
+      gegl_processor_collect (processor);
+      gegl_scheduler_job_free (processor->job);
+    }
+
+  gegl_region_destroy (processor->inflight_region);
+#if ENABLE_MT
+  g_mutex_free (processor->mutex);
+#endif
+
   if (processor->node)
     {
       g_object_unref (processor->node);
@@ -205,6 +263,10 @@ gegl_processor_set_property (GObject      *gobject,
         gegl_processor_set_rectangle (self, g_value_get_pointer (value));
         break;
 
+      case PROP_THREADED:
+        self->threaded = g_value_get_boolean (value);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -236,6 +298,10 @@ gegl_processor_get_property (GObject    *gobject,
         g_value_set_double (value, gegl_processor_progress (self));
         break;
 
+      case PROP_THREADED:
+        g_value_set_boolean (value, self->threaded);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, property_id, pspec);
         break;
@@ -383,6 +449,170 @@ gegl_processor_get_band_size (gint size)
   return band_size;
 }
 
+/* Cuts a band off the dirty rectangle dr and puts it first in the list of
+ * dirty rectangles.
+ */
+static void
+split_dirty_rectangle (GeglProcessor *processor,
+                       GeglRectangle *dr)
+{
+  GeglRectangle *fragment;
+  gint           band_size;
+
+  fragment = g_slice_dup (GeglRectangle, dr);
+
+  /* When splitting a rectangle, we'll do it on the biggest side */
+  if (dr->width > dr->height)
+    {
+      band_size = gegl_processor_get_band_size ( dr->width );
+
+      fragment->width = band_size;
+      dr->width      -= band_size;
+      dr->x          += band_size;
+    }
+  else
+    {
+      band_size = gegl_processor_get_band_size (dr->height);
+
+      fragment->height = band_size;
+      dr->height      -= band_size;
+      dr->y           += band_size;
+    }
+  processor->dirty_rectangles = g_slist_prepend (processor->dirty_rectangles, fragment);
+}
+
+/* Runs on a worker thread, renders one chunk into the cache and queues
+ * it for merging into the cache's valid region.
+ */
+static void
+gegl_processor_render_chunk (gpointer task_data,
+                             gpointer user_data)
+{
+  GeglProcessor      *processor = user_data;
+  GeglProcessorChunk *chunk     = task_data;
+  GeglRectangle      *dr        = &chunk->rect;
+  GeglCache          *cache     = gegl_node_get_cache (processor->input);
+  guchar             *buf;
+  gint                pxsize;
+
+  g_object_get (cache, "px-size", &pxsize, NULL);
+  buf = g_malloc (dr->width * dr->height * pxsize);
+
+  gegl_node_blit (cache->node, 1.0, dr, cache->format, buf,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_buffer_set (GEGL_BUFFER (cache), dr, cache->format, buf,
+                   GEGL_AUTO_ROWSTRIDE);
+  g_free (buf);
+
+#if ENABLE_MT
+  g_mutex_lock (processor->mutex);
+#endif
+  processor->finished = g_slist_prepend (processor->finished, chunk);
+#if ENABLE_MT
+  g_mutex_unlock (processor->mutex);
+#endif
+}
+
+/* Merges the chunks finished by the workers into the cache, this is done
+ * on the thread driving the processor so that the cache's "computed"
+ * signal is emitted where the callers expect it. Chunks the cache was
+ * invalidated under are dropped, once out of the inflight region they are
+ * queued again.
+ */
+static void
+gegl_processor_collect (GeglProcessor *processor)
+{
+  GeglCache *cache      = gegl_node_get_cache (processor->input);
+  gint       generation = g_atomic_int_get (&cache->generation);
+  GSList    *finished;
+  GSList    *iter;
+
+#if ENABLE_MT
+  g_mutex_lock (processor->mutex);
+#endif
+  finished = processor->finished;
+  processor->finished = NULL;
+#if ENABLE_MT
+  g_mutex_unlock (processor->mutex);
+#endif
+
+  for (iter = finished; iter; iter = g_slist_next (iter))
+    {
+      GeglProcessorChunk *chunk = iter->data;
+      GeglRegion         *tr    = gegl_region_rectangle (&chunk->rect);
+
+      gegl_region_subtract (processor->inflight_region, tr);
+      gegl_region_destroy (tr);
+      if (chunk->generation == generation)
+        gegl_cache_computed (cache, &chunk->rect);
+      processor->n_inflight--;
+      g_slice_free (GeglProcessorChunk, chunk);
+    }
+  g_slist_free (finished);
+}
+
+/* Cuts all the dirty rectangles to chunks and hands them to the workers,
+ * when there is nothing left to hand out it waits for a chunk to finish.
+ * Returns TRUE if the caller should not queue more dirty rectangles yet.
+ */
+static gboolean
+render_rectangle_threaded (GeglProcessor *processor,
+                           GeglCache     *cache)
+{
+  const gint max_area   = processor->chunk_size;
+  gboolean   dispatched = FALSE;
+
+  if (!processor->job)
+    processor->job = gegl_scheduler_job_new (gegl_processor_render_chunk,
+                                             processor);
+
+  while (processor->dirty_rectangles)
+    {
+      GeglRectangle      *dr = processor->dirty_rectangles->data;
+      GeglProcessorChunk *chunk;
+
+      if (dr->height * dr->width > max_area)
+        {
+          split_dirty_rectangle (processor, dr);
+          continue;
+        }
+
+      processor->dirty_rectangles = g_slist_remove (processor->dirty_rectangles, dr);
+
+      if (!dr->width || !dr->height ||
+          gegl_region_rect_in (cache->valid_region, dr) ==
+          GEGL_OVERLAP_RECTANGLE_IN)
+        {
+          g_slice_free (GeglRectangle, dr);
+          continue;
+        }
+
+      /* the generation is taken before the chunk starts reading the graph,
+       * any invalidation from here on makes its pixels stale
+       */
+      chunk             = g_slice_new (GeglProcessorChunk);
+      chunk->rect       = *dr;
+      chunk->generation = g_atomic_int_get (&cache->generation);
+      g_slice_free (GeglRectangle, dr);
+
+      gegl_region_union_with_rect (processor->inflight_region, &chunk->rect);
+      processor->n_inflight++;
+      gegl_scheduler_job_push (processor->job, chunk);
+      dispatched = TRUE;
+    }
+
+  if (!dispatched && processor->n_inflight > 0)
+    {
+      gegl_scheduler_job_wait_remaining (processor->job,
+                                         processor->n_inflight - 1);
+      gegl_processor_collect (processor);
+      return TRUE;
+    }
+
+  gegl_processor_collect (processor);
+  return FALSE;
+}
+
 /* If the processor's dirty rectangle is too big then it will be cut, added
  * to the processor's list of dirty rectangles and TRUE will be returned.
  * If the rectangle is small enough it will be processed, using a buffer or
@@ -403,6 +633,9 @@ render_rectangle (GeglProcessor *processor)
     {
       cache = gegl_node_get_cache (processor->input);
       g_object_get (cache, "px-size", &pxsize, NULL);
+
+      if (processor->threaded)
+        return render_rectangle_threaded (processor, cache);
     }
 
   if (processor->dirty_rectangles)
@@ -413,32 +646,7 @@ render_rectangle (GeglProcessor *processor)
        * to smaller pieces */
       if (dr->height * dr->width > max_area && 1)
         {
-          gint band_size;
-
-          {
-            GeglRectangle *fragment;
-
-            fragment = g_slice_dup (GeglRectangle, dr);
-
-            /* When splitting a rectangle, we'll do it on the biggest side */
-            if (dr->width > dr->height)
-              {
-                band_size = gegl_processor_get_band_size ( dr->width );
-              
-                fragment->width = band_size;
-                dr->width      -= band_size;
-                dr->x          += band_size;
-              }
-            else
-              {
-                band_size = gegl_processor_get_band_size (dr->height);
-
-                fragment->height = band_size;
-                dr->height      -= band_size;
-                dr->y           += band_size;
-              }
-            processor->dirty_rectangles = g_slist_prepend (processor->dirty_rectangles, fragment);
-          }
+          split_dirty_rectangle (processor, dr);
           return TRUE;
         }
       /* remove the rectangle that will be processed from the list of dirty ones */
@@ -540,7 +748,8 @@ static gboolean
 gegl_processor_is_rendered (GeglProcessor *processor)
 {
   if (gegl_region_empty (processor->queued_region) &&
-      processor->dirty_rectangles == NULL)
+      processor->dirty_rectangles == NULL &&
+      processor->n_inflight == 0)
     return TRUE;
   return FALSE;
 }
@@ -644,6 +853,7 @@ gegl_processor_render (GeglProcessor *processor,
       gint           i;
 
       gegl_region_subtract (region, valid_region);
+      gegl_region_subtract (region, processor->inflight_region);
       gegl_region_get_rectangles (region, &rectangles, &n_rectangles);
       gegl_region_destroy (region);
 
@@ -719,6 +929,14 @@ gegl_processor_work (GeglProcessor *processor,
       return TRUE;
     }
 
+  if (processor->n_inflight > 0)
+    {
+      /* everything is handed out, but not all of it is back yet */
+      if (progress)
+        *progress = gegl_processor_progress (processor);
+      return TRUE;
+    }
+
   if (progress)
     {
       *progress = 1.0;
@@ -0,0 +1,463 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gegl-scheduler.h"
+#include "gegl-config.h"
+
+typedef struct _GeglSchedulerTask  GeglSchedulerTask;
+typedef struct _GeglSchedulerDeque GeglSchedulerDeque;
+
+struct _GeglSchedulerTask
+{
+  GeglSchedulerJob *job;
+  gpointer          data;
+};
+
+struct _GeglSchedulerJob
+{
+  GeglSchedulerFunc  func;
+  gpointer           user_data;
+  GQueue            *inline_tasks; /* tasks run by gegl_scheduler_job_wait
+                                      when there are no workers */
+#if ENABLE_MT
+  GMutex            *mutex;
+  GCond             *cond;
+  gint               remaining;    /* pushed tasks that have not finished */
+#endif
+};
+
+#if ENABLE_MT
+
+/* A growable ring buffer of tasks, top and bottom increase monotonically
+ * and are masked with size-1 (size is always a power of two) when used
+ * as indices.
+ */
+struct _GeglSchedulerDeque
+{
+  GMutex            *mutex;
+  GeglSchedulerTask *tasks;
+  guint              size;
+  guint              top;     /* oldest task, this is where others steal */
+  guint              bottom;  /* one past the newest task, owner end */
+};
+
+#define GEGL_SCHEDULER_DEQUE_INITIAL_SIZE 64
+
+static GStaticMutex        init_mutex   = G_STATIC_MUTEX_INIT;
+static GeglSchedulerDeque *deques       = NULL;
+static GThread           **workers      = NULL;
+static GPrivate           *worker_key   = NULL;
+static GMutex             *sleep_mutex  = NULL;
+static GCond              *sleep_cond   = NULL;
+static gint                sleepers     = 0;
+static gboolean            quit         = FALSE;
+static volatile gint       queued       = 0; /* tasks sitting in deques */
+static volatile gint       next_deque   = 0; /* round robin for non workers */
+
+#endif
+
+static gint                n_workers    = -1; /* -1 means not initialized */
+
+#if ENABLE_MT
+
+static void
+gegl_scheduler_deque_push (GeglSchedulerDeque *deque,
+                           GeglSchedulerJob   *job,
+                           gpointer            data)
+{
+  GeglSchedulerTask *task;
+
+  g_mutex_lock (deque->mutex);
+  if (deque->bottom - deque->top == deque->size)
+    {
+      GeglSchedulerTask *tasks;
+      guint              i;
+
+      tasks = g_new (GeglSchedulerTask, deque->size * 2);
+      for (i = deque->top; i != deque->bottom; i++)
+        tasks[i & (deque->size * 2 - 1)] = deque->tasks[i & (deque->size - 1)];
+      g_free (deque->tasks);
+      deque->tasks = tasks;
+      deque->size *= 2;
+    }
+  task = &deque->tasks[deque->bottom & (deque->size - 1)];
+  task->job  = job;
+  task->data = data;
+  deque->bottom++;
+  g_mutex_unlock (deque->mutex);
+}
+
+/* the owner takes the most recently pushed task, it is the one most
+ * likely to still have its data in the caches.
+ */
+static gboolean
+gegl_scheduler_deque_pop (GeglSchedulerDeque *deque,
+                          GeglSchedulerTask  *task)
+{
+  gboolean found = FALSE;
+
+  g_mutex_lock (deque->mutex);
+  if (deque->bottom != deque->top)
+    {
+      deque->bottom--;
+      *task = deque->tasks[deque->bottom & (deque->size - 1)];
+      found = TRUE;
+    }
+  g_mutex_unlock (deque->mutex);
+  return found;
+}
+
+/* thieves take the oldest task, it is usually the largest remaining
+ * chunk of work and far from what the owner is touching.
+ */
+static gboolean
+gegl_scheduler_deque_steal (GeglSchedulerDeque *deque,
+                            GeglSchedulerTask  *task)
+{
+  gboolean found = FALSE;
+
+  g_mutex_lock (deque->mutex);
+  if (deque->bottom != deque->top)
+    {
+      *task = deque->tasks[deque->top & (deque->size - 1)];
+      deque->top++;
+      found = TRUE;
+    }
+  g_mutex_unlock (deque->mutex);
+  return found;
+}
+
+static gboolean
+gegl_scheduler_take_task (gint               id,
+                          GeglSchedulerTask *task)
+{
+  gint start;
+  gint i;
+
+  if (g_atomic_int_get (&queued) == 0)
+    return FALSE;
+
+  if (id >= 0 &&
+      gegl_scheduler_deque_pop (&deques[id], task))
+    {
+      g_atomic_int_add (&queued, -1);
+      return TRUE;
+    }
+
+  start = id >= 0 ? id + 1 : 0;
+  for (i = 0; i < n_workers; i++)
+    {
+      gint victim = (start + i) % n_workers;
+
+      if (victim == id)
+        continue;
+      if (gegl_scheduler_deque_steal (&deques[victim], task))
+        {
+          g_atomic_int_add (&queued, -1);
+          return TRUE;
+        }
+    }
+  return FALSE;
+}
+
+static void
+gegl_scheduler_run_task (GeglSchedulerTask *task)
+{
+  GeglSchedulerJob *job = task->job;
+
+  job->func (task->data, job->user_data);
+
+  g_mutex_lock (job->mutex);
+  job->remaining--;
+  g_cond_broadcast (job->cond);
+  /* the waiter might free the job as soon as we unlock */
+  g_mutex_unlock (job->mutex);
+}
+
+static gpointer
+gegl_scheduler_worker (gpointer data)
+{
+  gint id = GPOINTER_TO_INT (data);
+
+  g_private_set (worker_key, GINT_TO_POINTER (id + 1));
+
+  while (TRUE)
+    {
+      GeglSchedulerTask task;
+
+      if (gegl_scheduler_take_task (id, &task))
+        {
+          gegl_scheduler_run_task (&task);
+          continue;
+        }
+
+      g_mutex_lock (sleep_mutex);
+      while (g_atomic_int_get (&queued) == 0 && !quit)
+        {
+          sleepers++;
+          g_cond_wait (sleep_cond, sleep_mutex);
+          sleepers--;
+        }
+      if (quit && g_atomic_int_get (&queued) == 0)
+        {
+          g_mutex_unlock (sleep_mutex);
+          break;
+        }
+      g_mutex_unlock (sleep_mutex);
+    }
+  return NULL;
+}
+#endif
+
+static void
+gegl_scheduler_init (void)
+{
+#if ENABLE_MT
+  g_static_mutex_lock (&init_mutex);
+  if (n_workers < 0)
+    {
+      gint threads = gegl_config ()->threads;
+      gint i;
+
+      /* the thread waiting for a job does its share of the work, so one
+       * worker less than the configured thread count keeps all of them
+       * busy.
+       */
+      if (threads > 1 && g_thread_supported ())
+        {
+          if (!worker_key)
+            worker_key = g_private_new (NULL);
+          sleep_mutex = g_mutex_new ();
+          sleep_cond  = g_cond_new ();
+          quit        = FALSE;
+
+          deques  = g_new0 (GeglSchedulerDeque, threads - 1);
+          workers = g_new0 (GThread *, threads - 1);
+          for (i = 0; i < threads - 1; i++)
+            {
+              deques[i].mutex = g_mutex_new ();
+              deques[i].size  = GEGL_SCHEDULER_DEQUE_INITIAL_SIZE;
+              deques[i].tasks = g_new (GeglSchedulerTask, deques[i].size);
+            }
+          /* n_workers has to be set before the workers start stealing */
+          n_workers = threads - 1;
+          for (i = 0; i < threads - 1; i++)
+            workers[i] = g_thread_create (gegl_scheduler_worker,
+                                          GINT_TO_POINTER (i), TRUE, NULL);
+        }
+      else
+        {
+          n_workers = 0;
+        }
+    }
+  g_static_mutex_unlock (&init_mutex);
+#else
+  n_workers = 0;
+#endif
+}
+
+gint
+gegl_scheduler_get_n_workers (void)
+{
+  if (n_workers < 0)
+    gegl_scheduler_init ();
+  return n_workers;
+}
+
+gint
+gegl_scheduler_get_worker_id (void)
+{
+#if ENABLE_MT
+  if (worker_key)
+    return GPOINTER_TO_INT (g_private_get (worker_key)) - 1;
+#endif
+  return -1;
+}
+
+GeglSchedulerJob *
+gegl_scheduler_job_new (GeglSchedulerFunc func,
+                        gpointer          user_data)
+{
+  GeglSchedulerJob *job;
+
+  g_return_val_if_fail (func != NULL, NULL);
+
+  if (n_workers < 0)
+    gegl_scheduler_init ();
+
+  job = g_slice_new0 (GeglSchedulerJob);
+  job->func      = func;
+  job->user_data = user_data;
+  if (n_workers == 0)
+    job->inline_tasks = g_queue_new ();
+#if ENABLE_MT
+  job->mutex = g_mutex_new ();
+  job->cond  = g_cond_new ();
+#endif
+  return job;
+}
+
+void
+gegl_scheduler_job_push (GeglSchedulerJob *job,
+                         gpointer          task_data)
+{
+#if ENABLE_MT
+  gint id;
+#endif
+
+  g_return_if_fail (job != NULL);
+
+  if (job->inline_tasks)
+    {
+      g_queue_push_tail (job->inline_tasks, task_data);
+      return;
+    }
+
+#if ENABLE_MT
+  g_mutex_lock (job->mutex);
+  job->remaining++;
+  g_mutex_unlock (job->mutex);
+
+  /* workers keep the tasks they create to themselves until someone
+   * steals them, other threads spread their tasks over all the deques.
+   */
+  id = gegl_scheduler_get_worker_id ();
+  if (id < 0)
+    id = (g_atomic_int_exchange_and_add (&next_deque, 1) & G_MAXINT) % n_workers;
+
+  gegl_scheduler_deque_push (&deques[id], job, task_data);
+  g_atomic_int_inc (&queued);
+
+  g_mutex_lock (sleep_mutex);
+  if (sleepers)
+    g_cond_signal (sleep_cond);
+  g_mutex_unlock (sleep_mutex);
+#endif
+}
+
+void
+gegl_scheduler_job_wait (GeglSchedulerJob *job)
+{
+  gegl_scheduler_job_wait_remaining (job, 0);
+}
+
+void
+gegl_scheduler_job_wait_remaining (GeglSchedulerJob *job,
+                                   gint              max_remaining)
+{
+#if ENABLE_MT
+  gint id;
+#endif
+
+  g_return_if_fail (job != NULL);
+
+  if (job->inline_tasks)
+    {
+      while (g_queue_get_length (job->inline_tasks) > MAX (max_remaining, 0))
+        job->func (g_queue_pop_head (job->inline_tasks), job->user_data);
+      return;
+    }
+
+#if ENABLE_MT
+  id = gegl_scheduler_get_worker_id ();
+
+  while (TRUE)
+    {
+      GeglSchedulerTask task;
+      gboolean          done;
+
+      g_mutex_lock (job->mutex);
+      done = job->remaining <= max_remaining;
+      g_mutex_unlock (job->mutex);
+
+      if (done)
+        break;
+
+      /* help out with whatever is queued, it might not be a task of our
+       * own job but keeping the cores busy is what gets our tasks done
+       * the quickest.
+       */
+      if (gegl_scheduler_take_task (id, &task))
+        {
+          gegl_scheduler_run_task (&task);
+        }
+      else
+        {
+          /* all our remaining tasks are being run by others */
+          g_mutex_lock (job->mutex);
+          while (job->remaining > max_remaining)
+            g_cond_wait (job->cond, job->mutex);
+          g_mutex_unlock (job->mutex);
+        }
+    }
+#endif
+}
+
+void
+gegl_scheduler_job_free (GeglSchedulerJob *job)
+{
+  g_return_if_fail (job != NULL);
+
+  if (job->inline_tasks)
+    g_queue_free (job->inline_tasks);
+#if ENABLE_MT
+  g_mutex_free (job->mutex);
+  g_cond_free (job->cond);
+#endif
+  g_slice_free (GeglSchedulerJob, job);
+}
+
+void
+gegl_scheduler_cleanup (void)
+{
+#if ENABLE_MT
+  gint i;
+
+  g_static_mutex_lock (&init_mutex);
+  if (n_workers > 0)
+    {
+      g_mutex_lock (sleep_mutex);
+      quit = TRUE;
+      g_cond_broadcast (sleep_cond);
+      g_mutex_unlock (sleep_mutex);
+
+      for (i = 0; i < n_workers; i++)
+        g_thread_join (workers[i]);
+
+      for (i = 0; i < n_workers; i++)
+        {
+          g_mutex_free (deques[i].mutex);
+          g_free (deques[i].tasks);
+        }
+      g_free (deques);
+      g_free (workers);
+      g_mutex_free (sleep_mutex);
+      g_cond_free (sleep_cond);
+      deques      = NULL;
+      workers     = NULL;
+      sleep_mutex = NULL;
+      sleep_cond  = NULL;
+    }
+  n_workers = -1;
+  g_static_mutex_unlock (&init_mutex);
+#else
+  n_workers = -1;
+#endif
+}
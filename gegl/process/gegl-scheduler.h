@@ -0,0 +1,77 @@
+/* This file is part of GEGL
+ *
+ * GEGL is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * GEGL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GEGL; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEGL_SCHEDULER_H__
+#define __GEGL_SCHEDULER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The scheduler is a process wide pool of worker threads, each worker owns
+ * a double ended queue of tasks. Workers push and pop tasks at the bottom
+ * of their own queue and steal from the top of the other queues when they
+ * run dry, this keeps all cores busy even when some tasks are much more
+ * expensive than others.
+ *
+ * Tasks are grouped in jobs, every job has its own completion counter so
+ * that jobs from different callers can be in flight at the same time
+ * without waiting for each other.
+ */
+
+typedef struct _GeglSchedulerJob GeglSchedulerJob;
+
+typedef void (*GeglSchedulerFunc) (gpointer task_data,
+                                   gpointer user_data);
+
+GeglSchedulerJob * gegl_scheduler_job_new       (GeglSchedulerFunc  func,
+                                                 gpointer           user_data);
+
+/* queue a task, the job keeps a reference to task_data until the task
+ * has been run.
+ */
+void               gegl_scheduler_job_push      (GeglSchedulerJob  *job,
+                                                 gpointer           task_data);
+
+/* block until all tasks pushed to job have been run, the calling thread
+ * runs queued tasks itself while waiting.
+ */
+void               gegl_scheduler_job_wait      (GeglSchedulerJob  *job);
+
+/* like gegl_scheduler_job_wait but returns as soon as no more than
+ * max_remaining of the pushed tasks are left unfinished.
+ */
+void               gegl_scheduler_job_wait_remaining
+                                                (GeglSchedulerJob  *job,
+                                                 gint               max_remaining);
+
+void               gegl_scheduler_job_free      (GeglSchedulerJob  *job);
+
+/* the number of worker threads, 0 when all tasks are run by the thread
+ * waiting for the job.
+ */
+gint               gegl_scheduler_get_n_workers (void);
+
+/* the index of the worker running the calling thread or -1 when called
+ * from a thread not owned by the scheduler.
+ */
+gint               gegl_scheduler_get_worker_id (void);
+
+void               gegl_scheduler_cleanup       (void);
+
+G_END_DECLS
+
+#endif /* __GEGL_SCHEDULER_H__ */
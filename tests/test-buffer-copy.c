@@ -0,0 +1,108 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH  300
+#define HEIGHT 200
+
+static gint
+check_copy (GeglBuffer          *dst,
+            const GeglRectangle *dst_rect,
+            const guchar        *src,
+            const GeglRectangle *src_rect,
+            const gchar         *what)
+{
+  guchar *dest = g_malloc0 (dst_rect->width * dst_rect->height * 4);
+  gint    result = SUCCESS;
+  gint    x, y;
+
+  gegl_buffer_get (dst, 1.0, dst_rect, babl_format ("RGBA u8"), dest, GEGL_AUTO_ROWSTRIDE);
+
+  for (y = 0; y < dst_rect->height && result == SUCCESS; y++)
+    for (x = 0; x < dst_rect->width; x++)
+      if (memcmp (src + ((src_rect->y + y) * WIDTH + src_rect->x + x) * 4,
+                  dest + (y * dst_rect->width + x) * 4, 4))
+        {
+          g_printerr ("%s: pixel %d,%d differs\n", what, x, y);
+          result = FAILURE;
+          break;
+        }
+
+  g_free (dest);
+  return result;
+}
+
+/* Copies a buffer to another one with the tile grids lined up, where
+ * whole tiles are shared, and with an offset, where pixels are copied.
+ * Writing to the source afterwards must not show up in the copies.
+ */
+int main(int argc, char *argv[])
+{
+  int           result    = SUCCESS;
+  GeglRectangle rect      = { 0, 0, WIDTH, HEIGHT };
+  GeglRectangle part      = { 3, 5, WIDTH - 10, HEIGHT - 20 };
+  GeglRectangle moved     = { 7, 11, WIDTH - 10, HEIGHT - 20 };
+  GeglBuffer   *buffer;
+  GeglBuffer   *aligned;
+  GeglBuffer   *unaligned;
+  guchar       *src;
+  guchar       *scribble;
+  gint          i;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  src      = g_malloc (WIDTH * HEIGHT * 4);
+  scribble = g_malloc (WIDTH * HEIGHT * 4);
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    {
+      src[i]      = g_random_int ();
+      scribble[i] = g_random_int ();
+    }
+
+  buffer    = gegl_buffer_new (&rect, babl_format ("RGBA u8"));
+  aligned   = gegl_buffer_new (&rect, babl_format ("RGBA u8"));
+  unaligned = gegl_buffer_new (&rect, babl_format ("RGBA u8"));
+  gegl_buffer_set (buffer, &rect, babl_format ("RGBA u8"), src, GEGL_AUTO_ROWSTRIDE);
+
+  gegl_buffer_copy (buffer, &rect, aligned, &rect);
+  gegl_buffer_copy (buffer, &part, unaligned, &moved);
+
+  /* the copies are independent of the source */
+  gegl_buffer_set (buffer, &rect, babl_format ("RGBA u8"), scribble, GEGL_AUTO_ROWSTRIDE);
+
+  if (check_copy (aligned, &rect, src, &rect, "aligned copy") ||
+      check_copy (unaligned, &moved, src, &part, "unaligned copy") ||
+      check_copy (buffer, &rect, scribble, &rect, "source"))
+    result = FAILURE;
+
+  /* Cleanup */
+  g_free (src);
+  g_free (scribble);
+  g_object_unref (buffer);
+  g_object_unref (aligned);
+  g_object_unref (unaligned);
+  gegl_exit ();
+
+  return result;
+}
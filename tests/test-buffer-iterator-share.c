@@ -0,0 +1,110 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+#include "gegl.h"
+#include "gegl-buffer-iterator.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH    256
+#define HEIGHT   128
+
+/* Adds 0.25 to every component of buffer, reading it in another format
+ * than it is written in. The read iterable is added before the written
+ * one when read_first is set.
+ */
+static void
+add_quarter (GeglBuffer *buffer,
+             gboolean    read_first)
+{
+  GeglBufferIterator *iter;
+  gint                read, write;
+  gint                k;
+
+  iter = gegl_buffer_iterator_new (buffer, NULL,
+                                   babl_format (read_first ? "RGBA u8" :
+                                                             "RGBA float"),
+                                   read_first ? GEGL_BUFFER_READ :
+                                                GEGL_BUFFER_WRITE);
+  k = gegl_buffer_iterator_add (iter, buffer, NULL,
+                                babl_format (read_first ? "RGBA float" :
+                                                          "RGBA u8"),
+                                read_first ? GEGL_BUFFER_WRITE :
+                                             GEGL_BUFFER_READ);
+  read  = read_first ? 0 : k;
+  write = read_first ? k : 0;
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      guchar *in  = iter->data[read];
+      gfloat *out = iter->data[write];
+
+      for (k = 0; k < iter->length * 4; k++)
+        out[k] = in[k] / 255.0 + 0.25;
+    }
+  gegl_buffer_iterator_free (iter);
+}
+
+/* Iterates a buffer for writing and, in another format, for reading the
+ * same tiles. The tile locked for writing must serve the read too instead
+ * of the reading iterable waiting for the write lock to go away.
+ */
+int main(int argc, char *argv[])
+{
+  int            result = SUCCESS;
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer    *buffer;
+  gfloat        *pixels;
+  gfloat         gray[4] = { 0.25, 0.25, 0.25, 0.25 };
+  gint           k;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  buffer = gegl_buffer_new (&rect, babl_format ("RGBA float"));
+  pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+
+  for (k = 0; k < WIDTH * HEIGHT; k++)
+    memcpy (pixels + k * 4, gray, sizeof (gray));
+  gegl_buffer_set (buffer, &rect, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  add_quarter (buffer, FALSE);
+  add_quarter (buffer, TRUE);
+
+  gegl_buffer_get (buffer, 1.0, &rect, babl_format ("RGBA float"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  for (k = 0; k < WIDTH * HEIGHT * 4; k++)
+    if (fabs (pixels[k] - 0.75) > 2.0 / 255.0)
+      {
+        g_printerr ("The pixels differ at %d,%d: %f\n",
+                    (k / 4) % WIDTH, (k / 4) / WIDTH, pixels[k]);
+        result = FAILURE;
+        break;
+      }
+
+  /* Cleanup */
+  g_free (pixels);
+  g_object_unref (buffer);
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,135 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+#include "gegl-buffer-iterator.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH    64
+#define HEIGHT   48
+
+#define PIXEL(x, y, c) ((guchar) ((x) * 3 + (y) * 5 + (c) * 64))
+
+/* Opens a direct view of a linear buffer, then a second view in another
+ * format, a gegl_buffer_get and gegl_buffer_set and an iterator over part
+ * of the same tile while the first view is still open. None of them may
+ * wait for the tile lock held by the first view, and all of them see its
+ * pixels.
+ */
+int main(int argc, char *argv[])
+{
+  int                 result = SUCCESS;
+  GeglRectangle       rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglRectangle       sub    = { 8, 4, 16, 8 };
+  GeglBuffer         *buffer;
+  GeglBufferIterator *iter;
+  guchar             *direct;
+  gfloat             *view;
+  guchar              pixels[16 * 8 * 4];
+  gint                rowstride;
+  gint                view_rowstride;
+  gint                x, y, c;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  buffer = gegl_buffer_linear_new (&rect, babl_format ("RGBA u8"));
+
+  direct = gegl_buffer_linear_open_full (buffer, NULL, &rowstride, NULL,
+                                         GEGL_BUFFER_READWRITE, 0);
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      for (c = 0; c < 4; c++)
+        direct[y * rowstride + x * 4 + c] = PIXEL (x, y, c);
+
+  view = gegl_buffer_linear_open_full (buffer, &sub, &view_rowstride,
+                                       babl_format ("RGBA float"),
+                                       GEGL_BUFFER_READ, 0);
+  for (y = 0; y < sub.height && view && result == SUCCESS; y++)
+    for (x = 0; x < sub.width * 4; x++)
+      {
+        gfloat value = view[y * view_rowstride / sizeof (gfloat) + x];
+
+        if ((gint) (value * 255.0 + 0.5) !=
+            PIXEL (sub.x + x / 4, sub.y + y, x % 4))
+          {
+            g_printerr ("The second view differs at %d,%d\n",
+                        sub.x + x / 4, sub.y + y);
+            result = FAILURE;
+            break;
+          }
+      }
+  if (view == NULL)
+    result = FAILURE;
+
+  gegl_buffer_get (buffer, 1.0, &sub, babl_format ("RGBA u8"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  for (y = 0; y < sub.height && result == SUCCESS; y++)
+    for (x = 0; x < sub.width * 4; x++)
+      if (pixels[(y * sub.width * 4) + x] !=
+          PIXEL (sub.x + x / 4, sub.y + y, x % 4))
+        {
+          g_printerr ("gegl_buffer_get differs at %d,%d\n",
+                      sub.x + x / 4, sub.y + y);
+          result = FAILURE;
+          break;
+        }
+
+  /* written through to the open view */
+  memset (pixels, 0x7f, sizeof (pixels));
+  gegl_buffer_set (buffer, &sub, babl_format ("RGBA u8"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  if (direct[sub.y * rowstride + sub.x * 4] != 0x7f)
+    {
+      g_printerr ("gegl_buffer_set did not reach the open view\n");
+      result = FAILURE;
+    }
+
+  iter = gegl_buffer_iterator_new (buffer, &sub, babl_format ("RGBA u8"),
+                                   GEGL_BUFFER_WRITE);
+  while (gegl_buffer_iterator_next (iter))
+    memset (iter->data[0], 0x40, iter->length * 4);
+  gegl_buffer_iterator_free (iter);
+  if (direct[sub.y * rowstride + sub.x * 4] != 0x40)
+    {
+      g_printerr ("The iterator did not reach the open view\n");
+      result = FAILURE;
+    }
+
+  if (view)
+    gegl_buffer_linear_close (buffer, view);
+  gegl_buffer_linear_close (buffer, direct);
+
+  /* and the tile is free again */
+  gegl_buffer_get (buffer, 1.0, &sub, babl_format ("RGBA u8"), pixels,
+                   GEGL_AUTO_ROWSTRIDE);
+  if (pixels[0] != 0x40)
+    {
+      g_printerr ("The buffer lost the pixels of the view\n");
+      result = FAILURE;
+    }
+
+  /* Cleanup */
+  g_object_unref (buffer);
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,115 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH    300
+#define HEIGHT   200
+#define N_PIXELS 1000
+
+/* Scatters pixels to random coordinates, some of them repeated and some
+ * in the abyss, and gathers them back in another order and format. The
+ * result must match what reading the pixels one at a time gives.
+ */
+int main(int argc, char *argv[])
+{
+  int           result = SUCCESS;
+  GeglRectangle rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer   *buffer;
+  GRand        *rand;
+  gint          coords[N_PIXELS * 2];
+  guchar        src[N_PIXELS * 4];
+  gfloat        batch[N_PIXELS * 4];
+  gfloat        single[4];
+  gint          i;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  rand   = g_rand_new_with_seed (42);
+  buffer = gegl_buffer_new (&rect, babl_format ("RGBA u8"));
+
+  for (i = 0; i < N_PIXELS; i++)
+    {
+      coords[i * 2]     = g_rand_int_range (rand, -10, WIDTH + 10);
+      coords[i * 2 + 1] = g_rand_int_range (rand, -10, HEIGHT + 10);
+      src[i * 4]     = i;
+      src[i * 4 + 1] = i >> 8;
+      src[i * 4 + 2] = 0x55;
+      src[i * 4 + 3] = 0xff;
+    }
+  /* a pixel written twice keeps the last value */
+  coords[10] = coords[0];
+  coords[11] = coords[1];
+
+  gegl_buffer_set_pixels (buffer, N_PIXELS, coords, NULL, src);
+
+  /* read back in reverse order */
+  for (i = 0; i < N_PIXELS / 2; i++)
+    {
+      gint x = coords[i * 2];
+      gint y = coords[i * 2 + 1];
+
+      coords[i * 2]     = coords[(N_PIXELS - 1 - i) * 2];
+      coords[i * 2 + 1] = coords[(N_PIXELS - 1 - i) * 2 + 1];
+      coords[(N_PIXELS - 1 - i) * 2]     = x;
+      coords[(N_PIXELS - 1 - i) * 2 + 1] = y;
+    }
+
+  gegl_buffer_get_pixels (buffer, N_PIXELS, coords,
+                          babl_format ("RGBA float"), batch);
+
+  for (i = 0; i < N_PIXELS && result == SUCCESS; i++)
+    {
+      GeglRectangle pixel = { coords[i * 2], coords[i * 2 + 1], 1, 1 };
+
+      gegl_buffer_get (buffer, 1.0, &pixel, babl_format ("RGBA float"),
+                       single, GEGL_AUTO_ROWSTRIDE);
+      if (memcmp (single, batch + i * 4, sizeof (single)))
+        {
+          g_printerr ("pixel %d at %d,%d differs\n", i, pixel.x, pixel.y);
+          result = FAILURE;
+        }
+    }
+
+  {
+    GeglRectangle pixel = { coords[(N_PIXELS - 1) * 2],
+                            coords[(N_PIXELS - 1) * 2 + 1], 1, 1 };
+    guchar        value[4];
+
+    gegl_buffer_get (buffer, 1.0, &pixel, babl_format ("RGBA u8"),
+                     value, GEGL_AUTO_ROWSTRIDE);
+    if (gegl_rectangle_contains (&rect, &pixel) &&
+        memcmp (value, src + 5 * 4, 4))
+      {
+        g_printerr ("repeated pixel does not hold the last write\n");
+        result = FAILURE;
+      }
+  }
+
+  /* Cleanup */
+  g_rand_free (rand);
+  g_object_unref (buffer);
+  gegl_exit ();
+
+  return result;
+}
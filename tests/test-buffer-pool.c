@@ -0,0 +1,82 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+#include "gegl-buffer-pool.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH    512
+#define HEIGHT   256
+
+/* Copies a buffer into one taken from the pool, with the tile grids lined
+ * up so that the tiles are shared instead of written, and releases it. The
+ * same buffer handed out again must read as empty.
+ */
+int main(int argc, char *argv[])
+{
+  int            result = SUCCESS;
+  GeglRectangle  rect   = { 0, 0, WIDTH, HEIGHT };
+  const Babl    *format;
+  GeglBuffer    *src;
+  GeglBuffer    *pooled;
+  GeglBuffer    *again;
+  guchar        *buf;
+  gint           i;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  format = babl_format ("RGBA u8");
+  buf    = g_malloc (WIDTH * HEIGHT * 4);
+
+  src = gegl_buffer_new (&rect, format);
+  memset (buf, 0xff, WIDTH * HEIGHT * 4);
+  gegl_buffer_set (src, &rect, format, buf, GEGL_AUTO_ROWSTRIDE);
+
+  pooled = gegl_buffer_pool_get (&rect, format);
+  gegl_buffer_copy (src, &rect, pooled, &rect);
+  gegl_buffer_pool_release (pooled);
+
+  again = gegl_buffer_pool_get (&rect, format);
+  if (again != pooled)
+    {
+      g_printerr ("The released buffer was not handed out again\n");
+      result = FAILURE;
+    }
+
+  gegl_buffer_get (again, 1.0, &rect, format, buf, GEGL_AUTO_ROWSTRIDE);
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    if (buf[i])
+      {
+        g_printerr ("Pixel %d,%d of the reused buffer is not empty\n",
+                    (i / 4) % WIDTH, (i / 4) / WIDTH);
+        result = FAILURE;
+        break;
+      }
+
+  /* Cleanup */
+  gegl_buffer_pool_release (again);
+  g_object_unref (src);
+  g_free (buf);
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,108 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH  300
+#define HEIGHT 200
+
+/* Saves a buffer holding uniform tiles, tiles with long runs and tiles
+ * of noise with rle tile compression, loads it again and checks that
+ * every pixel survived the round trip.
+ */
+int main(int argc, char *argv[])
+{
+  int           result = SUCCESS;
+  GeglRectangle rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglBuffer   *buffer;
+  GeglBuffer   *loaded;
+  guchar       *src;
+  guchar       *dest;
+  gchar        *path;
+  gint          x, y;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+  g_object_set (gegl_config (), "tile-compression", "rle", NULL);
+
+  path = g_build_filename (g_get_tmp_dir (), "test-buffer-save-compressed.gegl", NULL);
+  src  = g_malloc (WIDTH * HEIGHT * 4);
+  dest = g_malloc0 (WIDTH * HEIGHT * 4);
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        guchar *pixel = src + (y * WIDTH + x) * 4;
+
+        if (x < WIDTH / 3)
+          {
+            pixel[0] = 10; pixel[1] = 20; pixel[2] = 30; pixel[3] = 255;
+          }
+        else if (x < WIDTH * 2 / 3)
+          {
+            pixel[0] = x / 16; pixel[1] = y; pixel[2] = 0; pixel[3] = 255;
+          }
+        else
+          {
+            pixel[0] = g_random_int ();
+            pixel[1] = g_random_int ();
+            pixel[2] = g_random_int ();
+            pixel[3] = g_random_int ();
+          }
+      }
+
+  buffer = gegl_buffer_new (&rect, babl_format ("RGBA u8"));
+  gegl_buffer_set (buffer, &rect, babl_format ("RGBA u8"), src, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_save (buffer, path, &rect);
+
+  loaded = gegl_buffer_load (path);
+  if (!loaded)
+    {
+      g_printerr ("Failed to load %s\n", path);
+      result = FAILURE;
+    }
+  else
+    {
+      gegl_buffer_get (loaded, 1.0, &rect, babl_format ("RGBA u8"), dest, GEGL_AUTO_ROWSTRIDE);
+
+      for (y = 0; y < HEIGHT && result == SUCCESS; y++)
+        for (x = 0; x < WIDTH; x++)
+          if (memcmp (src + (y * WIDTH + x) * 4, dest + (y * WIDTH + x) * 4, 4))
+            {
+              g_printerr ("Pixel %d,%d differs after loading\n", x, y);
+              result = FAILURE;
+              break;
+            }
+      g_object_unref (loaded);
+    }
+
+  /* Cleanup */
+  g_unlink (path);
+  g_free (path);
+  g_free (src);
+  g_free (dest);
+  g_object_unref (buffer);
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,125 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define WIDTH  300
+#define HEIGHT 200
+
+static const guchar color[4] = { 200, 100, 50, 255 };
+static const guchar dot[4]   = { 1, 2, 3, 4 };
+static const guchar zero[4]  = { 0, 0, 0, 0 };
+
+static const GeglRectangle cleared = { 10, 20, 250, 150 };
+static const GeglRectangle spot    = { 100, 100, 1, 1 };
+
+static const guchar *
+expected (gint x,
+          gint y)
+{
+  if (x == spot.x && y == spot.y)
+    return dot;
+  if (x >= cleared.x && x < cleared.x + cleared.width &&
+      y >= cleared.y && y < cleared.y + cleared.height)
+    return zero;
+  return color;
+}
+
+static gint
+check_buffer (GeglBuffer  *buffer,
+              const gchar *format_name)
+{
+  GeglRectangle rect   = { 0, 0, WIDTH, HEIGHT };
+  const Babl   *format = babl_format (format_name);
+  const Babl   *fish   = babl_fish (babl_format ("RGBA u8"), format);
+  gint          bpp    = babl_format_get_bytes_per_pixel (format);
+  guchar       *dest   = g_malloc (WIDTH * HEIGHT * bpp);
+  guchar       *pixel  = g_malloc (bpp);
+  gint          result = SUCCESS;
+  gint          x, y;
+
+  gegl_buffer_get (buffer, 1.0, &rect, format, dest, GEGL_AUTO_ROWSTRIDE);
+
+  for (y = 0; y < HEIGHT && result == SUCCESS; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        babl_process ((Babl *) fish, (gpointer) expected (x, y), pixel, 1);
+        if (memcmp (pixel, dest + (y * WIDTH + x) * bpp, bpp))
+          {
+            g_printerr ("%s: pixel %d,%d differs\n", format_name, x, y);
+            result = FAILURE;
+            break;
+          }
+      }
+
+  g_free (pixel);
+  g_free (dest);
+  return result;
+}
+
+/* Fills a buffer with a single color, clears a part of it that covers
+ * whole tiles as well as parts of tiles, and writes a pixel inside the
+ * cleared area. Reading it back with and without conversion, and through
+ * the mipmap of the uniform parts, must give the written pixels.
+ */
+int main(int argc, char *argv[])
+{
+  int           result = SUCCESS;
+  GeglRectangle rect   = { 0, 0, WIDTH, HEIGHT };
+  GeglRectangle corner = { 0, 0, 8, 8 };
+  GeglBuffer   *buffer;
+  guchar       *src;
+  guchar        scaled[8 * 8 * 4];
+  gint          i;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+
+  src = g_malloc (WIDTH * HEIGHT * 4);
+  for (i = 0; i < WIDTH * HEIGHT; i++)
+    memcpy (src + i * 4, color, 4);
+
+  buffer = gegl_buffer_new (&rect, babl_format ("RGBA u8"));
+  gegl_buffer_set (buffer, &rect, babl_format ("RGBA u8"), src, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_clear (buffer, &cleared);
+  gegl_buffer_set (buffer, &spot, babl_format ("RGBA u8"), (gpointer) dot, GEGL_AUTO_ROWSTRIDE);
+
+  if (check_buffer (buffer, "RGBA u8") ||
+      check_buffer (buffer, "RGBA float"))
+    result = FAILURE;
+
+  /* the top left corner is outside the cleared area at every level */
+  gegl_buffer_get (buffer, 0.5, &corner, babl_format ("RGBA u8"), scaled, GEGL_AUTO_ROWSTRIDE);
+  for (i = 0; i < 8 * 8 && result == SUCCESS; i++)
+    if (memcmp (scaled + i * 4, color, 4))
+      {
+        g_printerr ("scaled: pixel %d differs\n", i);
+        result = FAILURE;
+      }
+
+  /* Cleanup */
+  g_free (src);
+  g_object_unref (buffer);
+  gegl_exit ();
+
+  return result;
+}
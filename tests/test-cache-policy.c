@@ -0,0 +1,113 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define EPSILON  1e-5
+
+/* Blits an invert, which is not cached by default, with its cache forced
+ * on and checks the result against its source, the cached result has to
+ * follow the changes of the source.
+ */
+static int
+test_invert (GeglNode            *checker,
+             GeglNode            *invert,
+             const GeglRectangle *roi)
+{
+  int     result = SUCCESS;
+  gint    n      = roi->width * roi->height;
+  gfloat *source = g_new (gfloat, n * 4);
+  gfloat *buf    = g_new (gfloat, n * 4);
+  gint    i, c;
+
+  gegl_node_blit (checker, 1.0, roi, babl_format ("RGBA float"), source,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_node_blit (invert, 1.0, roi, babl_format ("RGBA float"), buf,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (i = 0; i < n && result == SUCCESS; i++)
+    for (c = 0; c < 3; c++)
+      {
+        gfloat value    = buf[i * 4 + c];
+        gfloat expected = 1.0 - source[i * 4 + c];
+
+        if (fabs (value - expected) > EPSILON)
+          {
+            result = FAILURE;
+            g_printerr ("Component %d of pixel %d,%d is %f, expected %f\n",
+                        c, roi->x + i % roi->width, roi->y + i / roi->width,
+                        value, expected);
+            break;
+          }
+      }
+
+  g_free (source);
+  g_free (buf);
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  int           result = SUCCESS;
+  GeglRectangle roi    = { 0, 0, 128, 64 };
+  GeglNode     *graph;
+  GeglNode     *checker;
+  GeglNode     *invert;
+  GeglColor    *red;
+  gint          i;
+
+  /* Init */
+  gegl_init (&argc, &argv);
+
+  red   = gegl_color_new ("rgb(1.0, 0.0, 0.0)");
+  graph = gegl_node_new ();
+
+  checker = gegl_node_new_child (graph,
+                                 "operation", "gegl:checkerboard",
+                                 NULL);
+  invert  = gegl_node_new_child (graph,
+                                 "operation", "gegl:invert",
+                                 NULL);
+  gegl_node_link (checker, invert);
+
+  if (gegl_node_get_cache_policy (invert, "output") != GEGL_NODE_CACHE_POLICY_AUTO)
+    result = FAILURE;
+
+  gegl_node_set_cache_policy (invert, "output", GEGL_NODE_CACHE_POLICY_ALWAYS);
+  gegl_node_set_cache_policy (checker, "output", GEGL_NODE_CACHE_POLICY_NEVER);
+  if (gegl_node_get_cache_policy (invert, "output") != GEGL_NODE_CACHE_POLICY_ALWAYS)
+    result = FAILURE;
+
+  /* read it a few times for it to be measured */
+  for (i = 0; i < 3 && result == SUCCESS; i++)
+    result = test_invert (checker, invert, &roi);
+
+  gegl_node_set (checker, "color1", red, NULL);
+  if (result == SUCCESS)
+    result = test_invert (checker, invert, &roi);
+
+  /* Cleanup */
+  g_object_unref (graph);
+  g_object_unref (red);
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,88 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define THREADS  4
+#define PADDING  16
+#define SENTINEL 0x7f
+
+/* Blits a non tile aligned rectangle of a one pixel checkerboard with
+ * several threads into a buffer with a padded rowstride, and checks that
+ * every pixel ended up where it belongs and that the padding was left
+ * alone.
+ */
+int main(int argc, char *argv[])
+{
+  int           result    = SUCCESS;
+  GeglNode     *checker   = NULL;
+  GeglRectangle roi       = { -37, 13, 517, 389 };
+  gint          rowstride = roi.width + PADDING;
+  guchar       *buf       = NULL;
+  gint          x, y;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+  g_object_set (gegl_config (), "threads", THREADS, NULL);
+
+  checker = gegl_node_new_child (NULL,
+                                 "operation", "gegl:checkerboard",
+                                 "x",         1,
+                                 "y",         1,
+                                 NULL);
+
+  buf = g_malloc (rowstride * roi.height);
+  memset (buf, SENTINEL, rowstride * roi.height);
+
+  gegl_node_blit (checker,
+                  1.0,
+                  &roi,
+                  babl_format ("Y u8"),
+                  buf,
+                  rowstride,
+                  GEGL_BLIT_DEFAULT);
+
+  for (y = 0; y < roi.height && result == SUCCESS; y++)
+    for (x = 0; x < rowstride; x++)
+      {
+        guchar value    = buf[y * rowstride + x];
+        guchar expected = SENTINEL;
+
+        if (x < roi.width)
+          expected = ((roi.x + x + roi.y + y) & 1) ? 255 : 0;
+
+        if (value != expected)
+          {
+            result = FAILURE;
+            g_printerr ("Pixel %d,%d is %d, expected %d\n",
+                        roi.x + x, roi.y + y, value, expected);
+            break;
+          }
+      }
+
+  /* Cleanup */
+  g_free (buf);
+  g_object_unref (checker);
+  gegl_exit ();
+
+  return result;
+}
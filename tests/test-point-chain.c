@@ -0,0 +1,133 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define THREADS  4
+#define EPSILON  1e-5
+
+/* Blits a chain of point operations, which is processed in a single pass,
+ * once for a region smaller than a tile and once for a region spread
+ * over the threads, and checks the result against the formula the chain
+ * computes on every pixel of its source.
+ *
+ *   checkerboard -> invert -> multiply (aux) -> multiply (value) -> invert
+ */
+static int
+test_region (GeglNode            *checker,
+             GeglNode            *chain,
+             const GeglRectangle *roi)
+{
+  int     result = SUCCESS;
+  gint    n      = roi->width * roi->height;
+  gfloat *source = g_new (gfloat, n * 4);
+  gfloat *buf    = g_new (gfloat, n * 4);
+  gint    i, c;
+
+  gegl_node_blit (checker, 1.0, roi, babl_format ("RGBA float"), source,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_node_blit (chain, 1.0, roi, babl_format ("RGBA float"), buf,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  for (i = 0; i < n && result == SUCCESS; i++)
+    for (c = 0; c < 4; c++)
+      {
+        gfloat value    = buf[i * 4 + c];
+        gfloat expected = source[i * 4 + c];
+
+        if (c < 3)
+          expected = 1.0 - (1.0 - expected) * 0.5 * 0.5;
+
+        if (fabs (value - expected) > EPSILON)
+          {
+            result = FAILURE;
+            g_printerr ("Component %d of pixel %d,%d is %f, expected %f\n",
+                        c, roi->x + i % roi->width, roi->y + i / roi->width,
+                        value, expected);
+            break;
+          }
+      }
+
+  g_free (source);
+  g_free (buf);
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  int           result = SUCCESS;
+  GeglRectangle small  = { 3, 5, 37, 11 };
+  GeglRectangle large  = { -37, 13, 517, 389 };
+  GeglNode     *graph;
+  GeglNode     *checker;
+  GeglNode     *grey;
+  GeglNode     *invert1;
+  GeglNode     *multiply1;
+  GeglNode     *multiply2;
+  GeglNode     *invert2;
+  GeglColor    *half;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+  g_object_set (gegl_config (), "threads", THREADS, NULL);
+
+  half  = gegl_color_new ("rgb(0.5, 0.5, 0.5)");
+  graph = gegl_node_new ();
+
+  checker   = gegl_node_new_child (graph,
+                                   "operation", "gegl:checkerboard",
+                                   "x",         3,
+                                   "y",         2,
+                                   NULL);
+  grey      = gegl_node_new_child (graph,
+                                   "operation", "gegl:color",
+                                   "value",     half,
+                                   NULL);
+  invert1   = gegl_node_new_child (graph,
+                                   "operation", "gegl:invert",
+                                   NULL);
+  multiply1 = gegl_node_new_child (graph,
+                                   "operation", "gegl:multiply",
+                                   NULL);
+  multiply2 = gegl_node_new_child (graph,
+                                   "operation", "gegl:multiply",
+                                   "value",     0.5,
+                                   NULL);
+  invert2   = gegl_node_new_child (graph,
+                                   "operation", "gegl:invert",
+                                   NULL);
+
+  gegl_node_link_many (checker, invert1, multiply1, multiply2, invert2, NULL);
+  gegl_node_connect_to (grey, "output", multiply1, "aux");
+
+  if (test_region (checker, invert2, &small) != SUCCESS ||
+      test_region (checker, invert2, &large) != SUCCESS)
+    result = FAILURE;
+
+  /* Cleanup */
+  g_object_unref (graph);
+  g_object_unref (half);
+  gegl_exit ();
+
+  return result;
+}
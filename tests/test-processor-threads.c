@@ -0,0 +1,117 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "gegl.h"
+
+#define SUCCESS  0
+#define FAILURE -1
+
+#define THREADS  4
+#define CHUNK    (64 * 64) /* many chunks for the workers to share */
+
+/* Renders the same graph with a threaded and an unthreaded processor and
+ * checks that both produce the same pixels, and that a processor renders
+ * threaded by default exactly when its "threaded" property says so.
+ */
+static guchar *
+render (gboolean             threaded,
+        const GeglRectangle *roi)
+{
+  GeglNode      *graph;
+  GeglNode      *checker;
+  GeglNode      *blur;
+  GeglProcessor *processor;
+  guchar        *buf = g_malloc (roi->width * roi->height * 4);
+
+  graph   = gegl_node_new ();
+  checker = gegl_node_new_child (graph,
+                                 "operation", "gegl:checkerboard",
+                                 "x",         7,
+                                 "y",         5,
+                                 NULL);
+  blur    = gegl_node_new_child (graph,
+                                 "operation", "gegl:gaussian-blur",
+                                 "std-dev-x", 3.0,
+                                 "std-dev-y", 2.0,
+                                 NULL);
+  gegl_node_link (checker, blur);
+
+  processor = gegl_node_new_processor (blur, roi);
+  g_object_set (processor, "threaded", threaded, NULL);
+  while (gegl_processor_work (processor, NULL));
+
+  /* read what the processor left in the cache */
+  gegl_node_blit (blur, 1.0, roi, babl_format ("R'G'B'A u8"), buf,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_CACHE | GEGL_BLIT_DIRTY);
+
+  gegl_processor_destroy (processor);
+  g_object_unref (graph);
+  return buf;
+}
+
+int main(int argc, char *argv[])
+{
+  int            result = SUCCESS;
+  GeglRectangle  roi    = { -19, 11, 413, 297 };
+  GeglNode      *node;
+  GeglProcessor *processor;
+  GParamSpec    *pspec;
+  gboolean       threaded;
+  guchar        *threaded_buf;
+  guchar        *unthreaded_buf;
+
+  /* Init */
+  g_thread_init (NULL);
+  gegl_init (&argc, &argv);
+  g_object_set (gegl_config (),
+                "threads",    THREADS,
+                "chunk-size", CHUNK,
+                NULL);
+
+  node      = gegl_node_new_child (NULL,
+                                   "operation", "gegl:checkerboard",
+                                   NULL);
+  processor = gegl_node_new_processor (node, &roi);
+  pspec     = g_object_class_find_property (G_OBJECT_GET_CLASS (processor),
+                                            "threaded");
+  g_object_get (processor, "threaded", &threaded, NULL);
+  if (threaded != G_PARAM_SPEC_BOOLEAN (pspec)->default_value)
+    {
+      g_printerr ("A new processor has threaded %d, the default is %d\n",
+                  threaded, G_PARAM_SPEC_BOOLEAN (pspec)->default_value);
+      result = FAILURE;
+    }
+  gegl_processor_destroy (processor);
+  g_object_unref (node);
+
+  threaded_buf   = render (TRUE, &roi);
+  unthreaded_buf = render (FALSE, &roi);
+
+  if (memcmp (threaded_buf, unthreaded_buf, roi.width * roi.height * 4))
+    {
+      g_printerr ("The threaded and unthreaded renderings differ\n");
+      result = FAILURE;
+    }
+
+  /* Cleanup */
+  g_free (threaded_buf);
+  g_free (unthreaded_buf);
+  gegl_exit ();
+
+  return result;
+}